@@ -72,13 +72,6 @@ void AddGFull(double R[3], cdouble k, double kBloch[2],
               double Lx, double Ly, cdouble *Sum, 
               bool ValueOnly=false);
 
-void GetRLBasis(int LDim, double (*LBV)[3], double (*Gamma)[3],
-                cdouble k, double *EOpt, double R[3], double *pRho);
-
-void AddGLongRealSpace(double *R, cdouble k, double *kBloch,
-                       int n1, int n2, double (*LBV)[3], int LDim, 
-                       double E, cdouble *Sum);
-
 }
 
 
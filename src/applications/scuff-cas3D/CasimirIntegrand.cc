@@ -36,11 +36,6 @@
 #include "scuff-cas3D.h"
 #include "libscuffInternals.h"
 
-extern "C" {
-int dgetrf_(int *m, int *n, double *a, int *lda, int *ipiv, int *info);
-int zgetrf_(int *m, int *n, cdouble *a, int *lda, int *ipiv, int *info);
-}
-
 using namespace scuff;
 
 #define II cdouble(0.0,1.0)
@@ -51,7 +46,6 @@ using namespace scuff;
 double GetLNDetMInvMInf(SC3Data *SC3D)
 { 
   HMatrix *M              = SC3D->M;
-  int N                   = SC3D->N;
 
   double LNDet=0.0;
   if (SC3D->NewEnergyMethod==false)
@@ -59,10 +53,9 @@ double GetLNDetMInvMInf(SC3Data *SC3D)
      /*--------------------------------------------------------------*/
      /*- calculation method 1  --------------------------------------*/
      /*--------------------------------------------------------------*/
-     HVector *MInfLUDiagonal = SC3D->MInfLUDiagonal;
-
-     for(int n=0; n<N; n++)
-      LNDet+=log( abs( MInfLUDiagonal->GetEntryD(n) / M->GetEntry(n,n) ) );
+     for(int ns=0; ns<SC3D->G->NumSurfaces; ns++)
+      LNDet+=SC3D->TLogDet[ns];
+     LNDet-=M->GetLULogDet();
    }
   else
    {
@@ -77,9 +70,7 @@ double GetLNDetMInvMInf(SC3Data *SC3D)
       MM1MInf->InsertBlock(SC3D->TBlocks[ns], G->BFIndexOffset[ns], G->BFIndexOffset[ns]);
      M->LUSolve(MM1MInf); 
      MM1MInf->LUFactorize();
-
-     for(int n=0; n<N; n++)
-      LNDet+=log( abs( MM1MInf->GetEntry(n,n) ) );
+     LNDet=MM1MInf->GetLULogDet();
    }
 
   /*--------------------------------------------------------------*/
@@ -94,58 +85,387 @@ double GetLNDetMInvMInf(SC3Data *SC3D)
 } 
 
 /***************************************************************/
-/* compute \trace \{ M^{-1} dMdAlpha\},                        */
-/* where Alpha=x, y, z                                         */
+/* compute \log \det \{ M^{-1} MInfinity \} by eliminating the */
+/* block A of the BEM matrix coupling surfaces that are never  */
+/* moved (or else the self block of the largest surface); A is */
+/* factorized only once per frequency, the first time this     */
+/* routine is called (or while computing TLogDet), and each    */
+/* call costs O(NF*NF*NM) for NF (NM) basis functions in A (S).*/
+/*                                                             */
+/* the T and U blocks are stamped into A, B, D (= S) exactly   */
+/* as they are stamped into M by Factorize().                  */
 /***************************************************************/
-double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
-{ 
-  /***************************************************************/
-  /* unpack fields from workspace structure **********************/
-  /***************************************************************/
+double GetLNDetMInvMInfSchur(SC3Data *SC3D)
+{
+  RWGGeometry *G     = SC3D->G;
+  int NS             = G->NumSurfaces;
+  bool *SurfaceFixed = SC3D->SurfaceFixed;
+  int *Offset        = SC3D->SchurOffset;
+  HMatrix *A=SC3D->A, *B=SC3D->B, *X=SC3D->X, *S=SC3D->S;
+
+  if (!SC3D->AFactorized)
+   { Log("  LU-factorizing fixed-surface block (N=%i)...",A->NR);
+     for(int ns=0; ns<NS; ns++)
+      if (SurfaceFixed[ns])
+       A->InsertBlock(SC3D->TBlocks[ns], Offset[ns], Offset[ns]);
+     for(int nb=0, ns=0; ns<NS; ns++)
+      for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+       if (SurfaceFixed[ns] && SurfaceFixed[nsp])
+        { A->InsertBlock(SC3D->UBlocks[nb], Offset[ns], Offset[nsp]);
+          if (A->StorageType==LHM_NORMAL)
+           A->InsertBlockAdjoint(SC3D->UBlocks[nb], Offset[nsp], Offset[ns]);
+        };
+     A->LUFactorize();
+     SC3D->ALogDet=A->GetLULogDet();
+     SC3D->AFactorized=true;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- B = fixed-moving block, S = moving-moving block ------------*/
+  /*--------------------------------------------------------------*/
+  for(int ns=0; ns<NS; ns++)
+   if (!SurfaceFixed[ns])
+    S->InsertBlock(SC3D->TBlocks[ns], Offset[ns], Offset[ns]);
+  for(int nb=0, ns=0; ns<NS; ns++)
+   for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+    { HMatrix *U=SC3D->UBlocks[nb];
+      if (SurfaceFixed[ns] && !SurfaceFixed[nsp])
+       B->InsertBlock(U, Offset[ns], Offset[nsp]);
+      else if (!SurfaceFixed[ns] && SurfaceFixed[nsp])
+       B->InsertBlockAdjoint(U, Offset[nsp], Offset[ns]);
+      else if (!SurfaceFixed[ns] && !SurfaceFixed[nsp])
+       { S->InsertBlock(U, Offset[ns], Offset[nsp]);
+         S->InsertBlockAdjoint(U, Offset[nsp], Offset[ns]);
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- S <- D - B' * A^{-1} * B -----------------------------------*/
+  /*--------------------------------------------------------------*/
+  X->Copy(B);
+  A->LUSolve(X);
+  B->Multiply(X, SC3D->BX, "--transA C");
+  if (S->RealComplex==LHM_REAL)
+   { for(size_t n=0; n<((size_t)S->NR)*S->NC; n++)
+      S->DM[n] -= SC3D->BX->DM[n];
+   }
+  else
+   { for(size_t n=0; n<((size_t)S->NR)*S->NC; n++)
+      S->ZM[n] -= SC3D->BX->ZM[n];
+   };
+  S->LUFactorize();
+
+  double LNDet=0.0;
+  for(int ns=0; ns<NS; ns++)
+   LNDet+=SC3D->TLogDet[ns];
+  LNDet -= SC3D->ALogDet + S->GetLULogDet();
+
+  if (!IsFinite(LNDet))
+   LNDet=0.0;
+  return -LNDet/(2.0*M_PI);
+}
+
+/***************************************************************/
+/* Write A_Alpha for the N1 x N1 matrix obtained by restricting*/
+/* M^{-1} dMdAlpha to the basis functions on surface 0 (the    */
+/* only columns in which dMdAlpha is nonzero). Given an N1 x K */
+/* matrix V, this routine computes A_Alpha^\dagger V for all   */
+/* requested components Alpha with a single K-RHS solve:       */
+/*                                                             */
+/*  A^\dagger V = dM^\dagger M^{-\dagger} (V 0)^T               */
+/*              = \sum_{ns} dU_{0,ns} Y_{ns}                    */
+/*                                                             */
+/* where Y_{ns} is the block of rows of M^{-\dagger}(V 0)^T     */
+/* belonging to surface #ns. The dM matrices are never formed. */
+/***************************************************************/
+static void GetAdjointAV(SC3Data *SC3D, bool Need[6], HMatrix *V, HMatrix *AV[6])
+{
   RWGGeometry *G     = SC3D->G;
   HMatrix *M         = SC3D->M;
-  HMatrix *dM        = SC3D->dM;
   HMatrix **dUBlocks = SC3D->dUBlocks;
+  int N              = SC3D->N;
+  int N1             = SC3D->N1;
+  int K              = V->NC;
+  int RealComplex    = M->RealComplex;
+
+  HMatrix *Y = new HMatrix(N, K, RealComplex);
+  Y->InsertBlock(V, 0, 0);
+  if (M->StorageType==LHM_NORMAL)
+   M->LUSolve(Y, 'C');
+  else // packed storage is used only for real symmetric M
+   M->LUSolve(Y);
+
+  HMatrix *dUY = new HMatrix(N1, K, RealComplex);
+  for(int Mu=0; Mu<6; Mu++)
+   if (Need[Mu]) AV[Mu]->Zero();
+  for(int ns=1; ns<G->NumSurfaces; ns++)
+   { HMatrix *Yns = new HMatrix(G->Surfaces[ns]->NumBFs, K, RealComplex);
+     Y->ExtractBlock(G->BFIndexOffset[ns], 0, Yns);
+     for(int Mu=0; Mu<6; Mu++)
+      { if (!Need[Mu]) continue;
+        dUBlocks[ 6*(ns-1) + Mu ]->Multiply(Yns, dUY);
+        AV[Mu]->AddBlock(dUY, 0, 0);
+      };
+     delete Yns;
+   };
+
+  delete dUY;
+  delete Y;
+}
+
+/***************************************************************/
+/* 2 Re \sum_{ij} conj(B_{ij}) V_{ij}; if B = A^\dagger V, this */
+/* is 2 Re \trace V^\dagger A V.                                */
+/***************************************************************/
+static double ReTraceProduct(HMatrix *B, HMatrix *V)
+{ 
+  double Sum=0.0;
+  for(int nc=0; nc<V->NC; nc++)
+   for(int nr=0; nr<V->NR; nr++)
+    Sum += 2.0*real( conj(B->GetEntry(nr,nc)) * V->GetEntry(nr,nc) );
+  return Sum;
+}
+
+/***************************************************************/
+/* orthonormalize the columns of V in place (Gram-Schmidt with */
+/* reorthogonalization), dropping columns that are linearly    */
+/* dependent on previous ones; returns the number of columns   */
+/* retained, which are packed into the first columns of V.     */
+/***************************************************************/
+static int Orthonormalize(HMatrix *V)
+{
+  int NR=V->NR, K=0;
+  cdouble *Column = new cdouble[NR];
+  double MaxNorm=0.0;
+  for(int nc=0; nc<V->NC; nc++)
+   { 
+     double Norm0=0.0;
+     for(int nr=0; nr<NR; nr++)
+      { Column[nr]=V->GetEntry(nr,nc);
+        Norm0+=norm(Column[nr]);
+      };
+     Norm0=sqrt(Norm0);
+     if (Norm0>MaxNorm) MaxNorm=Norm0;
+
+     for(int Pass=0; Pass<2; Pass++)
+      for(int k=0; k<K; k++)
+       { cdouble Dot=0.0;
+         for(int nr=0; nr<NR; nr++)
+          Dot += conj(V->GetEntry(nr,k))*Column[nr];
+         for(int nr=0; nr<NR; nr++)
+          Column[nr] -= Dot*V->GetEntry(nr,k);
+       };
+
+     double Norm=0.0;
+     for(int nr=0; nr<NR; nr++)
+      Norm+=norm(Column[nr]);
+     Norm=sqrt(Norm);
+     if ( Norm <= 1.0e-10*MaxNorm )
+      continue;
 
-  int Mu=0;
-  switch(XYZT)
-   {  case 'X': Mu   = 0; break;
-      case 'Y': Mu   = 1; break;
-      case 'Z': Mu   = 2; break;
-      case '1': Mu   = 3; break; 
-      case '2': Mu   = 4; break; 
-      case '3': Mu   = 5; break; 
+     for(int nr=0; nr<NR; nr++)
+      V->SetEntry(nr, K, Column[nr]/Norm);
+     K++;
    };
+  delete[] Column;
+  return K;
+}
 
-  if ( '1'<=XYZT && XYZT<='3' )
-   Log("  Computing torque about axis #%c...",XYZT);
-  else
-   Log("  Computing %cForce...",XYZT);
+/***************************************************************/
+/* fill V with random +-1 entries                              */
+/***************************************************************/
+static void RandomSigns(HMatrix *V)
+{ for(int nc=0; nc<V->NC; nc++)
+   for(int nr=0; nr<V->NR; nr++)
+    V->SetEntry(nr, nc, (lrand48() & 1) ? 1.0 : -1.0);
+}
 
-  /***************************************************************/
-  /* stamp derivative blocks into dM matrix, compute M^{-1} dM,  */
-  /* then sum the diagonals of the upper matrix block            */
-  /***************************************************************/
-  dM->Zero();
-  for(int ns=1; ns<G->NumSurfaces; ns++)
-   dM->InsertBlockAdjoint(dUBlocks[ 6*(ns-1) + Mu ], G->BFIndexOffset[ns], 0);
+/***************************************************************/
+/* compute \trace \{ M^{-1} dMdAlpha\} = \trace A_Alpha for all */
+/* requested force and torque components Alpha at once.        */
+/*                                                             */
+/* By default the traces are computed exactly from the first   */
+/* N1 rows of M^{-1}, i.e. from A^\dagger applied to the N1 x N1*/
+/* unit matrix: this costs one N1-RHS solve for all components,*/
+/* instead of one per component.                               */
+/*                                                             */
+/* If SC3D->TraceProbes > 0, the traces are instead estimated  */
+/* by the Hutch++ method: a random sketch S (N1 x m, with      */
+/* m = TraceProbes/3) yields an orthonormal basis Q for the    */
+/* combined ranges of all A_Alpha^\dagger S, the trace of the  */
+/* deflated part Q^\dagger A Q is computed exactly, and the     */
+/* trace of the remainder (1-QQ^\dagger) A (1-QQ^\dagger) is    */
+/* estimated by Hutchinson's method with random +-1 probes     */
+/* added in batches of TRACE_PROBEBATCH until the standard     */
+/* error of every requested trace is below TraceTol times its  */
+/* magnitude, or until TraceProbes solves have been done. All  */
+/* solves are shared by all components.                        */
+/*                                                             */
+/* On return, FT[Mu] is -Tr/(2\pi) for Mu=0..5 (x,y,z force    */
+/* and torque about axes 1,2,3); entries for quantities that   */
+/* were not requested are left untouched.                      */
+/***************************************************************/
+#define TRACE_PROBEBATCH 16
+void GetTracesMInvdM(SC3Data *SC3D, double FT[6])
+{ 
+  int N1          = SC3D->N1;
+  int RealComplex = SC3D->M->RealComplex;
+
+  bool Need[6];
+  int NQ=0;
+  for(int Mu=0; Mu<6; Mu++)
+   { Need[Mu] = (SC3D->WhichQuantities & (QUANTITY_XFORCE<<Mu));
+     if (Need[Mu]) NQ++;
+   };
 
-  M->LUSolve(dM);
+  HMatrix *AV[6];
+  if (SC3D->TraceProbes<=0)
+   { 
+     /***************************************************************/
+     /* exact traces ************************************************/
+     /***************************************************************/
+     Log("  Computing force/torque traces...");
+     HMatrix *E = new HMatrix(N1, N1, RealComplex);
+     for(int n=0; n<N1; n++)
+      E->SetEntry(n, n, 1.0);
+     for(int Mu=0; Mu<6; Mu++)
+      AV[Mu] = Need[Mu] ? new HMatrix(N1, N1, RealComplex) : 0;
+     GetAdjointAV(SC3D, Need, E, AV);
+     for(int Mu=0; Mu<6; Mu++)
+      if (Need[Mu])
+       { FT[Mu]=0.0;
+         for(int n=0; n<N1; n++)
+          FT[Mu] += 2.0*real(AV[Mu]->GetEntry(n,n));
+         delete AV[Mu];
+       };
+     delete E;
+   }
+  else
+   {
+     /***************************************************************/
+     /* Hutch++ estimate ********************************************/
+     /***************************************************************/
+     int MaxProbes   = SC3D->TraceProbes;
+     double TraceTol = SC3D->TraceTol;
+     Log("  Estimating force/torque traces (at most %i probes, tolerance %g)...",
+         MaxProbes,TraceTol);
+
+     // sketch the ranges of the A^\dagger matrices 
+     int m = MaxProbes/3;
+     if (m<1)  m=1;
+     if (m>N1) m=N1;
+     HMatrix *S = new HMatrix(N1, m, RealComplex);
+     RandomSigns(S);
+     for(int Mu=0; Mu<6; Mu++)
+      AV[Mu] = Need[Mu] ? new HMatrix(N1, m, RealComplex) : 0;
+     GetAdjointAV(SC3D, Need, S, AV);
+
+     HMatrix *Q = new HMatrix(N1, NQ*m, RealComplex);
+     for(int Mu=0, nq=0; Mu<6; Mu++)
+      if (Need[Mu])
+       { Q->InsertBlock(AV[Mu], 0, (nq++)*m);
+         delete AV[Mu];
+       };
+     delete S;
+     int K=Orthonormalize(Q);
+     HMatrix *QK = new HMatrix(N1, K, RealComplex);
+     Q->ExtractBlock(0, 0, QK);
+     delete Q;
+
+     // exact trace of the deflated part
+     double LowRankTrace[6];
+     for(int Mu=0; Mu<6; Mu++)
+      AV[Mu] = Need[Mu] ? new HMatrix(N1, K, RealComplex) : 0;
+     GetAdjointAV(SC3D, Need, QK, AV);
+     for(int Mu=0; Mu<6; Mu++)
+      if (Need[Mu])
+       { LowRankTrace[Mu] = ReTraceProduct(AV[Mu], QK);
+         delete AV[Mu];
+       };
+     int NumSolves = m + K;
+
+     // Hutchinson estimate of the trace of the remainder
+     double Sum[6], Sum2[6];
+     memset(Sum,  0, 6*sizeof(double));
+     memset(Sum2, 0, 6*sizeof(double));
+     int NumProbes=0;
+     bool Converged=(K==N1);
+     HMatrix *G   = new HMatrix(N1, TRACE_PROBEBATCH, RealComplex);
+     HMatrix *QG  = new HMatrix(K,  TRACE_PROBEBATCH, RealComplex);
+     HMatrix *QQG = new HMatrix(N1, TRACE_PROBEBATCH, RealComplex);
+     HMatrix *Gn  = new HMatrix(N1, 1, RealComplex);
+     HMatrix *AGn = new HMatrix(N1, 1, RealComplex);
+     for(int Mu=0; Mu<6; Mu++)
+      AV[Mu] = Need[Mu] ? new HMatrix(N1, TRACE_PROBEBATCH, RealComplex) : 0;
+     while( !Converged && (NumProbes==0 || NumSolves<MaxProbes) )
+      { 
+        // G <- (1-QQ^\dagger) G for a new batch of random probes
+        RandomSigns(G);
+        if (K>0)
+         { QK->Multiply(G, QG, "--transA C");
+           QK->Multiply(QG, QQG);
+           for(int nc=0; nc<TRACE_PROBEBATCH; nc++)
+            for(int nr=0; nr<N1; nr++)
+             G->AddEntry(nr, nc, -1.0*QQG->GetEntry(nr,nc));
+         };
+        GetAdjointAV(SC3D, Need, G, AV);
+        NumSolves += TRACE_PROBEBATCH;
+
+        for(int nc=0; nc<TRACE_PROBEBATCH; nc++)
+         { G->ExtractBlock(0, nc, Gn);
+           for(int Mu=0; Mu<6; Mu++)
+            { if (!Need[Mu]) continue;
+              AV[Mu]->ExtractBlock(0, nc, AGn);
+              double Sample = ReTraceProduct(AGn, Gn);
+              Sum[Mu]  += Sample;
+              Sum2[Mu] += Sample*Sample;
+            };
+         };
+        NumProbes += TRACE_PROBEBATCH;
+
+        // check standard errors of the sample means
+        Converged=true;
+        for(int Mu=0; Converged && Mu<6; Mu++)
+         { if (!Need[Mu]) continue;
+           double Mean     = Sum[Mu] / NumProbes;
+           double Variance = (Sum2[Mu] - NumProbes*Mean*Mean) / (NumProbes-1);
+           double StdErr   = sqrt( fmax(Variance,0.0) / NumProbes );
+           if ( StdErr > TraceTol*fabs(LowRankTrace[Mu] + Mean) )
+            Converged=false;
+         };
+      };
 
-  double Trace=0.0;
-  for(int n=0; n<dM->NC; n++)
-   Trace+=dM->GetEntryD(n,n);
-  Trace*=2.0;
+     if (!Converged)
+      Warn("trace estimates not converged to tolerance %g after %i solves",TraceTol,NumSolves);
+     else
+      Log("  ...converged after %i solves (rank %i, %i probes)",NumSolves,K,NumProbes);
 
-  // paraphrasing the physicists of the 1930s, 'just because
-  // something is infinite doesn't mean that it's zero.' and yet...
-  if (!IsFinite(Trace))
-   Trace=0.0;
+     for(int Mu=0; Mu<6; Mu++)
+      if (Need[Mu])
+       { FT[Mu] = LowRankTrace[Mu] + (NumProbes ? Sum[Mu]/NumProbes : 0.0);
+         delete AV[Mu];
+       };
+     delete AGn;
+     delete Gn;
+     delete QQG;
+     delete QG;
+     delete G;
+     delete QK;
+   };
 
-  return -Trace/(2.0*M_PI);
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  for(int Mu=0; Mu<6; Mu++)
+   { if (!Need[Mu]) continue;
+     // paraphrasing the physicists of the 1930s, 'just because
+     // something is infinite doesn't mean that it's zero.' and yet...
+     if (!IsFinite(FT[Mu]))
+      FT[Mu]=0.0;
+     FT[Mu] = -FT[Mu]/(2.0*M_PI);
+   };
 } 
 
-
 /***************************************************************/
 /* stamp T and U blocks into the BEM matrix, then LU-factorize.*/
 /***************************************************************/
@@ -173,11 +493,12 @@ void Factorize(SC3Data *SC3D)
       RowOffset=G->BFIndexOffset[ns];
       ColOffset=G->BFIndexOffset[nsp];
       M->InsertBlock(SC3D->UBlocks[nb], RowOffset, ColOffset);
-      M->InsertBlockAdjoint(SC3D->UBlocks[nb], ColOffset, RowOffset);
+      if (M->StorageType==LHM_NORMAL)
+       M->InsertBlockAdjoint(SC3D->UBlocks[nb], ColOffset, RowOffset);
     };
 
   /***************************************************************/
-  /* LU factorize                                                */
+  /* LU factorize (Bunch-Kaufman for packed storage)             */
   /***************************************************************/
   M->LUFactorize();
 
@@ -291,6 +612,7 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
    SurfaceNeverMoved=(bool *)mallocEC(G->NumSurfaces*sizeof(bool));
   for(int ns=0; ns<G->NumSurfaces; ns++)
    SurfaceNeverMoved[ns]=true;
+  SC3D->AFactorized=false;
 
   /***************************************************************/
   /* assemble T matrices                                         */
@@ -313,55 +635,45 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
 
   /***************************************************************/
   /* if an energy calculation was requested, compute and save    */
-  /* the diagonals of the LU factorization of the T blocks       */
-  /* (which collectively constitute the diagonal of the LU       */
-  /* factorization of the M_{\infinity} matrix).                 */
+  /* log|det T| for each surface (which collectively constitute  */
+  /* log|det M_{\infinity}|).                                    */
+  /* KIND OF HACKY: we use the data buffer inside M as temporary */
+  /* storage for the factorization of T, which fits there since  */
+  /* T has the same storage type as M and is no larger.          */
+  /* If the A block of the Schur-complement method is the self   */
+  /* block of a single surface, we factorize it directly into A  */
+  /* and keep it for all transformations; in that case the       */
+  /* buffer of M may hold A, and the other T blocks (which all   */
+  /* lie in the S block) are factorized in the buffer of S.      */
   /***************************************************************/
   if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
    {
-     HMatrix *M=SC3D->M;
-     HVector *V=SC3D->MInfLUDiagonal;
+     HMatrix *M=SC3D->M, *A=SC3D->A, *S=SC3D->S;
      for(int ns=0; ns<G->NumSurfaces; ns++)
       { 
-        int Offset=G->BFIndexOffset[ns];
-        int NBF=G->Surfaces[ns]->NumBFs;
-
         int nsp=G->Mate[ns];
+        HMatrix *T=SC3D->TBlocks[ns];
         if ( nsp != -1 )
-         { 
-           /* if this object has a mate, just copy the diagonals of the */
-           /* mate's LU factor                                          */
-           int MateOffset=G->BFIndexOffset[nsp];
-           memcpy(V->DV+Offset,V->DV+MateOffset,NBF*sizeof(double));
+         SC3D->TLogDet[ns] = SC3D->TLogDet[nsp];
+        else if ( SC3D->UseSchur && SC3D->SurfaceFixed[ns] && A->NR==T->NR )
+         { Log("LU-factorizing T%i at Xi=%g (retained)...",ns+1,Xi);
+           A->InsertBlock(T, 0, 0);
+           int info=A->LUFactorize();
+           if (info!=0)
+            Log("...FAILED with info=%i (N=%i)",info,T->NR);
+           SC3D->TLogDet[ns] = SC3D->ALogDet = A->GetLULogDet();
+           SC3D->AFactorized = true;
          }
         else
-         { 
-           /* LU factorize the matrix (non-PEC) case or cholesky-factorize */
-           /* the negative of the matrix (all-PEC case).                   */
-           /* KIND OF HACKY: we use the data buffer inside M as temporary  */
-           /* storage for the content of T; this means that we have to     */
-           /* call the lapack routines directly instead of using the nice  */
-           /* wrappers provided by libhmat.                                */
-           Log("LU-factorizing T%i at Xi=%g...",ns+1,Xi);
-           int info;
-           if (PBC)
-            { for(int nbf=0; nbf<NBF; nbf++)
-               for(int nbfp=0; nbfp<NBF; nbfp++)
-                M->ZM[nbf + nbfp*NBF] = SC3D->TBlocks[ns]->GetEntry(nbf,nbfp);
-              zgetrf_(&NBF, &NBF, M->ZM, &NBF, SC3D->ipiv, &info);
-              for(int nbf=0; nbf<NBF; nbf++)
-               V->SetEntry(Offset+nbf, abs(M->ZM[nbf+nbf*NBF]) );
-            }
-           else
-            { for(int nbf=0; nbf<NBF; nbf++)
-               for(int nbfp=0; nbfp<NBF; nbfp++)
-                M->DM[nbf + nbfp*NBF] = SC3D->TBlocks[ns]->GetEntryD(nbf,nbfp);
-              dgetrf_(&NBF, &NBF, M->DM, &NBF, SC3D->ipiv, &info);
-              for(int nbf=0; nbf<NBF; nbf++)
-               V->SetEntry(Offset+nbf, M->DM[nbf+nbf*NBF]);
-            };
+         { Log("LU-factorizing T%i at Xi=%g...",ns+1,Xi);
+           HMatrix *Buffer = (SC3D->UseSchur && !SC3D->SurfaceFixed[ns]) ? S : M;
+           HMatrix TFactor(T->NR, T->NC, T->RealComplex, T->StorageType,
+                           T->RealComplex==LHM_REAL ? (void *)Buffer->DM : (void *)Buffer->ZM);
+           TFactor.Copy(T);
+           int info=TFactor.LUFactorize();
            if (info!=0)
-            Log("...FAILED with info=%i (N=%i)",info,NBF);
+            Log("...FAILED with info=%i (N=%i)",info,T->NR);
+           SC3D->TLogDet[ns] = TFactor.GetLULogDet();
          };
       };
    };
@@ -456,21 +768,20 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
      /***************************************************************/
      /* factorize the M matrix and compute casimir quantities       */
      /***************************************************************/
-     Factorize(SC3D);
-     if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
-      EFT[ntnq++]=GetLNDetMInvMInf(SC3D);
-     if ( SC3D->WhichQuantities & QUANTITY_XFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'X');
-     if ( SC3D->WhichQuantities & QUANTITY_YFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'Y');
-     if ( SC3D->WhichQuantities & QUANTITY_ZFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'Z');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE1 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'1');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE2 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'2');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE3 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'3');
+     if (SC3D->UseSchur) // energy is the only quantity in this case
+      EFT[ntnq++]=GetLNDetMInvMInfSchur(SC3D);
+     else
+      { Factorize(SC3D);
+        if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
+         EFT[ntnq++]=GetLNDetMInvMInf(SC3D);
+      };
+     if ( SC3D->WhichQuantities & ~QUANTITY_ENERGY )
+      { double FT[6];
+        GetTracesMInvdM(SC3D, FT);
+        for(int Mu=0; Mu<6; Mu++)
+         if ( SC3D->WhichQuantities & (QUANTITY_XFORCE<<Mu) )
+          EFT[ntnq++]=FT[Mu];
+      };
 
      /******************************************************************/
      /* for periodic geometries, write bloch-vector-resolved data      */
@@ -144,23 +144,96 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   int N  = SC3D->N  = SC3D->G->TotalBFs;
-  int N1 = SC3D->N1 = SC3D->G->Surfaces[0]->NumBFs;
-  SC3D->M           = new HMatrix(N,  N,  RealComplex);
-  SC3D->dM          = new HMatrix(N,  N1, RealComplex);
+  SC3D->N1 = SC3D->G->Surfaces[0]->NumBFs;
+  // for compact geometries the BEM matrix at imaginary frequency
+  // is real and symmetric, so we store only its upper triangle in
+  // packed form and factorize it by Bunch-Kaufman (dsptrf) 
+  SC3D->M           = new HMatrix(N,  N,  RealComplex, PBC ? LHM_NORMAL : LHM_SYMMETRIC);
   SC3D->NewEnergyMethod  = NewEnergyMethod;
 
   if (WhichQuantities & QUANTITY_ENERGY)
-   { SC3D->MInfLUDiagonal = new HVector(G->TotalBFs);
-     SC3D->ipiv = (int *)mallocEC(N*sizeof(int));
+   { SC3D->TLogDet = (double *)mallocEC(NS*sizeof(double));
      if (NewEnergyMethod)
       SC3D->MM1MInf = new HMatrix(N, N, RealComplex);
    }
   else
-   { SC3D->MInfLUDiagonal=0;
-     SC3D->ipiv=0;
+   { SC3D->TLogDet=0;
      SC3D->MM1MInf = 0;
    };
 
+  /*--------------------------------------------------------------*/
+  /*- for energy-only calculations, set up the block elimination  */
+  /*- described in scuff-cas3D.h. with more than one              */
+  /*- transformation, the A block comprises the surfaces that are */
+  /*- never moved; otherwise (or if there are no such surfaces,   */
+  /*- or no others) it is the self block of the largest surface,  */
+  /*- which is invariant under rigid transformations. A is stored */
+  /*- in the data buffer of M, which is not otherwise used in     */
+  /*- this case, if it fits there.                                */
+  /*--------------------------------------------------------------*/
+  SC3D->UseSchur=false;
+  SC3D->SurfaceFixed=0;
+  SC3D->SchurOffset=0;
+  SC3D->A=SC3D->B=SC3D->X=SC3D->S=SC3D->BX=0;
+  if ( WhichQuantities==QUANTITY_ENERGY && !NewEnergyMethod && NS>1 )
+   { 
+     SC3D->SurfaceFixed = (bool *)mallocEC(NS*sizeof(bool));
+     SC3D->SchurOffset  = (int *)mallocEC(NS*sizeof(int));
+     for(int ns=0; ns<NS; ns++)
+      SC3D->SurfaceFixed[ns]=(SC3D->NumTransformations>1);
+     for(int nt=0; nt<SC3D->NumTransformations; nt++)
+      { GTComplex *GTC=SC3D->GTCList[nt];
+        for(int nsa=0; nsa<GTC->NumSurfacesAffected; nsa++)
+         { int ns;
+           if ( G->GetSurfaceByLabel(GTC->SurfaceLabel[nsa], &ns) )
+            SC3D->SurfaceFixed[ns]=false;
+         };
+      };
+
+     int NF=0, NM=0;
+     for(int ns=0; ns<NS; ns++)
+      if (SC3D->SurfaceFixed[ns])
+       NF+=G->Surfaces[ns]->NumBFs;
+     if (NF==0 || NF==N)
+      { int nsMax=0;
+        for(int ns=1; ns<NS; ns++)
+         if (G->Surfaces[ns]->NumBFs > G->Surfaces[nsMax]->NumBFs)
+          nsMax=ns;
+        for(int ns=0; ns<NS; ns++)
+         SC3D->SurfaceFixed[ns]=(ns==nsMax);
+        NF=G->Surfaces[nsMax]->NumBFs;
+        Log("Eliminating self block of surface %s (%i basis functions, %i on other surfaces)",
+             G->Surfaces[nsMax]->Label,NF,N-NF);
+      }
+     else
+      Log("Eliminating %i basis functions on fixed surfaces (%i on moving surfaces)",NF,N-NF);
+
+     NF=0;
+     for(int ns=0; ns<NS; ns++)
+      { int NBF=G->Surfaces[ns]->NumBFs;
+        if (SC3D->SurfaceFixed[ns])
+         { SC3D->SchurOffset[ns]=NF; NF+=NBF; }
+        else
+         { SC3D->SchurOffset[ns]=NM; NM+=NBF; }
+      };
+
+     if (NF>0 && NM>0)
+      { SC3D->UseSchur = true;
+        // A is stored in full (not packed) form even if M is 
+        // packed, so that solves with A are BLAS3 (getrs)
+        HMatrix *M=SC3D->M;
+        size_t MSize = (M->StorageType==LHM_NORMAL) ? ((size_t)N)*N : ((size_t)N)*(N+1)/2;
+        void *ABuffer = 0;
+        if ( ((size_t)NF)*NF <= MSize )
+         ABuffer = (RealComplex==LHM_REAL) ? (void *)M->DM : (void *)M->ZM;
+        SC3D->A  = new HMatrix(NF, NF, RealComplex, LHM_NORMAL, ABuffer);
+        SC3D->B  = new HMatrix(NF, NM, RealComplex);
+        SC3D->X  = new HMatrix(NF, NM, RealComplex);
+        SC3D->S  = new HMatrix(NM, NM, RealComplex);
+        SC3D->BX = new HMatrix(NM, NM, RealComplex);
+      };
+   };
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
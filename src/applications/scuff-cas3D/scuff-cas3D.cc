@@ -102,6 +102,12 @@ int main(int argc, char *argv[])
   bool NewEnergyMethod = false;
   bool WriteHDF5Files  = false;
 
+  //
+  // options for stochastic estimation of force/torque traces
+  //
+  int TraceProbes=0;
+  double TraceTol=1.0e-2;
+
 //
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
@@ -137,6 +143,9 @@ int main(int argc, char *argv[])
      {"NewEnergyMethod", PA_BOOL,   0, 1,       (void *)&NewEnergyMethod, 0,           "use alternative method for energy calculation"},
 //
      {"WriteHDF5Files", PA_BOOL,    1, 1,       (void *)&WriteHDF5Files,0,             "write BEM matrices to .hdf5 files"},
+//
+     {"TraceProbes",    PA_INT,     1, 1,       (void *)&TraceProbes,   0,             "estimate force/torque traces with at most this many random probes"},
+     {"TraceTol",       PA_DOUBLE,  1, 1,       (void *)&TraceTol,      0,             "relative tolerance for estimated force/torque traces"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -273,6 +282,8 @@ int main(int argc, char *argv[])
   SC3D->UseExistingData    = UseExistingData;
   SC3D->MaxXiPoints        = MaxXiPoints;
   SC3D->XiMin              = XiMin;
+  SC3D->TraceProbes        = TraceProbes;
+  SC3D->TraceTol           = TraceTol;
 
   if (G->LDim>=1)
    { UpdateBZIArgs(BZIArgs, G->RLBasis, G->RLVolume);
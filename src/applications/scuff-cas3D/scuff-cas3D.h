@@ -65,9 +65,8 @@ typedef struct SC3Data
 
    // storage for BEM matrix blocks
    int N, N1;
-   HMatrix **TBlocks, **UBlocks, **dUBlocks, *M, *dM;
-   int *ipiv;
-   HVector *MInfLUDiagonal;
+   HMatrix **TBlocks, **UBlocks, **dUBlocks, *M;
+   double *TLogDet; // TLogDet[ns] = log |det T_ns| 
 
    // matrix-block-assembly accelerators for PBC geometries
    void **TAccelerators, ***UAccelerators;
@@ -110,6 +109,30 @@ typedef struct SC3Data
    bool NewEnergyMethod;
    HMatrix *MM1MInf;
 
+   // block elimination for transformation sweeps: if some surfaces
+   // are never moved by any transformation, we factorize the block
+   // A of the BEM matrix coupling those surfaces once per frequency;
+   // each transformation then costs only the factorization of the
+   // Schur complement S = D - B' * A^{-1} * B, where B and D are
+   // the fixed-moving and moving-moving blocks, and we have
+   // log det M = log det A + log det S.
+   // if no surfaces are fixed in this sense, A is instead the 
+   // self block of the largest surface, which is unchanged by
+   // rigid transformations and whose factorization is computed
+   // anyway for log det T.
+   bool UseSchur;
+   bool *SurfaceFixed;  // true if surface #ns belongs to A
+   int *SchurOffset;    // offset of surface #ns within A or D
+   HMatrix *A, *B, *X, *S, *BX;
+   double ALogDet;
+   bool AFactorized;
+
+   // if TraceProbes>0, force and torque traces are estimated
+   // stochastically with at most (about) TraceProbes random probe
+   // vectors, to relative accuracy TraceTol; see GetTracesMInvdM
+   int TraceProbes;
+   double TraceTol;
+
    // various other miscellaneous items
    bool UseExistingData;
    bool WriteHDF5Files;
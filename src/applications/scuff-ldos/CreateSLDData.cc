@@ -197,6 +197,13 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
      = new HMatrix(XMatrices[nm]->NR, 18, LHM_COMPLEX);
   Data->GMatrices = GMatrices;
 
+  Data->NumWorkspaces = 1;
+  Data->Workspaces = (SLDWorkspace *)mallocEC(sizeof(SLDWorkspace));
+  Data->Workspaces[0].M              = Data->M;
+  Data->Workspaces[0].GMatrices      = GMatrices;
+  Data->Workspaces[0].RFWorkspace[0] = 0;
+  Data->Workspaces[0].RFWorkspace[1] = 0;
+
   /***************************************************************/
   /* For PBC geometries we need to do some preliminary setup     */
   /***************************************************************/
@@ -27,6 +27,13 @@
 #include "libscuff.h"
 #include "scuff-ldos.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
 #define ABSTOL 1.0e-20
 #define MAXSTR 1000
 
@@ -108,6 +115,97 @@ void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
     WriteData(Data, Omega, kBloch, FileType, nt, nm, Result, Error);
 }
 
+/***************************************************************/
+/* assemble and factorize the BEM matrix for a geometry without*/
+/* geometrical transformations at a single (Omega, kBloch)     */
+/* point, then get DGFs at all evaluation points. All storage  */
+/* comes from the workspace WS, and for periodic geometries    */
+/* the kBloch-independent innermost-cell blocks come from      */
+/* Data->ABMBCache, so that once the caches are clean at this  */
+/* frequency the routine may be called concurrently with       */
+/* distinct workspaces.                                        */
+/***************************************************************/
+static void GetBEMDGFs(SLDData *Data, SLDWorkspace *WS,
+                       cdouble Omega, double *kBloch)
+{
+  RWGGeometry *G       = Data->G;
+  HMatrix *M           = WS->M;
+  void **ABMBCache     = Data->ABMBCache;
+
+  if (G->LDim==0)
+   G->AssembleBEMMatrix(Omega, M);
+  else
+   { int NS = G->NumSurfaces;
+     for(int ns=0, nb=0; ns<NS; ns++)
+      for(int nsp=ns; nsp<NS; nsp++, nb++)
+       { 
+         int RowOffset = G->BFIndexOffset[ns];
+         int ColOffset = G->BFIndexOffset[nsp];
+         G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch,
+                                   M, 0, RowOffset, ColOffset,
+                                   ABMBCache[nb], false);
+
+         if (nsp>ns)
+          G->AssembleBEMMatrixBlock(nsp, ns, Omega, kBloch,
+                                    M, 0, ColOffset, RowOffset,
+                                    ABMBCache[nb], true);
+       };
+   };
+  M->LUFactorize();
+  for(int nm=0; nm<Data->NumXMatrices; nm++)
+   G->GetDyadicGFs(Omega, kBloch, Data->XMatrices[nm], M,
+                   WS->GMatrices[nm], Data->ScatteringOnly,
+                   WS->RFWorkspace);
+}
+
+/***************************************************************/
+/* convert the DGFs in GMatrices[nt*NumXMatrices + nm] into    */
+/* the NFun quantities per evaluation point that make up the   */
+/* integrand vector.                                           */
+/* Note: The LDOS is defined as                                */
+/*  \Rho = (abs(\omega) / \pi c^2) * Im Tr G                   */
+/***************************************************************/
+static void GetLDOSFromDGFs(SLDData *Data, HMatrix **GMatrices,
+                            cdouble Omega, double *Result)
+{
+  int NumXMatrices = Data->NumXMatrices;
+  double PreFac = abs(Omega)/M_PI;
+  int nResult=0;
+  for(int nt=0; nt<Data->NumTransforms; nt++)
+   for(int nm=0; nm<NumXMatrices; nm++)
+    { 
+      HMatrix *XMatrix = Data->XMatrices[nm];
+      HMatrix *GMatrix = GMatrices[nt*NumXMatrices + nm];
+      for(int nx=0; nx<XMatrix->NR; nx++)
+       { cdouble GE[3][3], GM[3][3];
+         for(int i=0; i<3; i++)
+          for(int j=0; j<3; j++)
+           { GE[i][j] = GMatrix->GetEntry(nx, 0 + 3*i + j);
+             GM[i][j] = GMatrix->GetEntry(nx, 9 + 3*i + j);
+           };
+         double ELDOS = PreFac * imag( GE[0][0] + GE[1][1] + GE[2][2] );
+         double MLDOS = PreFac * imag( GM[0][0] + GM[1][1] + GM[2][2] );
+
+         Result[nResult++] = ELDOS;
+         Result[nResult++] = MLDOS;
+         if (Data->LDOSOnly == false)
+          { for(int Mu=0; Mu<3; Mu++)
+             for(int Nu=0; Nu<3; Nu++)
+              { Result[nResult++] = real(GE[Mu][Nu]);
+                Result[nResult++] = imag(GE[Mu][Nu]);
+              };
+            for(int Mu=0; Mu<3; Mu++)
+             for(int Nu=0; Nu<3; Nu++)
+              { Result[nResult++] = real(GM[Mu][Nu]);
+                Result[nResult++] = imag(GM[Mu][Nu]);
+              };
+          }; // if (Data->LDOSOnly == false)
+ 
+       }; // for(int nx=0; nx<XMatrix->NR; nx++)
+
+    }; // for(int nm=0; nm<NumXMatrices; nm++)
+}
+
 /***************************************************************/
 /* routine to compute the LDOS at a single (Omega, kBloch)     */
 /* point (but typically multiple spatial evaluation points)    */
@@ -124,7 +222,6 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
   HMatrix **XMatrices  = Data->XMatrices;
   HMatrix **GMatrices  = Data->GMatrices;
   int NumXMatrices     = Data->NumXMatrices;
-  void **ABMBCache     = Data->ABMBCache;
   MatProp *HalfSpaceMP = Data->HalfSpaceMP;
   bool GroundPlane     = Data->GroundPlane;
   bool ScatteringOnly  = Data->ScatteringOnly;
@@ -165,31 +262,7 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
                          LBasis, GMatrices[nm]);
    }
   else if (GTCList==0)
-   { 
-     if (LDim==0)
-      G->AssembleBEMMatrix(Omega, M);
-     else
-      { int NS = G->NumSurfaces;
-        for(int ns=0, nb=0; ns<NS; ns++)
-         for(int nsp=ns; nsp<NS; nsp++, nb++)
-          { 
-            int RowOffset = G->BFIndexOffset[ns];
-            int ColOffset = G->BFIndexOffset[nsp];
-            G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch,
-                                      M, 0, RowOffset, ColOffset,
-                                      ABMBCache[nb], false);
-
-            if (nsp>ns)
-             G->AssembleBEMMatrixBlock(nsp, ns, Omega, kBloch,
-                                       M, 0, ColOffset, RowOffset,
-                                       ABMBCache[nb], true);
-          };
-      };
-     M->LUFactorize();
-     for(int nm=0; nm<NumXMatrices; nm++)
-      G->GetDyadicGFs(Omega, kBloch, XMatrices[nm], M, GMatrices[nm],
-                      ScatteringOnly);
-   }
+   GetBEMDGFs(Data, Data->Workspaces + 0, Omega, kBloch);
   else 
    {
      HMatrix **TBlocks   = Data->TBlocks;
@@ -234,52 +307,107 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
                                
   /*--------------------------------------------------------------*/
   /*- get LDOS at all evaluation points.                          */
-  /*- Note: The LDOS is defined as                                */
-  /*-  \Rho = (abs(\omega) / \pi c^2) * Im Tr G                   */
   /*--------------------------------------------------------------*/
-  double PreFac = abs(Omega)/M_PI;
-  int nResult=0;
+  GetLDOSFromDGFs(Data, GMatrices, Omega, Result);
+
+  /***************************************************************/
+  /* write output to kBloch-resolved data file for PBC geometries*/
+  /*  or the tput to kBloch-resolved data file for PBC geometries*/
+  /***************************************************************/
   for(int nt=0; nt<NumTransforms; nt++)
    for(int nm=0; nm<NumXMatrices; nm++)
-    { 
-      HMatrix *XMatrix = Data->XMatrices[nm];
-      HMatrix *GMatrix = Data->GMatrices[nt*NumXMatrices + nm];
-      for(int nx=0; nx<XMatrix->NR; nx++)
-       { cdouble GE[3][3], GM[3][3];
-         for(int i=0; i<3; i++)
-          for(int j=0; j<3; j++)
-           { GE[i][j] = GMatrix->GetEntry(nx, 0 + 3*i + j);
-             GM[i][j] = GMatrix->GetEntry(nx, 9 + 3*i + j);
-           };
-         double ELDOS = PreFac * imag( GE[0][0] + GE[1][1] + GE[2][2] );
-         double MLDOS = PreFac * imag( GM[0][0] + GM[1][1] + GM[2][2] );
+    { if (LDim>0)
+       WriteData(Data, Omega, kBloch, FILETYPE_BYK, nt, nm, Result, 0);
+      else
+       WriteData(Data, Omega, 0,      FILETYPE_LDOS, nt, nm, Result, 0);
+    };
 
-         Result[nResult++] = ELDOS;
-         Result[nResult++] = MLDOS;
-         if (Data->LDOSOnly == false)
-          { for(int Mu=0; Mu<3; Mu++)
-             for(int Nu=0; Nu<3; Nu++)
-              { Result[nResult++] = real(GE[Mu][Nu]);
-                Result[nResult++] = imag(GE[Mu][Nu]);
-              };
-            for(int Mu=0; Mu<3; Mu++)
-             for(int Nu=0; Nu<3; Nu++)
-              { Result[nResult++] = real(GM[Mu][Nu]);
-                Result[nResult++] = imag(GM[Mu][Nu]);
-              };
-          }; // if (Data->LDOSOnly == false)
- 
-       }; // for(int nx=0; nx<XMatrix->NR; nx++)
- 
-    /***************************************************************/
-    /* write output to kBloch-resolved data file for PBC geometries*/
-    /*  or the tput to kBloch-resolved data file for PBC geometries*/
-    /***************************************************************/
-    if (LDim>0)
-     WriteData(Data, Omega, kBloch, FILETYPE_BYK, nt, nm, Result, 0);
-    else
-     WriteData(Data, Omega, 0,      FILETYPE_LDOS, nt, nm, Result, 0);
+}
+
+/***************************************************************/
+/* allocate workspaces #1...#NumWorkspaces-1 (workspace #0     */
+/* uses the M and GMatrices fields of Data)                    */
+/***************************************************************/
+static void AllocateWorkspaces(SLDData *Data, int NumWorkspaces)
+{
+  if (NumWorkspaces <= Data->NumWorkspaces)
+   return;
+
+  Data->Workspaces = (SLDWorkspace *)reallocEC(Data->Workspaces,
+                                               NumWorkspaces*sizeof(SLDWorkspace));
+  for(int nw=Data->NumWorkspaces; nw<NumWorkspaces; nw++)
+   { SLDWorkspace *WS = Data->Workspaces + nw;
+     WS->M = Data->G->AllocateBEMMatrix();
+     WS->GMatrices = (HMatrix **)mallocEC(Data->NumXMatrices*sizeof(HMatrix *));
+     for(int nm=0; nm<Data->NumXMatrices; nm++)
+      WS->GMatrices[nm] = new HMatrix(Data->XMatrices[nm]->NR, 18, LHM_COMPLEX);
+     WS->RFWorkspace[0] = WS->RFWorkspace[1] = 0;
+   };
+  Log("Allocated %i BEM-matrix workspaces for kBloch points",NumWorkspaces);
+  Data->NumWorkspaces = NumWorkspaces;
+}
 
-   }; // for(int nm=0; nm<NumXMatrices; nm++)
+/***************************************************************/
+/* batched version of GetLDOS for Brillouin-zone integration:  */
+/* computes the integrand vector at NumPoints kBloch points    */
+/* (kBlochs[3*np + 0..2]) at a single frequency, storing the   */
+/* FDim values for point #np in Results[np*FDim...].           */
+/*                                                             */
+/* For geometries without geometrical transformations, the    */
+/* first point is computed on its own, which fills the         */
+/* kBloch-independent block caches at this frequency; the      */
+/* remaining points are then distributed over threads, each    */
+/* with its own BEM matrix and DGF storage. The by-kBloch      */
+/* output file is written afterwards in point order.           */
+/***************************************************************/
+void GetLDOS_v(void *pData, cdouble Omega, int NumPoints,
+               double *kBlochs, double *Results)
+{
+  SLDData *Data = (SLDData *)pData;
+  int NFun      = Data->LDOSOnly ? 2 : 38;
+  int FDim      = NFun * Data->TotalEvalPoints;
+
+  int NumThreads = GetNumThreads();
+  if (NumThreads > NumPoints-1)
+   NumThreads = NumPoints-1;
+
+  bool Concurrent =    Data->GTCList==0
+                    && Data->HalfSpaceMP==0
+                    && Data->GroundPlane==false
+                    && NumThreads>1;
+  if (!Concurrent)
+   { for(int np=0; np<NumPoints; np++)
+      GetLDOS(pData, Omega, kBlochs + 3*np, Results + np*FDim);
+     return;
+   };
 
+  AllocateWorkspaces(Data, NumThreads);
+
+  int LDim = Data->G->LDim;
+  Log("Computing LDOS at %i kBloch points (Omega=%s, %i threads)",
+       NumPoints, z2s(Omega), NumThreads);
+
+  GetBEMDGFs(Data, Data->Workspaces + 0, Omega, kBlochs);
+  GetLDOSFromDGFs(Data, Data->GMatrices, Omega, Results);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int np=1; np<NumPoints; np++)
+   { int nw=0;
+#ifdef USE_OPENMP
+     nw = omp_get_thread_num();
+#endif
+     SLDWorkspace *WS = Data->Workspaces + nw;
+     GetBEMDGFs(Data, WS, Omega, kBlochs + 3*np);
+     GetLDOSFromDGFs(Data, WS->GMatrices, Omega, Results + np*FDim);
+   };
+
+  for(int np=0; np<NumPoints; np++)
+   for(int nm=0; nm<Data->NumXMatrices; nm++)
+    { if (LDim>0)
+       WriteData(Data, Omega, kBlochs + 3*np, FILETYPE_BYK, 0, nm, Results + np*FDim, 0);
+      else
+       WriteData(Data, Omega, 0, FILETYPE_LDOS, 0, nm, Results + np*FDim, 0);
+    };
 }
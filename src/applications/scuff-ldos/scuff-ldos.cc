@@ -231,6 +231,7 @@ int main(int argc, char *argv[])
      /* that we started to initialize above                         */
      /***************************************************************/
      BZIArgs->BZIFunc     = GetLDOS;
+     BZIArgs->BZIFunc_v   = GetLDOS_v;
      BZIArgs->UserData    = (void *)Data;
      BZIArgs->FDim        = FDim;
      UpdateBZIArgs(BZIArgs, Data->G->RLBasis, Data->G->RLVolume);
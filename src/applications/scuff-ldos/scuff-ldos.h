@@ -36,6 +36,20 @@ using namespace scuff;
 #define FILETYPE_LDOS 0
 #define FILETYPE_BYK  1
 
+/***************************************************************/
+/* storage needed to compute DGFs at one kBloch point; the     */
+/* batched Brillouin-zone integrand GetLDOS_v() keeps one of   */
+/* these per thread so that several kBloch points can be       */
+/* handled at once                                             */
+/***************************************************************/
+typedef struct SLDWorkspace
+ {
+   HMatrix *M;             // BEM matrix
+   HMatrix **GMatrices;    // GMatrices[nm] = DGFs at XMatrices[nm]
+   HMatrix *RFWorkspace[2];// reduced-field buffers for GetDyadicGFs
+
+ } SLDWorkspace;
+
 /***************************************************************/
 /* data structure containing everything needed to execute an   */
 /* LDOS calculation                                            */
@@ -46,6 +60,11 @@ typedef struct SLDData
    RWGGeometry *G;
    HMatrix *M;
 
+   // Workspaces[0] refers to M and GMatrices; the others are
+   // allocated on first use by GetLDOS_v
+   SLDWorkspace *Workspaces;
+   int NumWorkspaces;
+
    // data on evaluation points and DGFs at evaluation points
    HMatrix **XMatrices, **GMatrices;
    char **EPFileBases;
@@ -94,6 +113,8 @@ void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
                int FileType, double *Result, double *Error);
 void GetLDOS(void *Data, cdouble Omega, double *kBloch, 
              double *Result);
+void GetLDOS_v(void *Data, cdouble Omega, int NumPoints,
+               double *kBlochs, double *Results);
 
 /***************************************************************/
 // AnalyticalDGFs.cc
@@ -175,6 +175,34 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
    };
   Log("After T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
 
+  /*--------------------------------------------------------------*/
+  /*- for periodic geometries, allocate caches for the kBloch-    */
+  /*- independent contributions of the innermost lattice cells to */
+  /*- the T and U blocks, so that these are computed only once    */
+  /*- per frequency instead of once per (Omega, kBloch) point.    */
+  /*--------------------------------------------------------------*/
+  SNEQD->TIntCache = SNEQD->TExtCache = SNEQD->UCache = 0;
+  if (G->LBasis)
+   { SNEQD->TIntCache = (void **)mallocEC(NS*sizeof(void *));
+     SNEQD->TExtCache = (void **)mallocEC(NS*sizeof(void *));
+     for(int ns=0; ns<NS; ns++)
+      if (G->Mate[ns]==-1)
+       { SNEQD->TExtCache[ns] = G->CreateABMBAccelerator(ns, ns);
+         if ( !(G->Surfaces[ns]->IsPEC) )
+          SNEQD->TIntCache[ns] = G->CreateABMBAccelerator(ns, ns);
+       };
+
+     // U blocks change with the transformation, so the cache
+     // would be stale after every G->Transform()
+     if (NT==1)
+      { SNEQD->UCache = (void **)mallocEC( ((NS*(NS-1))/2)*sizeof(void *));
+        for(int nb=0, ns=0; ns<NS; ns++)
+         for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+          SNEQD->UCache[nb] = G->CreateABMBAccelerator(ns, nsp);
+      };
+     Log("After block caches: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
+   };
+
   /*--------------------------------------------------------------*/
   /*- allocate BEM matrix and dressed Rytov matrix ---------------*/
   /*--------------------------------------------------------------*/
@@ -194,6 +194,187 @@ int GetSIFlux(SNEQData *SNEQD, int SourceSurface, cdouble Omega,
 
 } 
 
+/***************************************************************/
+/* assemble the (transformation-independent) T matrix blocks   */
+/* at a single frequency.                                      */
+/***************************************************************/
+static void AssembleTBlocks(SNEQData *SNEQD, cdouble Omega, double *kBloch)
+{
+  RWGGeometry *G = SNEQD->G;
+  HMatrix **TExt = SNEQD->TExt;
+  HMatrix **TInt = SNEQD->TInt;
+  int NS         = G->NumSurfaces;
+  void **TExtCache = SNEQD->TExtCache;
+  void **TIntCache = SNEQD->TIntCache;
+
+  for(int nr=0; nr<G->NumRegions; nr++)
+   G->RegionMPs[nr]->Zero();
+  for(int ns=0; ns<NS; ns++)
+   { 
+     if (G->Mate[ns]!=-1)
+      { Log(" Block %i is identical to %i (reusing T matrices)",ns,G->Mate[ns]);
+        continue;
+      }
+     else
+      Log(" Assembling self contributions to T(%i)...",ns);
+
+     if ( !(G->Surfaces[ns]->IsPEC) )
+      { G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->UnZero();
+        G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TInt[ns], 0, 0, 0,
+                                  TIntCache ? TIntCache[ns] : 0);
+        G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->Zero();
+      };
+
+     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->UnZero();
+     G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TExt[ns], 0, 0, 0,
+                               TExtCache ? TExtCache[ns] : 0);
+     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->Zero();
+   };
+  for(int nr=0; nr<G->NumRegions; nr++)
+   G->RegionMPs[nr]->UnZero();
+}
+
+/***************************************************************/
+/* initialize frequency interpolation of BEM blocks: the T     */
+/* blocks (and, if there is only one geometrical transform,    */
+/* the U blocks) are assembled exactly at the anchor           */
+/* frequencies, after which all frequencies in the sweep are   */
+/* handled by interpolation.                                   */
+/***************************************************************/
+static void InitBlockInterpolators(SNEQData *SNEQD)
+{
+  RWGGeometry *G   = SNEQD->G;
+  int NS           = G->NumSurfaces;
+  int NB           = (NS*(NS-1))/2;
+  int NumAnchors   = SNEQD->NumAnchors;
+  cdouble OmegaMin = SNEQD->OmegaMin;
+  cdouble OmegaMax = SNEQD->OmegaMax;
+  bool InterpolateU = (SNEQD->NumTransformations==1);
+
+  SNEQD->TExtInterp=(BEMBlockInterpolator **)mallocEC(NS*sizeof(BEMBlockInterpolator *));
+  SNEQD->TIntInterp=(BEMBlockInterpolator **)mallocEC(NS*sizeof(BEMBlockInterpolator *));
+  for(int ns=0; ns<NS; ns++)
+   { if (G->Mate[ns]!=-1) continue;
+     SNEQD->TExtInterp[ns]
+      = new BEMBlockInterpolator(G, ns, ns, OmegaMin, OmegaMax, NumAnchors);
+     if ( !(G->Surfaces[ns]->IsPEC) )
+      SNEQD->TIntInterp[ns]
+       = new BEMBlockInterpolator(G, ns, ns, OmegaMin, OmegaMax, NumAnchors);
+   };
+
+  if (InterpolateU && NB>0)
+   { G->Transform(SNEQD->GTCList[0]);
+     SNEQD->UInterp=(BEMBlockInterpolator **)mallocEC(NB*sizeof(BEMBlockInterpolator *));
+     for(int nb=0, ns=0; ns<NS; ns++)
+      for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+       SNEQD->UInterp[nb]
+        = new BEMBlockInterpolator(G, ns, nsp, OmegaMin, OmegaMax, NumAnchors);
+   };
+
+  for(int na=0; na<NumAnchors; na++)
+   { cdouble Omega = SNEQD->TExtInterp[0]->GetAnchor(na);
+     Log("Assembling BEM blocks at anchor frequency %s (%i/%i)",z2s(Omega),na+1,NumAnchors);
+
+     AssembleTBlocks(SNEQD, Omega, 0);
+     for(int ns=0; ns<NS; ns++)
+      { if (SNEQD->TExtInterp[ns])
+         SNEQD->TExtInterp[ns]->SetAnchorBlock(na, SNEQD->TExt[ns]);
+        if (SNEQD->TIntInterp[ns])
+         SNEQD->TIntInterp[ns]->SetAnchorBlock(na, SNEQD->TInt[ns]);
+      };
+
+     if (SNEQD->UInterp)
+      for(int nb=0, ns=0; ns<NS; ns++)
+       for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+        { G->AssembleBEMMatrixBlock(ns, nsp, Omega, 0, SNEQD->U[nb]);
+          SNEQD->UInterp[nb]->SetAnchorBlock(na, SNEQD->U[nb]);
+        };
+   };
+
+  if (SNEQD->UInterp)
+   G->UnTransform();
+}
+
+/***************************************************************/
+/* free the interpolators created by InitBlockInterpolators    */
+/***************************************************************/
+void DeleteBlockInterpolators(SNEQData *SNEQD)
+{
+  if (SNEQD->TExtInterp==0)
+   return;
+
+  int NS = SNEQD->G->NumSurfaces;
+  int NB = (NS*(NS-1))/2;
+  for(int ns=0; ns<NS; ns++)
+   { if (SNEQD->TExtInterp[ns]) delete SNEQD->TExtInterp[ns];
+     if (SNEQD->TIntInterp[ns]) delete SNEQD->TIntInterp[ns];
+   };
+  free(SNEQD->TExtInterp);
+  free(SNEQD->TIntInterp);
+  SNEQD->TExtInterp=SNEQD->TIntInterp=0;
+
+  if (SNEQD->UInterp)
+   { for(int nb=0; nb<NB; nb++)
+      if (SNEQD->UInterp[nb]) delete SNEQD->UInterp[nb];
+     free(SNEQD->UInterp);
+     SNEQD->UInterp=0;
+   };
+}
+
+/***************************************************************/
+/* free the kBloch-independent block caches allocated for      */
+/* periodic geometries in CreateSNEQData                       */
+/***************************************************************/
+void DeleteABMBCaches(SNEQData *SNEQD)
+{
+  RWGGeometry *G = SNEQD->G;
+  int NS = G->NumSurfaces;
+  int NB = (NS*(NS-1))/2;
+
+  if (SNEQD->TExtCache)
+   { for(int ns=0; ns<NS; ns++)
+      { G->DestroyABMBAccelerator(SNEQD->TExtCache[ns]);
+        G->DestroyABMBAccelerator(SNEQD->TIntCache[ns]);
+      };
+     free(SNEQD->TExtCache);
+     free(SNEQD->TIntCache);
+     SNEQD->TExtCache=SNEQD->TIntCache=0;
+   };
+
+  if (SNEQD->UCache)
+   { for(int nb=0; nb<NB; nb++)
+      G->DestroyABMBAccelerator(SNEQD->UCache[nb]);
+     free(SNEQD->UCache);
+     SNEQD->UCache=0;
+   };
+}
+
+/***************************************************************/
+/* returns true if the interpolation error estimate is within  */
+/* the tolerance, which may be set by SCUFF_BEM_INTERP_TOL.    */
+/* otherwise the caller discards the interpolated blocks and   */
+/* assembles them exactly at this frequency; we warn (once)    */
+/* that this is happening.                                     */
+/***************************************************************/
+static bool InterpolationErrorOK(double Error)
+{
+  static bool Warned=false;
+  static double Tol=-1.0;
+  if (Tol<0.0)
+   { Tol=1.0e-4;
+     char *s=getenv("SCUFF_BEM_INTERP_TOL");
+     if (s && sscanf(s,"%le",&Tol)==1)
+      Log("Setting BEM interpolation tolerance to %e",Tol);
+   };
+  if ( Error<=Tol )
+   return true;
+  if (!Warned)
+   { Warn("estimated BEM interpolation error %.1e exceeds tolerance %.1e; assembling exactly instead (consider more --InterpolateBEM anchor points)",Error,Tol);
+     Warned=true;
+   };
+  return false;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -223,31 +404,27 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
 
   /***************************************************************/
   /* before entering the loop over transformations, we first     */
-  /* assemble the (transformation-independent) T matrix blocks.  */
+  /* assemble the (transformation-independent) T matrix blocks,  */
+  /* or interpolate them between anchor frequencies if the user  */
+  /* asked for that.                                             */
   /***************************************************************/
-  for(int nr=0; nr<G->NumRegions; nr++)
-   G->RegionMPs[nr]->Zero();
-  for(int ns=0; ns<NS; ns++)
-   { 
-     if (G->Mate[ns]!=-1)
-      { Log(" Block %i is identical to %i (reusing T matrices)",ns,G->Mate[ns]);
-        continue;
-      }
-     else
-      Log(" Assembling self contributions to T(%i)...",ns);
-
-     if ( !(G->Surfaces[ns]->IsPEC) )
-      { G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->UnZero();
-        G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TInt[ns]);
-        G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->Zero();
+  if (SNEQD->NumAnchors>0 && SNEQD->TExtInterp==0)
+   InitBlockInterpolators(SNEQD);
+  bool Interpolate = SNEQD->TExtInterp && SNEQD->TExtInterp[0]->Contains(Omega);
+  if (Interpolate)
+   { double MaxError=0.0;
+     for(int ns=0; ns<NS; ns++)
+      { if (SNEQD->TExtInterp[ns])
+         MaxError=fmax(MaxError, SNEQD->TExtInterp[ns]->GetBlock(Omega, TExt[ns]));
+        if (SNEQD->TIntInterp[ns])
+         MaxError=fmax(MaxError, SNEQD->TIntInterp[ns]->GetBlock(Omega, TInt[ns]));
       };
-
-     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->UnZero();
-     G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TExt[ns]);
-     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->Zero();
-   };
-  for(int nr=0; nr<G->NumRegions; nr++)
-   G->RegionMPs[nr]->UnZero();
+     Log(" Interpolated T blocks (estimated relative error %.1e)",MaxError);
+     if (!InterpolationErrorOK(MaxError))
+      AssembleTBlocks(SNEQD, Omega, kBloch);
+   }
+  else
+   AssembleTBlocks(SNEQD, Omega, kBloch);
 
   /***************************************************************/
   /* now loop over transformations.                              */
@@ -272,7 +449,12 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      for(int nb=0, ns=0; ns<NS; ns++)
       for(int nsp=ns+1; nsp<NS; nsp++, nb++)
        if ( nt==0 || G->SurfaceMoved[ns] || G->SurfaceMoved[nsp] )
-        G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb]);
+        { if (    Interpolate && SNEQD->UInterp
+               && InterpolationErrorOK(SNEQD->UInterp[nb]->GetBlock(Omega, U[nb]))
+             ) continue;
+          G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb], 0, 0, 0,
+                                    SNEQD->UCache ? SNEQD->UCache[nb] : 0);
+        };
      Log("...SN done with ABMB");
 
      /*--------------------------------------------------------------*/
@@ -90,6 +90,9 @@ int main(int argc, char *argv[])
   bool PlotFlux=false;
   bool OmitSelfTerms=false;
 
+  /*--------------------------------------------------------------*/
+  int InterpolateBEM=0;
+
   /*--------------------------------------------------------------*/
   char *Cache=0;
   char *ReadCache[MAXCACHE];         int nReadCache;
@@ -119,6 +122,8 @@ int main(int argc, char *argv[])
      {"DSIMesh",        PA_STRING,  1, 1,       (void *)&DSIMesh,    0,             "bounding surface .msh file for DSIPFT"},
      {"DSIRadius",      PA_DOUBLE,  1, 1,       (void *)&DSIRadius,  0,             "bounding-sphere radius for DSIPFT"},
      {"DSIOmegaFile",   PA_STRING,  1, 1,       (void *)&DSIOmegaFile,  0,          "list of frequencies at which to perform DSI calculations"},
+/**/
+     {"InterpolateBEM", PA_INT,     1, 1,       (void *)&InterpolateBEM, 0,         "number of anchor frequencies for interpolating BEM blocks"},
 /**/
      {"Cache",          PA_STRING,  1, 1,       (void *)&Cache,      0,             "read/write cache"},
      {"ReadCache",      PA_STRING,  1, MAXCACHE,(void *)ReadCache,   &nReadCache,   "read cache"},
@@ -214,10 +219,35 @@ int main(int argc, char *argv[])
   SNEQD->PFTOpts.DSIFarField     = DSIFarField;
   SNEQD->DSIOmegaPoints          = DSIOmegaFile ? new HVector(DSIOmegaFile) : 0;
 
+  /*******************************************************************/
+  /* for frequency sweeps with more frequencies than anchor points,  */
+  /* the frequency-dependent BEM blocks are interpolated between     */
+  /* anchor frequencies spanning the sweep (see WriteFlux.cc)        */
+  /*******************************************************************/
+  if (InterpolateBEM>0)
+   { if (G->LBasis)
+      Warn("--InterpolateBEM is not available for extended geometries (ignoring)");
+     else if (NumFreqs<=InterpolateBEM)
+      Warn("--InterpolateBEM %i: only %i frequencies requested (ignoring)",InterpolateBEM,NumFreqs);
+     else
+      { cdouble OmegaMin=OmegaPoints->GetEntry(0), OmegaMax=OmegaMin;
+        for(int nFreq=1; nFreq<NumFreqs; nFreq++)
+         { cdouble Omega=OmegaPoints->GetEntry(nFreq);
+           if (real(Omega)<real(OmegaMin)) OmegaMin=Omega;
+           if (real(Omega)>real(OmegaMax)) OmegaMax=Omega;
+         };
+        SNEQD->NumAnchors=InterpolateBEM;
+        SNEQD->OmegaMin=OmegaMin;
+        SNEQD->OmegaMax=OmegaMax;
+        Log("Interpolating BEM blocks at %i anchor frequencies in [%g,%g]",
+             InterpolateBEM,real(OmegaMin),real(OmegaMax));
+      };
+   };
+
   if (OmegaKBPoints && !G->LBasis)
-   ErrExit("--OmegaKBPoints may only be used with extended geometries");
-  else if (G->LBasis && !OmegaKBPoints==0)
-   ErrExit("--OmegaKBPoints is required for extended geometries");
+   ErrExit("--OmegaKBFile may only be used with extended geometries");
+  else if (G->LBasis && OmegaKBPoints==0)
+   ErrExit("--OmegaKBFile is required for extended geometries");
          
   /*******************************************************************/
   /* preload the scuff cache with any cache preload files the user   */
@@ -250,6 +280,9 @@ int main(int argc, char *argv[])
    for (int nFreq=0; nFreq<NumFreqs; nFreq++)
     WriteFlux(SNEQD, OmegaPoints->GetEntry(nFreq));
 
+  DeleteBlockInterpolators(SNEQD);
+  DeleteABMBCaches(SNEQD);
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
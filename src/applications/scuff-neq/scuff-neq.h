@@ -109,6 +109,26 @@ typedef struct SNEQData
    HMatrix **TExt;    // contributions to BEM block for surface #ns
    HMatrix **U;       // U[nb] = // off-diagonal U-matrix block #nb 
 
+   /*--------------------------------------------------------------*/
+   /*- frequency interpolation of BEM blocks (--InterpolateBEM);   */
+   /*- NumAnchors=0 means all blocks are assembled exactly.        */
+   /*- UInterp is only used when there is a single transformation. */
+   /*--------------------------------------------------------------*/
+   int NumAnchors;
+   cdouble OmegaMin, OmegaMax;
+   BEMBlockInterpolator **TIntInterp;
+   BEMBlockInterpolator **TExtInterp;
+   BEMBlockInterpolator **UInterp;
+
+   /*--------------------------------------------------------------*/
+   /*- kBloch-independent block caches for periodic geometries,    */
+   /*- reused for all kBloch points at a given frequency. UCache   */
+   /*- is only used when there is a single transformation.         */
+   /*--------------------------------------------------------------*/
+   void **TIntCache;
+   void **TExtCache;
+   void **UCache;
+
    /*--------------------------------------------------------------*/
    /*- miscellaneous other options                                -*/
    /*--------------------------------------------------------------*/
@@ -130,5 +150,7 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
 /*- in GetFlux.cc ----------------------------------------------*/
 /*--------------------------------------------------------------*/
 void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch=0);
+void DeleteBlockInterpolators(SNEQData *SNEQD);
+void DeleteABMBCaches(SNEQData *SNEQD);
 
 #endif
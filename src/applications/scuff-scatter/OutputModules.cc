@@ -37,6 +37,55 @@
 
 #define II cdouble(0.0,1.0)
 
+/***************************************************************/
+/* data passed to WriteEPChunk() by ProcessEPFile()            */
+/***************************************************************/
+typedef struct EPChunkData
+ { RWGGeometry *G;
+   IncField *IF;
+   cdouble Omega;
+   double *kBloch;
+   char *OmegaStr, *TransformLabel, *IFLabel;
+   FILE *f[2];   // .scattered, .total output files
+ } EPChunkData;
+
+/***************************************************************/
+/* write the scattered and total fields at one chunk of        */
+/* evaluation points to the output files; called by            */
+/* GetFieldsChunked() as each chunk of fields is completed.    */
+/***************************************************************/
+static void WriteEPChunk(int nxStart, HMatrix *XChunk,
+                         HMatrix *SFChunk, void *UserData)
+{
+  (void) nxStart;
+  EPChunkData *Data = (EPChunkData *)UserData;
+
+  HMatrix *IFChunk
+   = Data->G->GetFields(Data->IF, 0, Data->Omega, Data->kBloch, XChunk);
+
+  for(int ST=0; ST<2; ST++)
+   { FILE *f=Data->f[ST];
+     for(int nr=0; nr<SFChunk->NR; nr++)
+      { double X[3];
+        cdouble EH[6];
+        XChunk->GetEntriesD(nr,":",X);
+        SFChunk->GetEntries(nr,":",EH);
+        if (ST==1) 
+         for(int n=0; n<6; n++) 
+          EH[n]+=IFChunk->GetEntry(nr,n);
+        fprintf(f,"%+.8e %+.8e %+.8e ",X[0],X[1],X[2]);
+        fprintf(f,"%s ",Data->OmegaStr);
+        if (Data->TransformLabel) fprintf(f,"%s ",Data->TransformLabel);
+        if (Data->IFLabel) fprintf(f,"%s ",Data->IFLabel);
+        fprintf(f,"%s %s %s   ",CD2S(EH[0]),CD2S(EH[1]),CD2S(EH[2]));
+        fprintf(f,"%s %s %s\n", CD2S(EH[3]),CD2S(EH[4]),CD2S(EH[5]));
+      };
+     fflush(f);
+   };
+
+  delete IFChunk;
+}
+
 /***************************************************************/
 /* compute scattered and total fields at a user-specified list */
 /* of evaluation points                                        */
@@ -64,15 +113,7 @@ void ProcessEPFile(SSData *SSD, char *EPFileName)
    };
 
   /*--------------------------------------------------------------*/
-  /*- get components of scattered and incident fields            -*/
-  /*--------------------------------------------------------------*/
-  Log("Evaluating fields at points in file %s...",EPFileName);
-
-  HMatrix *SFMatrix = G->GetFields( 0, KN, Omega, kBloch, XMatrix); // scattered
-  HMatrix *IFMatrix = G->GetFields(IF,  0, Omega, kBloch, XMatrix); // incident
-
-  /*--------------------------------------------------------------*/
-  /*- create .scattered and .total output files and write fields -*/
+  /*- create .scattered and .total output files and write headers */
   /*--------------------------------------------------------------*/
   SetDefaultCD2SFormat("%+.8e %+.8e ");
   char OmegaStr[100];
@@ -80,10 +121,11 @@ void ProcessEPFile(SSData *SSD, char *EPFileName)
   char *TransformLabel=SSD->TransformLabel;
   char *IFLabel=SSD->IFLabel;
   const char *Ext[2]={"scattered","total"};
+  EPChunkData MyData, *Data=&MyData;
   for(int ST=0; ST<2; ST++)
    { char OutFileName[MAXSTR];
      snprintf(OutFileName,MAXSTR,"%s.%s.%s",FileBase,GetFileBase(EPFileName),Ext[ST]);
-     FILE *f=fopen(OutFileName,"a");
+     FILE *f=Data->f[ST]=fopen(OutFileName,"a");
      fprintf(f,"# scuff-scatter run on %s (%s)\n",GetHostName(),GetTimeString());
      fprintf(f,"# columns: \n");
      fprintf(f,"# 1,2,3   x,y,z (evaluation point coordinates)\n");
@@ -99,27 +141,26 @@ void ProcessEPFile(SSData *SSD, char *EPFileName)
      fprintf(f,"# %02i,%02i   real, imag Hx\n",nc,nc+1); nc+=2;
      fprintf(f,"# %02i,%02i   real, imag Hy\n",nc,nc+1); nc+=2;
      fprintf(f,"# %02i,%02i   real, imag Hz\n",nc,nc+1); nc+=2;
-     for(int nr=0; nr<SFMatrix->NR; nr++)
-      { double X[3];
-        cdouble EH[6];
-        XMatrix->GetEntriesD(nr,":",X);
-        SFMatrix->GetEntries(nr,":",EH);
-        if (ST==1) 
-         for(int n=0; n<6; n++) 
-          EH[n]+=IFMatrix->GetEntry(nr,n);
-        fprintf(f,"%+.8e %+.8e %+.8e ",X[0],X[1],X[2]);
-        fprintf(f,"%s ",OmegaStr);
-        if (TransformLabel) fprintf(f,"%s ",TransformLabel);
-        if (IFLabel) fprintf(f,"%s ",IFLabel);
-        fprintf(f,"%s %s %s   ",CD2S(EH[0]),CD2S(EH[1]),CD2S(EH[2]));
-        fprintf(f,"%s %s %s\n", CD2S(EH[3]),CD2S(EH[4]),CD2S(EH[5]));
-      };
-     fclose(f);
    };
 
+  /*--------------------------------------------------------------*/
+  /*- compute scattered fields a chunk of points at a time and   -*/
+  /*- write scattered and total fields for each chunk as soon as -*/
+  /*- it is available                                            -*/
+  /*--------------------------------------------------------------*/
+  Log("Evaluating fields at points in file %s...",EPFileName);
+  Data->G              = G;
+  Data->IF             = IF;
+  Data->Omega          = Omega;
+  Data->kBloch         = kBloch;
+  Data->OmegaStr       = OmegaStr;
+  Data->TransformLabel = TransformLabel;
+  Data->IFLabel        = IFLabel;
+  G->GetFieldsChunked(0, KN, Omega, kBloch, XMatrix, WriteEPChunk, (void *)Data);
+
+  fclose(Data->f[0]);
+  fclose(Data->f[1]);
   delete XMatrix;
-  delete SFMatrix;
-  delete IFMatrix;
 
 }
 
@@ -111,6 +111,13 @@ int main(int argc, char *argv[])
   bool PlotSurfaceCurrents=false;
 //
   char *HDF5File=0;
+  char *SolverName=0;
+  bool Compress=false;
+  double ACATol=1.0e-4;
+  bool MatrixFree=false;
+  double NearFactor=3.0;
+  double FarFieldTol=1.0e-3;
+  bool Distributed=false;
   char *Cache=0;
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
@@ -167,6 +174,14 @@ int main(int argc, char *argv[])
      {"PlotSurfaceCurrents", PA_BOOL, 0, 1,     (void *)&PlotSurfaceCurrents,  0,   "generate surface current visualization files\n"},
 /**/
      {"HDF5File",       PA_STRING,  1, 1,       (void *)&HDF5File,   0,             "name of HDF5 file for BEM matrix/vector export\n"},
+/**/
+     {"Solver",         PA_STRING,  1, 1,       (void *)&SolverName, 0,             "method for solving the BEM system: LU | GMRES | BiCGStab"},
+     {"Compress",       PA_BOOL,    0, 1,       (void *)&Compress,   0,             "store far-field BEM matrix blocks in compressed (low-rank) form"},
+     {"ACATol",         PA_DOUBLE,  1, 1,       (void *)&ACATol,     0,             "relative tolerance for low-rank compression of BEM matrix blocks"},
+     {"MatrixFree",     PA_BOOL,    0, 1,       (void *)&MatrixFree, 0,             "apply the BEM matrix on the fly without storing it"},
+     {"NearFactor",     PA_DOUBLE,  1, 1,       (void *)&NearFactor, 0,             "near-field radius (in units of edge radii) for --MatrixFree"},
+     {"FarFieldTol",    PA_DOUBLE,  1, 1,       (void *)&FarFieldTol, 0,            "relative tolerance for the FFT far-field approximation with --MatrixFree"},
+     {"Distributed",    PA_BOOL,    0, 1,       (void *)&Distributed, 0,            "assemble and LU-factorize the BEM matrix distributed over MPI ranks\n"},
 /**/
      {"LogLevel",       PA_STRING,  1, 1,       (void *)&LogLevel,   0,             "none | terse | verbose | verbose2\n"},
 /**/
@@ -184,6 +199,21 @@ int main(int argc, char *argv[])
   if (FileBase==0) 
    FileBase=vstrdup(GetFileBase(GeoFile));
 
+  /*******************************************************************/
+  /* the default is to solve the BEM system by dense LU              */
+  /* factorization; the iterative solvers are preconditioned by the  */
+  /* LU-factorized single-surface diagonal blocks of the BEM matrix  */
+  /*******************************************************************/
+  int Solver=SCUFF_SOLVER_LU;
+  if (SolverName==0 || !strcasecmp(SolverName,"LU"))
+   Solver=SCUFF_SOLVER_LU;
+  else if (!strcasecmp(SolverName,"GMRES"))
+   Solver=SCUFF_SOLVER_GMRES;
+  else if (!strcasecmp(SolverName,"BiCGStab"))
+   Solver=SCUFF_SOLVER_BICGSTAB;
+  else
+   OSUsage(argv[0], OSArray, "unknown solver %s",SolverName);
+
   /*******************************************************************/
   /* process frequency-related options                               */
   /*******************************************************************/
@@ -284,7 +314,13 @@ int main(int argc, char *argv[])
   SSData MySSData, *SSD=&MySSData;
 
   RWGGeometry *G      = SSD->G   = new RWGGeometry(GeoFile);
-  HMatrix *M          = SSD->M   = G->AllocateBEMMatrix();
+
+  // for compact geometries solved by dense LU, the BEM matrix is
+  // complex symmetric; store only its upper triangle (packed) and
+  // factorize it by Bunch-Kaufman, halving memory and flops
+  bool PackedM = (    Solver==SCUFF_SOLVER_LU && !G->LBasis && !HDF5File
+                   && !(RWGGeometry::UseHRWGFunctions && G->NumMMJs>0) );
+  HMatrix *M          = SSD->M   = (Compress || MatrixFree || Distributed) ? 0 : G->AllocateBEMMatrix(false, PackedM);
   HVector *RHS        = SSD->RHS = G->AllocateRHSVector();
   HVector *KN         = SSD->KN  = G->AllocateRHSVector();
   double *kBloch      = SSD->kBloch = 0;
@@ -308,6 +344,66 @@ int main(int argc, char *argv[])
   if (ErrMsg)
    ErrExit("file %s: %s",TransFile,ErrMsg);
 
+  /*******************************************************************/
+  /* with --Compress, the BEM matrix is stored in hierarchical form  */
+  /* with low-rank far-field blocks, and the BEM system is solved by */
+  /* LU factorization in the same hierarchical form (or, with        */
+  /* --Solver GMRES | BiCGStab, iteratively)                         */
+  /*******************************************************************/
+  CompressedBEMMatrix *CM=0;
+  if (Compress)
+   { if (G->LDim>0)
+      ErrExit("--Compress is not available for periodic geometries");
+     if (NumTransformations>1)
+      ErrExit("--Compress is not available with --TransFile");
+     if (HDF5File)
+      ErrExit("--Compress is incompatible with --HDF5File");
+     CM = new CompressedBEMMatrix(G, ACATol, 32, 2.0, Solver);
+   };
+
+  /*******************************************************************/
+  /* with --MatrixFree, the BEM matrix is not stored at all; only a  */
+  /* sparse near-field correction is, and matrix-vector products are */
+  /* computed on the fly within an iterative solver                  */
+  /*******************************************************************/
+  MatrixFreeBEMOperator *MF=0;
+  if (MatrixFree)
+   { if (Compress)
+      ErrExit("--MatrixFree and --Compress are mutually exclusive");
+     if (G->LDim>0)
+      ErrExit("--MatrixFree is not available for periodic geometries");
+     if (NumTransformations>1)
+      ErrExit("--MatrixFree is not available with --TransFile");
+     if (HDF5File)
+      ErrExit("--MatrixFree is incompatible with --HDF5File");
+     if (Solver==SCUFF_SOLVER_LU)
+      Solver=SCUFF_SOLVER_GMRES;
+     MF = new MatrixFreeBEMOperator(G, NearFactor, Solver, FarFieldTol);
+   };
+
+  /*******************************************************************/
+  /* with --Distributed, the BEM matrix is stored in ScaLAPACK's     */
+  /* block-cyclic layout over the ranks of an MPI job (run e.g. as   */
+  /* mpirun -np 4 scuff-scatter ... in builds configured             */
+  /* --with-scalapack), each rank assembling only its own tiles.     */
+  /* all ranks solve for the surface currents, but only rank 0       */
+  /* writes output files.                                            */
+  /*******************************************************************/
+  DHMatrix *DM=0;
+  if (Distributed)
+   { if (Compress || MatrixFree)
+      ErrExit("--Distributed is incompatible with --Compress and --MatrixFree");
+     if (G->LDim>0)
+      ErrExit("--Distributed is not available for periodic geometries");
+     if (NumTransformations>1)
+      ErrExit("--Distributed is not available with --TransFile");
+     if (HDF5File)
+      ErrExit("--Distributed is incompatible with --HDF5File");
+     if (Solver!=SCUFF_SOLVER_LU)
+      ErrExit("--Distributed requires --Solver LU");
+     DHMatrixInit(&argc, &argv);
+   };
+
   /*******************************************************************/
   /* for periodic geometries, all incident field sources that are    */
   /* active at a given time must involve  single incident field      */
@@ -345,7 +441,8 @@ int main(int argc, char *argv[])
   /* if we have more than one geometrical transformation,            */
   /* allocate storage for BEM matrix blocks                          */
   /*******************************************************************/
-  HMatrix **TBlocks=0, **UBlocks=0;
+  HMatrix **TBlocks=0, **UBlocks=0, **DBlocks=0;
+  HMatrix *RHSMatrix=0, *KNMatrix=0;
   int NS=G->NumSurfaces;
   if (NumTransformations>1)
    { int NADB = NS*(NS-1)/2; // number of above-diagonal blocks
@@ -398,7 +495,13 @@ int main(int argc, char *argv[])
      /* matrix blocks at this frequency; otherwise just assemble the    */
      /* whole matrix                                                    */
      /*******************************************************************/
-     if (NumTransformations==1)
+     if (CM)
+      G->AssembleCompressedBEMMatrix(Omega, CM);
+     else if (MF)
+      MF->Assemble(Omega);
+     else if (Distributed)
+      DM=G->AssembleDistributedBEMMatrix(Omega, DM);
+     else if (NumTransformations==1)
       G->AssembleBEMMatrix(Omega, kBloch, M);
      else
       for(int ns=0; ns<G->NumSurfaces; ns++)
@@ -445,7 +548,8 @@ int main(int argc, char *argv[])
               for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
                { int ColOffset=G->BFIndexOffset[nsp];
                  M->InsertBlock(UBlocks[nb], RowOffset, ColOffset);
-                 M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+                 if (M->StorageType==LHM_NORMAL)
+                  M->InsertBlockTranspose(UBlocks[nb], ColOffset, RowOffset);
                };
             };
          };
@@ -468,8 +572,51 @@ int main(int argc, char *argv[])
         /* LU-factorize the BEM matrix to prepare for solving scattering   */
         /* problems                                                        */
         /*******************************************************************/
-        Log("  LU-factorizing BEM matrix...");
-        M->LUFactorize();
+        if (CM && Solver==SCUFF_SOLVER_LU)
+         { Log("  H-LU-factorizing compressed BEM matrix...");
+           if (CM->LUFactorize()!=0)
+            { Warn("H-LU factorization failed (omega=%s%s); skipping",OmegaStr,TransformStr);
+              continue;
+            };
+         }
+        else if (CM)
+         { Log("  Factorizing diagonal blocks of compressed BEM matrix...");
+           CM->FactorizePreconditioner();
+         }
+        else if (MF)
+         { Log("  Inverting diagonal blocks of BEM matrix...");
+           MF->FactorizePreconditioner();
+         }
+        else if (DM)
+         { Log("  LU-factorizing distributed BEM matrix...");
+           if (DM->LUFactorize()!=0)
+            ErrExit("LU factorization of distributed BEM matrix failed");
+         }
+        else if (Solver==SCUFF_SOLVER_LU)
+         { Log("  LU-factorizing BEM matrix...");
+           M->LUFactorize();
+         }
+        else
+         { Log("  LU-factorizing diagonal blocks of BEM matrix...");
+           DBlocks=G->FactorizeDiagonalBlocks(M, DBlocks);
+         };
+
+        /***************************************************************/
+        /* with dense LU factorization and more than one incident      */
+        /* field, assemble the RHS vectors for all incident fields at  */
+        /* once and solve them all with a single multi-RHS LU solve    */
+        /***************************************************************/
+        bool BatchSolve = ( !CM && !MF && !DM && Solver==SCUFF_SOLVER_LU && IFList->NumIFs>1 );
+        if (BatchSolve)
+         { Log("  Assembling RHS vectors for %i incident fields...",IFList->NumIFs);
+           RHSMatrix=G->AssembleRHSVector(Omega, kBloch, IFList->IFs, IFList->NumIFs, RHSMatrix);
+           if (KNMatrix==0)
+            KNMatrix=new HMatrix(RHSMatrix);
+           else
+            KNMatrix->Copy(RHSMatrix);
+           Log("  Solving the BEM system for %i incident fields...",IFList->NumIFs);
+           M->LUSolve(KNMatrix);
+         };
 
         /***************************************************************/
         /* loop over incident fields                                   */
@@ -488,16 +635,48 @@ int main(int argc, char *argv[])
            /***************************************************************/
            /* assemble RHS vector and solve BEM system*********************/
            /***************************************************************/
-           Log("  Assembling RHS vector...");
-           G->AssembleRHSVector(Omega, kBloch, IF, KN);
-           RHS->Copy(KN); // copy RHS vector for later 
-           Log("  Solving the BEM system...");
-           M->LUSolve(KN);
+           if (BatchSolve)
+            { HVector RHSColumn(G->TotalBFs, LHM_COMPLEX, RHSMatrix->GetColumnPointer(nIF));
+              HVector KNColumn(G->TotalBFs, LHM_COMPLEX, KNMatrix->GetColumnPointer(nIF));
+              RHS->Copy(&RHSColumn);
+              KN->Copy(&KNColumn);
+            }
+           else
+            { Log("  Assembling RHS vector...");
+              G->AssembleRHSVector(Omega, kBloch, IF, KN);
+              RHS->Copy(KN); // copy RHS vector for later 
+              Log("  Solving the BEM system...");
+              if (CM)
+               { if (CM->Solve(KN)!=0)
+                  { Warn("compressed BEM solve failed (omega=%s%s%s); skipping outputs",OmegaStr,TransformStr,IFStr);
+                    continue;
+                  };
+               }
+              else if (MF)
+               { if (MF->Solve(KN)!=0)
+                  { Warn("matrix-free BEM solve did not converge (omega=%s%s%s); skipping outputs",OmegaStr,TransformStr,IFStr);
+                    continue;
+                  };
+               }
+              else if (DM)
+               DM->LUSolve(KN);
+              else if (Solver==SCUFF_SOLVER_LU)
+               M->LUSolve(KN);
+              else if (G->IterativeSolve(M, DBlocks, KN, Solver)<0)
+               { Warn("iterative BEM solve did not converge (omega=%s%s%s); skipping outputs",OmegaStr,TransformStr,IFStr);
+                 continue;
+               };
+            };
    
            if (HDF5Context)
             { RHS->ExportToHDF5(HDF5Context,"RHS_%s%s%s",OmegaStr,TransformStr,IFStr);
               KN->ExportToHDF5(HDF5Context,"KN_%s%s%s",OmegaStr,TransformStr,IFStr);
             };
+
+           // the surface currents are replicated on all ranks of a
+           // distributed solve, so only one rank need write outputs
+           if (DM && DM->Rank!=0)
+            continue;
    
            /***************************************************************/
            /* now process all requested outputs                           */
@@ -573,6 +752,17 @@ int main(int argc, char *argv[])
   /***************************************************************/
   if (HDF5Context)
    HMatrix::CloseHDF5Context(HDF5Context);
+  if (DBlocks)
+   { // surfaces with mates share the factorized block of the mate
+     for(int ns=0; ns<NS; ns++)
+      if (G->Mate[ns]==-1)
+       delete DBlocks[ns];
+     free(DBlocks);
+   };
+  if (Distributed)
+   { if (DM) delete DM;
+     DHMatrixFinalize();
+   };
   printf("Thank you for your support.\n");
    
 }
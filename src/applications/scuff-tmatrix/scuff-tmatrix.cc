@@ -100,12 +100,6 @@ int main(int argc, char *argv[])
   if (Cache)
    PreloadCache(Cache);
 
-  /*--------------------------------------------------------------*/
-  /* preallocate BEM matrix and RHS vector                        */
-  /*--------------------------------------------------------------*/
-  HMatrix *M  = G->AllocateBEMMatrix();
-  HVector *KN = G->AllocateRHSVector();
-
   /*--------------------------------------------------------------*/
   /*- preallocate an HMatrix to store the T-matrix data           */
   /*--------------------------------------------------------------*/
@@ -114,18 +108,37 @@ int main(int argc, char *argv[])
   HVector *AVector = new HVector(NumMoments, LHM_COMPLEX);
 
   /*--------------------------------------------------------------*/
-  /* instantiate a SphericalWave structure (we will set the l, m, */
-  /* and Type fields later)                                       */
+  /* instantiate one SphericalWave structure for each incident    */
+  /* wave (i.e. each column of the T matrix except the l=0 ones), */
+  /* so that the scattering problems for all incident waves can   */
+  /* be solved at once with a single multi-RHS LU solve           */
   /*--------------------------------------------------------------*/
-  SphericalWave SW;
+  int NumWaves = NumMoments - 2;
+  IncField **SWs = new IncField *[NumWaves];
+  int *SWColumns = new int[NumWaves];
+  int Type, l, m;
+  int nc, nw;
+  for(nc=nw=l=0; l<=lMax; l++)
+   for(m=-l; m<=l; m++)
+    for(Type=SW_MAGNETIC; Type<=SW_ELECTRIC; Type++, nc++)
+     { if (l==0) continue;
+       SWs[nw]       = new SphericalWave(l, m, Type);
+       SWColumns[nw] = nc;
+       nw++;
+     };
+
+  /*--------------------------------------------------------------*/
+  /* preallocate BEM matrix and RHS vectors                       */
+  /*--------------------------------------------------------------*/
+  HMatrix *M  = G->AllocateBEMMatrix();
+  HMatrix *KNMatrix = new HMatrix(G->TotalBFs, NumWaves, LHM_COMPLEX);
 
   /*--------------------------------------------------------------*/
   /*- outer loop over frequencies --------------------------------*/
   /*--------------------------------------------------------------*/
-  int Type, l, m;
   int TypeP, lP, mP;
   const char *TypeChar="ME";
-  int nr, nc;
+  int nr;
   FILE *TextOutputFile;
   if (FileBase)
    TextOutputFile=vfopen("%s.TMatrix","w",FileBase);
@@ -143,37 +156,34 @@ int main(int argc, char *argv[])
      M->LUFactorize();
 
      /*--------------------------------------------------------------*/
-     /*- inner loop over incident spherical waves (i.e. over columns-*/
-     /*- of the T matrix; note nc is a running column index)        -*/
+     /*- solve the scattering problems for all incident spherical   -*/
+     /*- waves at once                                              -*/
      /*--------------------------------------------------------------*/
-     TMatrix->Zero();
-     for(nc=l=0; l<=lMax; l++)
-      for(m=-l; m<=l; m++)
-       for(Type=SW_MAGNETIC; Type<=SW_ELECTRIC; Type++, nc++)
-        { 
-           if (l==0) 
-            continue;
-
-           SW.SetType(Type);
-           SW.SetL(l);
-           SW.SetM(m);
+     Log("Solving scattering problems for %i incident spherical waves",NumWaves);
+     G->AssembleRHSVector(Omega, SWs, NumWaves, KNMatrix);
+     M->LUSolve(KNMatrix);
 
-           // solve the scattering problem for this incident spherical wave
-           Log("Solving scattering problem with incident spherical wave P(l,m)=%c(%i,%i)",TypeChar[Type],l,m);
-           G->AssembleRHSVector(Omega, &SW, KN);
-           M->LUSolve(KN);
+     /*--------------------------------------------------------------*/
+     /*- loop over incident spherical waves (i.e. over columns of   -*/
+     /*- the T matrix)                                              -*/
+     /*--------------------------------------------------------------*/
+     TMatrix->Zero();
+     for(nw=0; nw<NumWaves; nw++)
+      { 
+        nc=SWColumns[nw];
+        HVector KN(G->TotalBFs, LHM_COMPLEX, KNMatrix->GetColumnPointer(nw));
 
-           // compute the spherical multipole moments induced by the 
-           // incident wave on the object 
-           GetSphericalMoments(G, Omega, lMax, KN, AVector);
+        // compute the spherical multipole moments induced by the 
+        // incident wave on the object 
+        GetSphericalMoments(G, Omega, lMax, &KN, AVector);
 
-           // stamp in the vector of moments as the ncth row of the T-matrix
-           // NOTE: i don't know here the missing factor of -1.0 is coming
-           // from here...
-           for(nr=0; nr<NumMoments; nr++)
-            TMatrix->SetEntry(nr, nc, -1.0*Omega*AVector->GetEntry(nr));
+        // stamp in the vector of moments as the ncth row of the T-matrix
+        // NOTE: i don't know here the missing factor of -1.0 is coming
+        // from here...
+        for(nr=0; nr<NumMoments; nr++)
+         TMatrix->SetEntry(nr, nc, -1.0*Omega*AVector->GetEntry(nr));
 
-        }; // for (nc=l=0...)
+      }; // for (nw=0...)
 
      /*--------------------------------------------------------------*/
      /*- write the full content of the T-matrix at this frequency to */
@@ -198,6 +208,12 @@ int main(int argc, char *argv[])
     }; // for( nOmega= ... )
 
   fclose(TextOutputFile);
+
+  for(nw=0; nw<NumWaves; nw++)
+   delete SWs[nw];
+  delete[] SWs;
+  delete[] SWColumns;
+  delete KNMatrix;
       
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -170,6 +170,85 @@ static void *GetPhiVD_Thread(void *data)
   
 }
 
+/****************************************************************/
+/* the matrix whose inverse maps the vector of phi values and   */
+/* derivatives at the 4 corners of a grid cell into the NCOEFF  */
+/* coefficients of the interpolating polynomial in that cell is */
+/* the same for every cell (once the derivatives are scaled by  */
+/* the cell dimensions), so we assemble and invert it once,     */
+/* the first time it is needed, and keep the inverse around.    */
+/*                                                              */
+/* most entries of the inverse vanish, so we store it in       */
+/* compressed-row form: the nonzero entries in row #nm are      */
+/* Entries[RowStart[nm]...RowStart[nm+1]-1], in the columns     */
+/* given by the corresponding entries of Columns[].             */
+/****************************************************************/
+typedef struct CoefficientTransform
+ { int RowStart[NCOEFF+1];
+   int Columns[NCOEFF*NEQUATIONS];
+   double Entries[NCOEFF*NEQUATIONS];
+ } CoefficientTransform;
+
+static CoefficientTransform *CreateCoefficientTransform()
+{
+  double X1Bar, X2Bar;
+  double X1Powers[5], X2Powers[5];
+  int nm, ncp, p, q;
+  HMatrix *M=new HMatrix(NEQUATIONS, NCOEFF);
+
+  M->Zero();
+
+  /* note: X1Powers[p] = 0        ,  p==0 */
+  /*                   = X1^{p-1} ,  p>0  */
+  X1Powers[0]=0.0; X1Powers[1]=1.0; 
+  X2Powers[0]=0.0; X2Powers[1]=1.0; 
+
+  for(ncp=0, X1Bar=0.0; X1Bar<=1.0; X1Bar+=1.0)
+   for(X2Bar=0.0; X2Bar<=1.0; X2Bar+=1.0, ncp++)
+    { 
+      X1Powers[2]=X1Powers[3]=X1Powers[4]=X1Bar;
+      X2Powers[2]=X2Powers[3]=X2Powers[4]=X2Bar;
+
+      for(nm=0, p=0; p<4; p++)
+       for(q=0; q<4; q++, nm++)
+        { 
+          /* the nmth monomial is x1^p x2^q                 */
+          /* its x1 derivative is p x1^{p-1} x2^q ,     etc */
+          /* since xi={0,1}, we have xi^n = xi for all n    */
+          M->SetEntry(NDATA*ncp + 0, nm, X1Powers[p+1]*X2Powers[q+1]);
+          M->SetEntry(NDATA*ncp + 1, nm, p*X1Powers[p]*X2Powers[q+1]);
+          M->SetEntry(NDATA*ncp + 2, nm, q*X1Powers[p+1]*X2Powers[q]);
+          M->SetEntry(NDATA*ncp + 3, nm, p*q*X1Powers[p]*X2Powers[q]);
+        };
+    }; 
+  M->LUFactorize();
+  M->LUInvert();
+
+  CoefficientTransform *T=(CoefficientTransform *)mallocEC(sizeof(*T));
+  int NNZ=0;
+  for(nm=0; nm<NCOEFF; nm++)
+   { T->RowStart[nm]=NNZ;
+     for(int ne=0; ne<NEQUATIONS; ne++)
+      { double Entry=M->GetEntryD(nm, ne);
+        if (Entry==0.0) continue;
+        T->Columns[NNZ]=ne;
+        T->Entries[NNZ]=Entry;
+        NNZ++;
+      };
+   };
+  T->RowStart[NCOEFF]=NNZ;
+
+  delete M;
+  return T;
+}
+
+static const CoefficientTransform *GetCoefficientTransform()
+{
+  static const CoefficientTransform *T=CreateCoefficientTransform();
+  return T;
+}
+
+
 /****************************************************************/
 /* class constructor 1: construct the class from a user-supplied*/
 /* function and grid                                            */
@@ -366,91 +445,50 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
 #endif
 
    /*--------------------------------------------------------------*/
-   /*- construct the matrix whose inverse maps a vector of        -*/
-   /*- phi values and derivatives into polynomial coefficients.   -*/
-   /*- (since this matrix is a fixed constant entity i could just -*/
-   /*-  assemble and invert it once and hard-code the inverse     -*/
-   /*-  here, but i find it just as easy to do it this way.)      -*/
-   /*-                                                            -*/
-   /*- the outer loop (actually two loops) loops over the 4       -*/
-   /*- corners of the grid cell.                                  -*/
-   /*-                                                            -*/
-   /*- the inner loop (actually two loops) loops over the NCOEFF  -*/
-   /*- monomials in the interpolating polynomial.                 -*/
+   /*- compute the coefficients of the interpolating polynomial in -*/
+   /*- each grid cell by applying the (constant) inverse of the    -*/
+   /*- corner-data matrix to the vector of phi values and          -*/
+   /*- derivatives at the 4 corners of the cell                    -*/
    /*--------------------------------------------------------------*/
-   double X1Bar, X2Bar;
-   double X1Powers[5], X2Powers[5];
-   int nm, ncp, p, q;
-   HMatrix *M=new HMatrix(NEQUATIONS, NCOEFF);
-
-   M->Zero();
-
-   /* note: X1Powers[p] = 0        ,  p==0 */
-   /*                   = X1^{p-1} ,  p>0  */
-   X1Powers[0]=0.0; X1Powers[1]=1.0; 
-   X2Powers[0]=0.0; X2Powers[1]=1.0; 
-
-   for(ncp=0, X1Bar=0.0; X1Bar<=1.0; X1Bar+=1.0)
-    for(X2Bar=0.0; X2Bar<=1.0; X2Bar+=1.0, ncp++)
-     { 
-       X1Powers[2]=X1Powers[3]=X1Powers[4]=X1Bar;
-       X2Powers[2]=X2Powers[3]=X2Powers[4]=X2Bar;
-
-       for(nm=0, p=0; p<4; p++)
-        for(q=0; q<4; q++, nm++)
-         { 
-           /* the nmth monomial is x1^p x2^q                 */
-           /* its x1 derivative is p x1^{p-1} x2^q ,     etc */
-           /* since xi={0,1}, we have xi^n = xi for all n    */
-           M->SetEntry(NDATA*ncp + 0, nm, X1Powers[p+1]*X2Powers[q+1]);
-           M->SetEntry(NDATA*ncp + 1, nm, p*X1Powers[p]*X2Powers[q+1]);
-           M->SetEntry(NDATA*ncp + 2, nm, q*X1Powers[p+1]*X2Powers[q]);
-           M->SetEntry(NDATA*ncp + 3, nm, p*q*X1Powers[p]*X2Powers[q]);
-         };
-     }; 
-   M->LUFactorize();
-
-   /*--------------------------------------------------------------*/
-   /*- now go through and solve a linear system for each grid      */
-   /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
-   /*--------------------------------------------------------------*/
-   // int nPoints=0, TotalPoints=(N1-1)*(N2-1), pc;
-   int n1, dn1, n2, dn2;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
+   const CoefficientTransform *T=GetCoefficientTransform();
 
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(nThread)
+#endif
+   for(int n1=0; n1<(N1-1); n1++)
+    for(int n2=0; n2<(N2-1); n2++)
      { 
+       double D1=DX1, D2=DX2;
        if (X1Points)
-        { DX1=X1Points[n1+1]-X1Points[n1];
-          DX2=X2Points[n2+1]-X2Points[n2];
+        { D1=X1Points[n1+1]-X1Points[n1];
+          D2=X2Points[n2+1]-X2Points[n2];
         };
 
        /* separately compute interpolation coefficients for each function  */
-       for(nf=0; nf<nFun; nf++)
+       for(int nf=0; nf<nFun; nf++)
         { 
           /* construct the RHS vector by extracting from PhiVDTable the 4 data */
           /* values for each of the 4 corners of this grid cell.               */
-          for(ncp=0, dn1=0; dn1<=1; dn1++)
-           for(dn2=0; dn2<=1; dn2++, ncp++)
-            { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
-              C->SetEntry( NDATA*ncp + 0, P[0]);
-              C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-              C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-              C->SetEntry( NDATA*ncp + 3, DX1*DX2*P[3]);
+          double RHS[NEQUATIONS];
+          for(int ncp=0, dn1=0; dn1<=1; dn1++)
+           for(int dn2=0; dn2<=1; dn2++, ncp++)
+            { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
+              RHS[ NDATA*ncp + 0 ] = P[0];
+              RHS[ NDATA*ncp + 1 ] = D1*P[1];
+              RHS[ NDATA*ncp + 2 ] = D2*P[2];
+              RHS[ NDATA*ncp + 3 ] = D1*D2*P[3];
             };
 
-          /* solve the 16x16 system */
-          M->LUSolve(C);
-
           /* store the coefficients in the appropriate place in CTable */
-          P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
-          memcpy(P, C->DV, NCOEFF*sizeof(double));
+          double *C=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
+          for(int nm=0; nm<NCOEFF; nm++)
+           { double Sum=0.0;
+             for(int nnz=T->RowStart[nm]; nnz<T->RowStart[nm+1]; nnz++)
+              Sum += T->Entries[nnz]*RHS[T->Columns[nnz]];
+             C[nm]=Sum;
+           };
         };
 
      };
@@ -458,8 +496,6 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
-   delete M;
    free(PhiVDTable);
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("...interpolation table constructed!");
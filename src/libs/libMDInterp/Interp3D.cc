@@ -183,6 +183,98 @@ static void *GetPhiVD_Thread(void *data)
   
 }
 
+/****************************************************************/
+/* the matrix whose inverse maps the vector of phi values and   */
+/* derivatives at the 8 corners of a grid cell into the NCOEFF  */
+/* coefficients of the interpolating polynomial in that cell is */
+/* the same for every cell (once the derivatives are scaled by  */
+/* the cell dimensions), so we assemble and invert it once,     */
+/* the first time it is needed, and keep the inverse around.    */
+/*                                                              */
+/* the outer loop (actually three loops) loops over the 8       */
+/* corners of the grid cell; the inner loop (actually three     */
+/* loops) loops over the NCOEFF monomials in the interpolating  */
+/* polynomial.                                                  */
+/*                                                              */
+/* most entries of the inverse vanish, so we store it in       */
+/* compressed-row form: the nonzero entries in row #nm are      */
+/* Entries[RowStart[nm]...RowStart[nm+1]-1], in the columns     */
+/* given by the corresponding entries of Columns[].             */
+/****************************************************************/
+typedef struct CoefficientTransform
+ { int RowStart[NCOEFF+1];
+   int Columns[NCOEFF*NEQUATIONS];
+   double Entries[NCOEFF*NEQUATIONS];
+ } CoefficientTransform;
+
+static CoefficientTransform *CreateCoefficientTransform()
+{
+  double X1Bar, X2Bar, X3Bar;
+  double X1Powers[5], X2Powers[5], X3Powers[5];
+  int nm, ncp, p, q, r;
+  HMatrix *M=new HMatrix(NEQUATIONS, NCOEFF);
+
+  M->Zero();
+
+  /* note: X1Powers[p] = 0        ,  p==0 */
+  /*                   = X1^{p-1} ,  p>0  */
+  X1Powers[0]=0.0; X1Powers[1]=1.0; 
+  X2Powers[0]=0.0; X2Powers[1]=1.0; 
+  X3Powers[0]=0.0; X3Powers[1]=1.0; 
+
+  for(ncp=0, X1Bar=0.0; X1Bar<=1.0; X1Bar+=1.0)
+   for(X2Bar=0.0; X2Bar<=1.0; X2Bar+=1.0)
+    for(X3Bar=0.0; X3Bar<=1.0; X3Bar+=1.0, ncp++)
+     { 
+       X1Powers[2]=X1Powers[3]=X1Powers[4]=X1Bar;
+       X2Powers[2]=X2Powers[3]=X2Powers[4]=X2Bar;
+       X3Powers[2]=X3Powers[3]=X3Powers[4]=X3Bar;
+
+       for(nm=0, p=0; p<4; p++)
+        for(q=0; q<4; q++)
+         for(r=0; r<4; r++, nm++)
+          { 
+            /* the nmth monomial is x1^p x2^q x3^r            */
+            /* its x1 derivative is p x1^{p-1} x2^q x3^r, etc */
+            /* since xi={0,1}, we have xi^n = xi for all n    */
+            M->SetEntry(NDATA*ncp + 0, nm, X1Powers[p+1]*X2Powers[q+1]*X3Powers[r+1]);
+            M->SetEntry(NDATA*ncp + 1, nm, p*X1Powers[p]*X2Powers[q+1]*X3Powers[r+1]);
+            M->SetEntry(NDATA*ncp + 2, nm, q*X1Powers[p+1]*X2Powers[q]*X3Powers[r+1]);
+            M->SetEntry(NDATA*ncp + 3, nm, r*X1Powers[p+1]*X2Powers[q+1]*X3Powers[r]);
+            M->SetEntry(NDATA*ncp + 4, nm, p*q*X1Powers[p]*X2Powers[q]*X3Powers[r+1]);
+            M->SetEntry(NDATA*ncp + 5, nm, p*r*X1Powers[p]*X2Powers[q+1]*X3Powers[r]);
+            M->SetEntry(NDATA*ncp + 6, nm, q*r*X1Powers[p+1]*X2Powers[q]*X3Powers[r]);
+            M->SetEntry(NDATA*ncp + 7, nm, p*q*r*X1Powers[p]*X2Powers[q]*X3Powers[r]);
+          };
+     }; 
+  M->LUFactorize();
+  M->LUInvert();
+
+  CoefficientTransform *T=(CoefficientTransform *)mallocEC(sizeof(*T));
+  int NNZ=0;
+  for(nm=0; nm<NCOEFF; nm++)
+   { T->RowStart[nm]=NNZ;
+     for(int ne=0; ne<NEQUATIONS; ne++)
+      { double Entry=M->GetEntryD(nm, ne);
+        if (Entry==0.0) continue;
+        T->Columns[NNZ]=ne;
+        T->Entries[NNZ]=Entry;
+        NNZ++;
+      };
+   };
+  T->RowStart[NCOEFF]=NNZ;
+
+  delete M;
+  return T;
+}
+
+static const CoefficientTransform *GetCoefficientTransform()
+{
+  static const CoefficientTransform *T=CreateCoefficientTransform();
+  return T;
+}
+
+
 /****************************************************************/
 /* class constructor 1: construct the class from a user-supplied*/
 /* function and nonuniform grid                                 */
@@ -395,113 +487,57 @@ void Interp3D::InitInterp3D(Phi3D PhiFunc, void *UserData)
  
 
    /*--------------------------------------------------------------*/
-   /*- construct the matrix whose inverse maps a vector of        -*/
-   /*- phi values and derivatives into polynomial coefficients.   -*/
-   /*- (since this matrix is a fixed constant entity i could just -*/
-   /*-  assemble and invert it once and hard-code the inverse     -*/
-   /*-  here, but i find it just as easy to do it this way.)      -*/
-   /*-                                                            -*/
-   /*- the outer loop (actually three loops) loops over the 8     -*/
-   /*- corners of the grid cell.                                  -*/
-   /*-                                                            -*/
-   /*- the inner loop (actually three loops) loops over the NCOEFF-*/
-   /*- monomials in the interpolating polynomial.                 -*/
-   /*--------------------------------------------------------------*/
-   double X1Bar, X2Bar, X3Bar;
-   double X1Powers[5], X2Powers[5], X3Powers[5];
-   int nm, ncp, p, q, r;
-   HMatrix *M=new HMatrix(NEQUATIONS, NCOEFF);
-
-   M->Zero();
-
-   /* note: X1Powers[p] = 0        ,  p==0 */
-   /*                   = X1^{p-1} ,  p>0  */
-   X1Powers[0]=0.0; X1Powers[1]=1.0; 
-   X2Powers[0]=0.0; X2Powers[1]=1.0; 
-   X3Powers[0]=0.0; X3Powers[1]=1.0; 
-
-   for(ncp=0, X1Bar=0.0; X1Bar<=1.0; X1Bar+=1.0)
-    for(X2Bar=0.0; X2Bar<=1.0; X2Bar+=1.0)
-     for(X3Bar=0.0; X3Bar<=1.0; X3Bar+=1.0, ncp++)
-      { 
-        X1Powers[2]=X1Powers[3]=X1Powers[4]=X1Bar;
-        X2Powers[2]=X2Powers[3]=X2Powers[4]=X2Bar;
-        X3Powers[2]=X3Powers[3]=X3Powers[4]=X3Bar;
-
-        for(nm=0, p=0; p<4; p++)
-         for(q=0; q<4; q++)
-          for(r=0; r<4; r++, nm++)
-           { 
-             /* the nmth monomial is x1^p x2^q x3^r            */
-             /* its x1 derivative is p x1^{p-1} x2^q x3^r, etc */
-             /* since xi={0,1}, we have xi^n = xi for all n    */
-             M->SetEntry(NDATA*ncp + 0, nm, X1Powers[p+1]*X2Powers[q+1]*X3Powers[r+1]);
-             M->SetEntry(NDATA*ncp + 1, nm, p*X1Powers[p]*X2Powers[q+1]*X3Powers[r+1]);
-             M->SetEntry(NDATA*ncp + 2, nm, q*X1Powers[p+1]*X2Powers[q]*X3Powers[r+1]);
-             M->SetEntry(NDATA*ncp + 3, nm, r*X1Powers[p+1]*X2Powers[q+1]*X3Powers[r]);
-             M->SetEntry(NDATA*ncp + 4, nm, p*q*X1Powers[p]*X2Powers[q]*X3Powers[r+1]);
-             M->SetEntry(NDATA*ncp + 5, nm, p*r*X1Powers[p]*X2Powers[q+1]*X3Powers[r]);
-             M->SetEntry(NDATA*ncp + 6, nm, q*r*X1Powers[p+1]*X2Powers[q]*X3Powers[r]);
-             M->SetEntry(NDATA*ncp + 7, nm, p*q*r*X1Powers[p]*X2Powers[q]*X3Powers[r]);
-           };
-      }; 
-   M->LUFactorize();
-
-   /*--------------------------------------------------------------*/
-   /*- now go through and solve a linear system for each grid      */
-   /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
+   /*- compute the coefficients of the interpolating polynomial in -*/
+   /*- each grid cell by applying the (constant) inverse of the    -*/
+   /*- corner-data matrix to the vector of phi values and          -*/
+   /*- derivatives at the 8 corners of the cell                    -*/
    /*--------------------------------------------------------------*/
-   //   int nPoints=0, TotalPoints=(N1-1)*(N2-1)*(N3-1), pc;
-   int n1, dn1, n2, dn2, n3, dn3;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
+   const CoefficientTransform *T=GetCoefficientTransform();
 
    if (LogLevel >= LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
-     for(n3=0; n3<(N3-1); n3++)
-      { 
-#if 0  
-        for(pc=10; pc<=90; pc++)
-         if ( nPoints++ == pc*TotalPoints/100 )
-          Log("...%i %%...\n",pc);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(nThread)
 #endif
-
+   for(int n1=0; n1<(N1-1); n1++)
+    for(int n2=0; n2<(N2-1); n2++)
+     for(int n3=0; n3<(N3-1); n3++)
+      { 
+        double D1=DX1, D2=DX2, D3=DX3;
         if (X1Points)
-         { DX1=X1Points[n1+1]-X1Points[n1];
-           DX2=X2Points[n2+1]-X2Points[n2];
-           DX3=X3Points[n3+1]-X3Points[n3];
+         { D1=X1Points[n1+1]-X1Points[n1];
+           D2=X2Points[n2+1]-X2Points[n2];
+           D3=X3Points[n3+1]-X3Points[n3];
          };
 
         /* separately compute interpolation coefficients for each function  */
-        for(nf=0; nf<nFun; nf++)
+        for(int nf=0; nf<nFun; nf++)
          { 
-           
            /* construct the RHS vector by extracting from PhiVDTable the 8 data */
            /* values for each of the 8 corners of this grid cell                */
-           for(ncp=0, dn1=0; dn1<=1; dn1++)
-            for(dn2=0; dn2<=1; dn2++)
-             for(dn3=0; dn3<=1; dn3++, ncp++)
-              { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
-                C->SetEntry( NDATA*ncp + 0, P[0]);
-                C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-                C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-                C->SetEntry( NDATA*ncp + 3, DX3*P[3]);
-                C->SetEntry( NDATA*ncp + 4, DX1*DX2*P[4]);
-                C->SetEntry( NDATA*ncp + 5, DX1*DX3*P[5]);
-                C->SetEntry( NDATA*ncp + 6, DX2*DX3*P[6]);
-                C->SetEntry( NDATA*ncp + 7, DX1*DX2*DX3*P[7]);
+           double RHS[NEQUATIONS];
+           for(int ncp=0, dn1=0; dn1<=1; dn1++)
+            for(int dn2=0; dn2<=1; dn2++)
+             for(int dn3=0; dn3<=1; dn3++, ncp++)
+              { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
+                RHS[ NDATA*ncp + 0 ] = P[0];
+                RHS[ NDATA*ncp + 1 ] = D1*P[1];
+                RHS[ NDATA*ncp + 2 ] = D2*P[2];
+                RHS[ NDATA*ncp + 3 ] = D3*P[3];
+                RHS[ NDATA*ncp + 4 ] = D1*D2*P[4];
+                RHS[ NDATA*ncp + 5 ] = D1*D3*P[5];
+                RHS[ NDATA*ncp + 6 ] = D2*D3*P[6];
+                RHS[ NDATA*ncp + 7 ] = D1*D2*D3*P[7];
               };
 
-           /* solve the 64x64 system */
-           M->LUSolve(C);
-
            /* store the coefficients in the appropriate place in CTable */
-           P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
-           memcpy(P,C->DV, NCOEFF*sizeof(double));
+           double *C=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
+           for(int nm=0; nm<NCOEFF; nm++)
+            { double Sum=0.0;
+              for(int nnz=T->RowStart[nm]; nnz<T->RowStart[nm+1]; nnz++)
+               Sum += T->Entries[nnz]*RHS[T->Columns[nnz]];
+              C[nm]=Sum;
+            };
          };
 
       };
@@ -509,8 +545,6 @@ void Interp3D::InitInterp3D(Phi3D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
-   delete M;
    free(PhiVDTable);
    if (LogLevel >= LMDI_LOGLEVEL_TERSE)
     Log("...interpolation table constructed!");
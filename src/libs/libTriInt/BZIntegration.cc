@@ -33,6 +33,10 @@
 #include "libTriInt.h"
 #include "BZIntegration.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #define MAXBZDIM 3
 #define MAXSTR 1000
 
@@ -86,27 +90,85 @@ void GetOctantImage(double kBloch[2], int n, double Image[2])
   Image[1] = ySign * (Swap ? kBloch[0] : kBloch[1]);
 }
 
+/***************************************************************/
+/* evaluate the user's integrand at a batch of Bloch vectors.  */
+/* if the caller supplied a batched integrand we hand it the   */
+/* whole batch; otherwise we call the single-point integrand   */
+/* once per point, distributing the points over threads if the */
+/* caller has told us this is safe.                            */
+/***************************************************************/
+void EvaluateBZIntegrand(GetBZIArgStruct *Args, cdouble Omega,
+                         int NumPoints, double *kBlochs,
+                         double *BZIntegrands)
+{
+  if (NumPoints==0) return;
+
+  int FDim = Args->FDim;
+  if (Args->BZIFunc_v)
+   Args->BZIFunc_v(Args->UserData, Omega, NumPoints, kBlochs, BZIntegrands);
+  else
+   { BZIFunction BZIFunc = Args->BZIFunc;
+     void *UserData      = Args->UserData;
+     bool Parallel       = Args->Reentrant && NumPoints>1;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) if(Parallel)
+#endif
+     for(int np=0; np<NumPoints; np++)
+      BZIFunc(UserData, Omega, kBlochs + 3*np, BZIntegrands + FDim*np);
+     (void) Parallel;
+   };
+
+  Args->NumCalls+=NumPoints;
+}
+
+/***************************************************************/
+/* sum of the integrand over the images of kBloch in the       */
+/* octants not accounted for by the symmetry factor            */
+/***************************************************************/
+void GetOctantSum(GetBZIArgStruct *Args, cdouble Omega,
+                  double kBloch[2], double *BZIntegrand)
+{
+  int FDim       = Args->FDim;
+  int NumOctants = 8/Args->SymmetryFactor;
+
+  double kBlochs[3*8];
+  memset(kBlochs, 0, 3*NumOctants*sizeof(double));
+  for(int n=0; n<NumOctants; n++)
+   GetOctantImage(kBloch, n, kBlochs + 3*n);
+
+  double *DeltaBZI = (double *)mallocEC(NumOctants*FDim*sizeof(double));
+  EvaluateBZIntegrand(Args, Omega, NumOctants, kBlochs, DeltaBZI);
+
+  memset(BZIntegrand, 0, FDim*sizeof(double));
+  for(int n=0; n<NumOctants; n++)
+   VecPlusEquals(BZIntegrand, 1.0, DeltaBZI + n*FDim, FDim);
+  free(DeltaBZI);
+}
+
 /***************************************************************/
 /* BZ integrand function passed to clenshaw-curtis cubature    */
-/* routines                                                    */
+/* routines. the cubature routines hand us a whole batch of    */
+/* points at once (for adaptive cubature, one full refinement  */
+/* generation) which we pass on to the user's integrand as a   */
+/* single batch.                                               */
 /***************************************************************/
-int BZIntegrand_CCCubature(unsigned ndim, const double *u,
+int BZIntegrand_CCCubature(unsigned ndim, size_t npt, const double *u,
                            void *pArgs, unsigned fdim,
-                           double *BZIntegrand)
+                           double *BZIntegrands)
 {
-  (void) ndim; // unused
-
   /*--------------------------------------------------------------*/
   /*- unpack fields from user data structure ---------------------*/
   /*--------------------------------------------------------------*/
   GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
   cdouble Omega          = Args->Omega;
-  BZIFunction BZIFunc    = Args->BZIFunc;
-  void *UserData         = Args->UserData;
   HMatrix *RLBasis       = Args->RLBasis;
   int SymmetryFactor     = Args->SymmetryFactor;
   int LDim               = RLBasis->NC;
 
+  double *Weights = (double *)mallocEC(npt*sizeof(double));
+  double *kBlochs = (double *)mallocEC(3*npt*sizeof(double));
+  int *Slot       = (int *)mallocEC(npt*sizeof(int));
+
   /*--------------------------------------------------------------*/
   /*- special handling for SymmetryFactor = 8:                    */
   /*-  (a) if we are doing fixed-order CC cubature, omit          */
@@ -115,42 +177,62 @@ int BZIntegrand_CCCubature(unsigned ndim, const double *u,
   /*-  (b) if we are doing adaptive cubature, use a Duffy         */
   /*-      transform to map the square integration domain into a  */
   /*-      triangle                                               */
+  /*- then convert (ux, uy) variable to kBloch. points that are   */
+  /*- omitted get Slot=-1; the others are packed into kBlochs.    */
   /*--------------------------------------------------------------*/
-  double Weight=1.0;
-  double uVector[3];
-  memcpy(uVector, u, LDim*sizeof(double));
-  if (SymmetryFactor==8)
-   { if (Args->Order==0)
-      { uVector[1]*=uVector[0];
-        Weight*=uVector[0];
-      }
-     else 
-      { if ( EqualFloat(u[0],u[1]) ) 
-         Weight*=0.5;
-        else if (u[1]<u[0])
-         Weight*=1.0;
-        else // ky>kx
-         { memset(BZIntegrand, 0, fdim*sizeof(double));
-           return 0;
+  int NumPoints=0;
+  for(size_t np=0; np<npt; np++)
+   { 
+     const double *uPoint = u + np*ndim;
+     double Weight=1.0;
+     double uVector[3];
+     memcpy(uVector, uPoint, LDim*sizeof(double));
+     if (SymmetryFactor==8)
+      { if (Args->Order==0)
+         { uVector[1]*=uVector[0];
+           Weight*=uVector[0];
+         }
+        else 
+         { if ( EqualFloat(uPoint[0],uPoint[1]) ) 
+            Weight*=0.5;
+           else if (uPoint[1]>uPoint[0])  // ky>kx
+            Weight=0.0;
          };
       };
-   };
 
-  /*--------------------------------------------------------------*/
-  /*- convert (ux, uy) variable to kBloch ------------------------*/
-  /*--------------------------------------------------------------*/
-  double kBloch[3]={0.0, 0.0, 0.0};
-  for(int nd=0; nd<LDim; nd++)
-   for(int nc=0; nc<3; nc++)
-    kBloch[nc] += uVector[nd]*RLBasis->GetEntryD(nc,nd);
+     if (Weight==0.0)
+      { Slot[np]=-1;
+        continue;
+      };
+
+     double *kBloch=kBlochs + 3*NumPoints;
+     kBloch[0]=kBloch[1]=kBloch[2]=0.0;
+     for(int nd=0; nd<LDim; nd++)
+      for(int nc=0; nc<3; nc++)
+       kBloch[nc] += uVector[nd]*RLBasis->GetEntryD(nc,nd);
+     Weights[NumPoints]=Weight;
+     Slot[np]=NumPoints++;
+   };
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  BZIFunc(UserData, Omega, kBloch, BZIntegrand);
-  VecScale(BZIntegrand, Weight, fdim);
-  
-  Args->NumCalls++;
+  double *Values = (double *)mallocEC(fdim*(NumPoints+1)*sizeof(double));
+  EvaluateBZIntegrand(Args, Omega, NumPoints, kBlochs, Values);
+
+  for(size_t np=0; np<npt; np++)
+   { double *BZIntegrand = BZIntegrands + np*fdim;
+     int ns=Slot[np];
+     if (ns==-1)
+      memset(BZIntegrand, 0, fdim*sizeof(double));
+     else
+      VecScale(Values + ns*fdim, Weights[ns], BZIntegrand, fdim);
+   };
+
+  free(Values);
+  free(Slot);
+  free(kBlochs);
+  free(Weights);
 
   return 0;
 }
@@ -192,9 +274,9 @@ void GetBZIntegral_CC(GetBZIArgStruct *Args,
              Upper[0]=0.5; Upper[1]=(Order==0) ? 1.0 : 0.5;
              break;
    };
-  CCCubature(Order, FDim, BZIntegrand_CCCubature, (void *)Args, LDim,
-	     Lower, Upper, MaxEvals, AbsTol, RelTol,
-	     ERROR_INDIVIDUAL, BZIntegral, DataBuffer[0]);
+  CCCubature_v(Order, FDim, BZIntegrand_CCCubature, (void *)Args, LDim,
+	       Lower, Upper, MaxEvals, AbsTol, RelTol,
+	       ERROR_INDIVIDUAL, BZIntegral, DataBuffer[0]);
   VecScale(BZIntegral, SymmetryFactor, FDim);
  
 }
@@ -209,13 +291,8 @@ void BZIntegrand_TC(double *u, void *pArgs, double *BZIntegrand)
   /*--------------------------------------------------------------*/
   GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
   cdouble Omega          = Args->Omega;
-  BZIFunction BZIFunc    = Args->BZIFunc;
-  void *UserData         = Args->UserData;
-  int FDim               = Args->FDim;
-  int SymmetryFactor     = Args->SymmetryFactor;
   HMatrix *RLBasis       = Args->RLBasis;
   int LDim               = RLBasis->NC;
-  double **DataBuffer    = Args->DataBuffer;
 
   if (LDim!=2)
    ErrExit("Triangle-cubature BZ integrators require 2D lattices");
@@ -231,18 +308,7 @@ void BZIntegrand_TC(double *u, void *pArgs, double *BZIntegrand)
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  int NumOctants = 8/SymmetryFactor;
-  memset(BZIntegrand, 0, FDim*sizeof(double));
-  for(int n=0; n<NumOctants; n++)
-   { 
-     double RkB[3]={0.0, 0.0, 0.0};
-     GetOctantImage(kBloch, n, RkB);
-     double *DeltaBZI=DataBuffer[0];
-     BZIFunc(UserData, Omega, RkB, DeltaBZI);
-     VecPlusEquals(BZIntegrand, 1.0, DeltaBZI, FDim);
-     Args->NumCalls++;
-   };
-
+  GetOctantSum(Args, Omega, kBloch, BZIntegrand);
 }
 
 /***************************************************************/
@@ -305,14 +371,9 @@ int BZIntegrand_Angular(unsigned ndim, const double *u, void *pArgs,
 
   GetBZIArgStruct *Args=(GetBZIArgStruct *)pArgs;
 
-  BZIFunction BZIFunc = Args->BZIFunc;
-  void *UserData      = Args->UserData;
-  int FDim            = Args->FDim;
   double kRhoHat      = Args->kRhoHat;
   HMatrix *RLBasis    = Args->RLBasis;
-  int SymmetryFactor  = Args->SymmetryFactor;
   cdouble Omega       = Args->Omega;
-  double *DeltaBZI    = Args->DataBuffer[2];
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -322,16 +383,7 @@ int BZIntegrand_Angular(unsigned ndim, const double *u, void *pArgs,
   double kBloch[2];
   kBloch[0]=kRhoHat*Gamma*cos(kTheta);
   kBloch[1]=kRhoHat*Gamma*sin(kTheta);
-  int NumOctants = 8/SymmetryFactor;
-  memset(BZIntegrand, 0, FDim*sizeof(double));
-  for(int n=0; n<NumOctants; n++)
-   { 
-     double RkB[3]={0.0, 0.0, 0.0};
-     GetOctantImage(kBloch, n, RkB);
-     BZIFunc(UserData, Omega, RkB, DeltaBZI);
-     VecPlusEquals(BZIntegrand, 1.0, DeltaBZI, FDim);
-     Args->NumCalls++;
-   };  
+  GetOctantSum(Args, Omega, kBloch, BZIntegrand);
   return 0;
 
 }
@@ -400,8 +452,6 @@ int BZIntegrand_Radial(unsigned ndim, const double *u, void *pArgs,
    }
   else if ( (AngularOrder%2)==0 )
    { 
-     BZIFunction BZIFunc = Args->BZIFunc;
-     void *UserData      = Args->UserData;
      double Gamma        = Args->RLBasis->GetEntryD(0,0);
      double kBloch[3]={0.0, 0.0, 0.0};
      switch(AngularOrder)
@@ -410,9 +460,8 @@ int BZIntegrand_Radial(unsigned ndim, const double *u, void *pArgs,
         case 6: 
         default: kBloch[0] = kBloch[1] = kRhoHat*Gamma/(M_SQRT2); break;
       };
-     BZIFunc(UserData, Omega, kBloch, BZIntegrand);
+     EvaluateBZIntegrand(Args, Omega, 1, kBloch, BZIntegrand);
      VecScale(BZIntegrand, 2.0*M_PI, FDim);
-     Args->NumCalls++;
    }
   else
    { memset(BZIntegrand, 0, FDim*sizeof(double));
@@ -677,6 +726,8 @@ GetBZIArgStruct *InitBZIArgs(int argc, char **argv)
   GetBZIArgStruct *BZIArgs = (GetBZIArgStruct *)mallocEC(sizeof(*BZIArgs));
 
   BZIArgs->BZIFunc=0;
+  BZIArgs->BZIFunc_v=0;
+  BZIArgs->Reentrant=false;
   BZIArgs->UserData=0;
   BZIArgs->FDim=0;
   BZIArgs->RLBasis=0;
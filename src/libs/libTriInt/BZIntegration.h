@@ -48,6 +48,13 @@ typedef void (*BZIFunction)(void *UserData,
                             cdouble Omega, double *kBloch,
                             double *BZIntegrand);
 
+// batched version: kBlochs[3*np + nc] is the ncth cartesian component
+// of the npth Bloch vector, and the integrand vector for that point
+// goes in BZIntegrands[FDim*np + ...]
+typedef void (*BZIFunction_v)(void *UserData, cdouble Omega,
+                              int NumPoints, double *kBlochs,
+                              double *BZIntegrands);
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -55,6 +62,8 @@ typedef struct GetBZIArgStruct
 {
   // information on the Brillouin-zone integrand function
   BZIFunction BZIFunc;
+  BZIFunction_v BZIFunc_v; // if nonzero, used instead of BZIFunc
+  bool Reentrant;          // true if BZIFunc may be called concurrently
   void *UserData;
   int FDim;            // number of doubles in the integrand vector
   int SymmetryFactor;  // either 1, 2, 4, or 8
@@ -93,6 +93,89 @@ int CCCubature(int Order, unsigned fdim, integrand f, void *fdata,
   return nCalls;
 }
 
+/***************************************************************/
+/* vectorized version of CCCubature: each call to f receives   */
+/* a whole batch of cubature points (all points of a fixed-    */
+/* order rule, or one refinement generation of the adaptive    */
+/* rule), so that the integrand routine is free to evaluate    */
+/* them concurrently.                                          */
+/***************************************************************/
+typedef struct VToScalarData
+ { integrand_v f;
+   void *fdata;
+ } VToScalarData;
+
+static int VToScalar(unsigned ndim, const double *x, void *fdata,
+                     unsigned fdim, double *fval)
+{ VToScalarData *Data = (VToScalarData *)fdata;
+  return Data->f(ndim, 1, x, Data->fdata, fdim, fval);
+}
+
+int CCCubature_v(int Order, unsigned fdim, integrand_v f, void *fdata,
+	         unsigned dim, const double *xmin, const double *xmax, 
+	         size_t maxEval, double reqAbsError, double reqRelError,
+                 error_norm norm, double *Integral, double *Error)
+{
+  if (Order==0)
+   return pcubature_v(fdim, f, fdata, dim, xmin, xmax, maxEval,
+                      reqAbsError, reqRelError, norm, Integral, Error);
+ 
+  if (Order<0)
+   { VToScalarData Data={f, fdata};
+     return RRCubature(-Order, 0, fdim, VToScalar, (void *)&Data,
+                       dim, xmin, xmax, Integral, Error);
+   };
+
+  double *CCQR = GetCCRule(Order);
+  if (!CCQR) 
+   ErrExit("invalid CCRule order (%i) in CCCubature_v",Order);
+
+  if (dim>MAXDIM) 
+   ErrExit("dimension too high in CCCubature_v");
+
+  double uAvg[MAXDIM], uDelta[MAXDIM];
+  for(unsigned d=0; d<dim; d++)
+   { uAvg[d]   = 0.5*(xmax[d] + xmin[d]);
+     uDelta[d] = 0.5*(xmax[d] - xmin[d]);
+   };
+
+  int NumPoints=1;
+  for(unsigned d=0; d<dim; d++)
+   NumPoints*=Order;
+
+  double *u         = (double *)mallocEC(dim*NumPoints*sizeof(double));
+  double *w         = (double *)mallocEC(NumPoints*sizeof(double));
+  double *Integrand = (double *)mallocEC(fdim*NumPoints*sizeof(double));
+
+  int ncp[MAXDIM];
+  memset(ncp, 0, dim*sizeof(int));
+  for(int np=0; np<NumPoints; np++)
+   { 
+     w[np]=1.0;
+     for(unsigned nd=0; nd<dim; nd++)
+      { u[np*dim + nd]  = uAvg[nd] - uDelta[nd]*CCQR[2*ncp[nd] + 0];
+        w[np]          *=            uDelta[nd]*CCQR[2*ncp[nd] + 1];
+      }; 
+
+     for(unsigned nd=0; nd<dim; nd++)
+      { ncp[nd] = (ncp[nd]+1)%Order;
+        if(ncp[nd]) break;
+      };
+   };
+
+  f(dim, NumPoints, u, fdata, fdim, Integrand);
+
+  memset(Integral, 0, fdim*sizeof(double));
+  for(int np=0; np<NumPoints; np++)
+   VecPlusEquals(Integral, w[np], Integrand + np*fdim, fdim);
+
+  free(u);
+  free(w);
+  free(Integrand);
+
+  return NumPoints;
+}
+
 
 /***************************************************************/
 /* embedded clenshaw-curtis cubature in two dimensions.        */
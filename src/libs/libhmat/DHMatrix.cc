@@ -0,0 +1,320 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * DHMatrix.cc   -- distributed-memory complex matrices in ScaLAPACK's
+ *               -- two-dimensional block-cyclic layout, with LAPACK
+ *               -- fallbacks for builds without ScaLAPACK
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+extern "C" {
+ #include "lapack.h"
+}
+
+#include "libhmat.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifdef HAVE_SCALAPACK
+#include <mpi.h>
+
+/***************************************************************/
+/* prototypes for the BLACS and ScaLAPACK routines we use      */
+/***************************************************************/
+extern "C" {
+ void Cblacs_pinfo(int *mypnum, int *nprocs);
+ void Cblacs_get(int icontxt, int what, int *val);
+ void Cblacs_gridinit(int *icontxt, const char *order, int nprow, int npcol);
+ void Cblacs_gridinfo(int icontxt, int *nprow, int *npcol, int *myrow, int *mycol);
+ void Cblacs_gridexit(int icontxt);
+ void descinit_(int *desc, int *m, int *n, int *mb, int *nb,
+                int *irsrc, int *icsrc, int *ictxt, int *lld, int *info);
+ void pzgetrf_(int *m, int *n, cdouble *a, int *ia, int *ja, int *desca,
+               int *ipiv, int *info);
+ void pzgetrs_(const char *trans, int *n, int *nrhs,
+               cdouble *a, int *ia, int *ja, int *desca, int *ipiv,
+               cdouble *b, int *ib, int *jb, int *descb, int *info);
+}
+#endif
+
+/***************************************************************/
+/* DHMatrixFinalize() shuts MPI down only if DHMatrixInit()    */
+/* was the one that started it; a caller that initialized MPI  */
+/* itself remains responsible for finalizing it.               */
+/***************************************************************/
+#ifdef HAVE_SCALAPACK
+static bool DHMatrixStartedMPI=false;
+#endif
+
+void DHMatrixInit(int *argc, char ***argv)
+{
+#ifdef HAVE_SCALAPACK
+  int Initialized;
+  MPI_Initialized(&Initialized);
+  if (!Initialized)
+   { MPI_Init(argc, argv);
+     DHMatrixStartedMPI=true;
+   };
+#else
+  (void) argc;
+  (void) argv;
+#endif
+}
+
+void DHMatrixFinalize()
+{
+#ifdef HAVE_SCALAPACK
+  if (!DHMatrixStartedMPI) return;
+  int Finalized;
+  MPI_Finalized(&Finalized);
+  if (!Finalized)
+   MPI_Finalize();
+  DHMatrixStartedMPI=false;
+#endif
+}
+
+/***************************************************************/
+/* number of rows (or columns) of an N-row (or N-column)       */
+/* matrix stored on the process in row (or column) #MyProc of  */
+/* a process grid with NumProcs rows (or columns); this is     */
+/* ScaLAPACK's NUMROC with source process 0.                   */
+/***************************************************************/
+static int NumLocal(int N, int BlockSize, int MyProc, int NumProcs)
+{
+  int NumBlocks = N / BlockSize;
+  int NLocal    = (NumBlocks / NumProcs) * BlockSize;
+  int Extra     = NumBlocks % NumProcs;
+  if (MyProc < Extra)
+   NLocal += BlockSize;
+  else if (MyProc == Extra)
+   NLocal += N % BlockSize;
+  return NLocal;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+DHMatrix::DHMatrix(int pNR, int pNC, int pBlockSize)
+{
+  NR=pNR;
+  NC=pNC;
+  BlockSize=pBlockSize;
+  Factorized=false;
+  Context=-1;
+  memset(Desc, 0, 9*sizeof(int));
+
+#ifdef HAVE_SCALAPACK
+  /*--------------------------------------------------------------*/
+  /*- set up the most nearly square process grid -----------------*/
+  /*--------------------------------------------------------------*/
+  Cblacs_pinfo(&Rank, &NumProcs);
+  NPRow=(int)floor(sqrt((double)NumProcs));
+  while( NumProcs%NPRow ) NPRow--;
+  NPCol=NumProcs/NPRow;
+  Cblacs_get(-1, 0, &Context);
+  Cblacs_gridinit(&Context, "Row", NPRow, NPCol);
+  Cblacs_gridinfo(Context, &NPRow, &NPCol, &MyRow, &MyCol);
+#else
+  NumProcs=1;
+  Rank=0;
+  NPRow=NPCol=1;
+  MyRow=MyCol=0;
+#endif
+
+  LocalNR = NumLocal(NR, BlockSize, MyRow, NPRow);
+  LocalNC = NumLocal(NC, BlockSize, MyCol, NPCol);
+
+#ifdef HAVE_SCALAPACK
+  int Zero=0, Info, LLD = LocalNR > 1 ? LocalNR : 1;
+  descinit_(Desc, &NR, &NC, &BlockSize, &BlockSize, &Zero, &Zero,
+            &Context, &LLD, &Info);
+  if (Info!=0)
+   ErrExit("%s:%i: descinit failed (info=%i)",__FILE__,__LINE__,Info);
+#endif
+
+  size_t LocalSize = ((size_t)LocalNR) * ((size_t)LocalNC);
+  ZM = (cdouble *)mallocEC( (LocalSize > 0 ? LocalSize : 1)*sizeof(cdouble) );
+  ipiv = (int *)mallocEC( (LocalNR + BlockSize)*sizeof(int) );
+
+  if (NumProcs>1)
+   Log("Distributed %ix%i matrix over %ix%i process grid (%ix%i local)",
+        NR,NC,NPRow,NPCol,LocalNR,LocalNC);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+DHMatrix::~DHMatrix()
+{
+  free(ZM);
+  free(ipiv);
+#ifdef HAVE_SCALAPACK
+  Cblacs_gridexit(Context);
+#endif
+}
+
+/***************************************************************/
+/* global <--> local index conversions for block-cyclic layout */
+/***************************************************************/
+int DHMatrix::GlobalRow(int nrLocal)
+{ return ( (nrLocal/BlockSize)*NPRow + MyRow )*BlockSize + nrLocal%BlockSize; }
+
+int DHMatrix::GlobalCol(int ncLocal)
+{ return ( (ncLocal/BlockSize)*NPCol + MyCol )*BlockSize + ncLocal%BlockSize; }
+
+int DHMatrix::LocalRow(int nr)
+{ return (nr/(BlockSize*NPRow))*BlockSize + nr%BlockSize; }
+
+int DHMatrix::LocalCol(int nc)
+{ return (nc/(BlockSize*NPCol))*BlockSize + nc%BlockSize; }
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+cdouble DHMatrix::GetEntry(int nr, int nc)
+{ return ZM[ LocalRow(nr) + ((size_t)LocalNR)*LocalCol(nc) ]; }
+
+void DHMatrix::SetEntry(int nr, int nc, cdouble Entry)
+{ ZM[ LocalRow(nr) + ((size_t)LocalNR)*LocalCol(nc) ] = Entry; }
+
+void DHMatrix::AddEntry(int nr, int nc, cdouble Entry)
+{ ZM[ LocalRow(nr) + ((size_t)LocalNR)*LocalCol(nc) ] += Entry; }
+
+void DHMatrix::Zero()
+{
+  size_t LocalSize = ((size_t)LocalNR) * ((size_t)LocalNC);
+  for(size_t n=0; n<LocalSize; n++)
+   ZM[n]=0.0;
+  Factorized=false;
+}
+
+/***************************************************************/
+/* Y = this*X; each rank computes the contributions of its own */
+/* tiles and the partial results are summed over all ranks.    */
+/***************************************************************/
+void DHMatrix::Apply(HVector *X, HVector *Y)
+{
+  if ( X->N!=NC || Y->N!=NR )
+   ErrExit("%s:%i: dimension mismatch in DHMatrix::Apply",__FILE__,__LINE__);
+  if ( X->RealComplex!=LHM_COMPLEX || Y->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: DHMatrix::Apply requires complex vectors",__FILE__,__LINE__);
+  if (Factorized)
+   ErrExit("%s:%i: DHMatrix::Apply called on LU-factorized matrix",__FILE__,__LINE__);
+
+  Y->Zero();
+  for(int ncl=0; ncl<LocalNC; ncl++)
+   { cdouble XX = X->ZV[GlobalCol(ncl)];
+     cdouble *Column = ZM + ((size_t)LocalNR)*ncl;
+     for(int nrl=0; nrl<LocalNR; nrl++)
+      Y->ZV[GlobalRow(nrl)] += Column[nrl]*XX;
+   };
+
+#ifdef HAVE_SCALAPACK
+  MPI_Allreduce(MPI_IN_PLACE, (void *)Y->ZV, 2*NR, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int DHMatrix::LUFactorize()
+{
+  int Info;
+#ifdef HAVE_SCALAPACK
+  int One=1;
+  pzgetrf_(&NR, &NC, ZM, &One, &One, Desc, ipiv, &Info);
+#else
+  zgetrf_(&NR, &NC, ZM, &NR, ipiv, &Info);
+#endif
+  Factorized=true;
+  return Info;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int DHMatrix::LUSolve(HVector *X)
+{
+  if ( NR!=NC || X->N!=NR )
+   ErrExit("%s:%i: dimension mismatch in DHMatrix::LUSolve",__FILE__,__LINE__);
+  if ( X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: DHMatrix::LUSolve requires a complex vector",__FILE__,__LINE__);
+  if (!Factorized)
+   ErrExit("LUFactorize() must be called before LUSolve()");
+
+  int Info, One=1;
+#ifdef HAVE_SCALAPACK
+  /*--------------------------------------------------------------*/
+  /*- the RHS is an NRx1 distributed matrix, which lives entirely */
+  /*- on the first column of the process grid                     */
+  /*--------------------------------------------------------------*/
+  int Zero=0, DescB[9], LLD = LocalNR > 1 ? LocalNR : 1;
+  descinit_(DescB, &NR, &One, &BlockSize, &BlockSize, &Zero, &Zero,
+            &Context, &LLD, &Info);
+  cdouble *B = (cdouble *)mallocEC(LLD*sizeof(cdouble));
+  if (MyCol==0)
+   for(int nrl=0; nrl<LocalNR; nrl++)
+    B[nrl] = X->ZV[GlobalRow(nrl)];
+
+  pzgetrs_("N", &NR, &One, ZM, &One, &One, Desc, ipiv,
+           B, &One, &One, DescB, &Info);
+
+  X->Zero();
+  if (MyCol==0)
+   for(int nrl=0; nrl<LocalNR; nrl++)
+    X->ZV[GlobalRow(nrl)] = B[nrl];
+  MPI_Allreduce(MPI_IN_PLACE, (void *)X->ZV, 2*NR, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  free(B);
+#else
+  zgetrs_("N", &NR, &One, ZM, &NR, ipiv, X->ZV, &NR, &Info);
+#endif
+
+  return Info;
+}
+
+/***************************************************************/
+/* log |det M| = sum log |U_{nn}| where U is the upper-        */
+/* triangular LU factor; each rank sums over the diagonal      */
+/* entries it owns.                                            */
+/***************************************************************/
+double DHMatrix::GetLogAbsDeterminant()
+{
+  if (!Factorized)
+   ErrExit("LUFactorize() must be called before GetLogAbsDeterminant()");
+
+  double LogDet=0.0;
+  int NMin = (NR < NC) ? NR : NC;
+  for(int n=0; n<NMin; n++)
+   if ( IsLocal(n,n) )
+    LogDet += log( abs(GetEntry(n,n)) );
+
+#ifdef HAVE_SCALAPACK
+  MPI_Allreduce(MPI_IN_PLACE, (void *)&LogDet, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+  return LogDet;
+}
@@ -42,8 +42,9 @@ extern "C" {
 /*--------------------------------------------------------------*/
 /*--------------------------------------------------------------*/
 
-// initialization of static class flag
+// initialization of static class flags
 bool HMatrix::AbortOnIOError=true;
+bool HMatrix::MixedPrecisionLU=false;
 
 /***************************************************************/
 /* HMatrix constructors that create an empty (zero) HMatrix    */
@@ -73,6 +74,10 @@ void HMatrix::InitHMatrix(int NRows, int NCols, int pRealComplex,
    RealComplex=pRealComplex;
    StorageType=pStorageType;
    ipiv=0;
+   LPFactor=0;
+   LPLock=0;
+   LPReaders=0;
+   LPPromoting=false;
    lwork=0;
    work=0;
    liwork=0;
@@ -156,6 +161,10 @@ void HMatrix::ReadFromFile(const char *FileName, int FileType, const char *Optio
   DM=0;
   ZM=0;
   ipiv=0;
+  LPFactor=0;
+  LPLock=0;
+  LPReaders=0;
+  LPPromoting=false;
   lwork=0;
   work=0;
   liwork=0;
@@ -202,6 +211,10 @@ HMatrix::HMatrix(SMatrix *S)
    RealComplex=S->RealComplex;
    StorageType=LHM_NORMAL;
    ipiv=0;
+   LPFactor=0;
+   LPLock=0;
+   LPReaders=0;
+   LPPromoting=false;
    lwork=0;
    work=0;
    liwork=0;
@@ -251,6 +264,7 @@ HMatrix::~HMatrix()
     if (ZM) free(ZM);
   }
   if (ipiv) free(ipiv);
+  ClearLPFactor();
   if (ErrMsg) free(ErrMsg);
   if (work) free(work);
 }
@@ -0,0 +1,323 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * IterativeSolvers.cc -- krylov-subspace solvers for linear systems
+ *                     -- whose matrix is only accessible through its
+ *                     -- action on vectors
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#include "libhmat.h"
+
+/***************************************************************/
+/* euclidean norm of a complex vector                          */
+/***************************************************************/
+static double VecNorm(HVector *V)
+{ return sqrt( real(V->Dot(V)) ); }
+
+/***************************************************************/
+/* Y = PInv*X, or Y=X if there is no preconditioner            */
+/***************************************************************/
+static void ApplyPreconditioner(MatVecFunc PInv, void *PInvData,
+                                HVector *X, HVector *Y)
+{
+  if (PInv)
+   PInv(X, Y, PInvData);
+  else
+   Y->Copy(X);
+}
+
+/***************************************************************/
+/* Solve A*X=B by restarted GMRES with right preconditioning.  */
+/*                                                             */
+/* A is a user-supplied routine that computes Y=A*X; PInv, if  */
+/* non-null, is a user-supplied routine that computes the      */
+/* action of the inverse of a preconditioner on a vector.      */
+/*                                                             */
+/* On entry, X contains the initial guess (which may be zero). */
+/* On return, X contains the solution.                         */
+/*                                                             */
+/* The return value is the number of iterations needed to      */
+/* reduce the relative residual below Tol, or -1 if this did   */
+/* not happen within MaxIters iterations. If pResidual is      */
+/* non-null, the final relative residual is returned in it.    */
+/***************************************************************/
+int GMRES(MatVecFunc A, void *AData, HVector *B, HVector *X,
+          MatVecFunc PInv, void *PInvData,
+          double Tol, int MaxIters, int Restart, double *pResidual)
+{
+  if ( B->RealComplex!=LHM_COMPLEX || X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: GMRES implemented only for complex vectors",__FILE__,__LINE__);
+  if ( B->N != X->N )
+   ErrExit("%s:%i: dimension mismatch in GMRES",__FILE__,__LINE__);
+
+  int N=B->N;
+  if (Restart>N) Restart=N;
+  if (Restart<1) Restart=1;
+
+  /*--------------------------------------------------------------*/
+  /*- allocate krylov basis, hessenberg matrix, givens rotations  */
+  /*--------------------------------------------------------------*/
+  HVector **V = (HVector **)mallocEC( (Restart+1)*sizeof(HVector *));
+  for(int n=0; n<=Restart; n++)
+   V[n] = new HVector(N, LHM_COMPLEX);
+  HVector *W  = new HVector(N, LHM_COMPLEX);
+  HVector *Z  = new HVector(N, LHM_COMPLEX);
+  HVector *R  = new HVector(N, LHM_COMPLEX);
+
+  cdouble *H  = (cdouble *)mallocEC( (Restart+1)*Restart*sizeof(cdouble));
+  cdouble *CS = (cdouble *)mallocEC( Restart*sizeof(cdouble));
+  cdouble *SN = (cdouble *)mallocEC( Restart*sizeof(cdouble));
+  cdouble *G  = (cdouble *)mallocEC( (Restart+1)*sizeof(cdouble));
+  cdouble *Y  = (cdouble *)mallocEC( Restart*sizeof(cdouble));
+#define HH(i,j) H[ (i) + (j)*(Restart+1) ]
+
+  double BNorm = VecNorm(B);
+  if (BNorm==0.0) BNorm=1.0;
+
+  double Residual=1.0;
+  int Iter=0;
+  bool Converged=false;
+  while( !Converged && Iter<MaxIters )
+   {
+     /*--------------------------------------------------------------*/
+     /*- R = B - A*X ------------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     A(X, R, AData);
+     for(int n=0; n<N; n++)
+      R->ZV[n] = B->ZV[n] - R->ZV[n];
+     double Beta=VecNorm(R);
+     Residual = Beta / BNorm;
+     if (Residual < Tol)
+      { Converged=true;
+        break;
+      };
+
+     V[0]->Copy(R);
+     V[0]->Scale(1.0/Beta);
+     memset(G, 0, (Restart+1)*sizeof(cdouble));
+     G[0]=Beta;
+
+     /*--------------------------------------------------------------*/
+     /*- arnoldi iteration ------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     int j;
+     for(j=0; j<Restart && Iter<MaxIters; j++, Iter++)
+      {
+        ApplyPreconditioner(PInv, PInvData, V[j], Z);
+        A(Z, W, AData);
+
+        // modified gram-schmidt
+        for(int i=0; i<=j; i++)
+         { HH(i,j) = V[i]->Dot(W);
+           for(int n=0; n<N; n++)
+            W->ZV[n] -= HH(i,j)*V[i]->ZV[n];
+         };
+        HH(j+1,j) = VecNorm(W);
+        if ( abs(HH(j+1,j)) != 0.0 )
+         { V[j+1]->Copy(W);
+           V[j+1]->Scale(1.0/HH(j+1,j));
+         };
+
+        // apply previous givens rotations to new column
+        for(int i=0; i<j; i++)
+         { cdouble Temp = conj(CS[i])*HH(i,j) + conj(SN[i])*HH(i+1,j);
+           HH(i+1,j)    = -SN[i]*HH(i,j) + CS[i]*HH(i+1,j);
+           HH(i,j)      = Temp;
+         };
+
+        // compute and apply new givens rotation
+        double Denom = sqrt( norm(HH(j,j)) + norm(HH(j+1,j)) );
+        if (Denom==0.0)
+         { CS[j]=1.0; SN[j]=0.0; }
+        else
+         { CS[j] = HH(j,j) / Denom;
+           SN[j] = HH(j+1,j) / Denom;
+         };
+        HH(j,j)   = conj(CS[j])*HH(j,j) + conj(SN[j])*HH(j+1,j);
+        HH(j+1,j) = 0.0;
+        G[j+1]    = -SN[j]*G[j];
+        G[j]      = conj(CS[j])*G[j];
+
+        Residual = abs(G[j+1]) / BNorm;
+        if (Residual < Tol)
+         { j++; Iter++;
+           Converged=true;
+           break;
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- solve the upper-triangular system H*Y=G and update X        */
+     /*--------------------------------------------------------------*/
+     for(int i=j-1; i>=0; i--)
+      { Y[i]=G[i];
+        for(int k=i+1; k<j; k++)
+         Y[i] -= HH(i,k)*Y[k];
+        Y[i] /= HH(i,i);
+      };
+     W->Zero();
+     for(int i=0; i<j; i++)
+      for(int n=0; n<N; n++)
+       W->ZV[n] += Y[i]*V[i]->ZV[n];
+     ApplyPreconditioner(PInv, PInvData, W, Z);
+     for(int n=0; n<N; n++)
+      X->ZV[n] += Z->ZV[n];
+
+   }; // while( !Converged ...
+
+  /*--------------------------------------------------------------*/
+  /*- the residual estimated by the givens recurrence can drift   */
+  /*- from the true residual, so recompute it before returning    */
+  /*--------------------------------------------------------------*/
+  A(X, R, AData);
+  for(int n=0; n<N; n++)
+   R->ZV[n] = B->ZV[n] - R->ZV[n];
+  Residual = VecNorm(R) / BNorm;
+  if (pResidual) *pResidual=Residual;
+
+  for(int n=0; n<=Restart; n++)
+   delete V[n];
+  free(V);
+  delete W;
+  delete Z;
+  delete R;
+  free(H);
+  free(CS);
+  free(SN);
+  free(G);
+  free(Y);
+
+  return Converged ? Iter : -1;
+}
+
+/***************************************************************/
+/* Solve A*X=B by the stabilized biconjugate-gradient method   */
+/* (BiCGStab) with right preconditioning.                      */
+/*                                                             */
+/* Arguments and return value have the same meaning as for     */
+/* GMRES(). BiCGStab needs only a fixed handful of work        */
+/* vectors (no krylov basis), but requires two applications of */
+/* A per iteration.                                            */
+/***************************************************************/
+int BiCGStab(MatVecFunc A, void *AData, HVector *B, HVector *X,
+             MatVecFunc PInv, void *PInvData,
+             double Tol, int MaxIters, double *pResidual)
+{
+  if ( B->RealComplex!=LHM_COMPLEX || X->RealComplex!=LHM_COMPLEX )
+   ErrExit("%s:%i: BiCGStab implemented only for complex vectors",__FILE__,__LINE__);
+  if ( B->N != X->N )
+   ErrExit("%s:%i: dimension mismatch in BiCGStab",__FILE__,__LINE__);
+
+  int N=B->N;
+  HVector *R    = new HVector(N, LHM_COMPLEX);
+  HVector *RHat = new HVector(N, LHM_COMPLEX);
+  HVector *P    = new HVector(N, LHM_COMPLEX);
+  HVector *PHat = new HVector(N, LHM_COMPLEX);
+  HVector *V    = new HVector(N, LHM_COMPLEX);
+  HVector *S    = new HVector(N, LHM_COMPLEX);
+  HVector *SHat = new HVector(N, LHM_COMPLEX);
+  HVector *T    = new HVector(N, LHM_COMPLEX);
+
+  double BNorm = VecNorm(B);
+  if (BNorm==0.0) BNorm=1.0;
+
+  // R = B - A*X
+  A(X, R, AData);
+  for(int n=0; n<N; n++)
+   R->ZV[n] = B->ZV[n] - R->ZV[n];
+  RHat->Copy(R);
+  P->Zero();
+  V->Zero();
+
+  cdouble Rho=1.0, Alpha=1.0, Omega=1.0;
+  double Residual=VecNorm(R)/BNorm;
+  int Iter=0;
+  bool Converged = (Residual<Tol);
+  while( !Converged && Iter<MaxIters )
+   {
+     Iter++;
+
+     cdouble RhoNew = RHat->Dot(R);
+     if (RhoNew==0.0)
+      break; // breakdown
+
+     cdouble Beta = (RhoNew/Rho)*(Alpha/Omega);
+     for(int n=0; n<N; n++)
+      P->ZV[n] = R->ZV[n] + Beta*(P->ZV[n] - Omega*V->ZV[n]);
+
+     ApplyPreconditioner(PInv, PInvData, P, PHat);
+     A(PHat, V, AData);
+     Alpha = RhoNew / RHat->Dot(V);
+
+     for(int n=0; n<N; n++)
+      S->ZV[n] = R->ZV[n] - Alpha*V->ZV[n];
+     Residual = VecNorm(S)/BNorm;
+     if (Residual<Tol)
+      { for(int n=0; n<N; n++)
+         X->ZV[n] += Alpha*PHat->ZV[n];
+        Converged=true;
+        break;
+      };
+
+     ApplyPreconditioner(PInv, PInvData, S, SHat);
+     A(SHat, T, AData);
+     double TNorm2 = real(T->Dot(T));
+     Omega = (TNorm2==0.0) ? 0.0 : T->Dot(S) / TNorm2;
+
+     for(int n=0; n<N; n++)
+      { X->ZV[n] += Alpha*PHat->ZV[n] + Omega*SHat->ZV[n];
+        R->ZV[n]  = S->ZV[n] - Omega*T->ZV[n];
+      };
+     Residual = VecNorm(R)/BNorm;
+     if (Residual<Tol)
+      Converged=true;
+     else if (Omega==0.0)
+      break; // breakdown
+
+     Rho=RhoNew;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- report the true residual -----------------------------------*/
+  /*--------------------------------------------------------------*/
+  A(X, R, AData);
+  for(int n=0; n<N; n++)
+   R->ZV[n] = B->ZV[n] - R->ZV[n];
+  Residual = VecNorm(R) / BNorm;
+  if (pResidual) *pResidual=Residual;
+
+  delete R;
+  delete RHat;
+  delete P;
+  delete PHat;
+  delete V;
+  delete S;
+  delete SHat;
+  delete T;
+
+  return Converged ? Iter : -1;
+}
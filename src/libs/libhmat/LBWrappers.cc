@@ -29,9 +29,18 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <math.h>
+#include <float.h>
 
 #include <libhrutil.h>
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
 extern "C" {
  #include "lapack.h" 
 }
@@ -147,14 +156,93 @@ void HMatrix::GetMatrixProductDiagonal(HMatrix *B, HVector *DAB)
 
 /***************************************************************/
 /* replace the matrix with its LU factorization ****************/
+/*                                                             */
+/* if MixedPrecision is true and the matrix is in normal       */
+/* storage, the matrix is instead converted to single precision*/
+/* and factorized by sgetrf/cgetrf, with the factors stored in */
+/* LPFactor and the double-precision matrix left untouched for */
+/* use in computing residuals in LUSolve(). This halves the    */
+/* cost of the factorization, at the price of a few O(N^2)     */
+/* refinement sweeps per solve; the single-precision factors   */
+/* take half the memory of double-precision factors, but are   */
+/* stored in addition to the matrix. If the matrix cannot be   */
+/* represented in single precision or the single-precision     */
+/* factorization fails, we fall back to the usual double-      */
+/* precision factorization.                                    */
 /***************************************************************/
+static bool CheckMixedPrecisionEnvironment()
+{ 
+  if (getenv("SCUFF_MIXED_PRECISION_LU"))
+   { Log("Using mixed-precision LU factorization.");
+     HMatrix::MixedPrecisionLU=true;
+   };
+  return HMatrix::MixedPrecisionLU;
+}
+
 int HMatrix::LUFactorize()
+{ 
+  // initialization of a function-local static happens exactly
+  // once, even if the first calls come from several threads
+  static bool EnvChecked=CheckMixedPrecisionEnvironment();
+  (void) EnvChecked;
+  return LUFactorize(MixedPrecisionLU);
+}
+
+int HMatrix::LUFactorize(bool MixedPrecision)
 { 
   int info;
 
   if (ipiv==0)
    ipiv=(int *)mallocEC(NR*sizeof(int));
 
+  ClearLPFactor();
+
+  if ( MixedPrecision && StorageType==LHM_NORMAL && NR==NC )
+   { 
+     size_t NE=NumEntries();
+     char Norm[2]="I";
+     double *Work = (double *)mallocEC(NR*sizeof(double));
+     LPANorm = (RealComplex==LHM_REAL) ? dlange_(Norm, &NR, &NC, DM, &NR, Work)
+                                       : zlange_(Norm, &NR, &NC, ZM, &NR, Work);
+     free(Work);
+     if ( LPANorm < FLT_MAX )
+      { if (RealComplex==LHM_REAL)
+         { float *SM = (float *)mallocEC(NE*sizeof(float));
+           for(size_t n=0; n<NE; n++) SM[n]=(float)DM[n];
+           sgetrf_(&NR, &NC, SM, &NR, ipiv, &info);
+           LPFactor=(void *)SM;
+         }
+        else
+         { cfloat *CM = (cfloat *)mallocEC(NE*sizeof(cfloat));
+           for(size_t n=0; n<NE; n++) CM[n]=cfloat(ZM[n]);
+           cgetrf_(&NR, &NC, CM, &NR, ipiv, &info);
+           LPFactor=(void *)CM;
+         };
+        if (info==0)
+         { 
+#ifdef USE_OPENMP
+           omp_lock_t *Lock = (omp_lock_t *)mallocEC(sizeof(omp_lock_t));
+           omp_init_lock(Lock);
+           LPLock=(void *)Lock;
+#endif
+           return 0;
+         };
+        free(LPFactor);
+        LPFactor=0;
+      };
+     Log("single-precision LU factorization failed (N=%i); using double precision",NR);
+   };
+
+  return DPFactorize();
+}
+
+/***************************************************************/
+/* overwrite the matrix with its double-precision LU (or       */
+/* Bunch-Kaufman) factorization; ipiv must already exist.      */
+/***************************************************************/
+int HMatrix::DPFactorize()
+{
+  int info=0;
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrf_(&NR, &NC, DM, &NR, ipiv, &info); 
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
@@ -169,6 +257,199 @@ int HMatrix::LUFactorize()
   return info;
 }
 
+/***************************************************************/
+/* discard the single-precision factors and the lock that      */
+/* guards them. not thread-safe: this is only called when the  */
+/* matrix is refactorized or destroyed.                        */
+/***************************************************************/
+void HMatrix::ClearLPFactor()
+{
+  if (LPFactor)
+   { free(LPFactor);
+     LPFactor=0;
+   };
+#ifdef USE_OPENMP
+  if (LPLock)
+   { omp_destroy_lock((omp_lock_t *)LPLock);
+     free(LPLock);
+   };
+#endif
+  LPLock=0;
+  LPReaders=0;
+  LPPromoting=false;
+}
+
+static void SetLPLock(void *Lock)
+{
+#ifdef USE_OPENMP
+  if (Lock) omp_set_lock((omp_lock_t *)Lock);
+#else
+  (void) Lock;
+#endif
+}
+
+static void UnsetLPLock(void *Lock)
+{
+#ifdef USE_OPENMP
+  if (Lock) omp_unset_lock((omp_lock_t *)Lock);
+#else
+  (void) Lock;
+#endif
+}
+
+/***************************************************************/
+/* if the matrix has a single-precision LU factorization,      */
+/* discard it and replace the (still intact) matrix with its   */
+/* double-precision LU factorization. this is done when        */
+/* iterative refinement fails to converge, and by routines     */
+/* that need the LU factors themselves (log det, inverse,      */
+/* condition number).                                          */
+/*                                                             */
+/* several threads may be solving with the same matrix, so the */
+/* promotion is done under the matrix's own LPLock: we flag it */
+/* as in progress, wait for solves already running on the      */
+/* single-precision factors to finish (they read the matrix    */
+/* itself to compute residuals), and then swap the factors.    */
+/* threads that arrive in the meantime block on the lock until */
+/* the double-precision factors are in place.                  */
+/***************************************************************/
+int HMatrix::LUPromote()
+{
+  if (LPLock==0)
+   { if (LPFactor==0) return 0;
+     free(LPFactor);
+     LPFactor=0;
+     return DPFactorize();
+   };
+
+  int info=0;
+  SetLPLock(LPLock);
+  if (LPFactor && !LPPromoting)
+   { LPPromoting=true;
+     while(LPReaders>0)
+      { UnsetLPLock(LPLock);
+        SetLPLock(LPLock);
+      };
+     free(LPFactor);
+     LPFactor=0;
+     info=DPFactorize();
+     LPPromoting=false;
+   };
+  UnsetLPLock(LPLock);
+  return info;
+}
+
+/***************************************************************/
+/* solve op(M) X = B, with B the first nrhs columns of X on    */
+/* entry, by iterative refinement using the single-precision   */
+/* factors of M, with residuals computed in double precision   */
+/* from M itself. as in LAPACK's xgerfsx, each sweep reduces   */
+/* the correction dX until it is either negligible,            */
+/*  |dx|_inf <= |x|_inf * eps * sqrt(N)       (for each column)*/
+/* or stagnates (fails to shrink by a factor of 2); in the     */
+/* latter case we accept X if it passes the backward-error     */
+/* test of LAPACK's zcgesv,                                    */
+/*  |r|_inf <= |x|_inf * |M|_inf * eps * sqrt(N).              */
+/* returns 0 on success; otherwise X is restored to B and 1 is */
+/* returned.                                                   */
+/***************************************************************/
+#define LPSOLVE_MAXITER 30
+#define LPSOLVE_MAXRHS(N) ((N)/32)
+static double MaxColumnRatio(bool Real, int N, int nrhs, void *V, void *X)
+{ 
+  double MaxRatio=0.0;
+  for(int nc=0; nc<nrhs; nc++)
+   { double VNorm=0.0, XNorm=0.0;
+     for(int nr=0; nr<N; nr++)
+      { size_t n = nr + ((size_t)N)*nc;
+        VNorm=fmax(VNorm, Real ? fabs(((double *)V)[n]) : abs(((cdouble *)V)[n]));
+        XNorm=fmax(XNorm, Real ? fabs(((double *)X)[n]) : abs(((cdouble *)X)[n]));
+      };
+     double Ratio = (VNorm==0.0) ? 0.0 : VNorm / XNorm;
+     if ( !(Ratio<=MaxRatio) ) MaxRatio=Ratio; // catches NaN
+   };
+  return MaxRatio;
+}
+
+int HMatrix::LPSolve(HMatrix *X, char Trans, int nrhs)
+{
+  int N=NR, info;
+  size_t NE = ((size_t)N)*nrhs;
+  bool Real = (RealComplex==LHM_REAL);
+  size_t ESize = Real ? sizeof(double) : sizeof(cdouble);
+  char TransS[2]={Trans,0};
+  void *XM = Real ? (void *)X->DM : (void *)X->ZM;
+
+  void *B  = mallocEC(NE*ESize);
+  void *R  = mallocEC(NE*ESize);
+  void *DX = mallocEC(NE*ESize);
+  void *W  = mallocEC(NE*(Real ? sizeof(float) : sizeof(cfloat)));
+  memcpy(B, XM, NE*ESize);
+  memcpy(R, B, NE*ESize);
+  memset(XM, 0, NE*ESize);
+
+  double Cte = dlamch_("Epsilon") * sqrt((double)N);
+  double LastRatio=0.0;
+  bool Converged=false;
+  for(int Iter=0; Iter<LPSOLVE_MAXITER; Iter++)
+   { 
+     /*--------------------------------------------------------------*/
+     /*- X += dX = op(M_single)^{-1} R ------------------------------*/
+     /*--------------------------------------------------------------*/
+     if (Real)
+      { float *WS=(float *)W;
+        double *RD=(double *)R, *DXD=(double *)DX;
+        for(size_t n=0; n<NE; n++) WS[n]=(float)RD[n];
+        sgetrs_(TransS, &N, &nrhs, (float *)LPFactor, &N, ipiv, WS, &N, &info);
+        for(size_t n=0; n<NE; n++) X->DM[n] += (DXD[n]=(double)WS[n]);
+      }
+     else
+      { cfloat *WC=(cfloat *)W;
+        cdouble *RZ=(cdouble *)R, *DXZ=(cdouble *)DX;
+        for(size_t n=0; n<NE; n++) WC[n]=cfloat(RZ[n]);
+        cgetrs_(TransS, &N, &nrhs, (cfloat *)LPFactor, &N, ipiv, WC, &N, &info);
+        for(size_t n=0; n<NE; n++) X->ZM[n] += (DXZ[n]=cdouble(WC[n]));
+      };
+
+     double DXRatio = MaxColumnRatio(Real, N, nrhs, DX, XM) / Cte;
+     if (DXRatio<=1.0)
+      { Converged=true;
+        break;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- R = B - op(M) X --------------------------------------------*/
+     /*--------------------------------------------------------------*/
+     memcpy(R, B, NE*ESize);
+     if (Real)
+      { double dMinusOne=-1.0, dOne=1.0;
+        dgemm_(TransS, "N", &N, &nrhs, &N, &dMinusOne, DM, &N,
+               X->DM, &N, &dOne, (double *)R, &N);
+      }
+     else
+      { cdouble zMinusOne=-1.0, zOne=1.0;
+        zgemm_(TransS, "N", &N, &nrhs, &N, &zMinusOne, ZM, &N,
+               X->ZM, &N, &zOne, (cdouble *)R, &N);
+      };
+
+     if ( Iter>0 && !(DXRatio < 0.5*LastRatio) )
+      { double RRatio = MaxColumnRatio(Real, N, nrhs, R, XM) / (LPANorm*Cte);
+        Converged = (RRatio<=1.0);
+        break;
+      };
+     LastRatio=DXRatio;
+   };
+
+  if (!Converged)
+   memcpy(XM, B, NE*ESize);
+
+  free(W);
+  free(DX);
+  free(R);
+  free(B);
+  return Converged ? 0 : 1;
+}
+
 /***************************************************************/
 /* solve linear system using LU factorization ******************/
 /***************************************************************/
@@ -185,12 +466,16 @@ int HMatrix::LUSolve(HVector *X)
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUSolve()");
 
-  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
-   dgetrs_("N", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
-  else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
+  // normal storage goes through the matrix version, which 
+  // handles mixed-precision factors
+  if ( StorageType==LHM_NORMAL )
+   { HMatrix XMatrix(NR, 1, RealComplex, LHM_NORMAL,
+                     RealComplex==LHM_REAL ? (void *)X->DV : (void *)X->ZV);
+     return LUSolve(&XMatrix, 'N', 1);
+   };
+
+  if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &iOne, DM, ipiv, X->DV, &NR, &info);
-  else if ( RealComplex==LHM_COMPLEX && StorageType==LHM_NORMAL )
-   zgetrs_("N", &NR, &iOne, ZM, &NR, ipiv, X->ZV, &NR, &info);
   else if ( RealComplex==LHM_COMPLEX && StorageType==LHM_HERMITIAN )
    zhptrs_("U", &NR, &iOne, ZM, ipiv, X->ZV, &NR, &info);
   else if ( RealComplex==LHM_COMPLEX && StorageType==LHM_SYMMETRIC )
@@ -219,7 +504,50 @@ int HMatrix::LUSolve(HMatrix *X, char Trans, int nrhs)
    ErrExit("LUFactorize() must be called before LUSolve()");
   if ( Trans!='N' && StorageType!=LHM_NORMAL )
    ErrExit("transposed LU-solves not available for packed matrices");
-if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
+
+  // each refinement sweep costs about as much as a full solve,
+  // so for many right-hand sides the savings of the single-
+  // precision factorization are lost and we revert to double.
+  // note that in this case, or if refinement stalls, the matrix
+  // is overwritten by its double-precision LU factors. LPLock
+  // is held only long enough to register this solve as a reader
+  // of the single-precision factors (or, if another thread is
+  // promoting them, to wait for it to finish); the solve itself
+  // runs unlocked, and LUPromote() waits for it to complete.
+  bool UseLP = (LPLock==0 && LPFactor!=0);
+  if (LPLock)
+   { for(bool Waiting=true; Waiting; )
+      { SetLPLock(LPLock);
+        if (!LPPromoting)
+         { if (LPFactor)
+            { LPReaders++;
+              UseLP=true;
+            };
+           Waiting=false;
+         };
+        UnsetLPLock(LPLock);
+      };
+   };
+
+  if (UseLP)
+   { bool Solved=false;
+     if ( nrhs>LPSOLVE_MAXRHS(NR) )
+      Log("%i RHS for mixed-precision LU (N=%i); refactorizing in double precision",nrhs,NR);
+     else if ( nrhs==0 || LPSolve(X, Trans, nrhs)==0 )
+      Solved=true;
+     else
+      Log("mixed-precision refinement stalled (N=%i); refactorizing in double precision",NR);
+
+     SetLPLock(LPLock);
+     LPReaders--;
+     UnsetLPLock(LPLock);
+
+     if (Solved)
+      return 0;
+     LUPromote();
+   };
+
+  if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_(&Trans, &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
    dsptrs_("U", &NR, &nrhs, DM, ipiv, X->DM, &NR, &info);
@@ -244,6 +572,69 @@ int HMatrix::LUSolve(HMatrix *X, int nrhs)
 int HMatrix::LUSolve(HMatrix *X) 
  { return LUSolve(X,'N',X->NC); }
 
+/***************************************************************/
+/* log|det M| for a matrix that has been LUFactorize()d. if    */
+/* Phase is nonzero, it is filled in with det(M)/|det(M)|.     */
+/*                                                             */
+/* for packed (symmetric or hermitian) storage the factorization*/
+/* is the Bunch-Kaufman factorization M = U*D*U^T (or U*D*U^H) */
+/* with U unit-triangular, so det(M) = det(D), where D is      */
+/* block-diagonal with 1x1 and 2x2 blocks; a 2x2 block in rows */
+/* n, n+1 is flagged by ipiv[n] = ipiv[n+1] < 0.               */
+/***************************************************************/
+double HMatrix::GetLULogDet(cdouble *Phase)
+{
+  if (ipiv==0)
+   ErrExit("LUFactorize() must be called before GetLULogDet()");
+  LUPromote();
+  if (NR!=NC)
+   ErrExit("GetLULogDet() called for non-square matrix");
+
+  double LogDet=0.0;
+  cdouble Sign=1.0;
+  for(int n=0; n<NR; n++)
+   { 
+     cdouble d;
+     if (StorageType==LHM_NORMAL || ipiv[n]>0 || n==NR-1)
+      d=GetEntry(n,n);
+     else
+      { cdouble a=GetEntry(n,n), b=GetEntry(n,n+1), c=GetEntry(n+1,n+1);
+        d = a*c - (StorageType==LHM_HERMITIAN ? norm(b) : b*b);
+        n++;
+      };
+
+     LogDet += log(abs(d));
+     Sign *= d/abs(d);
+
+     // row interchanges in the general LU factorization flip the sign
+     if (StorageType==LHM_NORMAL && ipiv[n]!=n+1)
+      Sign*=-1.0;
+   };
+
+  if (Phase) *Phase=Sign;
+  return LogDet;
+}
+
+/***************************************************************/
+/* trace of M^{-1} B for a matrix that has been LUFactorize()d.*/
+/* on return, B has been overwritten by M^{-1} B; the trace    */
+/* runs over the leading square part of B if B is not square.  */
+/***************************************************************/
+cdouble HMatrix::GetLUTraceInvProduct(HMatrix *B)
+{
+  LUSolve(B);
+
+  int N = (B->NC < NR) ? B->NC : NR;
+  cdouble Trace=0.0;
+  if (B->RealComplex==LHM_REAL)
+   for(int n=0; n<N; n++)
+    Trace += B->DM[n + ((size_t)NR)*n];
+  else
+   for(int n=0; n<N; n++)
+    Trace += B->ZM[n + ((size_t)NR)*n];
+  return Trace;
+}
+
 /***************************************************************/
 /* replace the matrix with its inverse, assuming LUFactorize() */
 /* has already been called                                     */
@@ -262,6 +653,7 @@ int HMatrix::LUInvert()
 
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUInvert()");
+  LUPromote();
 
   int MinusOne=-1;
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
@@ -888,6 +1280,7 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
 {
   char *Norm = const_cast<char *> (UseInfinityNorm ? "I" : "1");
   double RCond;
+  LUPromote();
 
   /***************************************************************/
   /***************************************************************/
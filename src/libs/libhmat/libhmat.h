@@ -297,7 +297,20 @@ class HMatrix
    
    /* routines for LU-factorizing, solving, inverting */
    /* (xgetrf, xgetrs, xgetri) */
+   /* if MixedPrecision is true (or, for the first form, if */
+   /* the class flag MixedPrecisionLU is true), a matrix in */
+   /* normal storage is factorized in single precision and  */
+   /* LUSolve() refines solutions to double precision (see  */
+   /* LBWrappers.cc); in this case the matrix itself is not */
+   /* overwritten by its factorization until LUSolve() is   */
+   /* called with more than N/32 RHSs or fails to refine a  */
+   /* solution, or until GetLULogDet(), LUInvert(), or      */
+   /* GetRCond() is called, at which point the matrix is    */
+   /* replaced by its double-precision LU factors. this is  */
+   /* done under a lock, so concurrent LUSolve()s are safe, */
+   /* but the matrix entries must not be read meanwhile.    */
    int LUFactorize();
+   int LUFactorize(bool MixedPrecision);
    int LUSolve(HVector *X);
    int LUSolve(HMatrix *X);
    int LUSolve(HMatrix *X, int nrhs);
@@ -305,6 +318,11 @@ class HMatrix
    int LUSolve(HMatrix *X, char Trans, int nrhs);
    int LUInvert();
 
+   /* log|det| and trace of inverse product for a matrix that */
+   /* has been LUFactorize()d (general or packed storage)     */
+   double GetLULogDet(cdouble *Phase=0);
+   cdouble GetLUTraceInvProduct(HMatrix *B);
+
    /* routines for cholesky-factorizing, solving, inverting */
    /* (xpotrf, xpotrs, xpotri) */
    int CholFactorize();
@@ -343,6 +361,22 @@ class HMatrix
    int StorageType;
    int *ipiv;
 
+   // single-precision LU factors (float or cfloat) after a 
+   // mixed-precision LUFactorize(), in which case DM or ZM 
+   // still holds the matrix itself, with infinity-norm LPANorm.
+   // LPLock (an omp_lock_t, in OpenMP builds) guards the
+   // promotion of LPFactor to double-precision factors;
+   // LPReaders counts solves in progress on LPFactor.
+   void *LPFactor;
+   double LPANorm;
+   void *LPLock;
+   int LPReaders;
+   bool LPPromoting;
+   int LPSolve(HMatrix *X, char Trans, int nrhs);
+   int LUPromote();
+   int DPFactorize();
+   void ClearLPFactor();
+
    // pointers to the actual data storage. only one of these is 
    // used in a given instance so if i wanted to save 8 bytes i 
    // could put them into a union
@@ -380,6 +414,13 @@ class HMatrix
    // non-NULL value of its ErrMsg field.
    static bool AbortOnIOError;
 
+   // static class variable that selects mixed-precision LU
+   // factorization for all calls to LUFactorize() without
+   // an explicit MixedPrecision argument. this is false by
+   // default, but is set to true on the first such call if
+   // the environment variable SCUFF_MIXED_PRECISION_LU is set.
+   static bool MixedPrecisionLU;
+
  };
 
 // make an unpacked copy of a symmetric/Hermitian matrix
@@ -455,4 +496,92 @@ class SMatrix
     int MakeEntry(int nr, int nc, bool force_new); // internal function to allocate entries
  };
 
+/***************************************************************/
+/* DHMatrix class definition                                   */
+/*                                                             */
+/* A DHMatrix is a complex-valued NRxNC matrix distributed     */
+/* over the ranks of an MPI job in the two-dimensional         */
+/* block-cyclic layout used by ScaLAPACK: the matrix is cut    */
+/* into BlockSize x BlockSize tiles, which are dealt out       */
+/* cyclically over an NPRow x NPCol grid of processes. Each    */
+/* rank stores only its own tiles, in column-major order with  */
+/* leading dimension LocalNR.                                  */
+/*                                                             */
+/* Without ScaLAPACK support (configure --with-scalapack) the  */
+/* process grid is 1x1, the single rank owns the whole matrix, */
+/* and the linear algebra is done by LAPACK.                   */
+/*                                                             */
+/* Vectors passed to Apply() and LUSolve() are replicated on   */
+/* all ranks, and all of these routines must be called         */
+/* collectively by all ranks.                                  */
+/***************************************************************/
+class DHMatrix
+ { 
+  public:  
+
+    DHMatrix(int NR, int NC, int BlockSize=64);
+    ~DHMatrix();
+
+    // true if entry (nr, nc) is stored on this rank
+    bool IsLocalRow(int nr) { return ((nr/BlockSize)%NPRow) == MyRow; }
+    bool IsLocalCol(int nc) { return ((nc/BlockSize)%NPCol) == MyCol; }
+    bool IsLocal(int nr, int nc) { return IsLocalRow(nr) && IsLocalCol(nc); }
+
+    // conversion between global and local indices
+    int GlobalRow(int nrLocal);
+    int GlobalCol(int ncLocal);
+    int LocalRow(int nr);
+    int LocalCol(int nc);
+
+    // these may only be called for entries stored on this rank
+    cdouble GetEntry(int nr, int nc);
+    void SetEntry(int nr, int nc, cdouble Entry);
+    void AddEntry(int nr, int nc, cdouble Entry);
+
+    void Zero();
+
+    // Y = this*X
+    void Apply(HVector *X, HVector *Y);
+
+    // LU factorization and solution of this*X = B; on entry
+    // X is the RHS vector B, on return it is the solution
+    int LUFactorize();
+    int LUSolve(HVector *X);
+
+    // log |det| of the matrix, computed from its LU factorization
+    double GetLogAbsDeterminant();
+
+ // private:
+    int NR, NC, BlockSize;
+    int NumProcs, Rank;
+    int NPRow, NPCol, MyRow, MyCol;
+    int LocalNR, LocalNC;
+    cdouble *ZM;
+    int *ipiv;
+    bool Factorized;
+    int Context, Desc[9];
+ };
+
+// initialize and shut down MPI; these are no-ops without
+// ScaLAPACK support
+void DHMatrixInit(int *argc, char ***argv);
+void DHMatrixFinalize();
+
+/***************************************************************/
+/* krylov-subspace solvers for linear systems whose matrix is  */
+/* only accessible through its action on vectors               */
+/***************************************************************/
+// user-supplied routine that computes Y = A*X
+typedef void (*MatVecFunc)(HVector *X, HVector *Y, void *UserData);
+
+int GMRES(MatVecFunc A, void *AData, HVector *B, HVector *X,
+          MatVecFunc PInv=0, void *PInvData=0,
+          double Tol=1.0e-8, int MaxIters=1000, int Restart=50,
+          double *pResidual=0);
+
+int BiCGStab(MatVecFunc A, void *AData, HVector *B, HVector *X,
+             MatVecFunc PInv=0, void *PInvData=0,
+             double Tol=1.0e-8, int MaxIters=1000,
+             double *pResidual=0);
+
 #endif
@@ -0,0 +1,137 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tDHMatrix.cc -- test distributed LU-factorization and solve;
+ *              -- run e.g. as  mpirun -np 4 tDHMatrix --N 1000
+ *              -- in builds configured --with-scalapack
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+/***************************************************************/
+/* entries of the test matrix are a deterministic function of  */
+/* their indices, so that each rank can fill in its own tiles  */
+/* without any communication                                   */
+/***************************************************************/
+cdouble TestEntry(int nr, int nc, int N)
+{
+  if (nr==nc)
+   return cdouble(N, 1.0);
+  return cdouble( cos(0.1*nr + 0.3*nc), sin(0.7*nr - 0.2*nc) );
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  DHMatrixInit(&argc, &argv);
+
+  /*--------------------------------------------------------------*/
+  /*- process options  -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int N=1000;
+  int BlockSize=64;
+  /* name               type    #args  max_instances  storage           count         description*/
+  OptStruct OSArray[]=
+   { {"N",         PA_INT,     1, 1, (void *)&N,         0, "dimension "},
+     {"BlockSize", PA_INT,     1, 1, (void *)&BlockSize, 0, "block-cyclic tile size"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  /*--------------------------------------------------------------*/
+  /*- fill in the local tiles of the distributed matrix and the   */
+  /*- same matrix in ordinary (non-distributed) form              */
+  /*--------------------------------------------------------------*/
+  DHMatrix *DM=new DHMatrix(N, N, BlockSize);
+  HMatrix *M=new HMatrix(N, N, LHM_COMPLEX);
+  for(int nrl=0; nrl<DM->LocalNR; nrl++)
+   for(int ncl=0; ncl<DM->LocalNC; ncl++)
+    { int nr=DM->GlobalRow(nrl), nc=DM->GlobalCol(ncl);
+      DM->SetEntry(nr, nc, TestEntry(nr, nc, N));
+    };
+  for(int nr=0; nr<N; nr++)
+   for(int nc=0; nc<N; nc++)
+    M->SetEntry(nr, nc, TestEntry(nr, nc, N));
+
+  /*--------------------------------------------------------------*/
+  /*- compare matrix-vector products -----------------------------*/
+  /*--------------------------------------------------------------*/
+  HVector *X=new HVector(N, LHM_COMPLEX);
+  HVector *Y1=new HVector(N, LHM_COMPLEX);
+  HVector *Y2=new HVector(N, LHM_COMPLEX);
+  for(int n=0; n<N; n++)
+   X->SetEntry(n, cdouble(cos(1.0*n), sin(2.0*n)));
+  DM->Apply(X, Y1);
+  M->Apply(X, Y2);
+  double Diff=0.0, Norm=0.0;
+  for(int n=0; n<N; n++)
+   { Diff += norm(Y1->ZV[n]-Y2->ZV[n]);
+     Norm += norm(Y2->ZV[n]);
+   };
+  double ApplyError=sqrt(Diff/Norm);
+  if (DM->Rank==0)
+   printf("Apply: relative difference %e\n",ApplyError);
+
+  /*--------------------------------------------------------------*/
+  /*- LU-factorize and solve, compare log-determinants -----------*/
+  /*--------------------------------------------------------------*/
+  Tic();
+  int Info=DM->LUFactorize();
+  double Elapsed=Toc();
+  if (DM->Rank==0)
+   printf("LU-factorize: info=%i, %.3f s\n",Info,Elapsed);
+
+  HVector *B=new HVector(Y2);
+  DM->LUSolve(B);
+  Diff=Norm=0.0;
+  for(int n=0; n<N; n++)
+   { Diff += norm(B->ZV[n]-X->ZV[n]);
+     Norm += norm(X->ZV[n]);
+   };
+  double SolveError=sqrt(Diff/Norm);
+  if (DM->Rank==0)
+   printf("LUSolve: relative error %e\n",SolveError);
+
+  M->LUFactorize();
+  double LogDet=M->GetLULogDet();
+  double DLogDet=DM->GetLogAbsDeterminant();
+  if (DM->Rank==0)
+   printf("log|det|: %.12e (distributed) %.12e (LAPACK) (rd %.1e)\n",
+           DLogDet,LogDet,RD(DLogDet,LogDet));
+
+  // the vectors are replicated, so every rank reaches the same verdict
+  bool Pass = Info==0
+               && ApplyError<1.0e-12
+               && SolveError<1.0e-10
+               && RD(DLogDet,LogDet)<1.0e-10;
+  if (DM->Rank==0)
+   printf("%s\n",Pass ? "PASS" : "FAIL");
+
+  delete DM;
+  DHMatrixFinalize();
+  return Pass ? 0 : 1;
+}
@@ -28,6 +28,10 @@
 #include <libhrutil.h>
 #include "libhmat.h"
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #if defined(_WIN32)
 #  define srand48 srand
 #  define drand48 my_drand48
@@ -36,6 +40,101 @@ static double my_drand48(void) {
 }
 #endif
 
+/***************************************************************/
+/* solve M1*X=B (or the transposed system) for a random B with */
+/* NRHS columns and return the normwise backward error         */
+/* |B - op(M)X|_max / (|M|_inf |X|_max).                       */
+/***************************************************************/
+double SolveAndCheck(HMatrix *M1, HMatrix *M1Copy, int NRHS, char *Flag)
+{
+  int N=M1->NR;
+  bool Complex = (M1->RealComplex==LHM_COMPLEX);
+  cdouble II = Complex ? cdouble(0.0,1.0) : cdouble(0.0,0.0);
+  HMatrix *M2=new HMatrix(N, NRHS, M1->RealComplex);
+  for(int m=0; m<N; m++)
+   for(int n=0; n<NRHS; n++)
+    M2->SetEntry(m, n, drand48() + II*drand48());
+  HMatrix *M2Copy=new HMatrix(M2);
+
+  printf("LU-solving M2 (Flag=%s, %i RHS)...",Flag,NRHS);
+  Tic();
+  M1->LUSolve(M2,Flag[0]);
+  double Elapsed=Toc();
+  printf("...%.3f s\n",Elapsed);
+
+  HMatrix *M3=new HMatrix(N, NRHS, M1->RealComplex);
+  M1Copy->Multiply(M2,M3,Flag[0]=='N' ? 0 : Flag[0]=='T' ? "--transA T" : "--transA C");
+
+  double MaxErr=0.0, MaxX=0.0;
+  for(int m=0; m<N; m++)
+   for(int n=0; n<NRHS; n++)
+    { MaxErr=fmax(MaxErr, abs(M3->GetEntry(m,n) - M2Copy->GetEntry(m,n)));
+      MaxX=fmax(MaxX, abs(M2->GetEntry(m,n)));
+    };
+  double ANorm=M1Copy->GetNorm(Flag[0]=='N');
+  double Residual = MaxErr / (ANorm*MaxX);
+  printf("Max residual: %e (backward error %e)\n",MaxErr,Residual);
+
+  delete M3;
+  delete M2Copy;
+  delete M2;
+  return Residual;
+}
+
+/***************************************************************/
+/* solve NumSolves systems with the same matrix from several   */
+/* threads at once. one of the solves has N right-hand sides,  */
+/* which promotes mixed-precision factors to double precision  */
+/* while the other threads may be refining with them. returns  */
+/* the largest normwise backward error.                        */
+/***************************************************************/
+double ConcurrentSolves(HMatrix *M1, HMatrix *M1Copy, int NumSolves, char *Flag)
+{
+  int N=M1->NR;
+  bool Complex = (M1->RealComplex==LHM_COMPLEX);
+  cdouble II = Complex ? cdouble(0.0,1.0) : cdouble(0.0,0.0);
+  HMatrix **X = new HMatrix *[NumSolves];
+  HMatrix **B = new HMatrix *[NumSolves];
+  for(int ns=0; ns<NumSolves; ns++)
+   { int NRHS = (ns==NumSolves/2) ? N : 1;
+     X[ns] = new HMatrix(N, NRHS, M1->RealComplex);
+     for(int m=0; m<N; m++)
+      for(int n=0; n<NRHS; n++)
+       X[ns]->SetEntry(m, n, drand48() + II*drand48());
+     B[ns] = new HMatrix(X[ns]);
+   };
+
+  printf("LU-solving %i systems concurrently (Flag=%s)...",NumSolves,Flag);
+  Tic();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+  for(int ns=0; ns<NumSolves; ns++)
+   M1->LUSolve(X[ns],Flag[0]);
+  printf("...%.3f s\n",Toc());
+
+  double ANorm=M1Copy->GetNorm(Flag[0]=='N');
+  double MaxResidual=0.0;
+  for(int ns=0; ns<NumSolves; ns++)
+   { HMatrix *R=new HMatrix(N, X[ns]->NC, M1->RealComplex);
+     M1Copy->Multiply(X[ns],R,Flag[0]=='N' ? 0 : Flag[0]=='T' ? "--transA T" : "--transA C");
+     double MaxErr=0.0, MaxX=0.0;
+     for(int m=0; m<N; m++)
+      for(int n=0; n<X[ns]->NC; n++)
+       { MaxErr=fmax(MaxErr, abs(R->GetEntry(m,n) - B[ns]->GetEntry(m,n)));
+         MaxX=fmax(MaxX, abs(X[ns]->GetEntry(m,n)));
+       };
+     MaxResidual=fmax(MaxResidual, MaxErr/(ANorm*MaxX));
+     delete R;
+     delete B[ns];
+     delete X[ns];
+   };
+  delete[] X;
+  delete[] B;
+  printf("Max backward error: %e\n",MaxResidual);
+  return MaxResidual;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -45,70 +144,72 @@ int main(int argc, char *argv[])
   /*- process options  -------------------------------------------*/
   /*--------------------------------------------------------------*/
   int N=1000;
+  int NRHS=0;
   int Complex=0;
   char *Flag=0;
+  bool MixedPrecision=false;
+  double Tolerance=1.0e-12;
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { {"N",       PA_INT,     1, 1, (void *)&N,       0, "dimension "},
+     {"NRHS",    PA_INT,     1, 1, (void *)&NRHS,    0, "number of RHSs in the first solve (default N/32)"},
      {"Complex", PA_BOOL,    0, 1, (void *)&Complex, 0, "complex-valued matrix"},
      {"Flag",    PA_STRING,  1, 1, (void *)&Flag,    0, "either N, C, or T"},
+     {"MixedPrecision", PA_BOOL, 0, 1, (void *)&MixedPrecision, 0, "single-precision LU with iterative refinement"},
+     {"Tolerance", PA_DOUBLE, 1, 1, (void *)&Tolerance, 0, "maximum backward error"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
 
   if (Flag==0)
    Flag=strdupEC("N");
+  if (NRHS==0)
+   NRHS = (N>=32) ? N/32 : 1;
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  printf("Creating random %ix%i matrices ... \n",N,N);
+  printf("Creating random %ix%i matrix ... \n",N,N);
   HMatrix *M1=new HMatrix(N, N, Complex ? LHM_COMPLEX : LHM_REAL);
-  HMatrix *M2=new HMatrix(N, N, Complex ? LHM_COMPLEX : LHM_REAL);
 
   cdouble II = Complex ? cdouble(0.0,1.0) : cdouble(0.0,0.0);
   srand48(time(0));
 
-  int m,n;
   double Elapsed;
   Tic();
-  for(m=0; m<N; m++)
-   for(n=0; n<N; n++)
-    { M1->SetEntry(m, n, drand48() + II*drand48());
-      M2->SetEntry(m, n, drand48() + II*drand48());
-    };
+  for(int m=0; m<N; m++)
+   for(int n=0; n<N; n++)
+    M1->SetEntry(m, n, drand48() + II*drand48());
   Elapsed=Toc();
   printf("...%.3f s\n",Elapsed);
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  printf("LU-factorizing M1...");
+  HMatrix *M1Copy=new HMatrix(M1);
+
+  printf("LU-factorizing M1%s...",MixedPrecision ? " (mixed precision)" : "");
   Tic();
-  M1->LUFactorize();
+  M1->LUFactorize(MixedPrecision);
   Elapsed=Toc();
   printf("...%.3f s\n",Elapsed);
 
   /*--------------------------------------------------------------*/
+  /*- with mixed precision, the first solve (few RHSs) goes      -*/
+  /*- through iterative refinement and the second (N RHSs)       -*/
+  /*- refactorizes in double precision                           -*/
   /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  printf("LU-solving M2 (Flag=%s)...",Flag);
-  Tic();
-  M1->LUSolve(M2,Flag[0]);
-  Elapsed=Toc();
-  printf("...%.3f s\n",Elapsed);
+  double Residual1 = SolveAndCheck(M1, M1Copy, NRHS, Flag);
+  double Residual2 = SolveAndCheck(M1, M1Copy, N, Flag);
 
   /*--------------------------------------------------------------*/
+  /*- refactorize and repeat with solves from several threads     -*/
   /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  HMatrix *M3=new HMatrix(N, N, Complex ? LHM_COMPLEX : LHM_REAL );
-  if (M3)
-   { 
-     printf("Multiplying M1*M2 ...\n");
-     Tic();
-     M1->Multiply(M2,M3);
-     Elapsed=Toc();
-     printf("...%.3f s\n",Elapsed);
-   };
+  M1->Copy(M1Copy);
+  M1->LUFactorize(MixedPrecision);
+  double Residual3 = ConcurrentSolves(M1, M1Copy, 8, Flag);
 
+  bool Pass = (Residual1 < Tolerance) && (Residual2 < Tolerance) && (Residual3 < Tolerance);
+  printf("%s\n",Pass ? "PASS" : "FAIL");
+  return Pass ? 0 : 1;
 }
@@ -0,0 +1,118 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tLogDet.cc -- compare log-determinants and traces of inverse products
+ *            -- computed from full LU and packed (Bunch-Kaufman) 
+ *            -- factorizations of a random symmetric matrix
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libhrutil.h>
+#include "libhmat.h"
+
+#if defined(_WIN32)
+#  define srand48 srand
+#  define drand48 my_drand48
+static double my_drand48(void) {
+  return rand() * 1.0 / RAND_MAX;
+}
+#endif
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  /*--------------------------------------------------------------*/
+  /*- process options  -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int N=500;
+  int NRHS=50;
+  bool Complex=false;
+  bool Hermitian=false;
+  /* name               type    #args  max_instances  storage           count         description*/
+  OptStruct OSArray[]=
+   { {"N",         PA_INT,     1, 1, (void *)&N,         0, "dimension "},
+     {"NRHS",      PA_INT,     1, 1, (void *)&NRHS,      0, "number of columns in trace product"},
+     {"Complex",   PA_BOOL,    0, 1, (void *)&Complex,   0, "complex-valued matrix"},
+     {"Hermitian", PA_BOOL,    0, 1, (void *)&Hermitian, 0, "hermitian instead of symmetric"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+  if (Hermitian) Complex=true;
+
+  int RealComplex = Complex ? LHM_COMPLEX : LHM_REAL;
+  int StorageType = Hermitian ? LHM_HERMITIAN : LHM_SYMMETRIC;
+  cdouble II = Complex ? cdouble(0.0,1.0) : cdouble(0.0,0.0);
+  srand48(time(0));
+
+  /*--------------------------------------------------------------*/
+  /*- random symmetric (or hermitian) matrix in full and packed  -*/
+  /*- storage, and a random right-hand side for the trace        -*/
+  /*--------------------------------------------------------------*/
+  HMatrix *MFull   = new HMatrix(N, N, RealComplex);
+  HMatrix *MPacked = new HMatrix(N, N, RealComplex, StorageType);
+  for(int m=0; m<N; m++)
+   for(int n=m; n<N; n++)
+    { cdouble z = drand48() - 0.5 + II*(drand48()-0.5);
+      if (m==n && Hermitian) z=real(z);
+      MPacked->SetEntry(m, n, z);
+      MFull->SetEntry(m, n, z);
+      MFull->SetEntry(n, m, Hermitian ? conj(z) : z);
+    };
+
+  HMatrix *BFull   = new HMatrix(N, NRHS, RealComplex);
+  for(int m=0; m<N; m++)
+   for(int n=0; n<NRHS; n++)
+    BFull->SetEntry(m, n, drand48() - 0.5 + II*(drand48()-0.5));
+  HMatrix *BPacked = new HMatrix(BFull);
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  Tic();
+  MFull->LUFactorize();
+  printf("Full LU:   %e s\n",Toc());
+  Tic();
+  MPacked->LUFactorize();
+  printf("Packed BK: %e s\n",Toc());
+
+  cdouble PhaseFull, PhasePacked;
+  double LogDetFull   = MFull->GetLULogDet(&PhaseFull);
+  double LogDetPacked = MPacked->GetLULogDet(&PhasePacked);
+  printf("log|det|: %+.12e %+.12e (rd %.1e)\n",LogDetFull,LogDetPacked,
+          RD(LogDetFull,LogDetPacked));
+  printf("phase:    %s ",CD2S(PhaseFull));
+  printf("%s (ad %.1e)\n",CD2S(PhasePacked),abs(PhaseFull-PhasePacked));
+
+  cdouble TraceFull   = MFull->GetLUTraceInvProduct(BFull);
+  cdouble TracePacked = MPacked->GetLUTraceInvProduct(BPacked);
+  printf("trace:    %s ",CD2S(TraceFull));
+  printf("%s (rd %.1e)\n",CD2S(TracePacked),abs(TraceFull-TracePacked)/abs(TraceFull));
+
+  bool Pass = RD(LogDetFull,LogDetPacked)<1.0e-8
+               && abs(PhaseFull-PhasePacked)<1.0e-8
+               && abs(TraceFull-TracePacked)<1.0e-8*abs(TraceFull);
+  printf("%s\n",Pass ? "PASS" : "FAIL");
+  return Pass ? 0 : 1;
+}
@@ -462,7 +462,6 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
   KBIMBCache *Cache = (KBIMBCache *)Accelerator;
   bool HaveCache = (Cache!=0);
   bool HaveCleanCache = HaveCache && EqualFloat(Cache->Omega, Omega);
-  if (HaveCache) Cache->Omega=Omega;
 
   int NumCommonRegions, CRIndices[2];
   double Signs[2];
@@ -477,8 +476,6 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
 
   bool UseSymmetry = (nsa==nsb);
 
-  double L[3]={0.0, 0.0, 0.0};
-
   bool OneDLattice = (LDim==1);
   double LBV[3][3];
   LBV[0][0] = LBasis->GetEntryD(0,0);
@@ -501,67 +498,58 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
   Args->GBA1         = 0;
   Args->GBA2         = 0;
   Args->Accumulate   = false;
-  Args->Displacement = L;
-
-  /*--------------------------------------------------------------*/
-  /*- If the caller didn't provide a cache, we need temporary     */
-  /*- storage for the kBloch-independent matrix blocks.           */
-  /*--------------------------------------------------------------*/
-  HMatrix *GradBBuffer[3]={0, 0, 0};
-  Args->GradB = (GradM && GradM[2]) ? GradBBuffer : 0;
-  if (!HaveCache)
-   { 
-     Args->B = new HMatrix(NBFA, NBFB, LHM_COMPLEX);
-     if (Args->GradB)
-      Args->GradB[2] = new HMatrix(NBFA, NBFB, LHM_COMPLEX);
-   };
 
   /***************************************************************/
   /* Assemble and stamp in contributions of innermost grid cells.*/
+  /* The (up to 9) cell blocks are computed together in a single */
+  /* batch so that they share one pool of parallel tasks; if the */
+  /* caller didn't provide a cache, each cell block needs its    */
+  /* own temporary storage.                                      */
   /***************************************************************/
-  M->ZeroBlock(RowOffset, NBFA, ColOffset, NBFB);
-  if (GradM && GradM[2]) GradM[2]->Zero();
-  if (LogLevel>=SCUFF_VERBOSELOGGING)
-   Log(" Step 1: Contributions of innermost grid cells...");
-  for(int n1=+1, nb=0; n1>=-1; n1--)
+  GetSSIArgStruct CellArgs[9], *CellArgsList[9];
+  HMatrix *CellGradB[9][3];
+  double CellL[9][3];
+  int NumCells=0;
+  for(int n1=+1; n1>=-1; n1--)
    for(int n2=+1; n2>=-1; n2--)
     { 
       if ( OneDLattice && n2!=0 ) continue;
 
-      L[0] = n1*LBV[0][0] + n2*LBV[1][0];
-      L[1] = n1*LBV[0][1] + n2*LBV[1][1];
- 
+      int nc=NumCells++;
+      GetSSIArgStruct *CArgs = CellArgsList[nc] = CellArgs + nc;
+      *CArgs = *Args;
+
+      CellL[nc][0] = n1*LBV[0][0] + n2*LBV[1][0];
+      CellL[nc][1] = n1*LBV[0][1] + n2*LBV[1][1];
+      CellL[nc][2] = 0.0;
+      CArgs->Displacement = CellL[nc];
+
+      CellGradB[nc][0] = CellGradB[nc][1] = CellGradB[nc][2] = 0;
+      CArgs->GradB = (GradM && GradM[2]) ? CellGradB[nc] : 0;
       if (HaveCache)
-       { Args->B = Cache->B[ nb ];
-         if (Args->GradB) Args->GradB[2] = Cache->dBdZ[ nb ];
-         nb++;
+       { CArgs->B = Cache->B[ nc ];
+         if (CArgs->GradB) CArgs->GradB[2] = Cache->dBdZ[ nc ];
+       }
+      else
+       { CArgs->B = new HMatrix(NBFA, NBFB, LHM_COMPLEX);
+         if (CArgs->GradB)
+          CArgs->GradB[2] = new HMatrix(NBFA, NBFB, LHM_COMPLEX);
        };
 
-      if ( !HaveCleanCache )
-       { 
-         // detect extendedness of regions and omit contributions of
-         // any regions that are not extended
-         if ( n1==0 && n2==0 )
-          { Args->OmitRegion1 = false;
-            Args->OmitRegion2 = (nr2==-1);
-          }
-         else 
-          { Args->OmitRegion1 = Args->OmitRegion2 = true;
-            if ( n1!=0 && RegionIsExtended[0][nr1] ) Args->OmitRegion1=false;
-            if ( n1!=0 && nr2!=-1 && RegionIsExtended[0][nr2] ) Args->OmitRegion2=false;
-            if ( n2!=0 && RegionIsExtended[1][nr1] ) Args->OmitRegion1=false;
-            if ( n2!=0 && nr2!=-1 && RegionIsExtended[1][nr2] ) Args->OmitRegion2=false;
-          };
- 
-         if (LogLevel>=SCUFF_VERBOSE2)
-          Log("  ...(%i,%i) block...",n1,n2);
-         Args->Symmetric = (nsa==nsb && n1==0 && n2==0); 
-         GetSurfaceSurfaceInteractions(Args);
+      // detect extendedness of regions and omit contributions of
+      // any regions that are not extended
+      if ( n1==0 && n2==0 )
+       { CArgs->OmitRegion1 = false;
+         CArgs->OmitRegion2 = (nr2==-1);
+       }
+      else 
+       { CArgs->OmitRegion1 = CArgs->OmitRegion2 = true;
+         if ( n1!=0 && RegionIsExtended[0][nr1] ) CArgs->OmitRegion1=false;
+         if ( n1!=0 && nr2!=-1 && RegionIsExtended[0][nr2] ) CArgs->OmitRegion2=false;
+         if ( n2!=0 && RegionIsExtended[1][nr1] ) CArgs->OmitRegion1=false;
+         if ( n2!=0 && nr2!=-1 && RegionIsExtended[1][nr2] ) CArgs->OmitRegion2=false;
        };
-
-      StampInNeighborBlock(Args->B, Args->GradB, NBFA, NBFB,
-                           M, GradM, RowOffset, ColOffset, L, kBloch, 
-                           UseSymmetry && !(n1==0 && n2==0) );
+      CArgs->Symmetric = (nsa==nsb && n1==0 && n2==0); 
 
       if ( UseSymmetry && (n1==0 && n2==0) )
        goto done; // want break, but need to break out of both loops
@@ -569,13 +557,33 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
 
 done: 
 
+  if (LogLevel>=SCUFF_VERBOSELOGGING)
+   Log(" Step 1: Contributions of innermost grid cells...");
+  if ( !HaveCleanCache )
+   { GetSurfaceSurfaceInteractions(CellArgsList, NumCells);
+     // a clean cache is only read from here on, so callers that
+     // have filled it once at a given frequency may then assemble
+     // blocks at several kBloch points concurrently
+     if (HaveCache) Cache->Omega=Omega;
+   };
+
+  M->ZeroBlock(RowOffset, NBFA, ColOffset, NBFB);
+  if (GradM && GradM[2]) GradM[2]->Zero();
+  for(int nc=0; nc<NumCells; nc++)
+   { bool CenterCell = (CellL[nc][0]==0.0 && CellL[nc][1]==0.0);
+     StampInNeighborBlock(CellArgs[nc].B, CellArgs[nc].GradB, NBFA, NBFB,
+                          M, GradM, RowOffset, ColOffset, CellL[nc], kBloch, 
+                          UseSymmetry && !CenterCell );
+   };
+
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   if (!HaveCache)
-   { delete Args->B;
-     if (Args->GradB) delete Args->GradB[2];
-   };
+   for(int nc=0; nc<NumCells; nc++)
+    { delete CellArgs[nc].B;
+      if (CellArgs[nc].GradB) delete CellArgs[nc].GradB[2];
+    };
 
   /***************************************************************/
   /***************************************************************/
@@ -729,6 +737,128 @@ void RWGGeometry::ApplyMMJTransformation(HMatrix *M, HVector *RHS)
 
 }
 
+/***************************************************************/
+/* copy the upper triangle of a square matrix into its lower   */
+/* triangle. this works directly on the data buffer in square  */
+/* tiles, so that both the reads (along rows of the upper      */
+/* triangle) and the writes stay within a few cache lines, and */
+/* distributes the tiles over threads.                         */
+/***************************************************************/
+#define MIRROR_TILE 64
+static void FillLowerTriangle(HMatrix *M)
+{
+  int N=M->NR;
+  int NT=(N+MIRROR_TILE-1)/MIRROR_TILE;
+  bool IsComplex = (M->RealComplex==LHM_COMPLEX);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+  for(int ntr=0; ntr<NT; ntr++)
+   for(int ntc=0; ntc<=ntr; ntc++)
+    { int nrMin=ntr*MIRROR_TILE, nrMax=nrMin+MIRROR_TILE;
+      int ncMin=ntc*MIRROR_TILE, ncMax=ncMin+MIRROR_TILE;
+      if (nrMax>N) nrMax=N;
+      if (ncMax>N) ncMax=N;
+      for(int nc=ncMin; nc<ncMax; nc++)
+       for(int nr=(nrMin>nc+1 ? nrMin : nc+1); nr<nrMax; nr++)
+        { size_t Lower = nr + ((size_t)N)*nc, Upper = nc + ((size_t)N)*nr;
+          if (IsComplex)
+           M->ZM[Lower] = M->ZM[Upper];
+          else
+           M->DM[Lower] = M->DM[Upper];
+        };
+    };
+}
+
+/***************************************************************/
+/* detection of off-diagonal blocks that are copies of other   */
+/* off-diagonal blocks.                                        */
+/*                                                             */
+/* if surface ns is a mate of surface nsm (Mate[ns]=nsm) then  */
+/* both were read from the same mesh, and their vertices (in   */
+/* the original mesh coordinates) are mapped to their current  */
+/* positions by rigid transformations Cns, Cnsm. the block     */
+/* (nsa,nsb) of the BEM matrix is unchanged by a rigid motion  */
+/* applied to both surfaces at once, so it depends only on the */
+/* mesh files of the two surfaces, the regions they bound, and */
+/* the relative transformation Cnsa^{-1} * Cnsb. two blocks    */
+/* that agree in all of these are identical, and a block that  */
+/* agrees with the mirror image (nsb,nsa) of another block is  */
+/* the transpose of that block, since the matrix is symmetric. */
+/***************************************************************/
+#define RTOL 1.0e-10
+static GTransformation GetMeshTransformation(RWGSurface *S)
+{
+  GTransformation C;
+  if (S->OTGT) C=*(S->OTGT);
+  if (S->GT) C.Transform(S->GT);
+  return C;
+}
+
+static bool SameTransformation(GTransformation *A, GTransformation *B, double Tol)
+{
+  for(int i=0; i<3; i++)
+   { if ( fabs(A->DX[i] - B->DX[i]) > Tol )
+      return false;
+     for(int j=0; j<3; j++)
+      if ( fabs(A->M[i][j] - B->M[i][j]) > RTOL )
+       return false;
+   };
+  return true;
+}
+
+/***************************************************************/
+/* returns true if the vertices of S are exactly those of SM   */
+/* carried through the inverse of CM and then through C, i.e.  */
+/* if S and its mate SM really are rigidly-transformed copies  */
+/* of the same mesh.                                           */
+/***************************************************************/
+static bool IsRigidCopy(RWGSurface *S, GTransformation *C,
+                        RWGSurface *SM, GTransformation *CM)
+{
+  if (S->NumVertices!=SM->NumVertices || S->NumBFs!=SM->NumBFs)
+   return false;
+  double Tol = RTOL + fmax(S->tolVecClose, SM->tolVecClose);
+  for(int nv=0; nv<S->NumVertices; nv++)
+   { double X[3];
+     CM->UnApply(SM->Vertices + 3*nv, X);
+     C->Apply(X);
+     if ( VecDistance(X, S->Vertices + 3*nv) > Tol )
+      return false;
+   };
+  return true;
+}
+
+typedef struct BlockCopy
+ { int nsa, nsb;        // destination block
+   int nsaSrc, nsbSrc;  // block it is copied from
+   bool Transpose;
+ } BlockCopy;
+
+/***************************************************************/
+/* the source block (nsaSrc, nsbSrc) must already have been    */
+/* computed and stored in the upper triangle of M.             */
+/***************************************************************/
+static void CopyBEMMatrixBlock(RWGGeometry *G, HMatrix *M, BlockCopy *BC)
+{
+  int RowOffset    = G->BFIndexOffset[BC->nsa];
+  int ColOffset    = G->BFIndexOffset[BC->nsb];
+  int SrcRowOffset = G->BFIndexOffset[BC->nsaSrc];
+  int SrcColOffset = G->BFIndexOffset[BC->nsbSrc];
+  int NRB          = G->Surfaces[BC->nsa]->NumBFs;
+  int NCB          = G->Surfaces[BC->nsb]->NumBFs;
+
+  if (!BC->Transpose)
+   { M->InsertBlock(M, RowOffset, ColOffset, NRB, NCB, SrcRowOffset, SrcColOffset);
+     return;
+   };
+
+  for(int nr=0; nr<NRB; nr++)
+   for(int nc=0; nc<NCB; nc++)
+    M->SetEntry(RowOffset+nr, ColOffset+nc, M->GetEntry(SrcRowOffset+nc, SrcColOffset+nr));
+}
+
 /***************************************************************/
 /* this is the actual API-exposed routine for assembling the   */
 /* BEM matrix, which is pretty simple and really just calls    */
@@ -774,25 +904,177 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
 
   /***************************************************************/
   /* loop over all pairs of objects to assemble the diagonal and */
-  /* above-diagonal blocks of the matrix                         */
+  /* above-diagonal blocks of the matrix. for compact geometries */
+  /* all blocks that need to be computed are collected and       */
+  /* computed together as one batch of parallel tasks; diagonal  */
+  /* blocks of surfaces with mates, and off-diagonal blocks that */
+  /* are rigidly-displaced copies of other off-diagonal blocks,  */
+  /* are copied in afterwards.                                   */
   /***************************************************************/
   int nsm; // 'number of surface mate'
   int nspStart = MatrixIsSymmetric ? 1 : 0;
-  for(int ns=0; ns<NumSurfaces; ns++)
-   for(int nsp=nspStart*ns; nsp<NumSurfaces; nsp++)
-    { 
-      // attempt to reuse the diagonal block of an identical previous object
-      if (ns==nsp && (nsm=Mate[ns])!=-1)
+  if (LBasis==0)
+   { 
+     int MaxBlocks = NumSurfaces*(NumSurfaces+1)/2;
+     GetSSIArgStruct *ArgsBuffer = new GetSSIArgStruct[MaxBlocks];
+     GetSSIArgStruct **ArgsList  = new GetSSIArgStruct *[MaxBlocks];
+     int NumBlocks=0;
+
+     /*--------------------------------------------------------------*/
+     /*- Root[ns] is the first surface of which ns is a rigid copy,  */
+     /*- or -1 if off-diagonal blocks involving ns are not to be     */
+     /*- reused                                                      */
+     /*--------------------------------------------------------------*/
+     int *Root=0;
+     GTransformation *C=0, *Rel=0;
+     BlockCopy *Copies=0;
+     int NumCopies=0, NumSources=0;
+     int *SourceA=0, *SourceB=0;
+     if (ReuseMateBlocks && NumSurfaces>2)
+      { Root    = new int[NumSurfaces];
+        C       = new GTransformation[NumSurfaces];
+        Rel     = new GTransformation[MaxBlocks];
+        Copies  = new BlockCopy[MaxBlocks];
+        SourceA = new int[MaxBlocks];
+        SourceB = new int[MaxBlocks];
+        for(int ns=0; ns<NumSurfaces; ns++)
+         { C[ns]=GetMeshTransformation(Surfaces[ns]);
+           Root[ns] = (Mate[ns]==-1) ? ns : Mate[ns];
+           if ( Root[ns]!=ns && !IsRigidCopy(Surfaces[ns], C+ns, Surfaces[Root[ns]], C+Root[ns]) )
+            Root[ns]=-1;
+         };
+      };
+
+     for(int ns=0; ns<NumSurfaces; ns++)
+      for(int nsp=ns; nsp<NumSurfaces; nsp++)
+       { 
+         if ( ns==nsp && Mate[ns]!=-1 ) 
+          continue;
+         if (    ns==nsp 
+              && TBlockCacheOp(TBCOP_READ, this, ns, Omega, kBloch, M,
+                               BFIndexOffset[ns], BFIndexOffset[ns])
+            ) continue;
+
+         /*--------------------------------------------------------------*/
+         /*- look for an identical block among those already scheduled  */
+         /*--------------------------------------------------------------*/
+         if ( Root && ns!=nsp && Root[ns]!=-1 && Root[nsp]!=-1 )
+          { 
+            GTransformation RelTF=C[nsp], RelTB=C[ns];
+            RelTF.Transform(C[ns].Inverse());  // Cns^{-1} * Cnsp
+            RelTB.Transform(C[nsp].Inverse()); // Cnsp^{-1} * Cns
+            double Tol=fmax(Surfaces[ns]->tolVecClose, Surfaces[nsp]->tolVecClose);
+            int *RIa=Surfaces[ns]->RegionIndices, *RIb=Surfaces[nsp]->RegionIndices;
+            BlockCopy *BC=Copies + NumCopies;
+            bool Found=false;
+            for(int nb=0; nb<NumSources && !Found; nb++)
+             { int a=SourceA[nb], b=SourceB[nb];
+               int *RIsa=Surfaces[a]->RegionIndices, *RIsb=Surfaces[b]->RegionIndices;
+               if (    Root[a]==Root[ns] && Root[b]==Root[nsp]
+                    && RIsa[0]==RIa[0] && RIsa[1]==RIa[1]
+                    && RIsb[0]==RIb[0] && RIsb[1]==RIb[1]
+                    && SameTransformation(Rel+nb, &RelTF, Tol)
+                  ) { Found=true; BC->Transpose=false; }
+               else if (    Root[a]==Root[nsp] && Root[b]==Root[ns]
+                         && RIsa[0]==RIb[0] && RIsa[1]==RIb[1]
+                         && RIsb[0]==RIa[0] && RIsb[1]==RIa[1]
+                         && SameTransformation(Rel+nb, &RelTB, Tol)
+                       ) { Found=true; BC->Transpose=true; }
+               if (Found)
+                { BC->nsa=ns;    BC->nsb=nsp;
+                  BC->nsaSrc=a;  BC->nsbSrc=b;
+                };
+             };
+            if (Found)
+             { NumCopies++;
+               continue;
+             };
+            SourceA[NumSources]=ns;
+            SourceB[NumSources]=nsp;
+            Rel[NumSources++]=RelTF;
+          };
+
+         if (LogLevel>=SCUFF_VERBOSELOGGING)
+          Log("Assembling BEM matrix block (%i,%i)",ns,nsp);
+
+         GetSSIArgStruct *Args = ArgsList[NumBlocks] = ArgsBuffer + NumBlocks;
+         NumBlocks++;
+         InitGetSSIArgs(Args);
+         Args->G=this;
+         Args->Sa=Surfaces[ns];
+         Args->Sb=Surfaces[nsp];
+         Args->Omega=Omega;
+         Args->Symmetric = (ns==nsp);
+         Args->B=M;
+         Args->RowOffset=BFIndexOffset[ns];
+         Args->ColOffset=BFIndexOffset[nsp];
+       };
+
+     GetSurfaceSurfaceInteractions(ArgsList, NumBlocks);
+
+     for(int nb=0; nb<NumBlocks; nb++)
+      if (ArgsList[nb]->Sa == ArgsList[nb]->Sb)
+       TBlockCacheOp(TBCOP_WRITE, this, ArgsList[nb]->Sa->Index, Omega, kBloch, M, 
+                     ArgsList[nb]->RowOffset, ArgsList[nb]->RowOffset);
+
+     delete[] ArgsList;
+     delete[] ArgsBuffer;
+
+     for(int nc=0; nc<NumCopies; nc++)
+      { BlockCopy *BC=Copies + nc;
+        if (LogLevel>=SCUFF_VERBOSELOGGING)
+         Log("Block(%i,%i) is identical to block (%i,%i)%s (reusing)",
+              BC->nsa,BC->nsb,BC->nsaSrc,BC->nsbSrc,BC->Transpose ? "^T" : "");
+        CopyBEMMatrixBlock(this, M, BC);
+      };
+     if (NumCopies>0)
+      Log("Reused %i of %i off-diagonal BEM matrix blocks",
+           NumCopies, NumCopies+NumSources);
+
+     if (Root)
+      { delete[] Root;
+        delete[] C;
+        delete[] Rel;
+        delete[] Copies;
+        delete[] SourceA;
+        delete[] SourceB;
+      };
+
+     for(int ns=0; ns<NumSurfaces; ns++)
+      if ( (nsm=Mate[ns])!=-1 )
        { int ThisOffset = BFIndexOffset[ns];
          int MateOffset = BFIndexOffset[nsm];
          int Dim = Surfaces[ns]->NumBFs;
          Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
          M->InsertBlock(M, ThisOffset, ThisOffset, Dim, Dim, MateOffset, MateOffset);
-       }
-      else
-       AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, M, 0,
-                              BFIndexOffset[ns], BFIndexOffset[nsp]);
-    };
+       };
+   }
+  else
+   /*--------------------------------------------------------------*/
+   /*- periodic geometries are excluded from the batching above:   */
+   /*- each surface pair is assembled on its own, and only the (up */
+   /*- to 9) innermost-cell blocks of that one pair share a batch  */
+   /*- of parallel tasks (see AssembleBEMMatrixBlock). batching    */
+   /*- all pairs at once would need temporary storage for all of   */
+   /*- their cell blocks simultaneously, i.e. up to 9 times the    */
+   /*- size of the whole BEM matrix, and the outer-cell step needs */
+   /*- a separate interpolation table for each pair.               */
+   /*--------------------------------------------------------------*/
+   for(int ns=0; ns<NumSurfaces; ns++)
+    for(int nsp=nspStart*ns; nsp<NumSurfaces; nsp++)
+     { 
+       // attempt to reuse the diagonal block of an identical previous object
+       if (ns==nsp && (nsm=Mate[ns])!=-1)
+        { int ThisOffset = BFIndexOffset[ns];
+          int MateOffset = BFIndexOffset[nsm];
+          int Dim = Surfaces[ns]->NumBFs;
+          Log("Block(%i,%i) is identical to block (%i,%i) (reusing)",ns,ns,nsm,nsm);
+          M->InsertBlock(M, ThisOffset, ThisOffset, Dim, Dim, MateOffset, MateOffset);
+        }
+       else
+        AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, M, 0,
+                               BFIndexOffset[ns], BFIndexOffset[nsp]);
+     };
 
   /***************************************************************/
   /* if the matrix is symmetric, then the computations above have*/
@@ -805,14 +1087,13 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
   /* slightly redundant because it re-fills-in those entries.    */
   /***************************************************************/
   if (MatrixIsSymmetric && M->StorageType==LHM_NORMAL)
-   { 
-     for(int nr=1; nr<TotalBFs; nr++)
-      for(int nc=0; nc<nr; nc++)
-       M->SetEntry(nr, nc, M->GetEntry(nc, nr) );
-   };
+   FillLowerTriangle(M);
 
   if (UseHRWGFunctions && NumMMJs>0 )
-   ApplyMMJTransformation(M, 0);
+   { if (M->StorageType!=LHM_NORMAL)
+      ErrExit("%s:%i: packed BEM matrices are incompatible with multi-material junctions",__FILE__,__LINE__);
+     ApplyMMJTransformation(M, 0);
+   };
 
   return M;
 
@@ -837,4 +1118,86 @@ HMatrix *RWGGeometry::AllocateBEMMatrix(bool PureImagFreq, bool Packed)
     
 }
 
+/***************************************************************/
+/* Assemble the BEM matrix in distributed (block-cyclic) form. */
+/* Each rank computes matrix elements only for those pairs of  */
+/* edges whose basis functions have rows and columns in its    */
+/* own tiles of the matrix.                                    */
+/***************************************************************/
+DHMatrix *RWGGeometry::AssembleDistributedBEMMatrix(cdouble Omega, DHMatrix *M,
+                                                    int BlockSize)
+{ 
+  if (LBasis!=0)
+   ErrExit("%s:%i: distributed BEM matrices are not available for periodic geometries",__FILE__,__LINE__);
+  if (UseHRWGFunctions && NumMMJs>0)
+   ErrExit("%s:%i: distributed BEM matrices are not available with multi-material junctions",__FILE__,__LINE__);
+  for(int ns=0; ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: distributed BEM matrices are not available with surface impedances",__FILE__,__LINE__);
+
+  if (M==NULL)
+   M=new DHMatrix(TotalBFs, TotalBFs, BlockSize);
+  else if ( M->NR != TotalBFs || M->NC != TotalBFs )
+   { Warn("wrong-size matrix passed to AssembleDistributedBEMMatrix; reallocating...");
+     M=new DHMatrix(TotalBFs, TotalBFs, BlockSize);
+   };
+
+  Log("Assembling distributed BEM matrix at Omega=%s",z2s(Omega));
+  UpdateCachedEpsMuValues(Omega);
+  M->Zero();
+
+  /*--------------------------------------------------------------*/
+  /*- make lists of the (global indices of) edges whose basis     */
+  /*- functions have rows or columns stored on this rank. the     */
+  /*- basis functions of each edge are consecutive, so duplicates */
+  /*- can only occur in adjacent positions.                       */
+  /*--------------------------------------------------------------*/
+  int *RowEdges = (int *)mallocEC(M->LocalNR*sizeof(int));
+  int *ColEdges = (int *)mallocEC(M->LocalNC*sizeof(int));
+  int NumRowEdges=0, NumColEdges=0;
+  for(int nrl=0; nrl<M->LocalNR; nrl++)
+   { int ns, ne;
+     ResolveBF(M->GlobalRow(nrl), &ns, &ne);
+     int neFull = EdgeIndexOffset[ns] + ne;
+     if ( NumRowEdges==0 || RowEdges[NumRowEdges-1]!=neFull )
+      RowEdges[NumRowEdges++]=neFull;
+   };
+  for(int ncl=0; ncl<M->LocalNC; ncl++)
+   { int ns, ne;
+     ResolveBF(M->GlobalCol(ncl), &ns, &ne);
+     int neFull = EdgeIndexOffset[ns] + ne;
+     if ( NumColEdges==0 || ColEdges[NumColEdges-1]!=neFull )
+      ColEdges[NumColEdges++]=neFull;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- compute and store the locally-owned matrix elements --------*/
+  /*--------------------------------------------------------------*/
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nra=0; nra<NumRowEdges; nra++)
+   { int nsa, nea, RowOffset;
+     ResolveEdge(RowEdges[nra], &nsa, &nea, &RowOffset);
+     int NBFA = Surfaces[nsa]->IsPEC ? 1 : 2;
+     for(int ncb=0; ncb<NumColEdges; ncb++)
+      { int nsb, neb, ColOffset;
+        ResolveEdge(ColEdges[ncb], &nsb, &neb, &ColOffset);
+        int NBFB = Surfaces[nsb]->IsPEC ? 1 : 2;
+
+        cdouble MEs[4];
+        GetBEMMatrixElements(this, nsa, nea, nsb, neb, Omega, MEs);
+        for(int i=0; i<NBFA; i++)
+         for(int j=0; j<NBFB; j++)
+          if ( M->IsLocal(RowOffset+i, ColOffset+j) )
+           M->SetEntry(RowOffset+i, ColOffset+j, MEs[i*NBFB + j]);
+      };
+   };
+
+  free(RowEdges);
+  free(ColEdges);
+  return M;
+}
+
 } // namespace scuff
@@ -153,8 +153,9 @@ static void InnerProductIntegrand(double *X, void *opIPID, double *F)
 
   /* get incident E and H fields at X */
   cdouble dEH[6], EH[6];
-  memset(EH, 0, 6*sizeof(cdouble));
   int n, nif;
+  for(n=0; n<6; n++) 
+   EH[n]=0.0;
   for(nif=0; nif<IPID->NPositiveIFs; nif++)
    { IPID->PositiveIFs[nif]->GetFields(X,dEH);
      for(n=0; n<6; n++) 
@@ -427,6 +428,88 @@ HVector *RWGGeometry::AssembleRHSVector(cdouble Omega, double *kBloch,
 HVector *RWGGeometry::AssembleRHSVector(cdouble Omega, IncField *IF, HVector *RHS)
 { return AssembleRHSVector(Omega, 0, IF, RHS); }
 
+/***************************************************************/
+/* Assemble RHS vectors for several incident fields at once.   */
+/*                                                             */
+/* On return, column #nif of RHSMatrix is the RHS vector for   */
+/* the incident field IFs[nif] (which may itself be the head   */
+/* of a chain of IncFields). The resulting matrix can be       */
+/* passed directly to HMatrix::LUSolve() to solve for all      */
+/* incident fields in a single (BLAS-3) call.                  */
+/*                                                             */
+/* If RHSMatrix is NULL on entry, a new HMatrix of the         */
+/* appropriate size is allocated and returned.                 */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleRHSVector(cdouble Omega, double *kBloch,
+                                        IncField **IFs, int NumIFs,
+                                        HMatrix *RHSMatrix)
+{ 
+  if (RHSMatrix==NULL)
+   RHSMatrix=new HMatrix(TotalBFs, NumIFs, LHM_COMPLEX);
+  else if ( RHSMatrix->NR!=TotalBFs || RHSMatrix->NC<NumIFs )
+   { Warn("wrong-size matrix passed to AssembleRHSVector; reallocating...");
+     RHSMatrix=new HMatrix(TotalBFs, NumIFs, LHM_COMPLEX);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- wrap each column of RHSMatrix in an HVector ----------------*/
+  /*--------------------------------------------------------------*/
+  HVector **RHSColumns = new HVector *[NumIFs];
+  int *NIFs = new int[NumIFs];
+  for(int nif=0; nif<NumIFs; nif++)
+   { RHSColumns[nif] = new HVector(TotalBFs, RHSMatrix->RealComplex,
+                                   RHSMatrix->GetColumnPointer(nif));
+     RHSColumns[nif]->Zero();
+     NIFs[nif]=UpdateIncFields(IFs[nif], Omega, kBloch);
+   };
+
+#ifdef USE_PTHREAD
+  for(int nif=0; nif<NumIFs; nif++)
+   AssembleRHSVector(Omega, kBloch, IFs[nif], RHSColumns[nif]);
+#else
+  /*--------------------------------------------------------------*/
+  /*- a single parallel loop over (incident field, task) pairs    */
+  /*--------------------------------------------------------------*/
+  int NumThreads = GetNumThreads();
+#ifndef USE_OPENMP
+  int NumTasks=1;
+#else
+  int NumTasks=NumThreads*100;
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumIFs*NumTasks; n++)
+   { 
+     int nif = n / NumTasks;
+     ThreadData TD1;
+     TD1.G        = this;
+     TD1.IF       = IFs[nif];
+     TD1.NIF      = NIFs[nif];
+     TD1.RHS      = RHSColumns[nif];
+     TD1.nt       = n % NumTasks;
+     TD1.NumTasks = NumTasks;
+     AssembleRHS_Thread((void *)&TD1);
+   };
+
+  if (UseHRWGFunctions && NumMMJs>0 )
+   for(int nif=0; nif<NumIFs; nif++)
+    ApplyMMJTransformation(0, RHSColumns[nif]);
+#endif
+
+  for(int nif=0; nif<NumIFs; nif++)
+   delete RHSColumns[nif];
+  delete[] RHSColumns;
+  delete[] NIFs;
+
+  return RHSMatrix;
+}
+
+/***************************************************************/
+/* non-PBC entry point for the multi-RHS version               */
+/***************************************************************/
+HMatrix *RWGGeometry::AssembleRHSVector(cdouble Omega, IncField **IFs, int NumIFs,
+                                        HMatrix *RHSMatrix)
+{ return AssembleRHSVector(Omega, 0, IFs, NumIFs, RHSMatrix); }
+
 /***************************************************************/
 /* Allocate an RHS vector of the appropriate size. *************/
 /***************************************************************/
@@ -0,0 +1,289 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * BEMBlockInterpolator.cc -- frequency interpolation of BEM matrix
+ *                         -- blocks for dense frequency sweeps
+ *
+ * The block is assembled exactly at the NumAnchors Chebyshev nodes
+ *
+ *  Omega_j = OmegaMid + OmegaHalfWidth * t_j,
+ *  t_j     = cos( pi*(j+1/2)/NumAnchors ),   j=0,...,NumAnchors-1
+ *
+ * and each entry, phase-extracted and multiplied by Omega to remove
+ * the 1/Omega pole of the scalar-potential terms, is represented by
+ * its Chebyshev series  f(t) = sum_k c_k T_k(t), whose coefficients are computed
+ * from the anchor values by a discrete cosine transform.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "libscuff.h"
+
+#define II cdouble(0.0,1.0)
+
+namespace scuff {
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BEMBlockInterpolator::BEMBlockInterpolator(RWGGeometry *pG, int pnsa, int pnsb,
+                                           cdouble pOmegaMin, cdouble pOmegaMax,
+                                           int pNumAnchors, double *pkBloch)
+{
+  G=pG;
+  nsa=pnsa;
+  nsb=pnsb;
+  NBFA=G->Surfaces[nsa]->NumBFs;
+  NBFB=G->Surfaces[nsb]->NumBFs;
+  OmegaMin=pOmegaMin;
+  OmegaMax=pOmegaMax;
+  NumAnchors=pNumAnchors;
+  if (NumAnchors<2)
+   ErrExit("%s:%i: BEMBlockInterpolator needs at least 2 anchor frequencies",__FILE__,__LINE__);
+  if (OmegaMin==OmegaMax)
+   ErrExit("%s:%i: empty frequency interval in BEMBlockInterpolator",__FILE__,__LINE__);
+
+  HavekBloch = (pkBloch!=0);
+  kBloch[0] = pkBloch ? pkBloch[0] : 0.0;
+  kBloch[1] = (pkBloch && G->LDim>1) ? pkBloch[1] : 0.0;
+  ErrorEstimate=0.0;
+
+  /*--------------------------------------------------------------*/
+  /*- phase extraction is only done for blocks coupling distinct  */
+  /*- surfaces through a single common region, and not for        */
+  /*- periodic geometries, where there is no single distance R    */
+  /*--------------------------------------------------------------*/
+  PhaseRegion=-1;
+  Distances=0;
+  int CommonRegionIndices[2];
+  double Signs[2];
+  if (    nsa!=nsb && !HavekBloch
+       && CountCommonRegions(G->Surfaces[nsa], G->Surfaces[nsb],
+                             CommonRegionIndices, Signs)==1
+     )
+   { PhaseRegion=CommonRegionIndices[0];
+     RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+     Distances=(double *)mallocEC(((size_t)NBFA)*NBFB*sizeof(double));
+     int BFsPerEdgeA = Sa->IsPEC ? 1 : 2;
+     int BFsPerEdgeB = Sb->IsPEC ? 1 : 2;
+     for(int nbfb=0; nbfb<NBFB; nbfb++)
+      for(int nbfa=0; nbfa<NBFA; nbfa++)
+       Distances[nbfa + ((size_t)NBFA)*nbfb]
+        = VecDistance( Sa->Edges[nbfa/BFsPerEdgeA]->Centroid,
+                       Sb->Edges[nbfb/BFsPerEdgeB]->Centroid );
+   };
+
+  size_t BlockSize = ((size_t)NBFA)*NBFB;
+  Coefficients=(cdouble *)mallocEC(NumAnchors*BlockSize*sizeof(cdouble));
+  HaveAnchor=(bool *)mallocEC(NumAnchors*sizeof(bool));
+  CoefficientsValid=false;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BEMBlockInterpolator::~BEMBlockInterpolator()
+{
+  if (Distances) free(Distances);
+  free(Coefficients);
+  free(HaveAnchor);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+cdouble BEMBlockInterpolator::GetAnchor(int na)
+{
+  double t = cos( M_PI*(na+0.5)/NumAnchors );
+  return 0.5*(OmegaMax+OmegaMin) + 0.5*t*(OmegaMax-OmegaMin);
+}
+
+/***************************************************************/
+/* wavenumber used for phase extraction. MatProps may be       */
+/* temporarily zeroed by callers assembling partial blocks, so */
+/* we look through that to get the actual material properties. */
+/***************************************************************/
+cdouble BEMBlockInterpolator::GetPhaseWavenumber(cdouble Omega)
+{
+  MatProp *MP=G->RegionMPs[PhaseRegion];
+  int SaveZeroed=MP->Zeroed;
+  MP->UnZero();
+  cdouble Eps, Mu;
+  MP->GetEpsMu(Omega, &Eps, &Mu);
+  MP->Zeroed=SaveZeroed;
+  return sqrt(Eps*Mu)*Omega;
+}
+
+/***************************************************************/
+/* store the block assembled at anchor frequency #na; the      */
+/* anchor values are stored in the slots that will later hold  */
+/* the Chebyshev coefficients.                                 */
+/***************************************************************/
+void BEMBlockInterpolator::SetAnchorBlock(int na, HMatrix *Block)
+{
+  if (Block->NR!=NBFA || Block->NC!=NBFB || Block->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: wrong-size block passed to SetAnchorBlock",__FILE__,__LINE__);
+
+  size_t BlockSize = ((size_t)NBFA)*NBFB;
+  cdouble *Values = Coefficients + na*BlockSize;
+  cdouble Omega = GetAnchor(na);
+  cdouble k = (PhaseRegion==-1) ? 0.0 : GetPhaseWavenumber(Omega);
+  for(int nbfb=0; nbfb<NBFB; nbfb++)
+   for(int nbfa=0; nbfa<NBFA; nbfa++)
+    { size_t Index = nbfa + ((size_t)NBFA)*nbfb;
+      cdouble Value = Omega*Block->GetEntry(nbfa, nbfb);
+      if (Distances)
+       Value *= exp(-II*k*Distances[Index]);
+      Values[Index] = Value;
+    };
+
+  HaveAnchor[na]=true;
+  CoefficientsValid=false;
+}
+
+/***************************************************************/
+/* assemble the block at all anchor frequencies ****************/
+/***************************************************************/
+void BEMBlockInterpolator::AssembleAnchors()
+{
+  HMatrix *Block=new HMatrix(NBFA, NBFB, LHM_COMPLEX);
+  for(int na=0; na<NumAnchors; na++)
+   { cdouble Omega=GetAnchor(na);
+     Log("Assembling BEM block (%i,%i) at anchor frequency %s (%i/%i)",
+          nsa,nsb,z2s(Omega),na+1,NumAnchors);
+     G->AssembleBEMMatrixBlock(nsa, nsb, Omega, HavekBloch ? kBloch : 0, Block);
+     SetAnchorBlock(na, Block);
+   };
+  delete Block;
+}
+
+/***************************************************************/
+/* convert anchor values to Chebyshev coefficients in place:   */
+/*  c_k = (2/N) sum_j f(t_j) cos(pi*k*(j+1/2)/N) (c_0 halved)  */
+/* and estimate the interpolation error from the size of the   */
+/* last two coefficients relative to that of the whole series. */
+/***************************************************************/
+void BEMBlockInterpolator::ComputeCoefficients()
+{
+  for(int na=0; na<NumAnchors; na++)
+   if (!HaveAnchor[na])
+    ErrExit("%s:%i: block (%i,%i) missing at anchor frequency %i",__FILE__,__LINE__,nsa,nsb,na);
+
+  int N=NumAnchors;
+  double *CosTable=new double[N*N];
+  for(int k=0; k<N; k++)
+   for(int j=0; j<N; j++)
+    CosTable[k*N+j] = (k==0 ? 1.0 : 2.0) * cos(M_PI*k*(j+0.5)/N) / N;
+
+  size_t BlockSize = ((size_t)NBFA)*NBFB;
+  double TailNorm2=0.0, TotalNorm2=0.0;
+#ifdef USE_OPENMP
+#pragma omp parallel
+#endif
+  { 
+    cdouble *f=new cdouble[N];
+#ifdef USE_OPENMP
+#pragma omp for reduction(+:TailNorm2,TotalNorm2)
+#endif
+    for(size_t Index=0; Index<BlockSize; Index++)
+     { for(int j=0; j<N; j++)
+        f[j]=Coefficients[j*BlockSize + Index];
+       for(int k=0; k<N; k++)
+        { cdouble c=0.0;
+          for(int j=0; j<N; j++)
+           c += CosTable[k*N+j]*f[j];
+          Coefficients[k*BlockSize + Index]=c;
+          TotalNorm2 += norm(c);
+          if (k>=N-2) TailNorm2 += norm(c);
+        };
+     };
+    delete[] f;
+  };
+  delete[] CosTable;
+
+  ErrorEstimate = (TotalNorm2==0.0) ? 0.0 : sqrt(TailNorm2/TotalNorm2);
+  CoefficientsValid=true;
+  Log("BEM block (%i,%i): %i-point frequency interpolation, estimated relative error %.1e",
+       nsa,nsb,N,ErrorEstimate);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool BEMBlockInterpolator::Contains(cdouble Omega)
+{
+  cdouble t = 2.0*(Omega-OmegaMin)/(OmegaMax-OmegaMin) - 1.0;
+  return fabs(imag(t))<1.0e-8 && fabs(real(t))<=1.0+1.0e-8;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double BEMBlockInterpolator::GetBlock(cdouble Omega, HMatrix *Block,
+                                      int RowOffset, int ColOffset)
+{
+  if (!Contains(Omega))
+   ErrExit("%s:%i: frequency (%g,%g) outside interpolation interval [(%g,%g),(%g,%g)]",
+            __FILE__,__LINE__,real(Omega),imag(Omega),
+            real(OmegaMin),imag(OmegaMin),real(OmegaMax),imag(OmegaMax));
+  if (!CoefficientsValid)
+   ComputeCoefficients();
+
+  /*--------------------------------------------------------------*/
+  /*- T_k(t) by the three-term recurrence ------------------------*/
+  /*--------------------------------------------------------------*/
+  int N=NumAnchors;
+  double t = real( 2.0*(Omega-OmegaMin)/(OmegaMax-OmegaMin) - 1.0 );
+  double *T=new double[N];
+  T[0]=1.0;
+  T[1]=t;
+  for(int k=2; k<N; k++)
+   T[k] = 2.0*t*T[k-1] - T[k-2];
+
+  size_t BlockSize = ((size_t)NBFA)*NBFB;
+  cdouble k = (PhaseRegion==-1) ? 0.0 : GetPhaseWavenumber(Omega);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+  for(int nbfb=0; nbfb<NBFB; nbfb++)
+   for(int nbfa=0; nbfa<NBFA; nbfa++)
+    { size_t Index = nbfa + ((size_t)NBFA)*nbfb;
+      cdouble Value=0.0;
+      for(int n=0; n<N; n++)
+       Value += T[n]*Coefficients[n*BlockSize + Index];
+      if (Distances)
+       Value *= exp(II*k*Distances[Index]);
+      Block->SetEntry(RowOffset+nbfa, ColOffset+nbfb, Value/Omega);
+    };
+
+  delete[] T;
+  return ErrorEstimate;
+}
+
+} // namespace scuff
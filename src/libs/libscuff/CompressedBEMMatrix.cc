@@ -0,0 +1,681 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrix.cc -- hierarchical storage of the BEM matrix, with
+ *                        -- far-field blocks compressed by adaptive
+ *                        -- cross approximation (ACA)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+/***************************************************************/
+/* record used to sort edges along a coordinate axis           */
+/***************************************************************/
+typedef struct EdgeSortRecord
+ { double x;
+   int ns, ne;
+ } EdgeSortRecord;
+
+static int CompareEdgeSortRecords(const void *p1, const void *p2)
+{
+  double x1=((const EdgeSortRecord *)p1)->x;
+  double x2=((const EdgeSortRecord *)p2)->x;
+  return (x1<x2) ? -1 : (x1>x2) ? 1 : 0;
+}
+
+/***************************************************************/
+/* two clusters are well-separated ('admissible') if the       */
+/* smaller of their diameters is no larger than Eta times the  */
+/* distance between their bounding spheres                     */
+/***************************************************************/
+static bool IsAdmissible(CBMCluster *CA, CBMCluster *CB, double Eta)
+{
+  double Dist = VecDistance(CA->Center, CB->Center) - CA->Radius - CB->Radius;
+  if (Dist<=0.0)
+   return false;
+  double MinDiam = 2.0*fmin(CA->Radius, CB->Radius);
+  return MinDiam <= Eta*Dist;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+CompressedBEMMatrix::CompressedBEMMatrix(RWGGeometry *pG, double pACATol,
+                                         int pLeafSize, double pEta,
+                                         int pSolver)
+{
+  G=pG;
+
+  if (G->LDim!=0)
+   ErrExit("%s:%i: compressed BEM matrices are not available for periodic geometries",__FILE__,__LINE__);
+  if (RWGGeometry::UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("%s:%i: compressed BEM matrices are not available with multi-material junctions",__FILE__,__LINE__);
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: compressed BEM matrices are not available with surface impedances",__FILE__,__LINE__);
+
+  N=G->TotalBFs;
+  ACATol=pACATol;
+  LeafSize=pLeafSize;
+  Eta=pEta;
+
+  SolverTol=1.0e-6;
+  MaxIters=1000;
+  Restart=200;
+  Solver=pSolver;
+
+  EdgeSurfaces = (int *)mallocEC(G->TotalEdges*sizeof(int));
+  EdgeIndices  = (int *)mallocEC(G->TotalEdges*sizeof(int));
+
+  NumClusters=MaxClusters=0;
+  Clusters=0;
+  NumBlocks=MaxBlocks=0;
+  Blocks=0;
+  Factorized=false;
+  LUFactors=0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+CompressedBEMMatrix::~CompressedBEMMatrix()
+{
+  ClearBlocks();
+  free(Blocks);
+
+  for(int nc=0; nc<NumClusters; nc++)
+   { free(Clusters[nc].BFIndices);
+     free(Clusters[nc].BFEdges);
+     free(Clusters[nc].BFSubIndices);
+   };
+  free(Clusters);
+
+  free(EdgeSurfaces);
+  free(EdgeIndices);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::ClearBlocks()
+{
+  for(int nb=0; nb<NumBlocks; nb++)
+   { CBMBlock *B=Blocks + nb;
+     if (B->D)  delete B->D;
+     if (B->U)  delete B->U;
+     if (B->V)  delete B->V;
+     if (B->LU) delete B->LU;
+   };
+  NumBlocks=0;
+  Factorized=false;
+  ClearLUFactors();
+}
+
+/***************************************************************/
+/* add a new cluster comprising the edges in the range         */
+/* [EdgeStart, EdgeStart+NumEdges) of the reordered edge list, */
+/* then recursively bisect it (after reordering the edges      */
+/* along the longest axis of their bounding box) until the     */
+/* clusters contain no more than LeafSize edges.               */
+/* the return value is the index of the new cluster.           */
+/***************************************************************/
+int CompressedBEMMatrix::AddCluster(int EdgeStart, int NumEdges)
+{
+  if (NumClusters==MaxClusters)
+   { MaxClusters = (MaxClusters==0) ? 64 : 2*MaxClusters;
+     Clusters=(CBMCluster *)reallocEC(Clusters, MaxClusters*sizeof(CBMCluster));
+   };
+  int nc=NumClusters++;
+
+  /*--------------------------------------------------------------*/
+  /*- bounding box of edge centroids -----------------------------*/
+  /*--------------------------------------------------------------*/
+  double XMin[3], XMax[3];
+  for(int i=0; i<3; i++)
+   { XMin[i]=HUGE_VAL; XMax[i]=-HUGE_VAL; };
+  for(int n=EdgeStart; n<EdgeStart+NumEdges; n++)
+   { double *X=G->Surfaces[EdgeSurfaces[n]]->Edges[EdgeIndices[n]]->Centroid;
+     for(int i=0; i<3; i++)
+      { XMin[i]=fmin(XMin[i],X[i]);
+        XMax[i]=fmax(XMax[i],X[i]);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort edges along the longest axis if we will be bisecting  -*/
+  /*--------------------------------------------------------------*/
+  bool IsLeaf = (NumEdges<=LeafSize);
+  if (!IsLeaf)
+   { int Axis=0;
+     for(int i=1; i<3; i++)
+      if ( (XMax[i]-XMin[i]) > (XMax[Axis]-XMin[Axis]) )
+       Axis=i;
+     EdgeSortRecord *ESRs=(EdgeSortRecord *)mallocEC(NumEdges*sizeof(EdgeSortRecord));
+     for(int n=0; n<NumEdges; n++)
+      { ESRs[n].ns = EdgeSurfaces[EdgeStart+n];
+        ESRs[n].ne = EdgeIndices[EdgeStart+n];
+        ESRs[n].x  = G->Surfaces[ESRs[n].ns]->Edges[ESRs[n].ne]->Centroid[Axis];
+      };
+     qsort(ESRs, NumEdges, sizeof(EdgeSortRecord), CompareEdgeSortRecords);
+     for(int n=0; n<NumEdges; n++)
+      { EdgeSurfaces[EdgeStart+n] = ESRs[n].ns;
+        EdgeIndices[EdgeStart+n]  = ESRs[n].ne;
+      };
+     free(ESRs);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- bounding sphere --------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  CBMCluster *C=Clusters + nc;
+  C->EdgeStart=EdgeStart;
+  C->NumEdges=NumEdges;
+  for(int i=0; i<3; i++)
+   C->Center[i] = 0.5*(XMin[i]+XMax[i]);
+
+  C->Radius=0.0;
+  for(int n=EdgeStart; n<EdgeStart+NumEdges; n++)
+   { RWGEdge *E=G->Surfaces[EdgeSurfaces[n]]->Edges[EdgeIndices[n]];
+     C->Radius = fmax(C->Radius, VecDistance(C->Center, E->Centroid) + E->Radius);
+   };
+
+  C->NumBFs=0;
+  C->BFIndices=C->BFEdges=C->BFSubIndices=0;
+  C->Children[0]=C->Children[1]=-1;
+  if (IsLeaf)
+   return nc;
+
+  // note: Clusters may be reallocated by the recursive calls
+  int Half=NumEdges/2;
+  int Child0=AddCluster(EdgeStart, Half);
+  int Child1=AddCluster(EdgeStart+Half, NumEdges-Half);
+  Clusters[nc].Children[0]=Child0;
+  Clusters[nc].Children[1]=Child1;
+  return nc;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::BuildClusterTree()
+{
+  for(int nc=0; nc<NumClusters; nc++)
+   { free(Clusters[nc].BFIndices);
+     free(Clusters[nc].BFEdges);
+     free(Clusters[nc].BFSubIndices);
+   };
+  NumClusters=0;
+
+  for(int ns=0, n=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++, n++)
+    { EdgeSurfaces[n]=ns;
+      EdgeIndices[n]=ne;
+    };
+
+  AddCluster(0, G->TotalEdges);
+
+  /*--------------------------------------------------------------*/
+  /*- the basis-function lists can only be filled in once the     */
+  /*- edge list has reached its final ordering, i.e. after all    */
+  /*- subclusters have been sorted                                */
+  /*--------------------------------------------------------------*/
+  for(int nc=0; nc<NumClusters; nc++)
+   { CBMCluster *C=Clusters + nc;
+     C->NumBFs=0;
+     for(int n=C->EdgeStart; n<C->EdgeStart+C->NumEdges; n++)
+      C->NumBFs += G->Surfaces[EdgeSurfaces[n]]->IsPEC ? 1 : 2;
+
+     C->BFIndices    = (int *)mallocEC(C->NumBFs*sizeof(int));
+     C->BFEdges      = (int *)mallocEC(C->NumBFs*sizeof(int));
+     C->BFSubIndices = (int *)mallocEC(C->NumBFs*sizeof(int));
+     for(int n=0, nbf=0; n<C->NumEdges; n++)
+      { int ns = EdgeSurfaces[C->EdgeStart+n];
+        int ne = EdgeIndices[C->EdgeStart+n];
+        int NBF = G->Surfaces[ns]->IsPEC ? 1 : 2;
+        for(int i=0; i<NBF; i++, nbf++)
+         { C->BFIndices[nbf]    = G->BFIndexOffset[ns] + NBF*ne + i;
+           C->BFEdges[nbf]      = n;
+           C->BFSubIndices[nbf] = i;
+         };
+      };
+   };
+}
+
+/***************************************************************/
+/* partition the block coupling clusters nca and ncb. blocks   */
+/* below the diagonal are not stored; instead, each stored     */
+/* off-diagonal block has Mirror=true and also stands for its  */
+/* transpose, which is legitimate because the BEM matrix of a  */
+/* compact geometry is symmetric.                              */
+/***************************************************************/
+void CompressedBEMMatrix::AddBlocks(int nca, int ncb, bool Mirror)
+{
+  CBMCluster *CA=Clusters + nca, *CB=Clusters + ncb;
+  bool ALeaf = (CA->Children[0]==-1);
+  bool BLeaf = (CB->Children[0]==-1);
+  bool Admissible = (nca!=ncb) && IsAdmissible(CA, CB, Eta);
+
+  if ( Admissible || (ALeaf && BLeaf) )
+   { if (NumBlocks==MaxBlocks)
+      { MaxBlocks = (MaxBlocks==0) ? 256 : 2*MaxBlocks;
+        Blocks=(CBMBlock *)reallocEC(Blocks, MaxBlocks*sizeof(CBMBlock));
+      };
+     CBMBlock *B=Blocks + (NumBlocks++);
+     B->RowCluster=nca;
+     B->ColCluster=ncb;
+     B->Mirror=Mirror;
+     B->Admissible=Admissible;
+     B->D=B->U=B->V=B->LU=0;
+     return;
+   };
+
+  int ACh[2]={CA->Children[0], CA->Children[1]};
+  int BCh[2]={CB->Children[0], CB->Children[1]};
+  if (nca==ncb)
+   { AddBlocks(ACh[0], ACh[0], false);
+     AddBlocks(ACh[0], ACh[1], true);
+     AddBlocks(ACh[1], ACh[1], false);
+   }
+  else if (ALeaf)
+   { AddBlocks(nca, BCh[0], Mirror);
+     AddBlocks(nca, BCh[1], Mirror);
+   }
+  else if (BLeaf)
+   { AddBlocks(ACh[0], ncb, Mirror);
+     AddBlocks(ACh[1], ncb, Mirror);
+   }
+  else
+   { for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       AddBlocks(ACh[i], BCh[j], Mirror);
+   };
+}
+
+/***************************************************************/
+/* fetch a single row or column of the block coupling clusters */
+/* CA and CB. each call to GetBEMMatrixElements computes all   */
+/* matrix elements between a pair of edges, of which we keep   */
+/* only those in the requested row or column.                  */
+/***************************************************************/
+static void GetBlockRow(CompressedBEMMatrix *CBM, CBMCluster *CA, CBMCluster *CB,
+                        int nr, cdouble Omega, cdouble *Row)
+{
+  RWGGeometry *G = CBM->G;
+  int na  = CA->EdgeStart + CA->BFEdges[nr];
+  int nsa = CBM->EdgeSurfaces[na], nea=CBM->EdgeIndices[na];
+  int i   = CA->BFSubIndices[nr];
+  cdouble MEs[4];
+  for(int eb=0, nc=0; eb<CB->NumEdges; eb++)
+   { int nb  = CB->EdgeStart + eb;
+     int nsb = CBM->EdgeSurfaces[nb], neb=CBM->EdgeIndices[nb];
+     int NBFb = G->Surfaces[nsb]->IsPEC ? 1 : 2;
+     GetBEMMatrixElements(G, nsa, nea, nsb, neb, Omega, MEs);
+     for(int j=0; j<NBFb; j++)
+      Row[nc++] = MEs[i*NBFb + j];
+   };
+}
+
+static void GetBlockColumn(CompressedBEMMatrix *CBM, CBMCluster *CA, CBMCluster *CB,
+                           int nc, cdouble Omega, cdouble *Column)
+{
+  RWGGeometry *G = CBM->G;
+  int nb  = CB->EdgeStart + CB->BFEdges[nc];
+  int nsb = CBM->EdgeSurfaces[nb], neb=CBM->EdgeIndices[nb];
+  int j   = CB->BFSubIndices[nc];
+  int NBFb = G->Surfaces[nsb]->IsPEC ? 1 : 2;
+  cdouble MEs[4];
+  for(int ea=0, nr=0; ea<CA->NumEdges; ea++)
+   { int na  = CA->EdgeStart + ea;
+     int nsa = CBM->EdgeSurfaces[na], nea=CBM->EdgeIndices[na];
+     int NBFa = G->Surfaces[nsa]->IsPEC ? 1 : 2;
+     GetBEMMatrixElements(G, nsa, nea, nsb, neb, Omega, MEs);
+     for(int i=0; i<NBFa; i++)
+      Column[nr++] = MEs[i*NBFb + j];
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::AssembleDenseBlock(CBMBlock *B, cdouble Omega)
+{
+  CBMCluster *CA=Clusters + B->RowCluster;
+  CBMCluster *CB=Clusters + B->ColCluster;
+  B->D = new HMatrix(CA->NumBFs, CB->NumBFs, LHM_COMPLEX);
+
+  // diagonal blocks are symmetric, so we only compute their upper triangle
+  bool Symmetric = (B->RowCluster==B->ColCluster);
+
+  cdouble MEs[4];
+  for(int ea=0, nr=0; ea<CA->NumEdges; ea++)
+   { int na  = CA->EdgeStart + ea;
+     int nsa = EdgeSurfaces[na], nea=EdgeIndices[na];
+     int NBFa = G->Surfaces[nsa]->IsPEC ? 1 : 2;
+     for(int eb=0, nc=0; eb<CB->NumEdges; eb++)
+      { int nb  = CB->EdgeStart + eb;
+        int nsb = EdgeSurfaces[nb], neb=EdgeIndices[nb];
+        int NBFb = G->Surfaces[nsb]->IsPEC ? 1 : 2;
+        if (Symmetric && eb<ea)
+         { nc+=NBFb;
+           continue;
+         };
+        GetBEMMatrixElements(G, nsa, nea, nsb, neb, Omega, MEs);
+        for(int i=0; i<NBFa; i++)
+         for(int j=0; j<NBFb; j++)
+          { B->D->SetEntry(nr+i, nc+j, MEs[i*NBFb + j]);
+            if (Symmetric)
+             B->D->SetEntry(nc+j, nr+i, MEs[i*NBFb + j]);
+          };
+        nc+=NBFb;
+      };
+     nr+=NBFa;
+   };
+}
+
+/***************************************************************/
+/* adaptive cross approximation with partial pivoting. on      */
+/* return, either B->U and B->V are the low-rank factors of the*/
+/* block (both zero if the block vanishes), or, if the block   */
+/* turned out not to be compressible enough to save storage,   */
+/* B->D holds the block in dense form.                         */
+/***************************************************************/
+void CompressedBEMMatrix::AssembleLowRankBlock(CBMBlock *B, cdouble Omega)
+{
+  CBMCluster *CA=Clusters + B->RowCluster;
+  CBMCluster *CB=Clusters + B->ColCluster;
+  int NR=CA->NumBFs, NC=CB->NumBFs;
+
+  // beyond this rank the low-rank form uses more storage than the dense form
+  int MaxRank = (NR*NC) / (NR+NC);
+
+  cdouble **UCols = (cdouble **)mallocEC( (MaxRank+1)*sizeof(cdouble *) );
+  cdouble **VRows = (cdouble **)mallocEC( (MaxRank+1)*sizeof(cdouble *) );
+  bool *RowUsed = (bool *)mallocEC(NR*sizeof(bool));
+  memset(RowUsed, 0, NR*sizeof(bool));
+
+  double Norm2=0.0;
+  int Rank=0, nr=0, NumZeroRows=0;
+  bool Converged=false;
+  while( Rank<MaxRank )
+   {
+     /*--------------------------------------------------------------*/
+     /*- residual of row #nr ----------------------------------------*/
+     /*--------------------------------------------------------------*/
+     cdouble *V = (cdouble *)mallocEC(NC*sizeof(cdouble));
+     RowUsed[nr]=true;
+     GetBlockRow(this, CA, CB, nr, Omega, V);
+     for(int l=0; l<Rank; l++)
+      for(int nc=0; nc<NC; nc++)
+       V[nc] -= UCols[l][nr]*VRows[l][nc];
+
+     int ncPivot=0;
+     for(int nc=1; nc<NC; nc++)
+      if ( abs(V[nc]) > abs(V[ncPivot]) )
+       ncPivot=nc;
+
+     /*--------------------------------------------------------------*/
+     /*- a vanishing row residual means either that the             -*/
+     /*- approximation is already exact or that this row is zero;   -*/
+     /*- try a few more rows before giving up                       -*/
+     /*--------------------------------------------------------------*/
+     if ( abs(V[ncPivot])==0.0 )
+      { free(V);
+        int nrNext=-1;
+        for(int n=0; n<NR && nrNext==-1; n++)
+         if (!RowUsed[n]) nrNext=n;
+        if ( nrNext==-1 || ++NumZeroRows==3 )
+         { Converged=true;
+           break;
+         };
+        nr=nrNext;
+        continue;
+      };
+
+     cdouble Pivot=V[ncPivot];
+     for(int nc=0; nc<NC; nc++)
+      V[nc]/=Pivot;
+
+     /*--------------------------------------------------------------*/
+     /*- residual of column #ncPivot --------------------------------*/
+     /*--------------------------------------------------------------*/
+     cdouble *U = (cdouble *)mallocEC(NR*sizeof(cdouble));
+     GetBlockColumn(this, CA, CB, ncPivot, Omega, U);
+     for(int l=0; l<Rank; l++)
+      for(int n=0; n<NR; n++)
+       U[n] -= VRows[l][ncPivot]*UCols[l][n];
+
+     /*--------------------------------------------------------------*/
+     /*- update the frobenius norm of the approximation and check   -*/
+     /*- convergence                                                -*/
+     /*--------------------------------------------------------------*/
+     double UNorm2=0.0, VNorm2=0.0;
+     for(int n=0; n<NR; n++)  UNorm2+=norm(U[n]);
+     for(int nc=0; nc<NC; nc++) VNorm2+=norm(V[nc]);
+     for(int l=0; l<Rank; l++)
+      { cdouble UU=0.0, VV=0.0;
+        for(int n=0; n<NR; n++)   UU += UCols[l][n]*conj(U[n]);
+        for(int nc=0; nc<NC; nc++) VV += VRows[l][nc]*conj(V[nc]);
+        Norm2 += 2.0*real(UU*VV);
+      };
+     Norm2 += UNorm2*VNorm2;
+
+     UCols[Rank]=U;
+     VRows[Rank]=V;
+     Rank++;
+
+     if ( sqrt(UNorm2*VNorm2) <= ACATol*sqrt(Norm2) )
+      { Converged=true;
+        break;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- next pivot row is the largest entry of the new column      -*/
+     /*--------------------------------------------------------------*/
+     nr=-1;
+     for(int n=0; n<NR; n++)
+      if ( !RowUsed[n] && (nr==-1 || abs(U[n])>abs(U[nr])) )
+       nr=n;
+     if (nr==-1)
+      { Converged=true;
+        break;
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- pack the factors into HMatrices, or fall back to dense      */
+  /*--------------------------------------------------------------*/
+  if (!Converged)
+   AssembleDenseBlock(B, Omega);
+  else if (Rank>0)
+   { B->U = new HMatrix(NR, Rank, LHM_COMPLEX);
+     B->V = new HMatrix(Rank, NC, LHM_COMPLEX);
+     for(int l=0; l<Rank; l++)
+      { for(int n=0; n<NR; n++)
+         B->U->SetEntry(n, l, UCols[l][n]);
+        for(int nc=0; nc<NC; nc++)
+         B->V->SetEntry(l, nc, VRows[l][nc]);
+      };
+   };
+
+  for(int l=0; l<Rank; l++)
+   { free(UCols[l]);
+     free(VRows[l]);
+   };
+  free(UCols);
+  free(VRows);
+  free(RowUsed);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::Assemble(cdouble Omega)
+{
+  // the cluster tree is rebuilt on every call because surfaces
+  // may have been displaced since the last call
+  BuildClusterTree();
+  ClearBlocks();
+  AddBlocks(0, 0, false);
+
+  G->UpdateCachedEpsMuValues(Omega);
+
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+  if (G->LogLevel>=SCUFF_VERBOSE2)
+   Log(" OpenMP multithreading (%i threads,%i blocks)...",NumThreads,NumBlocks);
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumBlocks; nb++)
+   { CBMBlock *B=Blocks + nb;
+     if (B->Admissible)
+      AssembleLowRankBlock(B, Omega);
+     else
+      AssembleDenseBlock(B, Omega);
+   };
+
+  int NumLowRank=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   if (Blocks[nb].D==0)
+    NumLowRank++;
+  size_t DenseStorage, Storage=GetStorage(&DenseStorage);
+  Log(" %i clusters, %i blocks (%i low-rank), %.1f MB (dense: %.1f MB)",
+        NumClusters, NumBlocks, NumLowRank,
+        ((double)Storage)/1048576.0, ((double)DenseStorage)/1048576.0);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+size_t CompressedBEMMatrix::GetStorage(size_t *DenseStorage)
+{
+  size_t Storage=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { CBMBlock *B=Blocks + nb;
+     if (B->D) Storage += ((size_t)B->D->NR)*B->D->NC;
+     if (B->U) Storage += ((size_t)B->U->NR)*B->U->NC;
+     if (B->V) Storage += ((size_t)B->V->NR)*B->V->NC;
+   };
+  if (DenseStorage)
+   *DenseStorage = ((size_t)N)*N*sizeof(cdouble);
+  return Storage*sizeof(cdouble);
+}
+
+/***************************************************************/
+/* Y = M*X                                                     */
+/***************************************************************/
+void CompressedBEMMatrix::Apply(HVector *X, HVector *Y)
+{
+  if ( X->N!=N || Y->N!=N )
+   ErrExit("%s:%i: dimension mismatch in CompressedBEMMatrix::Apply",__FILE__,__LINE__);
+
+  cdouble *XBuffer = (cdouble *)mallocEC(3*N*sizeof(cdouble));
+  cdouble *YBuffer = XBuffer + N;
+  cdouble *TBuffer = XBuffer + 2*N;
+
+  Y->Zero();
+  for(int nb=0; nb<NumBlocks; nb++)
+   {
+     CBMBlock *B=Blocks + nb;
+     if ( B->D==0 && B->U==0 )
+      continue;
+
+     CBMCluster *CA=Clusters + B->RowCluster;
+     CBMCluster *CB=Clusters + B->ColCluster;
+
+     // the block itself, and (if Mirror) its transpose
+     for(int Pass=0; Pass<(B->Mirror ? 2 : 1); Pass++)
+      {
+        CBMCluster *CIn  = (Pass==0) ? CB : CA;
+        CBMCluster *COut = (Pass==0) ? CA : CB;
+        char Trans = (Pass==0) ? 0 : 'T';
+
+        for(int n=0; n<CIn->NumBFs; n++)
+         XBuffer[n] = X->ZV[ CIn->BFIndices[n] ];
+        HVector XB(CIn->NumBFs,  LHM_COMPLEX, XBuffer);
+        HVector YB(COut->NumBFs, LHM_COMPLEX, YBuffer);
+
+        if (B->D)
+         B->D->Apply(&XB, &YB, Trans);
+        else
+         { HVector TB(B->U->NC, LHM_COMPLEX, TBuffer);
+           if (Pass==0)
+            { B->V->Apply(&XB, &TB);
+              B->U->Apply(&TB, &YB);
+            }
+           else
+            { B->U->Apply(&XB, &TB, 'T');
+              B->V->Apply(&TB, &YB, 'T');
+            };
+         };
+
+        for(int n=0; n<COut->NumBFs; n++)
+         Y->ZV[ COut->BFIndices[n] ] += YBuffer[n];
+      };
+   };
+
+  free(XBuffer);
+}
+
+/***************************************************************/
+/* solve the BEM system by H-LU or, for Solver=GMRES/BiCGStab, */
+/* iteratively (see IterativeSolve.cc).                        */
+/* on entry X is the RHS vector; on return it is the solution. */
+/* the return value is 0 on success, or nonzero if the H-LU    */
+/* factorization failed or the iteration did not converge.     */
+/***************************************************************/
+int CompressedBEMMatrix::Solve(HVector *X)
+{
+  if (Solver==SCUFF_SOLVER_LU)
+   return LUSolve(X);
+  return IterativeSolve(X);
+}
+
+/***************************************************************/
+/* If CM is NULL on entry, a new CompressedBEMMatrix is        */
+/* created with default parameters and returned. Otherwise the */
+/* return value is CM.                                         */
+/***************************************************************/
+CompressedBEMMatrix *RWGGeometry::AssembleCompressedBEMMatrix(cdouble Omega,
+                                                              CompressedBEMMatrix *CM)
+{
+  if (CM==0)
+   CM=new CompressedBEMMatrix(this);
+
+  Log("Assembling compressed BEM matrix at Omega=%s",z2s(Omega));
+  CM->Assemble(Omega);
+  return CM;
+}
+
+} // namespace scuff
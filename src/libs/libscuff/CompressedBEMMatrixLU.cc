@@ -0,0 +1,764 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrixLU.cc -- approximate LU factorization and direct
+ *                          -- solution of a CompressedBEMMatrix in
+ *                          -- hierarchical (H-LU) form
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* The factorization is stored as a tree of CBMNodes that      */
+/* covers the full (not only the upper-triangular) matrix.     */
+/* For a diagonal node split as [A00 A01; A10 A11], the kids   */
+/* hold on return from Factor()                                */
+/*                                                             */
+/*  Kids[0] = factorization of A00                             */
+/*  Kids[1] = W = inv(A00)*A01                                 */
+/*  Kids[2] = A10                                              */
+/*  Kids[3] = factorization of the Schur complement            */
+/*            S = A11 - A10*W                                  */
+/*                                                             */
+/* and the system [A00 A01; A10 A11] [X0; X1] = [B0; B1] is    */
+/* solved by Y0 = inv(A00)*B0, X1 = inv(S)*(B1 - A10*Y0),      */
+/* X0 = Y0 - W*X1. Dense diagonal leaves are LU-factorized by  */
+/* LAPACK (with pivoting within the leaf). Sums of low-rank    */
+/* blocks are recompressed to within the ACA tolerance.        */
+/***************************************************************/
+
+/***************************************************************/
+/* number of basis functions in cluster nc, and the cluster    */
+/* and row offset of subcluster #i of nc when nc is divided    */
+/* into NumKids (1 or 2) parts                                 */
+/***************************************************************/
+static int ClusterSize(CompressedBEMMatrix *CBM, int nc)
+{ return CBM->Clusters[nc].NumBFs; }
+
+static bool IsLeaf(CompressedBEMMatrix *CBM, int nc)
+{ return CBM->Clusters[nc].Children[0]==-1; }
+
+static int KidCluster(CompressedBEMMatrix *CBM, int nc, int NumKids, int i)
+{ return NumKids==1 ? nc : CBM->Clusters[nc].Children[i]; }
+
+static int KidOffset(CompressedBEMMatrix *CBM, int nc, int NumKids, int i)
+{ return (NumKids==1 || i==0) ? 0 : ClusterSize(CBM, CBM->Clusters[nc].Children[0]); }
+
+/***************************************************************/
+/* elementary operations on dense matrices                     */
+/***************************************************************/
+static HMatrix *NewZeroMatrix(int NR, int NC)
+{
+  HMatrix *M=new HMatrix(NR, NC, LHM_COMPLEX);
+  M->Zero();
+  return M;
+}
+
+// Y += Alpha*X
+static void AddScaled(HMatrix *Y, cdouble Alpha, HMatrix *X)
+{
+  size_t N=((size_t)X->NR)*X->NC;
+  for(size_t n=0; n<N; n++)
+   Y->ZM[n] += Alpha*X->ZM[n];
+}
+
+// rows [Offset, Offset+NumRows) of X as a new matrix
+static HMatrix *GetRows(HMatrix *X, int Offset, int NumRows)
+{
+  HMatrix *XR=new HMatrix(NumRows, X->NC, LHM_COMPLEX);
+  for(int nc=0; nc<X->NC; nc++)
+   memcpy(XR->ZM + ((size_t)nc)*NumRows, X->ZM + Offset + ((size_t)nc)*X->NR,
+          NumRows*sizeof(cdouble));
+  return XR;
+}
+
+// overwrite rows [Offset, Offset+XR->NR) of X with XR
+static void SetRows(HMatrix *X, int Offset, HMatrix *XR)
+{
+  for(int nc=0; nc<X->NC; nc++)
+   memcpy(X->ZM + Offset + ((size_t)nc)*X->NR, XR->ZM + ((size_t)nc)*XR->NR,
+          XR->NR*sizeof(cdouble));
+}
+
+// columns [Offset, Offset+NumCols) of X as a new matrix
+static HMatrix *GetColumns(HMatrix *X, int Offset, int NumCols)
+{
+  HMatrix *XC=new HMatrix(X->NR, NumCols, LHM_COMPLEX);
+  memcpy(XC->ZM, X->ZM + ((size_t)Offset)*X->NR, ((size_t)X->NR)*NumCols*sizeof(cdouble));
+  return XC;
+}
+
+// overwrite the block of X at (RowOffset, ColOffset) with B
+static void SetBlock(HMatrix *X, int RowOffset, int ColOffset, HMatrix *B)
+{
+  for(int nc=0; nc<B->NC; nc++)
+   memcpy(X->ZM + RowOffset + ((size_t)(ColOffset+nc))*X->NR,
+          B->ZM + ((size_t)nc)*B->NR, B->NR*sizeof(cdouble));
+}
+
+/***************************************************************/
+/* thin QR factorization A = Q*R by modified Gram-Schmidt with */
+/* reorthogonalization. A is NR x K; on return Q is NR x KQ    */
+/* with orthonormal columns and R is KQ x K, where KQ<=K is    */
+/* the number of numerically independent columns of A.         */
+/***************************************************************/
+static void ThinQR(HMatrix *A, HMatrix **pQ, HMatrix **pR)
+{
+  int NR=A->NR, K=A->NC;
+  HMatrix *Q=new HMatrix(NR, K, LHM_COMPLEX);
+  HMatrix *R=NewZeroMatrix(K, K);
+
+  int KQ=0;
+  for(int k=0; k<K; k++)
+   { cdouble *v=Q->ZM + ((size_t)KQ)*NR;
+     memcpy(v, A->ZM + ((size_t)k)*NR, NR*sizeof(cdouble));
+     double Norm0=0.0;
+     for(int n=0; n<NR; n++)
+      Norm0+=norm(v[n]);
+     for(int Pass=0; Pass<2; Pass++)
+      for(int l=0; l<KQ; l++)
+       { cdouble *q=Q->ZM + ((size_t)l)*NR, r=0.0;
+         for(int n=0; n<NR; n++)
+          r+=conj(q[n])*v[n];
+         for(int n=0; n<NR; n++)
+          v[n]-=r*q[n];
+         R->ZM[l + ((size_t)k)*K] += r;
+       };
+     double Norm=0.0;
+     for(int n=0; n<NR; n++)
+      Norm+=norm(v[n]);
+     Norm=sqrt(Norm);
+     if ( KQ==NR || Norm<=1.0e-12*sqrt(Norm0) )
+      continue;
+     for(int n=0; n<NR; n++)
+      v[n]/=Norm;
+     R->ZM[KQ + ((size_t)k)*K] = Norm;
+     KQ++;
+   };
+
+  *pQ=GetColumns(Q, 0, KQ);
+  *pR=GetRows(R, 0, KQ);
+  delete Q;
+  delete R;
+}
+
+/***************************************************************/
+/* truncate the low-rank block U*V to the smallest rank that   */
+/* reproduces it to relative accuracy Tol (in the 2-norm)      */
+/***************************************************************/
+static void Recompress(HMatrix **pU, HMatrix **pV, double Tol)
+{
+  HMatrix *U=*pU, *V=*pV;
+  if (U==0)
+   return;
+  int NR=U->NR, NC=V->NC;
+
+  HMatrix *QU, *RU, *QV, *RV;
+  ThinQR(U, &QU, &RU);
+  V->Transpose();
+  ThinQR(V, &QV, &RV);
+  V->Transpose();
+  int KU=QU->NC, KV=QV->NC;
+
+  delete U;
+  delete V;
+  *pU=*pV=0;
+  if (KU==0 || KV==0)
+   { delete QU; delete RU; delete QV; delete RV;
+     return;
+   };
+
+  // U*V = QU * (RU*RV^T) * QV^T; SVD the small core matrix
+  HMatrix *Core=new HMatrix(KU, KV, LHM_COMPLEX);
+  RU->Multiply(RV, Core, "--transB T");
+  int KMin = KU<KV ? KU : KV;
+  HMatrix *W=new HMatrix(KU, KU, LHM_COMPLEX);
+  HMatrix *ZT=new HMatrix(KV, KV, LHM_COMPLEX);
+  HVector *Sigma=Core->SVD(0, W, ZT);
+
+  int Rank=0;
+  while( Rank<KMin && Sigma->DV[Rank] > Tol*Sigma->DV[0] )
+   Rank++;
+
+  if (Rank>0)
+   { HMatrix *WS=GetColumns(W, 0, Rank);
+     for(int l=0; l<Rank; l++)
+      for(int n=0; n<KU; n++)
+       WS->ZM[n + ((size_t)l)*KU] *= Sigma->DV[l];
+     HMatrix *ZTR=GetRows(ZT, 0, Rank);
+     *pU=new HMatrix(NR, Rank, LHM_COMPLEX);
+     *pV=new HMatrix(Rank, NC, LHM_COMPLEX);
+     QU->Multiply(WS, *pU);
+     ZTR->Multiply(QV, *pV, "--transB T");
+     delete WS;
+     delete ZTR;
+   };
+
+  delete Sigma;
+  delete ZT;
+  delete W;
+  delete Core;
+  delete QU; delete RU; delete QV; delete RV;
+}
+
+/***************************************************************/
+/* allocation and deallocation of nodes                        */
+/***************************************************************/
+static CBMNode *NewNode(int RowCluster, int ColCluster)
+{
+  CBMNode *Node=(CBMNode *)mallocEC(sizeof(CBMNode));
+  memset(Node, 0, sizeof(CBMNode));
+  Node->RowCluster=RowCluster;
+  Node->ColCluster=ColCluster;
+  return Node;
+}
+
+static void DeleteNode(CBMNode *Node)
+{
+  if (Node==0)
+   return;
+  for(int n=0; n<Node->NumRowKids*Node->NumColKids; n++)
+   DeleteNode(Node->Kids[n]);
+  if (Node->D) delete Node->D;
+  if (Node->U) delete Node->U;
+  if (Node->V) delete Node->V;
+  free(Node);
+}
+
+// split Node into subblocks according to its clusters
+static void SplitNode(CompressedBEMMatrix *CBM, CBMNode *Node)
+{
+  Node->NumRowKids = IsLeaf(CBM, Node->RowCluster) ? 1 : 2;
+  Node->NumColKids = IsLeaf(CBM, Node->ColCluster) ? 1 : 2;
+}
+
+// kid (i,j) of a split node, or the node itself if it is not split
+static CBMNode *GetKid(CBMNode *Node, int i, int j)
+{
+  if (Node->NumRowKids==0)
+   return Node;
+  return Node->Kids[i*Node->NumColKids + j];
+}
+
+static size_t GetNodeStorage(CBMNode *Node)
+{
+  size_t Storage=0;
+  for(int n=0; n<Node->NumRowKids*Node->NumColKids; n++)
+   Storage+=GetNodeStorage(Node->Kids[n]);
+  if (Node->D) Storage += ((size_t)Node->D->NR)*Node->D->NC;
+  if (Node->U) Storage += ((size_t)Node->U->NR)*Node->U->NC;
+  if (Node->V) Storage += ((size_t)Node->V->NR)*Node->V->NC;
+  return Storage;
+}
+
+/***************************************************************/
+/* create a node holding the dense matrix M (which is taken    */
+/* over by the node), subdivided until both clusters are       */
+/* leaves                                                      */
+/***************************************************************/
+static CBMNode *DenseToNode(CompressedBEMMatrix *CBM, int RowCluster, int ColCluster, HMatrix *M)
+{
+  CBMNode *Node=NewNode(RowCluster, ColCluster);
+  if ( IsLeaf(CBM, RowCluster) && IsLeaf(CBM, ColCluster) )
+   { Node->D=M;
+     return Node;
+   };
+
+  SplitNode(CBM, Node);
+  int NRK=Node->NumRowKids, NCK=Node->NumColKids;
+  for(int i=0; i<NRK; i++)
+   for(int j=0; j<NCK; j++)
+    { int RC = KidCluster(CBM, RowCluster, NRK, i);
+      int CC = KidCluster(CBM, ColCluster, NCK, j);
+      HMatrix *MKid=new HMatrix(ClusterSize(CBM,RC), ClusterSize(CBM,CC), LHM_COMPLEX);
+      M->ExtractBlock(KidOffset(CBM, RowCluster, NRK, i),
+                      KidOffset(CBM, ColCluster, NCK, j), MKid);
+      Node->Kids[i*NCK+j]=DenseToNode(CBM, RC, CC, MKid);
+    };
+  delete M;
+  return Node;
+}
+
+/***************************************************************/
+/* the stored blocks, sorted by (RowCluster, ColCluster), for  */
+/* lookup while building the node tree                         */
+/***************************************************************/
+typedef struct BlockKey
+ { size_t Key;
+   int nb;
+ } BlockKey;
+
+static int CompareBlockKeys(const void *p1, const void *p2)
+{
+  size_t K1=((const BlockKey *)p1)->Key;
+  size_t K2=((const BlockKey *)p2)->Key;
+  return (K1<K2) ? -1 : (K1>K2) ? 1 : 0;
+}
+
+static CBMBlock *FindBlock(CompressedBEMMatrix *CBM, BlockKey *Keys, int nca, int ncb)
+{
+  BlockKey Target;
+  Target.Key = ((size_t)nca)*CBM->NumClusters + ncb;
+  BlockKey *Match=(BlockKey *)bsearch(&Target, Keys, CBM->NumBlocks, sizeof(BlockKey), CompareBlockKeys);
+  return Match ? CBM->Blocks + Match->nb : 0;
+}
+
+/***************************************************************/
+/* build the node for the block coupling clusters RowCluster   */
+/* and ColCluster from copies of the stored blocks. if         */
+/* Transposed==true, the block lies below the diagonal and is  */
+/* obtained by transposing the stored block coupling           */
+/* ColCluster to RowCluster.                                   */
+/***************************************************************/
+static CBMNode *BuildNode(CompressedBEMMatrix *CBM, BlockKey *Keys,
+                          int RowCluster, int ColCluster, bool Transposed)
+{
+  int nca = Transposed ? ColCluster : RowCluster;
+  int ncb = Transposed ? RowCluster : ColCluster;
+  CBMBlock *B=FindBlock(CBM, Keys, nca, ncb);
+
+  if (B==0)
+   { CBMNode *Node=NewNode(RowCluster, ColCluster);
+     SplitNode(CBM, Node);
+     int NRK=Node->NumRowKids, NCK=Node->NumColKids;
+     for(int i=0; i<NRK; i++)
+      for(int j=0; j<NCK; j++)
+       { int RC = KidCluster(CBM, RowCluster, NRK, i);
+         int CC = KidCluster(CBM, ColCluster, NCK, j);
+         // below-diagonal parts of diagonal blocks are not stored
+         bool KidTransposed = (RowCluster==ColCluster) ? (i>j) : Transposed;
+         Node->Kids[i*NCK+j]=BuildNode(CBM, Keys, RC, CC, KidTransposed);
+       };
+     return Node;
+   };
+
+  if (B->D)
+   { HMatrix *M=new HMatrix(B->D);
+     if (Transposed) M->Transpose();
+     return DenseToNode(CBM, RowCluster, ColCluster, M);
+   };
+
+  CBMNode *Node=NewNode(RowCluster, ColCluster);
+  if (B->U)
+   { Node->U=new HMatrix(Transposed ? B->V : B->U);
+     Node->V=new HMatrix(Transposed ? B->U : B->V);
+     if (Transposed)
+      { Node->U->Transpose();
+        Node->V->Transpose();
+      };
+   };
+  return Node;
+}
+
+/***************************************************************/
+/* dense form of the block stored in Node                      */
+/***************************************************************/
+static HMatrix *NodeToDense(CompressedBEMMatrix *CBM, CBMNode *Node)
+{
+  int NR=ClusterSize(CBM, Node->RowCluster), NC=ClusterSize(CBM, Node->ColCluster);
+  if (Node->D)
+   return new HMatrix(Node->D);
+
+  HMatrix *M=new HMatrix(NR, NC, LHM_COMPLEX);
+  if (Node->U)
+   Node->U->Multiply(Node->V, M);
+  else
+   M->Zero();
+
+  int NRK=Node->NumRowKids, NCK=Node->NumColKids;
+  for(int i=0; i<NRK; i++)
+   for(int j=0; j<NCK; j++)
+    { HMatrix *MKid=NodeToDense(CBM, Node->Kids[i*NCK+j]);
+      SetBlock(M, KidOffset(CBM, Node->RowCluster, NRK, i),
+                  KidOffset(CBM, Node->ColCluster, NCK, j), MKid);
+      delete MKid;
+    };
+  return M;
+}
+
+/***************************************************************/
+/* Y += Alpha * op(Node) * X for dense X, Y, where op(Node) is */
+/* the block or (if Trans==true) its transpose                 */
+/***************************************************************/
+static void MultiplyDense(CompressedBEMMatrix *CBM, CBMNode *Node, cdouble Alpha,
+                          HMatrix *X, HMatrix *Y, bool Trans=false)
+{
+  if (Node->D)
+   { HMatrix *T=new HMatrix(Y->NR, Y->NC, LHM_COMPLEX);
+     Node->D->Multiply(X, T, Trans ? "--transA T" : 0);
+     AddScaled(Y, Alpha, T);
+     delete T;
+     return;
+   };
+
+  if (Node->NumRowKids==0)
+   { if (Node->U==0)
+      return;
+     HMatrix *T1=new HMatrix(Node->U->NC, X->NC, LHM_COMPLEX);
+     HMatrix *T2=new HMatrix(Y->NR, Y->NC, LHM_COMPLEX);
+     if (Trans)
+      { Node->U->Multiply(X, T1, "--transA T");
+        Node->V->Multiply(T1, T2, "--transA T");
+      }
+     else
+      { Node->V->Multiply(X, T1);
+        Node->U->Multiply(T1, T2);
+      };
+     AddScaled(Y, Alpha, T2);
+     delete T1;
+     delete T2;
+     return;
+   };
+
+  // kids along the input and output dimensions
+  int NRK=Node->NumRowKids, NCK=Node->NumColKids;
+  int NumIn   = Trans ? NRK : NCK, NumOut   = Trans ? NCK : NRK;
+  int InCluster = Trans ? Node->RowCluster : Node->ColCluster;
+  int OutCluster = Trans ? Node->ColCluster : Node->RowCluster;
+
+  HMatrix *XParts[2], *YParts[2];
+  for(int n=0; n<NumIn; n++)
+   XParts[n]=GetRows(X, KidOffset(CBM, InCluster, NumIn, n),
+                     ClusterSize(CBM, KidCluster(CBM, InCluster, NumIn, n)));
+  for(int n=0; n<NumOut; n++)
+   YParts[n]=GetRows(Y, KidOffset(CBM, OutCluster, NumOut, n),
+                     ClusterSize(CBM, KidCluster(CBM, OutCluster, NumOut, n)));
+
+  for(int i=0; i<NRK; i++)
+   for(int j=0; j<NCK; j++)
+    { CBMNode *Kid=Node->Kids[i*NCK+j];
+      if (Trans)
+       MultiplyDense(CBM, Kid, Alpha, XParts[i], YParts[j], true);
+      else
+       MultiplyDense(CBM, Kid, Alpha, XParts[j], YParts[i]);
+    };
+
+  for(int n=0; n<NumOut; n++)
+   { SetRows(Y, KidOffset(CBM, OutCluster, NumOut, n), YParts[n]);
+     delete YParts[n];
+   };
+  for(int n=0; n<NumIn; n++)
+   delete XParts[n];
+}
+
+/***************************************************************/
+/* Node += Alpha * X * Y, where X*Y is a low-rank product      */
+/***************************************************************/
+static void AddLowRank(CompressedBEMMatrix *CBM, CBMNode *Node, cdouble Alpha,
+                       HMatrix *X, HMatrix *Y)
+{
+  int K=X->NC;
+  if (K==0)
+   return;
+
+  if (Node->D)
+   { HMatrix *T=new HMatrix(Node->D->NR, Node->D->NC, LHM_COMPLEX);
+     X->Multiply(Y, T);
+     AddScaled(Node->D, Alpha, T);
+     delete T;
+   }
+  else if (Node->NumRowKids==0)
+   { int NR=X->NR, NC=Y->NC, K0 = Node->U ? Node->U->NC : 0;
+     HMatrix *U=new HMatrix(NR, K0+K, LHM_COMPLEX);
+     HMatrix *V=new HMatrix(K0+K, NC, LHM_COMPLEX);
+     if (K0>0)
+      { SetBlock(U, 0, 0, Node->U);
+        SetBlock(V, 0, 0, Node->V);
+        delete Node->U;
+        delete Node->V;
+      };
+     HMatrix *AX=new HMatrix(X);
+     AX->Scale(Alpha);
+     SetBlock(U, 0, K0, AX);
+     SetBlock(V, K0, 0, Y);
+     delete AX;
+     Node->U=U;
+     Node->V=V;
+     Recompress(&(Node->U), &(Node->V), CBM->ACATol);
+   }
+  else
+   { int NRK=Node->NumRowKids, NCK=Node->NumColKids;
+     for(int i=0; i<NRK; i++)
+      { int RC=KidCluster(CBM, Node->RowCluster, NRK, i);
+        HMatrix *Xi=GetRows(X, KidOffset(CBM, Node->RowCluster, NRK, i), ClusterSize(CBM, RC));
+        for(int j=0; j<NCK; j++)
+         { int CC=KidCluster(CBM, Node->ColCluster, NCK, j);
+           HMatrix *Yj=GetColumns(Y, KidOffset(CBM, Node->ColCluster, NCK, j), ClusterSize(CBM, CC));
+           AddLowRank(CBM, Node->Kids[i*NCK+j], Alpha, Xi, Yj);
+           delete Yj;
+         };
+        delete Xi;
+      };
+   };
+}
+
+/***************************************************************/
+/* C += Alpha * A * B, where A couples clusters (t,r), B       */
+/* couples (r,s), and C couples (t,s). the result is stored in */
+/* the existing format of C.                                   */
+/***************************************************************/
+static void MultiplyAdd(CompressedBEMMatrix *CBM, CBMNode *C, cdouble Alpha,
+                        CBMNode *A, CBMNode *B)
+{
+  bool ALowRank = (A->D==0 && A->NumRowKids==0);
+  bool BLowRank = (B->D==0 && B->NumRowKids==0);
+  bool CLowRank = (C->D==0 && C->NumRowKids==0);
+
+  /*--------------------------------------------------------------*/
+  /*- if either factor is low-rank, so is the product             */
+  /*--------------------------------------------------------------*/
+  if (ALowRank)
+   { if (A->U==0)
+      return;
+     // (V_A * B)^T = B^T * V_A^T
+     HMatrix *VAT=new HMatrix(A->V);
+     VAT->Transpose();
+     HMatrix *Y=NewZeroMatrix(ClusterSize(CBM, B->ColCluster), A->V->NR);
+     MultiplyDense(CBM, B, 1.0, VAT, Y, true);
+     Y->Transpose();
+     AddLowRank(CBM, C, Alpha, A->U, Y);
+     delete Y;
+     delete VAT;
+     return;
+   };
+
+  if (BLowRank)
+   { if (B->U==0)
+      return;
+     HMatrix *X=NewZeroMatrix(ClusterSize(CBM, A->RowCluster), B->U->NC);
+     MultiplyDense(CBM, A, 1.0, B->U, X);
+     AddLowRank(CBM, C, Alpha, X, B->V);
+     delete X;
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- A and B are dense or split. a dense C (whose clusters are   */
+  /*- then both leaves) receives the product in dense form, as    */
+  /*- does a low-rank C coupling two leaf clusters                */
+  /*--------------------------------------------------------------*/
+  bool tLeaf=IsLeaf(CBM, C->RowCluster), sLeaf=IsLeaf(CBM, C->ColCluster);
+  if ( C->D || (CLowRank && tLeaf && sLeaf) )
+   { HMatrix *BD=NodeToDense(CBM, B);
+     if (C->D)
+      MultiplyDense(CBM, A, Alpha, BD, C->D);
+     else
+      { int NC=ClusterSize(CBM, C->ColCluster);
+        HMatrix *P=NewZeroMatrix(ClusterSize(CBM, C->RowCluster), NC);
+        MultiplyDense(CBM, A, Alpha, BD, P);
+        HMatrix *Identity=NewZeroMatrix(NC, NC);
+        for(int n=0; n<NC; n++)
+         Identity->SetEntry(n, n, 1.0);
+        AddLowRank(CBM, C, 1.0, P, Identity);
+        delete Identity;
+        delete P;
+      };
+     delete BD;
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- otherwise recurse into the subblocks. the numbers of kids   */
+  /*- of A, B, C along each cluster agree, since a split node is  */
+  /*- divided along exactly those of its clusters that are not    */
+  /*- leaves.                                                     */
+  /*--------------------------------------------------------------*/
+  int NRK = tLeaf ? 1 : 2;
+  int NCK = sLeaf ? 1 : 2;
+  int NK  = IsLeaf(CBM, A->ColCluster) ? 1 : 2;
+  for(int i=0; i<NRK; i++)
+   for(int j=0; j<NCK; j++)
+    {
+      if (!CLowRank)
+       { for(int k=0; k<NK; k++)
+          MultiplyAdd(CBM, GetKid(C,i,j), Alpha, GetKid(A,i,k), GetKid(B,k,j));
+         continue;
+       };
+
+      // for low-rank C, accumulate the low-rank (i,j) subblock of
+      // the product, then add it, padded with zeros, to C
+      int RC=KidCluster(CBM, C->RowCluster, NRK, i);
+      int CC=KidCluster(CBM, C->ColCluster, NCK, j);
+      CBMNode *T=NewNode(RC, CC);
+      for(int k=0; k<NK; k++)
+       MultiplyAdd(CBM, T, 1.0, GetKid(A,i,k), GetKid(B,k,j));
+      if (T->U)
+       { int Rank=T->U->NC;
+         HMatrix *X=NewZeroMatrix(ClusterSize(CBM, C->RowCluster), Rank);
+         HMatrix *Y=NewZeroMatrix(Rank, ClusterSize(CBM, C->ColCluster));
+         SetBlock(X, KidOffset(CBM, C->RowCluster, NRK, i), 0, T->U);
+         SetBlock(Y, 0, KidOffset(CBM, C->ColCluster, NCK, j), T->V);
+         AddLowRank(CBM, C, Alpha, X, Y);
+         delete X;
+         delete Y;
+       };
+      DeleteNode(T);
+    };
+}
+
+/***************************************************************/
+/* X <- inv(F)*X for dense X, where F is a factorized diagonal */
+/* node                                                        */
+/***************************************************************/
+static int SolveDense(CompressedBEMMatrix *CBM, CBMNode *F, HMatrix *X)
+{
+  if (F->D)
+   return F->D->LUSolve(X);
+
+  int n0=ClusterSize(CBM, CBM->Clusters[F->RowCluster].Children[0]);
+  HMatrix *X0=GetRows(X, 0, n0);
+  HMatrix *X1=GetRows(X, n0, X->NR - n0);
+  int Info=SolveDense(CBM, F->Kids[0], X0);
+  MultiplyDense(CBM, F->Kids[2], -1.0, X0, X1);
+  if (Info==0)
+   Info=SolveDense(CBM, F->Kids[3], X1);
+  MultiplyDense(CBM, F->Kids[1], -1.0, X1, X0);
+  SetRows(X, 0, X0);
+  SetRows(X, n0, X1);
+  delete X0;
+  delete X1;
+  return Info;
+}
+
+/***************************************************************/
+/* X <- inv(F)*X for a node X whose row cluster is that of the */
+/* factorized diagonal node F                                  */
+/***************************************************************/
+static int SolveNode(CompressedBEMMatrix *CBM, CBMNode *F, CBMNode *X)
+{
+  if (X->D)
+   return SolveDense(CBM, F, X->D);
+
+  if (X->NumRowKids==0)
+   return X->U ? SolveDense(CBM, F, X->U) : 0;
+
+  int Info=0;
+  int NCK=X->NumColKids;
+  for(int j=0; j<NCK && Info==0; j++)
+   { if (F->D)
+      { Info=SolveNode(CBM, F, X->Kids[j]);
+        continue;
+      };
+     CBMNode *X0=X->Kids[j], *X1=X->Kids[NCK+j];
+     Info=SolveNode(CBM, F->Kids[0], X0);
+     MultiplyAdd(CBM, X1, -1.0, F->Kids[2], X0);
+     if (Info==0)
+      Info=SolveNode(CBM, F->Kids[3], X1);
+     MultiplyAdd(CBM, X0, -1.0, F->Kids[1], X1);
+   };
+  return Info;
+}
+
+/***************************************************************/
+/* factorize the diagonal node F in place                      */
+/***************************************************************/
+static int Factorize(CompressedBEMMatrix *CBM, CBMNode *F)
+{
+  if (F->D)
+   return F->D->LUFactorize(false);
+
+  int Info=Factorize(CBM, F->Kids[0]);
+  if (Info==0)
+   Info=SolveNode(CBM, F->Kids[0], F->Kids[1]);
+  if (Info==0)
+   { MultiplyAdd(CBM, F->Kids[3], -1.0, F->Kids[2], F->Kids[1]);
+     Info=Factorize(CBM, F->Kids[3]);
+   };
+  return Info;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::ClearLUFactors()
+{
+  DeleteNode(LUFactors);
+  LUFactors=0;
+}
+
+/***************************************************************/
+/* compute the H-LU factorization of the matrix. the return    */
+/* value is nonzero if a dense diagonal leaf (or a Schur       */
+/* complement thereof) turned out to be singular.              */
+/***************************************************************/
+int CompressedBEMMatrix::LUFactorize()
+{
+  if (NumBlocks==0)
+   ErrExit("%s:%i: CompressedBEMMatrix::LUFactorize called before Assemble",__FILE__,__LINE__);
+
+  ClearLUFactors();
+
+  BlockKey *Keys=(BlockKey *)mallocEC(NumBlocks*sizeof(BlockKey));
+  for(int nb=0; nb<NumBlocks; nb++)
+   { Keys[nb].Key = ((size_t)Blocks[nb].RowCluster)*NumClusters + Blocks[nb].ColCluster;
+     Keys[nb].nb  = nb;
+   };
+  qsort(Keys, NumBlocks, sizeof(BlockKey), CompareBlockKeys);
+  LUFactors=BuildNode(this, Keys, 0, 0, false);
+  free(Keys);
+
+  int Info=Factorize(this, LUFactors);
+  if (Info!=0)
+   { Warn("H-LU factorization of compressed BEM matrix failed (info=%i)",Info);
+     ClearLUFactors();
+     return Info;
+   };
+
+  Log(" H-LU factors: %.1f MB",
+        ((double)(GetNodeStorage(LUFactors)*sizeof(cdouble)))/1048576.0);
+  return 0;
+}
+
+/***************************************************************/
+/* on entry X is the RHS vector; on return it is the solution. */
+/***************************************************************/
+int CompressedBEMMatrix::LUSolve(HVector *X)
+{
+  if ( X->N!=N )
+   ErrExit("%s:%i: dimension mismatch in CompressedBEMMatrix::LUSolve",__FILE__,__LINE__);
+  if (LUFactors==0)
+   { int Info=LUFactorize();
+     if (Info!=0)
+      return Info;
+   };
+
+  int *BFIndices=Clusters[0].BFIndices;
+  HMatrix *XC=new HMatrix(N, 1, LHM_COMPLEX);
+  for(int n=0; n<N; n++)
+   XC->ZM[n] = X->ZV[ BFIndices[n] ];
+  int Info=SolveDense(this, LUFactors, XC);
+  for(int n=0; n<N; n++)
+   X->ZV[ BFIndices[n] ] = XC->ZM[n];
+  delete XC;
+  return Info;
+}
+
+} // namespace scuff
@@ -58,13 +58,25 @@ namespace scuff{
 /*                                                             */
 /* FMatrix[nx, 0..2]  = PV_{x,y,z};                            */
 /* FMatrix[nx, 3..11] = MST_{xx}, MST_{xy}, ..., MST_{zz}      */
+/*                                                             */
+/* The fluxes are bilinear in the field components at each     */
+/* point, which are in turn linear in the surface currents:    */
+/* if R_i (i=0..5) is the column of RFMatrix giving E_x, ...,  */
+/* H_z at point #nx, then the 6x6 matrix of field-field        */
+/* correlations at that point is                               */
+/*                                                             */
+/*  C_{ij} = \sum_{ab} conj(R_{ai}) W_{ab} R_{bj},              */
+/*                                                             */
+/*  W_{ab} = s_a s_b DR_{ba},                                   */
+/*                                                             */
+/* where s_a = 1 or -1/ZVAC for electric or magnetic currents. */
+/* Rather than summing over all (a,b) pairs separately for     */
+/* each point, we process the points in tiles and compute      */
+/* Q = DR^T * S * R for all columns of a tile at once with a   */
+/* single matrix-matrix multiplication; then C_{ij} is just    */
+/* the dot product of columns i of R and j of S*Q.             */
 /***************************************************************/
-
-// unique index for the contribution of thread #nt to the
-// SRFlux quantity #nq at spatial point #nx
-inline int GetSRFluxIndex(int NX, int nt, int nx, int nq)
-{ return nt*NX*NUMSRFLUX + nx*NUMSRFLUX + nq; }
-
+#define SRFLUX_TILESIZE 64
 HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
                         HMatrix *DRMatrix, HMatrix *FMatrix)
 { 
@@ -86,8 +98,6 @@ HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
   for(int ns=0; ns<G->NumSurfaces; ns++)
    if (G->Surfaces[ns]->IsPEC)
     ErrExit("GetSRFluxTrace not implemented for PEC bodies");
-  bool IsPECA=false;
-  bool IsPECB=false;
 
   Log("Computing spatially-resolved fluxes at %i evaluation points...",NX);
 
@@ -97,7 +107,7 @@ HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
   int NBF = G->TotalBFs;
   static int NBFSave = 0, NXSave=0;
   static HMatrix *RFMatrix=0;
-  if (NBFSave!=NBF || NXSave<NX)
+  if (NBFSave!=NBF || NXSave!=NX)
    { NBFSave = NBF;
      NXSave  = NX;
      if (RFMatrix) delete RFMatrix;
@@ -106,124 +116,109 @@ HMatrix *GetSRFluxTrace(RWGGeometry *G, HMatrix *XMatrix, cdouble Omega,
   G->GetRFMatrix(Omega, 0, XMatrix, RFMatrix);
 
   /***************************************************************/
-  /* allocate per-thread storage to avoid costly synchronization */
-  /* primitives in the multithreaded loop                        */
-  /* [note the array is automatically zeroed by mallocEC()]      */
+  /* scale factors for electric and magnetic current coefficients*/
   /***************************************************************/
+  double *SFactor = (double *)mallocEC(NBF*sizeof(double));
+  for(int neTot=0; neTot<G->TotalEdges; neTot++)
+   { int KNIndex;
+     G->ResolveEdge(neTot, 0, 0, &KNIndex);
+     SFactor[KNIndex+0] = 1.0;
+     SFactor[KNIndex+1] = -1.0/ZVAC;
+   };
+
+  G->UpdateCachedEpsMuValues(Omega);
+  int *RegionIndices=G->GetRegionIndices(XMatrix);
+
   int NumThreads=1;
 #ifdef USE_OPENMP
   NumThreads=GetNumThreads();
+  LogC("(%i threads)",NumThreads);
 #endif
 
-  size_t DeltaSRFluxSize = NumThreads*NX*NUMSRFLUX*sizeof(cdouble);
-  static size_t DeltaSRFluxSizeSave=0;
-  static cdouble *DeltaSRFlux = 0;
-  if (DeltaSRFluxSizeSave<DeltaSRFluxSize)
-   { 
-     DeltaSRFluxSizeSave=DeltaSRFluxSize;
-     DeltaSRFlux=(cdouble *)reallocEC(DeltaSRFlux,DeltaSRFluxSize);
-   };
-  memset(DeltaSRFlux, 0, DeltaSRFluxSize);
-
-  /***************************************************************/
   /***************************************************************/
+  /* loop over tiles of evaluation points                        */
   /***************************************************************/
-  G->UpdateCachedEpsMuValues(Omega);
-#ifdef USE_OPENMP
-  LogC("(%i threads)",NumThreads);
-#pragma omp parallel for schedule(dynamic,1),		\
-                         num_threads(NumThreads)
-#endif
-  for(int nx=0; nx<NX; nx++)
-   {
-     double X[3];
-     XMatrix->GetEntriesD(nx,"0:2",X);
-     int nr=G->GetRegionIndex(X);
-     double  MuAbs = TENTHIRDS*real(G->MuTF[nr] )*ZVAC;
-     double EpsAbs = TENTHIRDS*real(G->EpsTF[nr])/ZVAC;
-    
-     cdouble *EKN[3], *HKN[3];
-     for(int Mu=0; Mu<3; Mu++)
-      { EKN[Mu] = RFMatrix->ZM + NBF*(6*nx + 3*0 + Mu);
-        HKN[Mu] = RFMatrix->ZM + NBF*(6*nx + 3*1 + Mu);
-      };
+  int TileSize = (NX < SRFLUX_TILESIZE) ? NX : SRFLUX_TILESIZE;
+  HMatrix *SR = new HMatrix(NBF, 6*TileSize, LHM_COMPLEX);
+  HMatrix *Q  = new HMatrix(NBF, 6*TileSize, LHM_COMPLEX);
+  for(int nxStart=0; nxStart<NX; nxStart+=TileSize)
+   { 
+     int NXTile = (nxStart+TileSize <= NX) ? TileSize : NX-nxStart;
+     int NC=6*NXTile;
+     cdouble *R = RFMatrix->ZM + NBF*6*nxStart;
+
+     // SR = S*R, Q = DR^T * SR
+     HMatrix SRTile(NBF, NC, LHM_COMPLEX, LHM_NORMAL, (void *)SR->ZM);
+     HMatrix QTile(NBF, NC, LHM_COMPLEX, LHM_NORMAL, (void *)Q->ZM);
+     for(int nc=0; nc<NC; nc++)
+      for(int a=0; a<NBF; a++)
+       SR->ZM[nc*NBF + a] = SFactor[a]*R[nc*NBF + a];
+     DRMatrix->Multiply(&SRTile, &QTile, "--transA T");
 
-     for(int neaTot=0; neaTot<G->TotalEdges; neaTot++)
-      for(int nebTot=0; nebTot<G->TotalEdges; nebTot++)
-       { 
-         int nsa, nea, nsb, neb, KNIndexA, KNIndexB;
-         G->ResolveEdge(neaTot, &nsa, &nea, &KNIndexA);
-         G->ResolveEdge(nebTot, &nsb, &neb, &KNIndexB);
-
-         cdouble Bilinears[4];
-         GetKNBilinears(0, DRMatrix,
-                        IsPECA, KNIndexA, IsPECB, KNIndexB, Bilinears);
-         cdouble KK=Bilinears[0];
-         cdouble KN=Bilinears[1]/(-1.0*ZVAC);
-         cdouble NK=Bilinears[2]/(-1.0*ZVAC);
-         cdouble NN=Bilinears[3]/(ZVAC*ZVAC);
- 
-         cdouble EE[3][3], EH[3][3], HH[3][3];
-         for(int Mu=0; Mu<3; Mu++)
-          for(int Nu=0; Nu<3; Nu++)
-           { EE[Mu][Nu] =  KK*conj(EKN[Mu][KNIndexA+0])*EKN[Nu][KNIndexB+0]
-                          +KN*conj(EKN[Mu][KNIndexA+0])*EKN[Nu][KNIndexB+1]
-                          +NK*conj(EKN[Mu][KNIndexA+1])*EKN[Nu][KNIndexB+0]
-                          +NN*conj(EKN[Mu][KNIndexA+1])*EKN[Nu][KNIndexB+1];
-
-             EH[Mu][Nu] =  KK*conj(EKN[Mu][KNIndexA+0])*HKN[Nu][KNIndexB+0]
-                          +KN*conj(EKN[Mu][KNIndexA+0])*HKN[Nu][KNIndexB+1]
-                          +NK*conj(EKN[Mu][KNIndexA+1])*HKN[Nu][KNIndexB+0]
-                          +NN*conj(EKN[Mu][KNIndexA+1])*HKN[Nu][KNIndexB+1];
-
-             HH[Mu][Nu] =  KK*conj(HKN[Mu][KNIndexA+0])*HKN[Nu][KNIndexB+0]
-                          +KN*conj(HKN[Mu][KNIndexA+0])*HKN[Nu][KNIndexB+1]
-                          +NK*conj(HKN[Mu][KNIndexA+1])*HKN[Nu][KNIndexB+0]
-                          +NN*conj(HKN[Mu][KNIndexA+1])*HKN[Nu][KNIndexB+1];
-           };
-
-         cdouble Trace, PV[3], MST[3][3];
-         Trace = EpsAbs*(EE[0][0] + EE[1][1] + EE[2][2])
-                 +MuAbs*(HH[0][0] + HH[1][1] + HH[2][2]);
-
-         PV[0] = 0.5*( EH[1][2] - EH[2][1] );
-         PV[1] = 0.5*( EH[2][0] - EH[0][2] );
-         PV[2] = 0.5*( EH[0][1] - EH[1][0] );
-
-         for(int Mu=0; Mu<3; Mu++)
-          for(int Nu=0; Nu<3; Nu++)
-           MST[Mu][Nu] = 0.5*(EpsAbs*EE[Mu][Nu] + MuAbs*HH[Mu][Nu]);
-         MST[0][0] -= 0.25*Trace;
-         MST[1][1] -= 0.25*Trace;
-         MST[2][2] -= 0.25*Trace;
-
-         int nt=0;
 #ifdef USE_OPENMP
-         nt = omp_get_thread_num();
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
 #endif
-         int Index=GetSRFluxIndex(NX, nt, nx, 0);
-         for(int Mu=0; Mu<3; Mu++)
-          DeltaSRFlux[Index++] += PV[Mu];
-         for(int Mu=0; Mu<3; Mu++)
-          for(int Nu=0; Nu<3; Nu++)
-           DeltaSRFlux[Index++] += MST[Mu][Nu];
-
-       }; // for(int nbfA=0 ... for(int nbfB=0...
-
-   }; //for(int nx=0; nx<NX; nx++)
-         
-  /*--------------------------------------------------------------*/
-  /*- sum contributions of all threads ---------------------------*/
-  /*--------------------------------------------------------------*/
-  FMatrix->Zero();
-  for(int nx=0; nx<NX; nx++)
-   for(int nq=0; nq<NUMSRFLUX; nq++)
-    for(int nt=0; nt<NumThreads; nt++)
-     FMatrix->AddEntry(nx, nq, real(DeltaSRFlux[ GetSRFluxIndex(NX, nt, nx, nq)] ));
+     for(int nxt=0; nxt<NXTile; nxt++)
+      { 
+        int nx=nxStart+nxt;
+        int nr=RegionIndices[nx];
+        double  MuAbs = TENTHIRDS*real(G->MuTF[nr] )*ZVAC;
+        double EpsAbs = TENTHIRDS*real(G->EpsTF[nr])/ZVAC;
+
+        // 6x6 field-field correlation matrix at this point
+        cdouble C[6][6];
+        for(int i=0; i<6; i++)
+         for(int j=0; j<6; j++)
+          { cdouble *Ri = R     + NBF*(6*nxt + i);
+            cdouble *Qj = Q->ZM + NBF*(6*nxt + j);
+            cdouble Sum=0.0;
+            for(int a=0; a<NBF; a++)
+             Sum += conj(Ri[a]) * SFactor[a] * Qj[a];
+            C[i][j]=Sum;
+          };
+
+        cdouble EE[3][3], EH[3][3], HH[3][3];
+        for(int Mu=0; Mu<3; Mu++)
+         for(int Nu=0; Nu<3; Nu++)
+          { EE[Mu][Nu] = C[0+Mu][0+Nu];
+            EH[Mu][Nu] = C[0+Mu][3+Nu];
+            HH[Mu][Nu] = C[3+Mu][3+Nu];
+          };
+
+        cdouble Trace, PV[3], MST[3][3];
+        Trace = EpsAbs*(EE[0][0] + EE[1][1] + EE[2][2])
+                +MuAbs*(HH[0][0] + HH[1][1] + HH[2][2]);
+
+        PV[0] = 0.5*( EH[1][2] - EH[2][1] );
+        PV[1] = 0.5*( EH[2][0] - EH[0][2] );
+        PV[2] = 0.5*( EH[0][1] - EH[1][0] );
+
+        for(int Mu=0; Mu<3; Mu++)
+         for(int Nu=0; Nu<3; Nu++)
+          MST[Mu][Nu] = 0.5*(EpsAbs*EE[Mu][Nu] + MuAbs*HH[Mu][Nu]);
+        MST[0][0] -= 0.25*Trace;
+        MST[1][1] -= 0.25*Trace;
+        MST[2][2] -= 0.25*Trace;
+
+        int nq=0;
+        for(int Mu=0; Mu<3; Mu++)
+         FMatrix->SetEntry(nx, nq++, real(PV[Mu]));
+        for(int Mu=0; Mu<3; Mu++)
+         for(int Nu=0; Nu<3; Nu++)
+          FMatrix->SetEntry(nx, nq++, real(MST[Mu][Nu]));
+
+      }; // for(int nxt=0; nxt<NXTile; nxt++)
+
+   }; // for(int nxStart=0; nxStart<NX; nxStart+=TileSize)
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
+  delete Q;
+  delete SR;
+  free(RegionIndices);
+  free(SFactor);
+
   return FMatrix;
 
 } // routine GetSRFlux
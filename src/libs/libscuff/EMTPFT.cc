@@ -341,7 +341,11 @@ void GetScatteredPFTIntegrals(RWGGeometry *G,
      Args->NumRegions = 1;
      Args->k[0] = k;
      Args->NeedGC=Args->NeedForce=Args->NeedTorque=true;
-     Args->FIBBICache = (nsa==nsb) ? G->FIBBICaches[nsa] : 0;
+     // FIBBI cache keys encode the relative positions of both basis
+     // functions, so the cache is equally valid for touching pairs
+     // on distinct surfaces; without it the frequency-independent
+     // singular integrals for those pairs are redone at every frequency
+     Args->FIBBICache = G->FIBBICaches[nsa];
      cdouble GabArray[2][NUMGCMES];
      cdouble ikCabArray[2][NUMGCMES];
      GetGCMatrixElements(G, Args, nea, neb, GabArray, ikCabArray);
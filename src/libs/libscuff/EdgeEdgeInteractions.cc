@@ -43,6 +43,59 @@ namespace scuff {
 // DBFTHRESHOLD * the larger of the radii of the two basis functions
 #define DBFTHRESHOLD 10.0
 
+/***************************************************************/
+/* get a single panel-panel interaction, from the panel-moment */
+/* cache if there is one that applies, and otherwise directly. */
+/***************************************************************/
+static void GetPPIs(GetEEIArgStruct *Args, GetPPIArgStruct *GetPPIArgs,
+                    cdouble *H, cdouble *GradH, cdouble *dHdT)
+{
+  PPIMomentCache *PMC=Args->PMC;
+  if (    PMC 
+       && PMC->NumKs==1 && PMC->ks[0]==GetPPIArgs->k
+       && PMC->Sa==GetPPIArgs->Sa && PMC->Sb==GetPPIArgs->Sb
+       && GetPPIArgs->NumGradientComponents==0
+       && GetPPIArgs->NumTorqueAxes==0
+       && GetPPIArgs->Displacement==0
+       && GetPPIArgs->GBA==0
+       && PMC->GetPPIs(GetPPIArgs->npa, GetPPIArgs->iQa,
+                       GetPPIArgs->npb, GetPPIArgs->iQb, H)
+     )
+   { Args->PPIAlgorithmCount[PPIALG_LOCUBATURE]++;
+     return;
+   };
+
+  GetPanelPanelInteractions(GetPPIArgs, H, GradH, dHdT);
+  Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithm]++;
+}
+
+/***************************************************************/
+/* multi-wavenumber version of GetPPIs                         */
+/***************************************************************/
+static void GetPPIs(GetEEIArgStruct *Args, GetPPIArgStruct *GetPPIArgs,
+                    int NumKs, cdouble *ks, cdouble *H)
+{
+  PPIMomentCache *PMC=Args->PMC;
+  bool UsePMC = (PMC && PMC->NumKs==NumKs 
+                     && PMC->Sa==GetPPIArgs->Sa && PMC->Sb==GetPPIArgs->Sb);
+  for(int nk=0; UsePMC && nk<NumKs; nk++)
+   if (PMC->ks[nk]!=ks[nk]) 
+    UsePMC=false;
+
+  if (    UsePMC
+       && PMC->GetPPIs(GetPPIArgs->npa, GetPPIArgs->iQa,
+                       GetPPIArgs->npb, GetPPIArgs->iQb, H)
+     )
+   { Args->PPIAlgorithmCount[PPIALG_LOCUBATURE]+=NumKs;
+     return;
+   };
+
+  int WhichAlgorithms[MAXPPIKS];
+  GetPanelPanelInteractions(GetPPIArgs, NumKs, ks, H, WhichAlgorithms);
+  for(int nk=0; nk<NumKs; nk++)
+   Args->PPIAlgorithmCount[WhichAlgorithms[nk]]++;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -152,28 +205,24 @@ void GetEdgeEdgeInteractions(GetEEIArgStruct *Args)
   /*--------------------------------------------------------------*/
   GetPPIArgs->npa = Ea->iPPanel;     GetPPIArgs->iQa = Ea->PIndex;
   GetPPIArgs->npb = Eb->iPPanel;     GetPPIArgs->iQb = Eb->PIndex;
-  GetPanelPanelInteractions(GetPPIArgs, HPP, GradHPP, dHdTPP);
-  Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithm]++;
+  GetPPIs(Args, GetPPIArgs, HPP, GradHPP, dHdTPP);
 
   if ( Eb->iMPanel!=-1 )
    { GetPPIArgs->npa = Ea->iPPanel;     GetPPIArgs->iQa = Ea->PIndex;
      GetPPIArgs->npb = Eb->iMPanel;     GetPPIArgs->iQb = Eb->MIndex;
-     GetPanelPanelInteractions(GetPPIArgs, HPM, GradHPM, dHdTPM);
-     Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithm]++;
+     GetPPIs(Args, GetPPIArgs, HPM, GradHPM, dHdTPM);
    };
 
   if ( Ea->iMPanel!=-1 )
    { GetPPIArgs->npa = Ea->iMPanel;     GetPPIArgs->iQa = Ea->MIndex;
      GetPPIArgs->npb = Eb->iPPanel;     GetPPIArgs->iQb = Eb->PIndex;
-     GetPanelPanelInteractions(GetPPIArgs, HMP, GradHMP, dHdTMP);
-     Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithm]++;
+     GetPPIs(Args, GetPPIArgs, HMP, GradHMP, dHdTMP);
    };
  
   if ( Ea->iMPanel!=-1 && Eb->iMPanel!=-1 )
    { GetPPIArgs->npa = Ea->iMPanel;     GetPPIArgs->iQa = Ea->MIndex;
      GetPPIArgs->npb = Eb->iMPanel;     GetPPIArgs->iQb = Eb->MIndex;
-     GetPanelPanelInteractions(GetPPIArgs, HMM, GradHMM, dHdTMM);
-     Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithm]++;
+     GetPPIs(Args, GetPPIArgs, HMM, GradHMM, dHdTMM);
    };
 
   /*--------------------------------------------------------------*/
@@ -291,6 +340,82 @@ void CreateGammaMatrix(double Theta, double Phi, double *GammaMatrix)
   CreateGammaMatrix(TorqueAxis,GammaMatrix);
 } 
 
+/***************************************************************/
+/* multi-wavenumber version of GetEdgeEdgeInteractions: on     */
+/* return, GC[2*nk + 0,1] are the G and C integrals for        */
+/* wavenumber ks[nk]. Args->k is ignored, and derivatives are  */
+/* not available in this version.                              */
+/***************************************************************/
+void GetEdgeEdgeInteractions(GetEEIArgStruct *Args, int NumKs, cdouble *ks, cdouble *GC)
+{
+  if (NumKs<1 || NumKs>MAXPPIKS)
+   ErrExit("%s:%i: invalid number of wavenumbers (%i)",__FILE__,__LINE__,NumKs);
+  if (Args->NumGradientComponents>0 || Args->NumTorqueAxes>0)
+   ErrExit("%s:%i: derivatives not available in multi-wavenumber EEIs",__FILE__,__LINE__);
+
+  /*--------------------------------------------------------------*/
+  /*- periodic and displaced cases, and the k==0 case, are done  -*/
+  /*- one wavenumber at a time                                   -*/
+  /*--------------------------------------------------------------*/
+  bool Batch = (Args->GBA==0 && Args->Displacement==0);
+  for(int nk=0; Batch && nk<NumKs; nk++)
+   if ( real(ks[nk])==0.0 && imag(ks[nk])==0.0 )
+    Batch=false;
+  if (!Batch)
+   { for(int nk=0; nk<NumKs; nk++)
+      { Args->k=ks[nk];
+        GetEdgeEdgeInteractions(Args);
+        memcpy(GC + 2*nk, Args->GC, 2*sizeof(cdouble));
+      };
+     return;
+   };
+
+  RWGSurface *Sa=Args->Sa;
+  RWGSurface *Sb=Args->Sb;
+  RWGEdge *Ea=Sa->Edges[Args->nea];
+  RWGEdge *Eb=Sb->Edges[Args->neb];
+
+  cdouble HPP[2*MAXPPIKS], HPM[2*MAXPPIKS], HMP[2*MAXPPIKS], HMM[2*MAXPPIKS];
+  memset(HPM, 0, 2*NumKs*sizeof(cdouble));
+  memset(HMP, 0, 2*NumKs*sizeof(cdouble));
+  memset(HMM, 0, 2*NumKs*sizeof(cdouble));
+
+  GetPPIArgStruct MyGetPPIArgs, *GetPPIArgs=&MyGetPPIArgs;
+  InitGetPPIArgs(GetPPIArgs);
+  GetPPIArgs->Sa   = Sa;
+  GetPPIArgs->Sb   = Sb;
+  GetPPIArgs->opFC = Args->opFC;
+
+  GetPPIArgs->npa = Ea->iPPanel;     GetPPIArgs->iQa = Ea->PIndex;
+  GetPPIArgs->npb = Eb->iPPanel;     GetPPIArgs->iQb = Eb->PIndex;
+  GetPPIs(Args, GetPPIArgs, NumKs, ks, HPP);
+
+  if ( Eb->iMPanel!=-1 )
+   { GetPPIArgs->npa = Ea->iPPanel;     GetPPIArgs->iQa = Ea->PIndex;
+     GetPPIArgs->npb = Eb->iMPanel;     GetPPIArgs->iQb = Eb->MIndex;
+     GetPPIs(Args, GetPPIArgs, NumKs, ks, HPM);
+   };
+
+  if ( Ea->iMPanel!=-1 )
+   { GetPPIArgs->npa = Ea->iMPanel;     GetPPIArgs->iQa = Ea->MIndex;
+     GetPPIArgs->npb = Eb->iPPanel;     GetPPIArgs->iQb = Eb->PIndex;
+     GetPPIs(Args, GetPPIArgs, NumKs, ks, HMP);
+   };
+ 
+  if ( Ea->iMPanel!=-1 && Eb->iMPanel!=-1 )
+   { GetPPIArgs->npa = Ea->iMPanel;     GetPPIArgs->iQa = Ea->MIndex;
+     GetPPIArgs->npb = Eb->iMPanel;     GetPPIArgs->iQb = Eb->MIndex;
+     GetPPIs(Args, GetPPIArgs, NumKs, ks, HMM);
+   };
+
+  double GPreFac = Ea->Length*Eb->Length;
+  for(int nk=0, n=0; nk<NumKs; nk++, n+=2)
+   { cdouble CPreFac = Ea->Length*Eb->Length / (II*ks[nk]);
+     GC[n+0] = GPreFac*(HPP[n+0] - HPM[n+0] - HMP[n+0] + HMM[n+0]);
+     GC[n+1] = CPreFac*(HPP[n+1] - HPM[n+1] - HMP[n+1] + HMM[n+1]);
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -301,6 +426,7 @@ void InitGetEEIArgs(GetEEIArgStruct *Args)
   Args->GammaMatrix=0;
   Args->Displacement=0;
   Args->opFC=0;
+  Args->PMC=0;
   Args->Force=EEI_NOFORCE;
   Args->GBA=0;
   Args->ForceFullEwald=false;
@@ -0,0 +1,173 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * FFT.cc -- mixed-radix fast Fourier transforms of complex data in
+ *        -- three dimensions, for the grid convolutions done by
+ *        -- MatrixFreeBEMOperator
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+/***************************************************************/
+/* smallest integer >= MinLength with no prime factors other   */
+/* than 2, 3, 5                                                */
+/***************************************************************/
+int GetFFTLength(int MinLength)
+{
+  for(int L=(MinLength<1 ? 1 : MinLength); ; L++)
+   { int M=L;
+     while(M%2==0) M/=2;
+     while(M%3==0) M/=3;
+     while(M%5==0) M/=5;
+     if (M==1) return L;
+   };
+}
+
+/***************************************************************/
+/* Stockham autosort FFT of length NTot, radix 4, 2, 3, 5.     */
+/* Roots[n] = exp(Sign*2*pi*i*n/NTot). x and y are both        */
+/* overwritten; the return value is whichever of the two holds */
+/* the transform.                                              */
+/*                                                             */
+/* at each stage, x holds s interleaved sequences of length n, */
+/* each of which is split into r sequences of length m=n/r by  */
+/* a radix-r decimation-in-frequency butterfly.                */
+/***************************************************************/
+static cdouble *FFT1D(int NTot, cdouble *x, cdouble *y, cdouble *Roots)
+{
+  int n=NTot, s=1;
+  while(n>1)
+   { int r = (n%4==0) ? 4 : (n%2==0) ? 2 : (n%3==0) ? 3 : 5;
+     int m = n/r;
+     int TwiddleStride = NTot/n;
+     int RadixStride   = NTot/r;
+
+     cdouble W[5][5];
+     for(int j=0; j<r; j++)
+      for(int k=0; k<r; k++)
+       W[j][k] = Roots[ (j*k*RadixStride) % NTot ];
+
+     for(int p=0; p<m; p++)
+      { cdouble Twiddle[5];
+        for(int k=0; k<r; k++)
+         Twiddle[k] = Roots[p*k*TwiddleStride];
+        for(int q=0; q<s; q++)
+         { cdouble a[5];
+           for(int j=0; j<r; j++)
+            a[j]=x[q + s*(p + j*m)];
+           for(int k=0; k<r; k++)
+            { cdouble b=a[0];
+              for(int j=1; j<r; j++)
+               b+=a[j]*W[j][k];
+              y[q + s*(r*p + k)] = b*Twiddle[k];
+            };
+         };
+      };
+
+     cdouble *t=x; x=y; y=t;
+     n=m;
+     s*=r;
+   };
+  return x;
+}
+
+/***************************************************************/
+/* in-place, unnormalized 3D FFT of Data[i + L[0]*(j + L[1]*k)]*/
+/* with sign convention exp(Sign*2*pi*i*...) (Sign = +-1).     */
+/*                                                             */
+/* if InBox is non-null, the input is taken to vanish outside  */
+/* the box [0,InBox[0]) x [0,InBox[1]) x [0,InBox[2]); if      */
+/* OutBox is non-null, only outputs inside the corresponding   */
+/* box are computed and the rest of Data is left undefined.    */
+/* the 1D transforms of lines that do not contribute are       */
+/* skipped.                                                    */
+/***************************************************************/
+void FFT3D(cdouble *Data, int L[3], int Sign, int *InBox, int *OutBox)
+{
+  int LMax = L[0];
+  if (L[1]>LMax) LMax=L[1];
+  if (L[2]>LMax) LMax=L[2];
+
+  int NumThreads=GetNumThreads();
+  cdouble *Roots   = (cdouble *)mallocEC(LMax*sizeof(cdouble));
+  cdouble *Buffers = (cdouble *)mallocEC(2*NumThreads*LMax*sizeof(cdouble));
+
+  size_t Stride[3];
+  Stride[0]=1;
+  Stride[1]=L[0];
+  Stride[2]=((size_t)L[0])*L[1];
+
+  for(int a=0; a<3; a++)
+   {
+     int La=L[a];
+     if (La==1) continue;
+     for(int n=0; n<La; n++)
+      { double Theta = Sign*2.0*M_PI*((double)n)/((double)La);
+        Roots[n]=cdouble(cos(Theta), sin(Theta));
+      };
+
+     // the other two axes, and the ranges of their indices over
+     // which lines along axis a must be transformed
+     int b=(a+1)%3, c=(a+2)%3;
+     int Nb = (b<a) ? (OutBox ? OutBox[b] : L[b]) : (InBox ? InBox[b] : L[b]);
+     int Nc = (c<a) ? (OutBox ? OutBox[c] : L[c]) : (InBox ? InBox[c] : L[c]);
+     int NumLines=Nb*Nc;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+     for(int nl=0; nl<NumLines; nl++)
+      { int nt=0;
+#ifdef USE_OPENMP
+        nt=omp_get_thread_num();
+#endif
+        cdouble *x = Buffers + 2*nt*LMax, *y = x + LMax;
+        cdouble *Line = Data + (nl%Nb)*Stride[b] + (nl/Nb)*Stride[c];
+        for(int n=0; n<La; n++)
+         x[n]=Line[n*Stride[a]];
+        cdouble *Result=FFT1D(La, x, y, Roots);
+        for(int n=0; n<La; n++)
+         Line[n*Stride[a]]=Result[n];
+      };
+   };
+
+  free(Buffers);
+  free(Roots);
+}
+
+} // namespace scuff
@@ -47,6 +47,7 @@
 
 #include <libhrutil.h>
 #include "libscuff.h"
+#include "libscuffInternals.h"
 
 namespace scuff {
 
@@ -63,6 +64,7 @@ void ComputeFIBBIData(RWGSurface *Sa, int nea,
 #define MAXSTR 256
 
 #define SUFFIX "scuffcache"
+#define MAPPED_SUFFIX "scuffmcache"
 
 /*--------------------------------------------------------------*/
 /*- note: i found this on wikipedia ... ------------------------*/
@@ -142,7 +144,8 @@ public:
    int PreLoad(const char *FileName);
    int Size(int *pHits, int *pMisses);
 
-   // data
+   // data; Hits and Misses are updated atomically, as
+   // GetFIBBIData() may be called from several threads at once
    int Hits, Misses;
    void *opTable;
 
@@ -151,6 +154,9 @@ public:
    char *LastFileName;
    unsigned int NumRecordsInFile;
 
+   // shared on-disk table consulted before opTable, if present
+   MappedCache *MC;
+
 };
 
 /*--------------------------------------------------------------*/
@@ -170,14 +176,35 @@ FIBBICache::FIBBICache(char *MeshFileName)
   /*--------------------------------------------------------------*/
   LastFileName=0;
   NumRecordsInFile=0;
+  MC=0;
   if (MeshFileName)
    { 
      char CacheFileName[MAXSTR];
      int Status=1;
 
-     // first look for ${SCUFF_CACHE_PATH}/MeshFile.scuffcache 
+     // if the user has asked for a shared cache file by setting 
+     // SCUFF_MAPPED_CACHE=1, or if one exists already, map 
+     // ${SCUFF_CACHE_PATH}/MeshFile.scuffmcache (or ./MeshFile.scuffmcache)
      char *CacheDir=getenv("SCUFF_CACHE_PATH");
      if (CacheDir)
+      snprintf(CacheFileName, MAXSTR, "%s/%s.%s",
+               CacheDir,GetFileBase(MeshFileName),MAPPED_SUFFIX);
+     else
+      snprintf(CacheFileName, MAXSTR, "%s.%s",
+               GetFileBase(MeshFileName),MAPPED_SUFFIX);
+     char *s=getenv("SCUFF_MAPPED_CACHE");
+     if ( (s && s[0]=='1') || MappedCache::IsMappedCacheFile(CacheFileName) )
+      { MC=new MappedCache(CacheFileName, KEYSIZE, DATASIZE);
+        if (!MC->IsValid())
+         { delete MC;
+           MC=0;
+         };
+      };
+
+     // otherwise first look for ${SCUFF_CACHE_PATH}/MeshFile.scuffcache 
+     if (MC)
+      Status=0;
+     else if (CacheDir)
       { snprintf(CacheFileName, MAXSTR, "%s/%s.%s",
                  CacheDir,GetFileBase(MeshFileName),SUFFIX);
         Status=PreLoad(CacheFileName);
@@ -204,6 +231,8 @@ FIBBICache::~FIBBICache()
   KDMap *KDM = (KDMap *)opTable;
   delete KDM;
 
+  if (MC) delete MC;
+
 } 
 
 /***************************************************************/
@@ -283,6 +312,15 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
   KeyStruct Key;
   GetFIBBICacheKey(SA, neA, SB, neB, Key.Key);
 
+  if (MC)
+   { double *SharedFIBBIs=(double *)MC->Lookup(Key.Key);
+     if (SharedFIBBIs)
+      { memcpy(FIBBIs, SharedFIBBIs, DATASIZE);
+        __atomic_fetch_add(&Hits, 1, __ATOMIC_RELAXED);
+        return;
+      };
+   };
+
   KDMap *KDM    = (KDMap *)opTable;
   bool Found;
   pthread_rwlock_rdlock(&lock);
@@ -292,7 +330,7 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
   pthread_rwlock_unlock(&lock);
 
   if ( Found )
-   { Hits++;
+   { __atomic_fetch_add(&Hits, 1, __ATOMIC_RELAXED);
      return;
    };
   
@@ -300,8 +338,10 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
   /* if it was not found, compute a new FIBBI data record and add*/
   /* it to the cache                                             */
   /***************************************************************/
-  Misses++;
+  __atomic_fetch_add(&Misses, 1, __ATOMIC_RELAXED);
   ComputeFIBBIData(SA, neA, SB, neB, FIBBIs);
+  if ( MC && MC->Insert(Key.Key, FIBBIs) )
+   return;
   DataStruct DS;
   memcpy(DS.Data, FIBBIs, DATASIZE);
   pthread_rwlock_wrlock(&lock);
@@ -334,6 +374,12 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
 /* of the FIBBI data record for that search key.               */
 /*                                                             */
 /* note: FIBBICF = 'FIBBI cache file'                          */
+/*                                                             */
+/* if SCUFF_MAPPED_CACHE=1, or if a file MeshFile.scuffmcache  */
+/* exists, the cache is instead kept in that memory-mapped     */
+/* file (see MappedCache.cc), which is shared by all processes */
+/* working with the same mesh and updated as new records are   */
+/* computed, so there is nothing to store or preload.          */
 /***************************************************************/
 const char FIBBICF_GSignature[]  = "FIBBI_CACHE";
 #define FIBBICF_SIGSIZE (sizeof(FIBBICF_GSignature))
@@ -342,6 +388,12 @@ void FIBBICache::Store(const char *MeshFileName)
 {
   if (!MeshFileName)
    return;
+
+  if (MC)
+   { Log("FC::S FIBBI cache %s is memory-mapped (%lu records; skipping cache dump)",
+          MC->FileName,(unsigned long)MC->NumRecords());
+     return;
+   };
   char MFNCopy[MAXSTR];
   strncpy(MFNCopy,MeshFileName,MAXSTR);
 
@@ -527,7 +579,7 @@ int FIBBICache::Size(int *pHits, int *pMisses)
   if (pMisses) *pMisses=Misses;
   if (opTable==0) return -1;
   KDMap *KDM = (KDMap *)opTable;
-  return KDM->size();
+  return KDM->size() + (MC ? MC->NumRecords() : 0);
 
 }
 
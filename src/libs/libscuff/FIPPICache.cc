@@ -117,6 +117,7 @@ FIPPICache::FIPPICache()
   opTable = (void *)KVM;
   PreloadFileName=0;
   RecordsPreloaded=0;
+  MC=0;
 }
 
 /*--------------------------------------------------------------*/
@@ -129,6 +130,9 @@ FIPPICache::~FIPPICache()
 
   KeyValueMap *KVM=(KeyValueMap *)opTable;
   delete KVM;
+
+  if (MC)
+   delete MC;
 } 
 
 static void inline VecSubFloat(double *V1, double *V2, float *V1mV2)
@@ -170,8 +174,17 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   VecSubFloat(OVb[2], OVa[0], K.Key+12 );
 
   /***************************************************************/
-  /* look for this key in the cache ******************************/
+  /* look for this key in the shared on-disk cache, if we have   */
+  /* one, and then in the process-local cache                    */
   /***************************************************************/
+  if (MC)
+   { QIFIPPIData *QIFD=(QIFIPPIData *)MC->Lookup(K.Key);
+     if (QIFD)
+      { __atomic_fetch_add(&Hits, 1, __ATOMIC_RELAXED);
+        return QIFD;
+      };
+   };
+
   KeyValueMap *KVM=(KeyValueMap *)opTable;
 
   FCLock.read_lock();
@@ -179,7 +192,7 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   FCLock.read_unlock();
 
   if ( p != (KVM->end()) )
-   { Hits++;
+   { __atomic_fetch_add(&Hits, 1, __ATOMIC_RELAXED);
      return (QIFIPPIData *)(p->second);
    };
   
@@ -187,11 +200,23 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   /* if it was not found, allocate and compute a new QIFIPPIData */
   /* structure, then add this structure to the cache             */
   /***************************************************************/
-  Misses++;
-  KeyStruct *K2 = (KeyStruct *)mallocEC(sizeof(*K2));
-  memcpy(K2->Key, K.Key, KEYSIZE);
+  __atomic_fetch_add(&Misses, 1, __ATOMIC_RELAXED);
   QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
   ComputeQIFIPPIData(OVa, OVb, ncv, QIFD);
+
+  // if the shared cache accepts the new record, the copy in the
+  // mapped file is the one we keep; otherwise (file full or 
+  // read-only) we fall back to the process-local table
+  if (MC)
+   { QIFIPPIData *SharedQIFD=(QIFIPPIData *)MC->Insert(K.Key, QIFD);
+     if (SharedQIFD)
+      { free(QIFD);
+        return SharedQIFD;
+      };
+   };
+
+  KeyStruct *K2 = (KeyStruct *)mallocEC(sizeof(*K2));
+  memcpy(K2->Key, K.Key, KEYSIZE);
    
   FCLock.write_lock();
   KVM->insert( KeyValuePair(*K2, QIFD) );
@@ -219,6 +244,10 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
 /* of the QIFIPPIDataRecord for that search key.               */
 /*                                                             */
 /* note: FIPPICF = 'FIPPI cache file'                          */
+/*                                                             */
+/* alternatively, PreLoad() may attach a memory-mapped cache   */
+/* file (see MappedCache.cc) that is shared with other         */
+/* processes and updated as new records are computed.          */
 /***************************************************************/
 const char FIPPICF_Signature[]="FIPPICACHE";
 #define FIPPICF_SIGSIZE sizeof(FIPPICF_Signature)
@@ -239,6 +268,16 @@ void FIPPICache::Store(const char *FileName)
 
   if (FileName==0) return;
 
+  /*--------------------------------------------------------------*/
+  /*- records in a shared (memory-mapped) cache file are written  */
+  /*- to the file as soon as they are computed                    */
+  /*--------------------------------------------------------------*/
+  if ( MC && !strcmp(MC->FileName, FileName) )
+   { Log("FIPPI cache %s is memory-mapped (%lu records; skipping cache dump)",
+          FileName,(unsigned long)MC->NumRecords());
+     return;
+   };
+
   /*--------------------------------------------------------------*/
   /*- pause to check if the following conditions are satisfied:  -*/
   /*-  (1) the FIPPI cache was preloaded from an input file whose-*/
@@ -310,6 +349,23 @@ void FIPPICache::Store(const char *FileName)
 
 void FIPPICache::PreLoad(const char *FileName)
 {
+  /*--------------------------------------------------------------*/
+  /*- if the file is a shared cache file (or if the user asked    */
+  /*- for one by setting SCUFF_MAPPED_CACHE), map it instead of   */
+  /*- reading it into memory.                                     */
+  /*--------------------------------------------------------------*/
+  char *s=getenv("SCUFF_MAPPED_CACHE");
+  if ( (s && s[0]=='1') || MappedCache::IsMappedCacheFile(FileName) )
+   { MappedCache *NewMC=new MappedCache(FileName, KEYSIZE, sizeof(QIFIPPIData));
+     if (NewMC->IsValid())
+      { FCLock.write_lock();
+        if (MC) delete MC;
+        MC=NewMC;
+        FCLock.write_unlock();
+        return;
+      };
+     delete NewMC;
+   };
 
   FCLock.write_lock();
 
@@ -21,8 +21,11 @@
  * GBarAccelerator.h -- 
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <libhrutil.h>
 #include <libMDInterp.h>
@@ -101,6 +104,83 @@ void GBarVDPhi3D(double X1, double X2, double X3, void *UserData, double *PhiVD)
 
 } 
 
+/***************************************************************/
+/* Interp3D callback that looks up GBar values precomputed at  */
+/* the nodes of a uniform grid.                                */
+/***************************************************************/
+typedef struct GBarGridData
+ { int N1, N2, N3;
+   double X1Min, X1Max, X2Min, X2Max, X3Min, X3Max;
+   cdouble *GBarVD;
+ } GBarGridData;
+
+static void GBarGridPhi3D(double X1, double X2, double X3, void *UserData, double *PhiVD)
+{
+  GBarGridData *Data = (GBarGridData *)UserData;
+
+  int N1=Data->N1, N2=Data->N2, N3=Data->N3;
+  int n1 = lround( (N1-1)*(X1 - Data->X1Min) / (Data->X1Max - Data->X1Min) );
+  int n2 = lround( (N2-1)*(X2 - Data->X2Min) / (Data->X2Max - Data->X2Min) );
+  int n3 = lround( (N3-1)*(X3 - Data->X3Min) / (Data->X3Max - Data->X3Min) );
+  if (n1<0) n1=0; else if (n1>=N1) n1=N1-1;
+  if (n2<0) n2=0; else if (n2>=N2) n2=N2-1;
+  if (n3<0) n3=0; else if (n3>=N3) n3=N3-1;
+
+  cdouble *GBarVD = Data->GBarVD + 8*((n1*N2 + n2)*N3 + n3);
+  for(int nd=0; nd<8; nd++)
+   { PhiVD[nd]   = real(GBarVD[nd]);
+     PhiVD[nd+8] = imag(GBarVD[nd]);
+   };
+}
+
+Interp3D *CreateGBarInterp3D(int N1, double X1Min, double X1Max,
+                             int N2, double X2Min, double X2Max,
+                             int N3, double X3Min, double X3Max,
+                             cdouble *GBarVD, int LMDILogLevel)
+{
+  GBarGridData Data;
+  Data.N1=N1; Data.X1Min=X1Min; Data.X1Max=X1Max;
+  Data.N2=N2; Data.X2Min=X2Min; Data.X2Max=X2Max;
+  Data.N3=N3; Data.X3Min=X3Min; Data.X3Max=X3Max;
+  Data.GBarVD=GBarVD;
+  return new Interp3D(X1Min, X1Max, N1, X2Min, X2Max, N2, X3Min, X3Max, N3,
+                      2, GBarGridPhi3D, (void *)&Data, LMDILogLevel);
+}
+
+/***************************************************************/
+/* evaluate GBar at all nodes of a uniform grid with a single  */
+/* batched Ewald summation, then build the interpolation table */
+/***************************************************************/
+static Interp3D *TabulateGBarInterp3D(GBarAccelerator *GBA,
+                                      int N1, double X1Min, double X1Max,
+                                      int N2, double X2Min, double X2Max,
+                                      int N3, double X3Min, double X3Max,
+                                      int LMDILogLevel)
+{
+  int NumPoints = N1*N2*N3;
+  double DX1 = (X1Max - X1Min) / ((double)(N1-1));
+  double DX2 = (X2Max - X2Min) / ((double)(N2-1));
+  double DX3 = (X3Max - X3Min) / ((double)(N3-1));
+  double *R = (double *)mallocEC(3*NumPoints*sizeof(double));
+  for(int n1=0, np=0; n1<N1; n1++)
+   for(int n2=0; n2<N2; n2++)
+    for(int n3=0; n3<N3; n3++, np++)
+     { R[3*np+0] = X1Min + n1*DX1;
+       R[3*np+1] = X2Min + n2*DX2;
+       R[3*np+2] = X3Min + n3*DX3;
+     };
+
+  cdouble *GBarVD = (cdouble *)mallocEC(8*NumPoints*sizeof(cdouble));
+  GBarVDEwald_v(NumPoints, R, GBA->k, GBA->kBloch, GBA->LBV, GBA->LDim,
+                -1.0, GBA->ExcludeInnerCells, GBarVD);
+  free(R);
+
+  Interp3D *I3D=CreateGBarInterp3D(N1, X1Min, X1Max, N2, X2Min, X2Max,
+                                   N3, X3Min, X3Max, GBarVD, LMDILogLevel);
+  free(GBarVD);
+  return I3D;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -228,7 +308,7 @@ void GetOptimalGridSpacing2D(GBarAccelerator *GBA,
   cdouble GExact, GInterp;
   cdouble dGExact[3], dGInterp[3];
   double RelError;
-  
+
   for(int Mu=0; Mu<3; Mu++)
    { 
     // estimate relative error in Mu direction
@@ -271,6 +351,51 @@ void GetOptimalGridSpacing2D(GBarAccelerator *GBA,
 
 }
 
+/***************************************************************/
+/* if the environment variable SCUFF_GBAR_PATH names a         */
+/* directory, interpolation tables are saved there and reused  */
+/* by later runs with the same parameters. the file name       */
+/* contains the frequency and bloch vector, plus a hash of the */
+/* remaining parameters on which the table depends.            */
+/***************************************************************/
+static bool GetGBarFileName(GBarAccelerator *GBA, double RelTol,
+                            char *FileName, int MaxLength)
+{
+  char *Dir = getenv("SCUFF_GBAR_PATH");
+  if (!Dir) return false;
+
+  double Key[9];
+  int NumKeys=0;
+  for(int nd=0; nd<GBA->LDim; nd++)
+   { Key[NumKeys++] = GBA->LBV[nd][0];
+     Key[NumKeys++] = GBA->LBV[nd][1];
+   };
+  Key[NumKeys++] = GBA->RhoMin;
+  Key[NumKeys++] = GBA->RhoMax;
+  Key[NumKeys++] = RelTol;
+  Key[NumKeys++] = GBA->ExcludeInnerCells ? 1.0 : 0.0;
+
+  // FNV-1a hash of the key bytes
+  unsigned long long Hash=14695981039346656037ULL;
+  unsigned char *Bytes=(unsigned char *)Key;
+  for(size_t nb=0; nb<NumKeys*sizeof(double); nb++)
+   { Hash ^= Bytes[nb];
+     Hash *= 1099511628211ULL;
+   };
+
+  char kStr[100];
+  if (GBA->LDim==1)
+   snprintf(kStr,100,"%.6e+%.6eI_%.6e",
+            real(GBA->k),imag(GBA->k),GBA->kBloch[0]);
+  else
+   snprintf(kStr,100,"%.6e+%.6eI_%.6e_%.6e",
+            real(GBA->k),imag(GBA->k),GBA->kBloch[0],GBA->kBloch[1]);
+
+  snprintf(FileName,MaxLength,"%s/GBar%iD_%s_%016llx.dat",
+           Dir,GBA->LDim,kStr,Hash);
+  return true;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -326,10 +451,20 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
        GBA->ForceFullEwald=true;
      };
    };
-  
+
   if (GBA->ForceFullEwald)
    return GBA;
 
+  char FileName[1000];
+  bool HaveFileName=GetGBarFileName(GBA, RelTol, FileName, 1000);
+  if ( HaveFileName && access(FileName, R_OK)==0 )
+   { if (LDim==1)
+      GBA->I2D=new Interp2D(FileName);
+     else
+      GBA->I3D=new Interp3D(FileName);
+     return GBA;
+   };
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -391,50 +526,91 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
    }
   else // LDim==2
    {
-      double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
-      if ( LMax<Lx ) 
-       { Lx=LMax;
-         Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
-       };
-      if ( LMax<Ly ) 
-       { Ly=LMax;
-         Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
-       };
+      // the grid, and the kBloch-independent part of the
+      // Ewald sum at the grid points, are shared by all
+      // bloch vectors at this frequency (GBarEwaldTable.cc)
+      GBarEwaldTable *Table=GetGBarEwaldTable(GBA, RelTol);
+      if (!Table)
+       {
+         double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
+         if ( LMax<Lx ) 
+          { Lx=LMax;
+            Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
+          };
+         if ( LMax<Ly ) 
+          { Ly=LMax;
+            Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
+          };
 
-      // estimate the optimal grid spacings at a few points
-      // in the domain of interest and take the smallest
-      double MinDelta[3], Delta[3];
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMin, RelTol, MinDelta, 0);
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      if (RhoMax!=RhoMin)
-       { GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
-       };
+         // estimate the optimal grid spacings at a few points
+         // in the domain of interest and take the smallest
+         double MinDelta[3], Delta[3];
+         GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMin, RelTol, MinDelta, 0);
+         GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
+         GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMin, RelTol, Delta, MinDelta);
+         GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
+         if (RhoMax!=RhoMin)
+          { GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
+            GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
+            GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
+            GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
+          };
 
-      int nx   = ceil( Lx / MinDelta[0] );
-      if (nx<2) nx=2;
+         int nx   = ceil( Lx / MinDelta[0] );
+         if (nx<2) nx=2;
 
-      int ny   = ceil( Ly / MinDelta[1] );
-      if (ny<2) ny=2;
-
-      int nRho; 
-      if (RhoMax<=RhoMin)
-       { RhoMax = RhoMin + MinDelta[0];
-         nRho=2;
-       }
-      else
-       { nRho = ceil( (RhoMax-RhoMin) / MinDelta[1] );
-         if (nRho<2) nRho=2;
+         int ny   = ceil( Ly / MinDelta[1] );
+         if (ny<2) ny=2;
+
+         int nRho; 
+         if (RhoMax<=RhoMin)
+          { RhoMax = RhoMin + MinDelta[2];
+            nRho=2;
+          }
+         else
+          { nRho = ceil( (RhoMax-RhoMin) / MinDelta[2] );
+            if (nRho<2) nRho=2;
+          };
+
+         Table=CreateGBarEwaldTable(GBA, RelTol, nx, -0.5*Lx, 0.5*Lx,
+                                                 ny, -0.5*Ly, 0.5*Ly,
+                                                 nRho, RhoMin, RhoMax);
+         if (!Table)
+          GBA->I3D=TabulateGBarInterp3D(GBA, nx, -0.5*Lx, 0.5*Lx,
+                                             ny, -0.5*Ly, 0.5*Ly,
+                                             nRho, RhoMin, RhoMax,
+                                             LMDILogLevel);
        };
 
       GBA->I2D=0;
-      GBA->I3D=new Interp3D(-0.5*Lx, 0.5*Lx, nx, -0.5*Ly, 0.5*Ly, ny,
-                            RhoMin, RhoMax, nRho,
-                            2, GBarVDPhi3D, (void *)GBA, LMDILogLevel);
+      if (Table)
+       GBA->I3D=GetGBarInterp3D(Table, kBloch, LMDILogLevel);
+   };
+
+  /***************************************************************/
+  /* other processes may be reading tables from the same         */
+  /* directory, so we write to a temporary file there and then   */
+  /* rename it, which atomically replaces any existing file.     */
+  /***************************************************************/
+  if (HaveFileName)
+   { Log("Writing GBar interpolation table to %s",FileName);
+     char TmpFileName[1100];
+     snprintf(TmpFileName,1100,"%s.XXXXXX",FileName);
+     int fd=mkstemp(TmpFileName);
+     if (fd==-1)
+      Warn("could not create temporary file %s (skipping table write)",TmpFileName);
+     else
+      { fchmod(fd, 0644); // mkstemp creates the file owner-only
+        close(fd);
+        if (GBA->I2D)
+         GBA->I2D->WriteToFile(TmpFileName);
+        else
+         GBA->I3D->WriteToFile(TmpFileName);
+        if (rename(TmpFileName, FileName)!=0)
+         { Warn("could not rename %s to %s",TmpFileName,FileName);
+           unlink(TmpFileName);
+         };
+      };
    };
 
   return GBA;
@@ -694,7 +870,7 @@ cdouble GetGBar_1D(double R[3], GBarAccelerator *GBA,
    };
 
   return G;
-  
+
 }
 
 /***************************************************************/
@@ -724,7 +900,7 @@ cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
   /*--------------------------------------------------------------*/
   if (GBA->LBV[0][1]!=0.0 || GBA->LBV[1][0]!=0.0)
    ErrExit("%s:%i: non-square lattice not yet supported",__FILE__,__LINE__);
-  
+
   double L0x = GBA->LBV[0][0];
   int mx = (int)(lround( R[0] / L0x ));
   double xBar = R[0] - mx*L0x;
@@ -832,7 +1008,7 @@ cdouble GetGBar_2D(double R[3], GBarAccelerator *GBA,
    };
 
   return GBar;
-  
+
 }
 
 /***************************************************************/
@@ -39,6 +39,21 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
                  double (*LBV)[3], int LDim,
                  double E, bool ExcludeInnerCells, cdouble *GBarVD);
 
+void GBarVDEwald_v(int NumPoints, double *R, cdouble k, double *kBloch,
+                   double (*LBV)[3], int LDim,
+                   double E, bool ExcludeInnerCells, cdouble *GBarVD);
+
+// building blocks of the Ewald sum, used by GBarEwaldTable.cc
+void GetRLBasis(int LDim, double (*L)[3], double (*Gamma)[3],
+                cdouble k, double *EOpt, double R[3], double *pRho);
+void AddGShort(double *R, cdouble k, double *kBloch,
+               int n1, int n2, double (*LBV)[3], int LDim,
+               double E, cdouble *Sum);
+void AddGLongRealSpace(double *R, cdouble k, double *kBloch,
+                       int n1, int n2, double (*LBV)[3], int LDim,
+                       double E, cdouble *Sum);
+void GetEEF(double z, double E, cdouble Q, cdouble *EEF, cdouble *EEFPrime);
+
 /***************************************************************/
 /* interpolation-based acceleration of periodic GF evaluation  */
 /***************************************************************/
@@ -59,6 +74,54 @@ typedef struct GBarAccelerator
 
  } GBarAccelerator;
 
+/***************************************************************/
+/* kBloch-independent data used to construct the interpolation */
+/* tables of GBarAccelerators for 2D lattices: the grid, and   */
+/* the real-space Ewald terms at each grid point for each       */
+/* lattice image with the bloch phase factor stripped off. one */
+/* table serves all bloch vectors at a given frequency.        */
+/***************************************************************/
+typedef struct GBarEwaldTable
+ {
+   // parameters on which the table depends
+   cdouble k;
+   double LBV[2][2];
+   double RhoMin, RhoMax, RelTol;
+   bool ExcludeInnerCells;
+
+   // interpolation grid
+   int N1, N2, N3;
+   double X1Min, X1Max, X2Min, X2Max, X3Min, X3Max;
+
+   // Ewald separation parameter, reciprocal lattice, and
+   // lattice-image terms; the term for image #ni at grid point
+   // #np is Terms[ 8*(ni*NumPoints + np) + 0..7 ]
+   double E;
+   double Gamma[3][3];
+   int NumPoints, NumImages;
+   int *Images;
+   cdouble *Terms;
+
+   size_t Bytes;
+   unsigned long LastUsed;
+
+ } GBarEwaldTable;
+
+GBarEwaldTable *GetGBarEwaldTable(GBarAccelerator *GBA, double RelTol);
+GBarEwaldTable *CreateGBarEwaldTable(GBarAccelerator *GBA, double RelTol,
+                                     int N1, double X1Min, double X1Max,
+                                     int N2, double X2Min, double X2Max,
+                                     int N3, double X3Min, double X3Max);
+Interp3D *GetGBarInterp3D(GBarEwaldTable *Table, double *kBloch,
+                          int LMDILogLevel);
+
+// interpolation table built from GBar values precomputed at the
+// nodes of a uniform grid, stored as GBarVD[8*((n1*N2 + n2)*N3 + n3) + 0..7]
+Interp3D *CreateGBarInterp3D(int N1, double X1Min, double X1Max,
+                             int N2, double X2Min, double X2Max,
+                             int N3, double X3Min, double X3Max,
+                             cdouble *GBarVD, int LMDILogLevel);
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -0,0 +1,460 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * GBarEwaldTable.cc -- kBloch-independent data for building
+ *                   -- interpolation tables of the 2D-periodic
+ *                   -- green's function at many bloch vectors
+ *
+ * In the Ewald representation of GBar, the real-space sum
+ *
+ *  sum_L e^{i kBloch*L} GShort(R-L)
+ *
+ * depends on kBloch only through the phase factors, while each term
+ * of the reciprocal-space sum has the form e^{i Px x} e^{i Py y} F(P,z)
+ * with P = kBloch - Gamma.
+ *
+ * A GBarEwaldTable stores the interpolation grid together with the
+ * real-space terms at each grid point for each lattice image, with
+ * the phase factor stripped off; this is computed once per frequency.
+ * For each new bloch vector, the values of GBar at the grid points
+ * are then obtained by phase-weighted sums over the stored terms plus
+ * a reciprocal-space sum that exploits the tensor-product structure
+ * of the grid, so that the erfc-dependent factor F is computed only
+ * once per z value instead of once per grid point.
+ *
+ * Tables are kept in a small cache whose total size is limited by
+ * the environment variable SCUFF_GBAR_CACHE_MB (default 512);
+ * setting it to 0 disables the tables. The cache is not thread-safe;
+ * like the other geometry-level caches it is only accessed from
+ * the serial parts of the BEM matrix assembly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libMDInterp.h>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "libscuff.h"
+#include "GBarAccelerator.h"
+
+#define II cdouble(0,1)
+
+// lattice sums are truncated once an entire ring of terms has
+// fallen below TRUNCTOL times the largest term
+#define TRUNCTOL 1.0e-12
+#define MAXRINGS 100
+
+#define MAXGBARTABLES  32
+#define DEF_GBARCACHEMB 512.0
+
+// grid points per chunk in the accumulation loops
+#define CHUNKSIZE 64
+
+namespace scuff {
+
+static GBarEwaldTable *GBarTables[MAXGBARTABLES];
+static int NumGBarTables=0;
+static size_t GBarTableBytes=0;
+static unsigned long GBarTableClock=0;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static size_t GetGBarCacheBudget()
+{
+  double MB=DEF_GBARCACHEMB;
+  char *s=getenv("SCUFF_GBAR_CACHE_MB");
+  if (s) sscanf(s,"%le",&MB);
+  return (size_t)(MB*1048576.0);
+}
+
+/***************************************************************/
+/* index pairs (n1,n2) of the cells on ring #NN, i.e. on the   */
+/* outer perimeter of the (2NN+1)x(2NN+1) square of cells      */
+/* centered at the origin. Ring must have room for 16*NN ints. */
+/***************************************************************/
+static int GetRing(int NN, int *Ring)
+{
+  if (NN==0)
+   { Ring[0]=Ring[1]=0;
+     return 1;
+   };
+
+  int n=0;
+  for(int m=-NN; m<NN; m++)
+   { Ring[2*n+0]=  m; Ring[2*n+1]= NN; n++;
+     Ring[2*n+0]= NN; Ring[2*n+1]= -m; n++;
+     Ring[2*n+0]= -m; Ring[2*n+1]=-NN; n++;
+     Ring[2*n+0]=-NN; Ring[2*n+1]=  m; n++;
+   };
+  return n;
+}
+
+static bool RingIsNegligible(double RingMax[8], double OverallMax[8])
+{
+  for(int nd=0; nd<8; nd++)
+   if ( RingMax[nd] > TRUNCTOL*OverallMax[nd] )
+    return false;
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void GetGridPoint(GBarEwaldTable *Table, int np, double R[3])
+{
+  int N2=Table->N2, N3=Table->N3;
+  int n3 = np%N3;
+  int n2 = (np/N3)%N2;
+  int n1 = np/(N2*N3);
+  double DX1 = (Table->X1Max - Table->X1Min) / ((double)(Table->N1-1));
+  double DX2 = (Table->X2Max - Table->X2Min) / ((double)(Table->N2-1));
+  double DX3 = (Table->X3Max - Table->X3Min) / ((double)(Table->N3-1));
+  R[0] = Table->X1Min + n1*DX1;
+  R[1] = Table->X2Min + n2*DX2;
+  R[2] = Table->X3Min + n3*DX3;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void DestroyGBarEwaldTable(GBarEwaldTable *Table)
+{
+  free(Table->Images);
+  free(Table->Terms);
+  free(Table);
+}
+
+/***************************************************************/
+/* look for a cached table matching the parameters of GBA      */
+/***************************************************************/
+GBarEwaldTable *GetGBarEwaldTable(GBarAccelerator *GBA, double RelTol)
+{
+  if (GBA->LDim!=2)
+   return 0;
+
+  for(int nt=0; nt<NumGBarTables; nt++)
+   { GBarEwaldTable *Table=GBarTables[nt];
+     if (    Table->k==GBA->k
+          && Table->LBV[0][0]==GBA->LBV[0][0] && Table->LBV[0][1]==GBA->LBV[0][1]
+          && Table->LBV[1][0]==GBA->LBV[1][0] && Table->LBV[1][1]==GBA->LBV[1][1]
+          && Table->RhoMin==GBA->RhoMin && Table->RhoMax==GBA->RhoMax
+          && Table->RelTol==RelTol
+          && Table->ExcludeInnerCells==GBA->ExcludeInnerCells
+        )
+      { Table->LastUsed = ++GBarTableClock;
+        return Table;
+      };
+   };
+
+  return 0;
+}
+
+/***************************************************************/
+/* compute the lattice-image terms at all grid points and add  */
+/* the new table to the cache. returns 0 if the table would    */
+/* not fit within the cache budget.                            */
+/***************************************************************/
+GBarEwaldTable *CreateGBarEwaldTable(GBarAccelerator *GBA, double RelTol,
+                                     int N1, double X1Min, double X1Max,
+                                     int N2, double X2Min, double X2Max,
+                                     int N3, double X3Min, double X3Max)
+{
+  if (GBA->LDim!=2 || GBA->k==0.0)
+   return 0;
+
+  size_t Budget=GetGBarCacheBudget();
+  if (Budget==0)
+   return 0;
+
+  GBarEwaldTable *Table=(GBarEwaldTable *)mallocEC(sizeof(GBarEwaldTable));
+  Table->k                 = GBA->k;
+  Table->LBV[0][0]         = GBA->LBV[0][0];
+  Table->LBV[0][1]         = GBA->LBV[0][1];
+  Table->LBV[1][0]         = GBA->LBV[1][0];
+  Table->LBV[1][1]         = GBA->LBV[1][1];
+  Table->RhoMin            = GBA->RhoMin;
+  Table->RhoMax            = GBA->RhoMax;
+  Table->RelTol            = RelTol;
+  Table->ExcludeInnerCells = GBA->ExcludeInnerCells;
+  Table->N1=N1; Table->X1Min=X1Min; Table->X1Max=X1Max;
+  Table->N2=N2; Table->X2Min=X2Min; Table->X2Max=X2Max;
+  Table->N3=N3; Table->X3Min=X3Min; Table->X3Max=X3Max;
+  Table->NumImages = 0;
+  Table->Images    = 0;
+  Table->Terms     = 0;
+
+  int NumPoints = Table->NumPoints = N1*N2*N3;
+
+  // for 2D lattices the optimal separation parameter
+  // does not depend on the evaluation point
+  double R0[3]={0.0, 0.0, 0.0}, Rho0;
+  GetRLBasis(2, GBA->LBV, Table->Gamma, GBA->k, &(Table->E), R0, &Rho0);
+
+  /*--------------------------------------------------------------*/
+  /*- add rings of lattice images until the terms are negligible -*/
+  /*--------------------------------------------------------------*/
+  cdouble k          = GBA->k;
+  double E           = Table->E;
+  bool ExcludeInner  = GBA->ExcludeInnerCells;
+  double OverallMax[8]={0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  int *Ring = (int *)mallocEC(16*MAXRINGS*sizeof(int));
+  bool Converged=false;
+  for(int NN=0; NN<MAXRINGS && !Converged; NN++)
+   {
+     int RingSize = GetRing(NN, Ring);
+     size_t Bytes = 8*sizeof(cdouble)*((size_t)NumPoints)*(Table->NumImages + RingSize);
+     if (Bytes > Budget)
+      { Log("GBar table for k=%s would exceed cache size (%lu MB); not tabulating",
+             z2s(k),(unsigned long)(Budget/1048576));
+        free(Ring);
+        DestroyGBarEwaldTable(Table);
+        return 0;
+      };
+
+     int NI=Table->NumImages;
+     Table->Images=(int *)reallocEC(Table->Images, 2*(NI+RingSize)*sizeof(int));
+     Table->Terms=(cdouble *)reallocEC(Table->Terms, Bytes);
+     memcpy(Table->Images + 2*NI, Ring, 2*RingSize*sizeof(int));
+
+     cdouble *RingTerms = Table->Terms + 8*((size_t)NI)*NumPoints;
+     memset(RingTerms, 0, 8*sizeof(cdouble)*((size_t)RingSize)*NumPoints);
+     double kBloch0[3]={0.0, 0.0, 0.0};
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,CHUNKSIZE)
+#endif
+     for(int np=0; np<NumPoints; np++)
+      { double R[3];
+        GetGridPoint(Table, np, R);
+        for(int nr=0; nr<RingSize; nr++)
+         { cdouble *T = RingTerms + 8*(((size_t)nr)*NumPoints + np);
+           int n1=Ring[2*nr+0], n2=Ring[2*nr+1];
+           if ( ExcludeInner && NN<=1 )
+            { AddGLongRealSpace(R, k, kBloch0, n1, n2, GBA->LBV, 2, E, T);
+              for(int nd=0; nd<8; nd++) T[nd]*=-1.0;
+            }
+           else
+            AddGShort(R, k, kBloch0, n1, n2, GBA->LBV, 2, E, T);
+         };
+      };
+
+     double RingMax[8]={0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+     for(size_t n=0; n<((size_t)RingSize)*NumPoints; n++)
+      for(int nd=0; nd<8; nd++)
+       RingMax[nd]=fmax(RingMax[nd], abs(RingTerms[8*n+nd]));
+
+     // the inner rings are always retained; beyond that, stop at
+     // (and discard) the first ring whose terms are all negligible
+     if ( NN>=2 && RingIsNegligible(RingMax, OverallMax) )
+      Converged=true;
+     else
+      { Table->NumImages += RingSize;
+        for(int nd=0; nd<8; nd++)
+         OverallMax[nd]=fmax(OverallMax[nd], RingMax[nd]);
+      };
+   };
+  free(Ring);
+  if (!Converged)
+   Warn("real-space lattice sum not converged in GBarEwaldTable (k=%s)",z2s(k));
+
+  Table->Terms=(cdouble *)reallocEC(Table->Terms, 8*sizeof(cdouble)*((size_t)Table->NumImages)*NumPoints);
+  Table->Bytes = 8*sizeof(cdouble)*((size_t)Table->NumImages)*NumPoints;
+
+  /*--------------------------------------------------------------*/
+  /*- make room in the cache, evicting least recently used tables */
+  /*--------------------------------------------------------------*/
+  while ( NumGBarTables>0 &&
+          (NumGBarTables==MAXGBARTABLES || GBarTableBytes+Table->Bytes > Budget)
+        )
+   { int ntLRU=0;
+     for(int nt=1; nt<NumGBarTables; nt++)
+      if (GBarTables[nt]->LastUsed < GBarTables[ntLRU]->LastUsed)
+       ntLRU=nt;
+     GBarTableBytes -= GBarTables[ntLRU]->Bytes;
+     DestroyGBarEwaldTable(GBarTables[ntLRU]);
+     GBarTables[ntLRU]=GBarTables[--NumGBarTables];
+   };
+
+  Table->LastUsed = ++GBarTableClock;
+  GBarTables[NumGBarTables++]=Table;
+  GBarTableBytes += Table->Bytes;
+
+  Log("Tabulated %i lattice-image terms at %i grid points for k=%s (%.1f MB)",
+       Table->NumImages,NumPoints,z2s(k),((double)Table->Bytes)/1048576.0);
+
+  return Table;
+}
+
+/***************************************************************/
+/* assemble GBar and its derivatives at all grid points for the*/
+/* given bloch vector and return the interpolation table.      */
+/***************************************************************/
+Interp3D *GetGBarInterp3D(GBarEwaldTable *Table, double *kBloch,
+                          int LMDILogLevel)
+{
+  int N1=Table->N1, N2=Table->N2, N3=Table->N3;
+  int NumPoints = Table->NumPoints;
+  int NumImages = Table->NumImages;
+  cdouble k     = Table->k;
+  double E      = Table->E;
+
+  cdouble *GBarVD = (cdouble *)mallocEC(8*NumPoints*sizeof(cdouble));
+  memset(GBarVD, 0, 8*NumPoints*sizeof(cdouble));
+
+  /*--------------------------------------------------------------*/
+  /*- real-space sum: phase-weighted sum over stored images       */
+  /*--------------------------------------------------------------*/
+  cdouble *Phase = (cdouble *)mallocEC(NumImages*sizeof(cdouble));
+  for(int ni=0; ni<NumImages; ni++)
+   { int n1=Table->Images[2*ni+0], n2=Table->Images[2*ni+1];
+     double L[2];
+     L[0] = n1*Table->LBV[0][0] + n2*Table->LBV[1][0];
+     L[1] = n1*Table->LBV[0][1] + n2*Table->LBV[1][1];
+     Phase[ni] = exp( II*(kBloch[0]*L[0] + kBloch[1]*L[1]) );
+   };
+
+  int NumChunks = (NumPoints + CHUNKSIZE - 1) / CHUNKSIZE;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int nc=0; nc<NumChunks; nc++)
+   { size_t Start = 8*((size_t)nc)*CHUNKSIZE;
+     size_t Stop  = 8*((size_t)(nc+1))*CHUNKSIZE;
+     if ( Stop > 8*((size_t)NumPoints) ) Stop=8*((size_t)NumPoints);
+     for(int ni=0; ni<NumImages; ni++)
+      { cdouble *T = Table->Terms + 8*((size_t)ni)*NumPoints;
+        cdouble P = Phase[ni];
+        for(size_t n=Start; n<Stop; n++)
+         GBarVD[n] += P*T[n];
+      };
+   };
+  free(Phase);
+
+  /*--------------------------------------------------------------*/
+  /*- reciprocal-space sum. on each ring of reciprocal-lattice    */
+  /*- vectors, we first compute the z-dependent factors and the   */
+  /*- x- and y-dependent phases, then accumulate their products   */
+  /*- at all grid points.                                         */
+  /*--------------------------------------------------------------*/
+  double (*Gamma)[3] = Table->Gamma;
+  double PreFac = (Gamma[0][0]*Gamma[1][1] - Gamma[0][1]*Gamma[1][0])/(16.0*M_PI*M_PI);
+  double DX1 = (Table->X1Max - Table->X1Min) / ((double)(N1-1));
+  double DX2 = (Table->X2Max - Table->X2Min) / ((double)(N2-1));
+  double DX3 = (Table->X3Max - Table->X3Min) / ((double)(N3-1));
+
+  int MaxRingSize = 8*MAXRINGS;
+  int *Ring       = (int *)mallocEC(2*MaxRingSize*sizeof(int));
+  double *PmG     = (double *)mallocEC(2*MaxRingSize*sizeof(double));
+  cdouble *A      = (cdouble *)mallocEC(MaxRingSize*N3*sizeof(cdouble));
+  cdouble *B      = (cdouble *)mallocEC(MaxRingSize*N3*sizeof(cdouble));
+  cdouble *ExpX   = (cdouble *)mallocEC(MaxRingSize*N1*sizeof(cdouble));
+  cdouble *ExpY   = (cdouble *)mallocEC(MaxRingSize*N2*sizeof(cdouble));
+
+  double OverallMax[8]={0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  bool Converged=false;
+  for(int NN=0; NN<MAXRINGS && !Converged; NN++)
+   {
+     int RingSize = GetRing(NN, Ring);
+     double RingMax[8]={0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+     for(int nr=0; nr<RingSize; nr++)
+      {
+        int m1=Ring[2*nr+0], m2=Ring[2*nr+1];
+        double Px = PmG[2*nr+0] = kBloch[0] - m1*Gamma[0][0] - m2*Gamma[1][0];
+        double Py = PmG[2*nr+1] = kBloch[1] - m1*Gamma[0][1] - m2*Gamma[1][1];
+        cdouble Q = sqrt( Px*Px + Py*Py - k*k );
+
+        for(int n3=0; n3<N3; n3++)
+         { cdouble EEF, EEFPrime;
+           GetEEF(Table->X3Min + n3*DX3, E, Q, &EEF, &EEFPrime);
+           cdouble a = A[nr*N3 + n3] = PreFac*EEF/Q;
+           cdouble b = B[nr*N3 + n3] = PreFac*EEFPrime/Q;
+           double Mags[8];
+           Mags[0]=abs(a);    Mags[1]=fabs(Px)*Mags[0]; Mags[2]=fabs(Py)*Mags[0];
+           Mags[3]=abs(b);    Mags[4]=fabs(Px*Py)*Mags[0];
+           Mags[5]=fabs(Px)*Mags[3]; Mags[6]=fabs(Py)*Mags[3];
+           Mags[7]=fabs(Px*Py)*Mags[3];
+           for(int nd=0; nd<8; nd++)
+            RingMax[nd]=fmax(RingMax[nd], Mags[nd]);
+         };
+        for(int n1=0; n1<N1; n1++)
+         ExpX[nr*N1 + n1] = exp( II*Px*(Table->X1Min + n1*DX1) );
+        for(int n2=0; n2<N2; n2++)
+         ExpY[nr*N2 + n2] = exp( II*Py*(Table->X2Min + n2*DX2) );
+      };
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+     for(int n1=0; n1<N1; n1++)
+      for(int nr=0; nr<RingSize; nr++)
+       { double Px=PmG[2*nr+0], Py=PmG[2*nr+1];
+         cdouble iPx=II*Px, iPy=II*Py;
+         double mPxPy=-Px*Py;
+         for(int n2=0; n2<N2; n2++)
+          { cdouble Ph = ExpX[nr*N1 + n1] * ExpY[nr*N2 + n2];
+            cdouble *G = GBarVD + 8*(n1*N2 + n2)*N3;
+            for(int n3=0; n3<N3; n3++, G+=8)
+             { cdouble a = Ph*A[nr*N3 + n3], b = Ph*B[nr*N3 + n3];
+               G[0] += a;
+               G[1] += iPx*a;
+               G[2] += iPy*a;
+               G[3] += b;
+               G[4] += mPxPy*a;
+               G[5] += iPx*b;
+               G[6] += iPy*b;
+               G[7] += mPxPy*b;
+             };
+          };
+       };
+
+     if ( NN>=1 && RingIsNegligible(RingMax, OverallMax) )
+      Converged=true;
+     for(int nd=0; nd<8; nd++)
+      OverallMax[nd]=fmax(OverallMax[nd], RingMax[nd]);
+   };
+  if (!Converged)
+   Warn("reciprocal-space lattice sum not converged in GBarEwaldTable (k=%s)",z2s(k));
+
+  free(Ring);
+  free(PmG);
+  free(A);
+  free(B);
+  free(ExpX);
+  free(ExpY);
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  Interp3D *I3D=CreateGBarInterp3D(N1, Table->X1Min, Table->X1Max,
+                                   N2, Table->X2Min, Table->X2Max,
+                                   N3, Table->X3Min, Table->X3Max,
+                                   GBarVD, LMDILogLevel);
+  free(GBarVD);
+  return I3D;
+}
+
+} // namespace scuff
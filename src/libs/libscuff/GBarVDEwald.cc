@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <math.h>
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #include <libhrutil.h>
 #include <libMDInterp.h>
 #include <libSpherical.h>
@@ -821,7 +825,17 @@ void AddGLongRealSpace(double *R, cdouble k, double *kBloch,
 
   double rml2=RmL[0]*RmL[0] + RmL[1]*RmL[1] + RmL[2]*RmL[2];
   double rml=sqrt(rml2);
-  bool Smallr = ( rml*E < 0.1 ) && ( rml*abs(k) < 1.0 );
+
+  // the small-r expansion is truncated at O(r^4), and its
+  // coefficients are differences of terms of magnitude
+  // ~E*exp(k^2/4E^2) that cancel badly when |k|>>E; the
+  // GFull-GShort difference instead loses precision like 1/r.
+  // use the expansion only where it is the more accurate of the two.
+  double ExpMag = exp(0.25*real(k*k)/(E*E));
+  bool Smallr =  ( rml < 1.0e-8 )
+             || (    ( rml*E < 1.0e-3 ) && ( rml*abs(k) < 1.0e-2 )
+                  && ( 4.0*M_PI*rml*E*ExpMag < 1.0 )
+                );
 
   if ( Smallr ) // use small-r expansion derived in memo
    { 
@@ -873,6 +887,24 @@ void AddGLongRealSpace(double *R, cdouble k, double *kBloch,
  
 }
 
+/***************************************************************/
+/* subtract the contributions of the inner grid cells to the   */
+/* 'distant' sum, computed in real space                       */
+/***************************************************************/
+static void SubtractGLongInner(double *R, cdouble k, double *kBloch,
+                               double (*LBV)[3], int LDim, double E,
+                               cdouble *GBarVD)
+{
+  cdouble GLongInner[NSUM];
+  memset(GLongInner,0,NSUM*sizeof(cdouble));
+  int n2Mult = (LDim==2) ? 1 : 0;
+  for(int n1=-1; n1<=1; n1++)
+   for(int n2=-1*n2Mult; n2<=1*n2Mult; n2++)
+    AddGLongRealSpace(R, k, kBloch, n1, n2, LBV, LDim, E, GLongInner);
+  for(int ns=0; ns<NSUM; ns++)
+   GBarVD[ns] -= GLongInner[ns];
+}
+
 /***************************************************************/
 /* 'GBar values and derivatives,' computed via Ewald's method  */
 /*                                                             */
@@ -945,17 +977,346 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
   /* from the inner grid cells in real space                     */
   /***************************************************************/
   if (ExcludeInnerCells)
+   SubtractGLongInner(R, k, kBloch, LBV, LDim, E, GBarVD);
+
+} 
+
+/***************************************************************/
+/* batched evaluation of GBarVD in the 2D case for a block of  */
+/* up to EWALD_BLOCKSIZE points.                               */
+/*                                                             */
+/* the terms of both lattice sums are added in the same order  */
+/* as in GetGBarNearby and GetGBarDistant, but:                */
+/*                                                             */
+/*  (a) quantities that depend only on the reciprocal-lattice  */
+/*      vector G are computed once per block;                  */
+/*  (b) the phase factors exp(i (P-G)*R) are obtained from     */
+/*      powers of the two basis phases exp(-i Gamma_{1,2}*R)   */
+/*      instead of one complex exponential per term;           */
+/*  (c) the factor EEF, which depends on R only through z, is  */
+/*      computed once for each distinct z value in the block;  */
+/*  (d) the sums for each point are truncated as soon as all   */
+/*      terms on a ring of cells have fallen below            */
+/*      EWALD_TRUNCTOL times the largest term seen so far.     */
+/*      since both sums converge like gaussians, this makes    */
+/*      unnecessary the three extra rings required by the      */
+/*      difference-based test in GetGBarNearby/GetGBarDistant, */
+/*      which must guard against rings that cancel.            */
+/***************************************************************/
+#define EWALD_BLOCKSIZE 32
+#define EWALD_TRUNCTOL  1.0e-12
+
+typedef struct EwaldBlock
+ {
+   int NumPoints;
+   double *R;
+   cdouble k;
+   double *kBloch;
+   double (*LBV)[3];
+   double (*Gamma)[3];
+   double E;
+
+   int NumZ, zIndex[EWALD_BLOCKSIZE];
+   double zValues[EWALD_BLOCKSIZE];
+
+   // Phase0[np] = exp(i*kBloch*R)
+   // Pow1[np*(MaxPow+1) + m] = exp(-i*m*Gamma1*R), m=0..MaxPow
+   cdouble Phase0[EWALD_BLOCKSIZE];
+   cdouble *Pow1, *Pow2;
+   int MaxPow;
+
+   // per-point truncation bookkeeping
+   bool Active[EWALD_BLOCKSIZE];
+   double RingMax[NSUM*EWALD_BLOCKSIZE];
+   double OverallMax[NSUM*EWALD_BLOCKSIZE];
+
+   cdouble *Sum;
+
+ } EwaldBlock;
+
+/***************************************************************/
+/* after each ring of cells: deactivate points whose sums have */
+/* converged, then reset the ring maxima. returns the number   */
+/* of points still active.                                     */
+/***************************************************************/
+static int UpdateActivePoints(EwaldBlock *B, bool Test)
+{
+  int NumActive=0;
+  for(int np=0; np<B->NumPoints; np++)
    { 
-     cdouble GLongInner[NSUM];
-     memset(GLongInner,0,NSUM*sizeof(cdouble));
-     int n2Mult = (LDim==2) ? 1 : 0;
-     for(int n1=-1; n1<=1; n1++)
-      for(int n2=-1*n2Mult; n2<=1*n2Mult; n2++)
-       AddGLongRealSpace(R, k, kBloch, n1, n2, LBV, LDim, E, GLongInner);
+     if (!B->Active[np]) continue;
+     double *RingMax=B->RingMax + NSUM*np, *OverallMax=B->OverallMax + NSUM*np;
+     bool Converged=Test;
+     for(int ns=0; ns<NSUM && Converged; ns++)
+      if ( RingMax[ns] > EWALD_TRUNCTOL*OverallMax[ns] )
+       Converged=false;
      for(int ns=0; ns<NSUM; ns++)
-      GBarVD[ns] -= GLongInner[ns];
+      { OverallMax[ns]=fmax(OverallMax[ns], RingMax[ns]);
+        RingMax[ns]=0.0;
+      };
+     if (Converged)
+      B->Active[np]=false;
+     else
+      NumActive++;
    };
+  return NumActive;
+}
 
-} 
+static void ResetActivePoints(EwaldBlock *B)
+{
+  for(int np=0; np<B->NumPoints; np++)
+   B->Active[np]=true;
+  memset(B->RingMax, 0, NSUM*B->NumPoints*sizeof(double));
+  memset(B->OverallMax, 0, NSUM*B->NumPoints*sizeof(double));
+}
+
+static void AddTerms(EwaldBlock *B, int np, cdouble *Terms)
+{
+  cdouble *Sum=B->Sum + NSUM*np;
+  double *RingMax=B->RingMax + NSUM*np;
+  for(int ns=0; ns<NSUM; ns++)
+   { Sum[ns] += Terms[ns];
+     RingMax[ns] = fmax(RingMax[ns], abs(Terms[ns]));
+   };
+}
+
+/***************************************************************/
+/* real-space sum **********************************************/
+/***************************************************************/
+static void AddGShort2D_Block(EwaldBlock *B, int n1, int n2)
+{
+  for(int np=0; np<B->NumPoints; np++)
+   { 
+     if (!B->Active[np]) continue;
+     cdouble Terms[NSUM];
+     memset(Terms, 0, NSUM*sizeof(cdouble));
+     AddGShort(B->R + 3*np, B->k, B->kBloch, n1, n2, B->LBV, 2, B->E, Terms);
+     AddTerms(B, np, Terms);
+   };
+}
+
+static void GetGBarNearby2D_Block(EwaldBlock *B, bool ExcludeInnerCells)
+{
+  ResetActivePoints(B);
+
+  for (int n1=-NFIRSTROUND; n1<=NFIRSTROUND; n1++)
+   for (int n2=-NFIRSTROUND; n2<=NFIRSTROUND; n2++)
+    if ( !ExcludeInnerCells || abs(n1)>1 || abs(n2)>1 )
+     AddGShort2D_Block(B, n1, n2);
+  int NumActive=UpdateActivePoints(B, false);
+
+  for(int NN=NFIRSTROUND+1; NumActive>0 && NN<=NMAX; NN++)
+   { 
+     for(int n=-NN; n<NN; n++)
+      { AddGShort2D_Block(B,   n,  NN);
+        AddGShort2D_Block(B,  NN,  -n);
+        AddGShort2D_Block(B,  -n, -NN);
+        AddGShort2D_Block(B, -NN,   n);
+      };
+
+     // with the inner cells excluded, the first ring we see
+     // is the one just beyond them, which must be retained
+     bool Test = !(ExcludeInnerCells && NN==NFIRSTROUND+1);
+     NumActive=UpdateActivePoints(B, Test);
+   };
+}
+
+/***************************************************************/
+/* reciprocal-space sum ****************************************/
+/***************************************************************/
+static void GrowPowers(EwaldBlock *B, int NewMaxPow)
+{
+  int NP=B->NumPoints, Old=B->MaxPow;
+  cdouble *Pow1=(cdouble *)mallocEC(NP*(NewMaxPow+1)*sizeof(cdouble));
+  cdouble *Pow2=(cdouble *)mallocEC(NP*(NewMaxPow+1)*sizeof(cdouble));
+  double (*Gamma)[3]=B->Gamma;
+  for(int np=0; np<NP; np++)
+   { double *R=B->R + 3*np;
+     cdouble *P1=Pow1 + np*(NewMaxPow+1), *P2=Pow2 + np*(NewMaxPow+1);
+     int m0;
+     if (B->Pow1)
+      { memcpy(P1, B->Pow1 + np*(Old+1), (Old+1)*sizeof(cdouble));
+        memcpy(P2, B->Pow2 + np*(Old+1), (Old+1)*sizeof(cdouble));
+        m0=Old+1;
+      }
+     else
+      { P1[0]=P2[0]=1.0;
+        m0=1;
+      };
+     cdouble W1=exp( -II*(Gamma[0][0]*R[0] + Gamma[0][1]*R[1]) );
+     cdouble W2=exp( -II*(Gamma[1][0]*R[0] + Gamma[1][1]*R[1]) );
+     for(int m=m0; m<=NewMaxPow; m++)
+      { P1[m] = P1[m-1]*W1;
+        P2[m] = P2[m-1]*W2;
+      };
+   };
+  free(B->Pow1);
+  free(B->Pow2);
+  B->Pow1=Pow1;
+  B->Pow2=Pow2;
+  B->MaxPow=NewMaxPow;
+}
+
+static void AddGLong2D_Block(EwaldBlock *B, int n1, int n2)
+{
+  double (*Gamma)[3]=B->Gamma;
+  cdouble k=B->k;
+  double PmG[2];
+  PmG[0] = B->kBloch[0] - n1*Gamma[0][0] - n2*Gamma[1][0];
+  PmG[1] = B->kBloch[1] - n1*Gamma[0][1] - n2*Gamma[1][1];
+  cdouble Q = sqrt ( PmG[0]*PmG[0] + PmG[1]*PmG[1] - k*k );
+
+  cdouble EEF[EWALD_BLOCKSIZE], EEFPrime[EWALD_BLOCKSIZE];
+  bool Have[EWALD_BLOCKSIZE];
+  for(int nz=0; nz<B->NumZ; nz++)
+   Have[nz]=false;
+
+  int Stride=B->MaxPow+1, a1=abs(n1), a2=abs(n2);
+  for(int np=0; np<B->NumPoints; np++)
+   { 
+     if (!B->Active[np]) continue;
+
+     int nz=B->zIndex[np];
+     if (!Have[nz])
+      { GetEEF(B->zValues[nz], B->E, Q, EEF+nz, EEFPrime+nz);
+        Have[nz]=true;
+      };
+
+     cdouble P1 = B->Pow1[np*Stride + a1]; if (n1<0) P1=conj(P1);
+     cdouble P2 = B->Pow2[np*Stride + a2]; if (n2<0) P2=conj(P2);
+     cdouble PreFactor = B->Phase0[np] * P1 * P2 / Q;
+
+     cdouble PFEEF=PreFactor*EEF[nz], PFEEFPrime=PreFactor*EEFPrime[nz];
+     cdouble Terms[NSUM];
+     Terms[0] = PFEEF;
+     Terms[1] = II*PmG[0]*PFEEF;
+     Terms[2] = II*PmG[1]*PFEEF;
+     Terms[3] = PFEEFPrime;
+     Terms[4] = -PmG[0]*PmG[1]*PFEEF;
+     Terms[5] = II*PmG[0]*PFEEFPrime;
+     Terms[6] = II*PmG[1]*PFEEFPrime;
+     Terms[7] = -PmG[0]*PmG[1]*PFEEFPrime;
+     AddTerms(B, np, Terms);
+   };
+}
+
+static void GetGBarDistant2D_Block(EwaldBlock *B)
+{
+  ResetActivePoints(B);
+
+  B->NumZ=0;
+  for(int np=0; np<B->NumPoints; np++)
+   { double *R=B->R + 3*np;
+     int nz;
+     for(nz=0; nz<B->NumZ && B->zValues[nz]!=R[2]; nz++)
+      ;
+     if (nz==B->NumZ)
+      B->zValues[B->NumZ++]=R[2];
+     B->zIndex[np]=nz;
+     B->Phase0[np]=exp( II*(B->kBloch[0]*R[0] + B->kBloch[1]*R[1]) );
+   };
+  B->Pow1=B->Pow2=0;
+  B->MaxPow=0;
+  GrowPowers(B, 2*NFIRSTROUND+2);
+
+  for (int m1=-NFIRSTROUND; m1<=NFIRSTROUND; m1++)
+   for (int m2=-NFIRSTROUND; m2<=NFIRSTROUND; m2++)
+    AddGLong2D_Block(B, m1, m2);
+  int NumActive=UpdateActivePoints(B, false);
+
+  for(int NN=NFIRSTROUND+1; NumActive>0 && NN<=NMAX; NN++)
+   { 
+     if (NN>B->MaxPow)
+      GrowPowers(B, 2*B->MaxPow);
+
+     for(int m=-NN; m<NN; m++)
+      { AddGLong2D_Block(B,   m,  NN);
+        AddGLong2D_Block(B,  NN,  -m);
+        AddGLong2D_Block(B,  -m, -NN);
+        AddGLong2D_Block(B, -NN,   m);
+      };
+     NumActive=UpdateActivePoints(B, true);
+   };
+
+  free(B->Pow1);
+  free(B->Pow2);
+}
+
+/***************************************************************/
+/* batched version of GBarVDEwald: on return,                  */
+/* GBarVD[8*np + 0..7] are the quantities GBarVD[0..7] computed*/
+/* by GBarVDEwald for the point R[3*np + 0..2].                */
+/* points are processed in blocks, which are distributed over  */
+/* threads.                                                    */
+/***************************************************************/
+void GBarVDEwald_v(int NumPoints, double *R, cdouble k, double *kBloch,
+                   double (*LBV)[3], int LDim,
+                   double E, bool ExcludeInnerCells,
+                   cdouble *GBarVD)
+{
+  if (k==0.0)
+   { memset(GBarVD, 0, NSUM*NumPoints*sizeof(cdouble));
+     return;
+   };
+
+  /***************************************************************/
+  /* in the 1D case the separation parameter depends on the      */
+  /* evaluation point, so we just parallelize over points        */
+  /***************************************************************/
+  if (LDim==1)
+   { 
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) if(NumPoints>1)
+#endif
+     for(int np=0; np<NumPoints; np++)
+      GBarVDEwald(R+3*np, k, kBloch, LBV, LDim, E, ExcludeInnerCells,
+                  GBarVD+NSUM*np);
+     return;
+   };
+
+  double Gamma[3][3], EOpt, Rho;
+  GetRLBasis(LDim, LBV, Gamma, k, &EOpt, R, &Rho);
+  if (E==-1.0) E=EOpt;
+  double PreFactor = (Gamma[0][0]*Gamma[1][1] - Gamma[0][1]*Gamma[1][0])/(16.0*M_PI*M_PI);
+
+  int NumBlocks = (NumPoints + EWALD_BLOCKSIZE - 1) / EWALD_BLOCKSIZE;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) if(NumBlocks>1)
+#endif
+  for(int nb=0; nb<NumBlocks; nb++)
+   { 
+     int Start = nb*EWALD_BLOCKSIZE;
+     int NP    = NumPoints - Start;
+     if (NP>EWALD_BLOCKSIZE) NP=EWALD_BLOCKSIZE;
+
+     EwaldBlock MyBlock, *B=&MyBlock;
+     B->NumPoints = NP;
+     B->R         = R + 3*Start;
+     B->k         = k;
+     B->kBloch    = kBloch;
+     B->LBV       = LBV;
+     B->Gamma     = Gamma;
+     B->E         = E;
+
+     cdouble Distant[NSUM*EWALD_BLOCKSIZE];
+     memset(Distant, 0, NSUM*NP*sizeof(cdouble));
+     if (E!=0.0)
+      { B->Sum = Distant;
+        GetGBarDistant2D_Block(B);
+      };
+
+     cdouble *GB = GBarVD + NSUM*Start;
+     memset(GB, 0, NSUM*NP*sizeof(cdouble));
+     B->Sum = GB;
+     GetGBarNearby2D_Block(B, ExcludeInnerCells);
+
+     for(int np=0; np<NP; np++)
+      { for(int ns=0; ns<NSUM; ns++)
+         GB[NSUM*np + ns] += PreFactor*Distant[NSUM*np + ns];
+        if (ExcludeInnerCells)
+         SubtractGLongInner(B->R + 3*np, k, kBloch, LBV, LDim, E, GB + NSUM*np);
+      };
+   };
+}
 
 } // namespace scuff
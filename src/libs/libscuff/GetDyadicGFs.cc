@@ -58,7 +58,8 @@ namespace scuff {
 HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
                                    HMatrix *XMatrix, HMatrix *M,
                                    HMatrix *GMatrix,
-                                   bool ScatteringOnly)
+                                   bool ScatteringOnly,
+                                   HMatrix **RFWorkspace)
 { 
   int NBF = TotalBFs;
   int NX  = XMatrix->NR;
@@ -69,16 +70,19 @@ HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
   /* on hand as statically-allocated buffers on the assumption    */
   /* that the routine will be called many times with the same     */
   /* number of evaluation points, for example in Brillouin-zone   */
-  /* integrations                                                 */
+  /* integrations. Callers that evaluate DGFs concurrently pass   */
+  /* their own buffers in RFWorkspace instead.                    */
   /*--------------------------------------------------------------*/
-  static HMatrix *RFSource=0, *RFDest=0;
-  if ( RFSource==0 || RFSource->NR!=NBF || RFSource->NC!=(6*NX) )
+  static HMatrix *StaticRFBuffers[2]={0,0};
+  HMatrix **RFBuffers = RFWorkspace ? RFWorkspace : StaticRFBuffers;
+  if ( RFBuffers[0]==0 || RFBuffers[0]->NR!=NBF || RFBuffers[0]->NC!=(6*NX) )
    { 
-     if (RFSource) delete RFSource;
-     if (RFDest)   delete RFDest;
-     RFSource=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
-     RFDest=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+     if (RFBuffers[0]) delete RFBuffers[0];
+     if (RFBuffers[1]) delete RFBuffers[1];
+     RFBuffers[0]=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+     RFBuffers[1]=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
    };
+  HMatrix *RFSource=RFBuffers[0], *RFDest=RFBuffers[1];
 
   /*--------------------------------------------------------------*/
   /*- allocate an output matrix of the right size if necessary   -*/
@@ -37,9 +37,14 @@
 #include "libscuffInternals.h"
 #include "PanelCubature.h"
 
+#include <config.h>
+
 #ifdef USE_PTHREAD
 #  include <pthread.h>
 #endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
 
 #define NUMFIELDS 6 // Ex, Ey, Ez, Hx, Hy, Hz
 #define II cdouble(0,1)
@@ -137,74 +142,50 @@ void GetDistanceToBF(double X0[3], RWGSurface *S, int ne)
 #endif
 
 /***************************************************************/
-/* RFMatrix is a matrix of "reduced fields", i.e. a matrix     */
-/* whose columns may be dot-producted with the KN vector (BEM  */
-/* system solution vector) to yield components of the          */
-/* scattered E and H fields.                                   */
-/* More specifically, for Mu=0...5, the (6*nx + Mu)th column   */
-/* of RFMatrix is dotted into KN to yield the Muth component   */
-/* of the field six-vector F=\{ E \choose H \}.                */
+/* frequency-dependent data needed to compute reduced-field    */
+/* entries, shared by GetRFMatrix() and GetFieldsChunked()     */
 /***************************************************************/
-HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
-                                  HMatrix *XMatrix, HMatrix *RFMatrix,
-                                  bool MinuskBloch, int ColumnOffset)
+typedef struct RFKernelData
+ { cdouble *ks, *ZRels;
+   GBarAccelerator **RegionGBAs;
+   double rRelOuterThreshold, rRelInnerThreshold;
+   int LowOrder, HighOrder;
+   bool UseNewMethod;
+ } RFKernelData;
+
+static void InitRFKernelData(RWGGeometry *G, cdouble Omega, double *kBloch,
+                             HMatrix *XMatrix, RFKernelData *KD)
 {
-  double *kBloch=kBloch0;
-  double kBlochBuffer[3];
-  if (kBloch && MinuskBloch)
-   { kBloch = kBlochBuffer;
-     kBloch[0] = kBloch[1] = kBloch[2] = 0.0;
-     for(int d=0; d<LDim; d++)
-      kBloch[d] = -1.0*kBloch0[d];
-   };
-
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
-  int NE  = TotalEdges;
-  int NBF = TotalBFs;
-  int NX  = XMatrix->NR;
-  if (     RFMatrix==0 
-       || (RFMatrix->NR != NBF) 
-       || (RFMatrix->NC != 6*NX) 
-     )
-   { if (RFMatrix) 
-      { Warn("wrong-size RFMatrix passed to GetRFMatrix; reallocating");
-        delete RFMatrix;
-      };
-     RFMatrix = new HMatrix(NBF, 6*NX, LHM_COMPLEX);
-   };
-  RFMatrix->Zero();
-
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  double rRelOuterThreshold=4.0;
-  double rRelInnerThreshold=1.0;
-  int LowOrder=7;
-  int HighOrder=20;
+  KD->rRelOuterThreshold=4.0;
+  KD->rRelInnerThreshold=1.0;
+  KD->LowOrder=7;
+  KD->HighOrder=20;
   char *s1=getenv("SCUFF_RREL_OUTER_THRESHOLD");
   char *s2=getenv("SCUFF_RREL_INNER_THRESHOLD");
   char *s3=getenv("SCUFF_LOWORDER");
   char *s4=getenv("SCUFF_HIGHORDER");
-  if (s1) sscanf(s1,"%le",&rRelOuterThreshold);
-  if (s2) sscanf(s2,"%le",&rRelInnerThreshold);
-  if (s3) sscanf(s3,"%i",&LowOrder);
-  if (s4) sscanf(s4,"%i",&HighOrder);
+  if (s1) sscanf(s1,"%le",&(KD->rRelOuterThreshold));
+  if (s2) sscanf(s2,"%le",&(KD->rRelInnerThreshold));
+  if (s3) sscanf(s3,"%i",&(KD->LowOrder));
+  if (s4) sscanf(s4,"%i",&(KD->HighOrder));
   if (s1||s2||s3||s4)
    Log("({O,I}rRelThreshold | LowOrder | HighOrder)=(%e,%e,%i,%i)",
-       rRelOuterThreshold,rRelInnerThreshold,LowOrder,HighOrder);
+       KD->rRelOuterThreshold,KD->rRelInnerThreshold,KD->LowOrder,KD->HighOrder);
 
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
-  cdouble *ZRels   = new cdouble[NumRegions];
-  cdouble *ks      = new cdouble[NumRegions];
+  int NumRegions = G->NumRegions;
+  KD->ZRels   = new cdouble[NumRegions];
+  KD->ks      = new cdouble[NumRegions];
   for(int nr=0; nr<NumRegions; nr++)
    { cdouble EpsRel, MuRel;
-     RegionMPs[nr]->GetEpsMu(Omega, &EpsRel, &MuRel);
-     ZRels[nr] = sqrt(MuRel/EpsRel);
-     ks[nr]    = sqrt(MuRel*EpsRel) * Omega;
+     G->RegionMPs[nr]->GetEpsMu(Omega, &EpsRel, &MuRel);
+     KD->ZRels[nr] = sqrt(MuRel/EpsRel);
+     KD->ks[nr]    = sqrt(MuRel*EpsRel) * Omega;
    };
 
   /***************************************************************/
@@ -213,13 +194,13 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
   /* the periodic Green's function in each extended region of    */
   /* the geometry.                                               */
   /***************************************************************/
-  GBarAccelerator **RegionGBAs=0;
-  if (LBasis)
-   { RegionGBAs=
-      (GBarAccelerator **)mallocEC(NumRegions*sizeof(RegionGBAs[0]));
+  KD->RegionGBAs=0;
+  if (G->LBasis)
+   { KD->RegionGBAs=
+      (GBarAccelerator **)mallocEC(NumRegions*sizeof(KD->RegionGBAs[0]));
      for(int nr=0; nr<NumRegions; nr++)
-      if ( ! ( RegionMPs[nr]->IsPEC() ) )
-       RegionGBAs[nr]=CreateRegionGBA(nr, Omega, kBloch, XMatrix);
+      if ( ! ( G->RegionMPs[nr]->IsPEC() ) )
+       KD->RegionGBAs[nr]=G->CreateRegionGBA(nr, Omega, kBloch, XMatrix);
    };
 
   /***************************************************************/
@@ -235,11 +216,175 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
         UseNewMethod=true;
       };
    };
+  KD->UseNewMethod=UseNewMethod;
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+}
+
+static void FreeRFKernelData(RWGGeometry *G, RFKernelData *KD)
+{
+  if (KD->RegionGBAs)
+   { for(int nr=0; nr<G->NumRegions; nr++)
+      if (KD->RegionGBAs[nr])
+       DestroyGBarAccelerator(KD->RegionGBAs[nr]);
+     free(KD->RegionGBAs);
+   };
+
+  delete[] KD->ZRels;
+  delete[] KD->ks;
+}
+
+/***************************************************************/
+/* compute the reduced-field entries contributed by full edge  */
+/* #neFull at an evaluation point X lying in region            */
+/* #RegionIndex. On return, *pnbf is the index of the first    */
+/* basis function associated with the edge, RF[0..5] are the   */
+/* six field components of the electric-current basis function */
+/* and (for non-PEC surfaces) RF[6..11] are those of the       */
+/* magnetic-current basis function.                            */
+/* The return value is the number of basis functions (0, 1, 2) */
+/* that contribute; 0 means the edge does not bound the region.*/
+/***************************************************************/
+static int GetRFEntries(RWGGeometry *G, RFKernelData *KD,
+                        double X[3], int RegionIndex, int neFull,
+                        int *pnbf, cdouble RF[12])
+{
+  int ns, ne;
+  RWGSurface *S = G->ResolveEdge(neFull, &ns, &ne, pnbf);
+  RWGEdge *E    = S->Edges[ne];
+
+  double Sign=0.0;
+  if      (S->RegionIndices[0]==RegionIndex) 
+   Sign=+1.0;
+  else if (S->RegionIndices[1]==RegionIndex)
+   Sign=-1.0;
+  else 
+   return 0;
+
+  cdouble k    = KD->ks[RegionIndex];
+  cdouble ZRel = KD->ZRels[RegionIndex];
+
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  cdouble GC[6];
+  RFIData MyData, *Data=&MyData;
+  Data->X0  = X;
+  Data->k   = k;
+  Data->GBA = KD->RegionGBAs ? KD->RegionGBAs[RegionIndex] : 0;
+  Data->RLBasis = G->RLBasis;
+  Data->RLVolume= G->RLVolume;
+  Data->NewMethod = KD->UseNewMethod;
+
+  double rRel = VecDistance(X, E->Centroid) / E->Radius;
+  const int IDim=12;
+  if (rRel >= KD->rRelOuterThreshold)
+   { 
+     GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                    IDim, KD->LowOrder, (double *)GC);
+   }
+  else if (rRel>=KD->rRelInnerThreshold)
+   { 
+     GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                    IDim, KD->HighOrder, (double *)GC);
+   }
+  else
+   { 
+     GetReducedFields_Nearby(S, ne, X, k, GC+0, GC+3);
+     GC[3] /= (-II*k);
+     GC[4] /= (-II*k);
+     GC[5] /= (-II*k);
+
+     if (KD->RegionGBAs)
+      { cdouble GC1[6], GC2[6];
+        int Order=4;
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, Order, (double *)GC1);
+        Data->GBA = 0;
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, Order, (double *)GC2);
+        for(int Mu=0; Mu<6; Mu++) 
+         GC[Mu] += (GC1[Mu] - GC2[Mu]);
+      };
+   };
+
+  /***************************************************/
+  /*                                                 */
+  /* E = ik*Z0 * Zr * k*g + ik*n*c                   */
+  /*   = ik*Z0 * Zr * k*g - ik*Z0*nScuff*c           */
+  /* H =        -ik * k*c + (ik/(Z0*Zr)) * n*c       */
+  /*   =        -ik * k*c - (ik/Zr) *nScuff*c        */
+  /***************************************************/
+  cdouble *GG=GC+0, *CC=GC+3;
+  cdouble EKFactor =      Sign*II*k*ZRel*ZVAC;
+  cdouble HKFactor = -1.0*Sign*II*k;
+  cdouble ENFactor = -1.0*Sign*II*k*ZVAC;
+  cdouble HNFactor = -1.0*Sign*II*k/ZRel;
+
+  RF[0] = EKFactor * GG[0];
+  RF[1] = EKFactor * GG[1];
+  RF[2] = EKFactor * GG[2];
+  RF[3] = HKFactor * CC[0];
+  RF[4] = HKFactor * CC[1];
+  RF[5] = HKFactor * CC[2];
+  if (S->IsPEC)
+   return 1;
+
+  RF[6]  = ENFactor * CC[0];
+  RF[7]  = ENFactor * CC[1];
+  RF[8]  = ENFactor * CC[2];
+  RF[9]  = HNFactor * GG[0];
+  RF[10] = HNFactor * GG[1];
+  RF[11] = HNFactor * GG[2];
+  return 2;
+}
+
+/***************************************************************/
+/* RFMatrix is a matrix of "reduced fields", i.e. a matrix     */
+/* whose columns may be dot-producted with the KN vector (BEM  */
+/* system solution vector) to yield components of the          */
+/* scattered E and H fields.                                   */
+/* More specifically, for Mu=0...5, the (6*nx + Mu)th column   */
+/* of RFMatrix is dotted into KN to yield the Muth component   */
+/* of the field six-vector F=\{ E \choose H \}.                */
+/***************************************************************/
+HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
+                                  HMatrix *XMatrix, HMatrix *RFMatrix,
+                                  bool MinuskBloch, int ColumnOffset)
+{
+  double *kBloch=kBloch0;
+  double kBlochBuffer[3];
+  if (kBloch && MinuskBloch)
+   { kBloch = kBlochBuffer;
+     kBloch[0] = kBloch[1] = kBloch[2] = 0.0;
+     for(int d=0; d<LDim; d++)
+      kBloch[d] = -1.0*kBloch0[d];
+   };
 
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
+  int NE  = TotalEdges;
+  int NBF = TotalBFs;
+  int NX  = XMatrix->NR;
+  if (     RFMatrix==0 
+       || (RFMatrix->NR != NBF) 
+       || (RFMatrix->NC != 6*NX) 
+     )
+   { if (RFMatrix) 
+      { Warn("wrong-size RFMatrix passed to GetRFMatrix; reallocating");
+        delete RFMatrix;
+      };
+     RFMatrix = new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+   };
+  RFMatrix->Zero();
+
+  RFKernelData MyKD, *KD=&MyKD;
+  InitRFKernelData(this, Omega, kBloch, XMatrix, KD);
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int *RegionIndices=GetRegionIndices(XMatrix, 0, ColumnOffset);
   int NENX=NE*NX;
 #ifndef USE_OPENMP
   if (LogLevel>SCUFF_VERBOSELOGGING)
@@ -255,117 +400,214 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
      int nx     = nenx / NE;
      int neFull = nenx % NE;
 
-     int ns, ne, nbf;
-     RWGSurface *S = ResolveEdge(neFull, &ns, &ne, &nbf);
-     RWGEdge *E    = S->Edges[ne];
-
      double X[3];
      X[0]=XMatrix->GetEntryD(nx,ColumnOffset+0);
      X[1]=XMatrix->GetEntryD(nx,ColumnOffset+1);
      X[2]=XMatrix->GetEntryD(nx,ColumnOffset+2);
-     int RegionIndex = GetRegionIndex(X);
+     int RegionIndex = RegionIndices[nx];
      if (RegionIndex==-1) continue; // inside a closed PEC surface
-   
-     double Sign=0.0;
-     if      (Surfaces[ns]->RegionIndices[0]==RegionIndex) 
-      Sign=+1.0;
-     else if (Surfaces[ns]->RegionIndices[1]==RegionIndex)
-      Sign=-1.0;
-     else 
-      continue;
-   
-     cdouble k    = ks[RegionIndex];
-     cdouble ZRel = ZRels[RegionIndex];
-
-     /*--------------------------------------------------------------*/
-     /*--------------------------------------------------------------*/
-     /*--------------------------------------------------------------*/
-     cdouble GC[6];
-     RFIData MyData, *Data=&MyData;
-     Data->X0  = X;
-     Data->k   = ks[RegionIndex];
-     Data->GBA = RegionGBAs ? RegionGBAs[RegionIndex] : 0;
-     Data->RLBasis = RLBasis;
-     Data->RLVolume= RLVolume;
-     Data->NewMethod = UseNewMethod;
-
-     double rRel = VecDistance(X, E->Centroid) / E->Radius;
-     const int IDim=12;
-     if (rRel >= rRelOuterThreshold)
-      { 
-        GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                       IDim, LowOrder, (double *)GC);
-      }
-     else if (rRel>=rRelInnerThreshold)
-      { 
-        GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                       IDim, HighOrder, (double *)GC);
-      }
-     else
-      { 
-        GetReducedFields_Nearby(S, ne, X, k, GC+0, GC+3);
-        GC[3] /= (-II*k);
-        GC[4] /= (-II*k);
-        GC[5] /= (-II*k);
-
-        if (RegionGBAs)
-         { cdouble GC1[6], GC2[6];
-           int Order=4;
-           GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                          IDim, Order, (double *)GC1);
-           Data->GBA = 0;
-           GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                          IDim, Order, (double *)GC2);
-           for(int Mu=0; Mu<6; Mu++) 
-            GC[Mu] += (GC1[Mu] - GC2[Mu]);
-         };
-      };
 
-     /***************************************************/
-     /*                                                 */
-     /* E = ik*Z0 * Zr * k*g + ik*n*c                   */
-     /*   = ik*Z0 * Zr * k*g - ik*Z0*nScuff*c           */
-     /* H =        -ik * k*c + (ik/(Z0*Zr)) * n*c       */
-     /*   =        -ik * k*c - (ik/Zr) *nScuff*c        */
-     /***************************************************/
-     cdouble *GG=GC+0, *CC=GC+3;
-     cdouble EKFactor =      Sign*II*k*ZRel*ZVAC;
-     cdouble HKFactor = -1.0*Sign*II*k;
-     cdouble ENFactor = -1.0*Sign*II*k*ZVAC;
-     cdouble HNFactor = -1.0*Sign*II*k/ZRel;
-
-     RFMatrix->SetEntry(nbf, 6*nx + 0, EKFactor * GG[0] );
-     RFMatrix->SetEntry(nbf, 6*nx + 1, EKFactor * GG[1] );
-     RFMatrix->SetEntry(nbf, 6*nx + 2, EKFactor * GG[2] );
-     RFMatrix->SetEntry(nbf, 6*nx + 3, HKFactor * CC[0] );
-     RFMatrix->SetEntry(nbf, 6*nx + 4, HKFactor * CC[1] );
-     RFMatrix->SetEntry(nbf, 6*nx + 5, HKFactor * CC[2] );
-
-     if ( !(S->IsPEC) )
-      { RFMatrix->SetEntry(nbf+1, 6*nx + 0, ENFactor * CC[0] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 1, ENFactor * CC[1] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 2, ENFactor * CC[2] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 3, HNFactor * GG[0] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 4, HNFactor * GG[1] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 5, HNFactor * GG[2] );
-      };
+     int nbf;
+     cdouble RF[12];
+     int NumBFs=GetRFEntries(this, KD, X, RegionIndex, neFull, &nbf, RF);
+     for(int n=0; n<NumBFs; n++)
+      for(int Mu=0; Mu<6; Mu++)
+       RFMatrix->SetEntry(nbf+n, 6*nx + Mu, RF[6*n + Mu]);
 
    }; // for(int nenx=0; nenx<NENX; nenx++)
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  if (RegionGBAs)
-   { for(int nr=0; nr<NumRegions; nr++)
-      if (RegionGBAs[nr])
-       DestroyGBarAccelerator(RegionGBAs[nr]);
-     free(RegionGBAs);
+  free(RegionIndices);
+  FreeRFKernelData(this, KD);
+
+  return RFMatrix;
+}
+
+/***************************************************************/
+/* streaming field evaluation: the evaluation points are       */
+/* processed in tiles of ChunkSize points. For each tile, the  */
+/* reduced fields are contracted with KN as soon as they are   */
+/* computed (into per-thread scratch buffers that are reused   */
+/* from tile to tile), so the full TotalBFs x 6NX RFMatrix is  */
+/* never formed. Once the fields at all points in a tile are   */
+/* known, Handler is called with the tile's evaluation points  */
+/* and fields, e.g. to write them to an output file.           */
+/*                                                             */
+/* for compact geometries the working storage is then          */
+/* independent of NX. for periodic geometries this is not      */
+/* quite true: the GBar interpolation table for each region    */
+/* is still built once, up front, to cover the bounding box of */
+/* all NX points (re-tabulating it for every tile would cost   */
+/* far more than it saves), so its size grows with the spatial */
+/* extent of the evaluation points, though not with their      */
+/* number.                                                     */
+/***************************************************************/
+#define DEFAULT_FIELD_CHUNKSIZE 1024
+void RWGGeometry::GetFieldsChunked(IncField *IFList, HVector *KN,
+                                   cdouble Omega, double *kBloch0,
+                                   HMatrix *XMatrix,
+                                   FieldChunkHandler Handler, void *UserData,
+                                   int ChunkSize)
+{
+  if ( XMatrix==0 || XMatrix->NC<3 || XMatrix->NR==0 )
+   ErrExit("wrong-size XMatrix passed to GetFieldsChunked");
+
+  int NX=XMatrix->NR;
+  if (ChunkSize<=0)
+   { ChunkSize=DEFAULT_FIELD_CHUNKSIZE;
+     char *s=getenv("SCUFF_FIELD_CHUNKSIZE");
+     if (s && sscanf(s,"%i",&ChunkSize)==1 && ChunkSize>0)
+      Log("Evaluating fields in chunks of %i points",ChunkSize);
+     if (ChunkSize<=0) ChunkSize=DEFAULT_FIELD_CHUNKSIZE;
    };
+  if (ChunkSize>NX) ChunkSize=NX;
 
-  delete[] ZRels;
-  delete[] ks;
+  /***************************************************************/
+  /* see the note in GetFields() below                           */
+  /***************************************************************/
+  if (IFList)
+   UpdateIncFields(IFList, Omega, kBloch0);
 
-  return RFMatrix;
+  /***************************************************************/
+  /* the reduced fields are computed at -kBloch, as in GetFields */
+  /***************************************************************/
+  double *kBloch=kBloch0;
+  double kBlochBuffer[3];
+  if (kBloch)
+   { kBloch = kBlochBuffer;
+     kBloch[0] = kBloch[1] = kBloch[2] = 0.0;
+     for(int d=0; d<LDim; d++)
+      kBloch[d] = -1.0*kBloch0[d];
+   };
+
+  RFKernelData MyKD, *KD=&MyKD;
+  if (KN)
+   InitRFKernelData(this, Omega, kBloch, XMatrix, KD);
+
+  /***************************************************************/
+  /* buffers for a single chunk, plus per-thread scratch space  */
+  /* in which the contributions of each thread are accumulated  */
+  /***************************************************************/
+  int NumThreads=1;
+#ifdef USE_OPENMP
+  NumThreads=GetNumThreads();
+#endif
+  double *XBuffer     = (double *)mallocEC(3*ChunkSize*sizeof(double));
+  cdouble *FBuffer    = (cdouble *)mallocEC(NUMFIELDS*ChunkSize*sizeof(cdouble));
+  cdouble *FScratch   = (cdouble *)mallocEC(NumThreads*NUMFIELDS*ChunkSize*sizeof(cdouble));
+  int *RegionIndices  = (int *)mallocEC(ChunkSize*sizeof(int));
+
+  /***************************************************************/
+  /* loop over chunks ********************************************/
+  /***************************************************************/
+  int NE=TotalEdges;
+  for(int nxStart=0; nxStart<NX; nxStart+=ChunkSize)
+   { 
+     int NXChunk = (nxStart+ChunkSize <= NX) ? ChunkSize : NX-nxStart;
+     HMatrix XChunk(NXChunk, 3, LHM_REAL, LHM_NORMAL, (void *)XBuffer);
+     HMatrix FChunk(NXChunk, NUMFIELDS, LHM_COMPLEX, LHM_NORMAL, (void *)FBuffer);
+     FChunk.Zero();
+
+     for(int nx=0; nx<NXChunk; nx++)
+      { double X[3];
+        XMatrix->GetEntriesD(nxStart+nx, "0:2", X);
+        XChunk.SetEntriesD(nx, "0:2", X);
+      };
+     GetRegionIndices(&XChunk, RegionIndices);
+
+     /*--------------------------------------------------------------*/
+     /*- contributions of surface currents --------------------------*/
+     /*--------------------------------------------------------------*/
+     if (KN)
+      { 
+        for(int n=0; n<NumThreads*NUMFIELDS*NXChunk; n++)
+         FScratch[n]=0.0;
+        int NENX=NE*NXChunk;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+        for(int nenx=0; nenx<NENX; nenx++)
+         { 
+           int nx     = nenx / NE;
+           int neFull = nenx % NE;
+           int RegionIndex = RegionIndices[nx];
+           if (RegionIndex==-1) continue; // inside a closed PEC surface
+
+           double X[3];
+           X[0]=XBuffer[nx + 0*NXChunk];
+           X[1]=XBuffer[nx + 1*NXChunk];
+           X[2]=XBuffer[nx + 2*NXChunk];
+
+           int nbf;
+           cdouble RF[12];
+           int NumBFs=GetRFEntries(this, KD, X, RegionIndex, neFull, &nbf, RF);
+           if (NumBFs==0) continue;
+
+           int nt=0;
+#ifdef USE_OPENMP
+           nt=omp_get_thread_num();
+#endif
+           cdouble *F = FScratch + (nt*NXChunk + nx)*NUMFIELDS;
+           for(int n=0; n<NumBFs; n++)
+            for(int Mu=0; Mu<6; Mu++)
+             F[Mu] += RF[6*n + Mu]*KN->ZV[nbf+n];
+         };
+
+        for(int nt=0; nt<NumThreads; nt++)
+         for(int nx=0; nx<NXChunk; nx++)
+          for(int Mu=0; Mu<NUMFIELDS; Mu++)
+           FChunk.AddEntry(nx, Mu, FScratch[(nt*NXChunk + nx)*NUMFIELDS + Mu]);
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- contributions of incident fields ---------------------------*/
+     /*--------------------------------------------------------------*/
+     if (IFList)
+      for(int nx=0; nx<NXChunk; nx++)
+       { 
+         int RegionIndex = RegionIndices[nx];
+         if (RegionIndex==-1) continue; // inside a closed PEC surface
+
+         double X[3];
+         XChunk.GetEntriesD(nx,"0:2",X);
+         for(IncField *IF=IFList; IF; IF=IF->Next)
+          if ( IF->RegionIndex == RegionIndex )
+           { cdouble EH[6];
+             IF->GetFields(X, EH);
+             for(int Mu=0; Mu<6; Mu++)
+              FChunk.AddEntry(nx, Mu, EH[Mu]);
+           };
+       };
+
+     Handler(nxStart, &XChunk, &FChunk, UserData);
+
+   }; // for(int nxStart=0; nxStart<NX; nxStart+=ChunkSize)
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  if (KN)
+   FreeRFKernelData(this, KD);
+  free(XBuffer);
+  free(FBuffer);
+  free(FScratch);
+  free(RegionIndices);
+}
+
+/***************************************************************/
+/* chunk handler used by GetFields() to stamp each chunk of    */
+/* fields into the full output matrix                          */
+/***************************************************************/
+static void StampFieldChunk(int nxStart, HMatrix *XChunk,
+                            HMatrix *FChunk, void *UserData)
+{
+  (void) XChunk;
+  HMatrix *FMatrix = (HMatrix *)UserData;
+  for(int nx=0; nx<FChunk->NR; nx++)
+   for(int Mu=0; Mu<NUMFIELDS; Mu++)
+    FMatrix->SetEntry(nxStart+nx, Mu, FChunk->GetEntry(nx,Mu));
 }
 
 /***************************************************************/
@@ -404,47 +646,15 @@ HMatrix *RWGGeometry::GetFields(IncField *IFList, HVector *KN,
   /* AssembleRHSVector(), but someone might call GetFields()     */
   /* to get information on just the incident fields before       */
   /* before setting up and solving the BEM problem, so we should */
-  /* do this just to make sure.                                  */
+  /* do this just to make sure (GetFieldsChunked takes care of   */
+  /* this).                                                      */
+  /*                                                             */
+  /* the contributions of surface currents are computed a chunk  */
+  /* of evaluation points at a time, so that we never need to    */
+  /* store the full RFMatrix.                                    */
   /***************************************************************/
-  if (IFList)
-   UpdateIncFields(IFList, Omega, kBloch);
-
-  /***************************************************************/
-  /* get contributions of surface currents if present ************/
-  /***************************************************************/
-  if (KN)
-   {
-     HMatrix *RFMatrix = GetRFMatrix(Omega, kBloch, XMatrix, 0, true);
-     HMatrix KNMatrix(1, TotalBFs, LHM_COMPLEX, LHM_NORMAL, (void *)KN->ZV);
-     HMatrix *FMatrixT = new HMatrix(1, 6*NX, LHM_COMPLEX);
-     KNMatrix.Multiply(RFMatrix, FMatrixT);
-     for(int nx=0; nx<NX; nx++)
-      for(int Mu=0; Mu<6; Mu++)
-       FMatrix->SetEntry(nx, Mu, FMatrixT->GetEntry(0, 6*nx + Mu));
-
-     delete RFMatrix;
-     delete FMatrixT;
-   };
-
-  /***************************************************************/
-  /* add contributions of incident fields if present *************/
-  /***************************************************************/
-  if (IFList)
-   for(int nx=0; nx<NX; nx++)
-    { 
-      double X[3];
-      XMatrix->GetEntriesD(nx,"0:2",X);
-      int RegionIndex = GetRegionIndex(X);
-      if (RegionIndex==-1) continue; // inside a closed PEC surface
-
-      for(IncField *IF=IFList; IF; IF=IF->Next)
-       if ( IF->RegionIndex == RegionIndex )
-        { cdouble EH[6];
-          IF->GetFields(X, EH);
-          for(int Mu=0; Mu<6; Mu++)
-           FMatrix->AddEntry(nx, Mu, EH[Mu]);
-        };
-    };
+  GetFieldsChunked(IFList, KN, Omega, kBloch, XMatrix,
+                   StampFieldChunk, (void *)FMatrix);
 
   return FMatrix;
          
@@ -0,0 +1,286 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * HelmholtzKernels.cc -- structure-of-arrays evaluation of the
+ *                     -- Helmholtz kernel and its radial derivatives
+ *                     -- at many cubature-point pairs at once
+ *
+ * The caller supplies N distances r_n and weights w_n together with
+ * a number of real 'factor' arrays, and gets back the weighted sums
+ *
+ *  sum_n F_n * w_n * Phi(r_n),   Phi  = exp(ikr) / (4 pi r)
+ *  sum_n F_n * w_n * Psi(r_n),   Psi  = Phi * (ik - 1/r) / r
+ *  sum_n F_n * w_n * Zeta(r_n),  Zeta = Phi * ((ik)^2 - 3ik/r + 3/r^2) / r^2
+ *
+ * for each factor array. The kernel values are computed with
+ * branch-free sine, cosine, and exponential routines written so that
+ * the loops over n vectorize; on x86-64 the routine is compiled
+ * for several instruction sets and the best one for the host CPU
+ * is selected at load time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <libhrutil.h>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+namespace scuff {
+
+// the arch=x86-64-v3/v4 micro-architecture levels need GCC 11 or later
+#if defined(__GNUC__) && (__GNUC__ >= 11) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#  define KERNEL_TARGETS __attribute__((target_clones("arch=x86-64-v4","arch=x86-64-v3","default")))
+#else
+#  define KERNEL_TARGETS
+#endif
+
+// the elementary functions must be inlined into the loops for these to vectorize
+#ifdef __GNUC__
+#  define KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#  define KERNEL_INLINE inline
+#endif
+
+// adding and subtracting this rounds a double of magnitude < 2^51
+// to the nearest integer q; the low-order bits of the intermediate
+// sum are then the two's-complement bits of q
+#define ROUNDMAGIC 6755399441055744.0
+
+// pi/2 split into three pieces for Cody-Waite argument reduction
+#define PIO2_1  1.57079632673412561417e+00
+#define PIO2_2  6.07710050630396597660e-11
+#define PIO2_3  2.02226624871116645580e-21
+#define TWOOPI  6.36619772367581382433e-01
+
+// log(2) split for the same purpose
+#define LN2HI   6.93147180369123816490e-01
+#define LN2LO   1.90821492927058770002e-10
+#define LOG2E   1.44269504088896338700e+00
+
+/***************************************************************/
+/* note: there are no branches in what follows; all choices    */
+/* between values are made by masking their bit patterns. (a   */
+/* compiler that respects IEEE semantics will not vectorize    */
+/* conditional selects of floating-point values that could     */
+/* trap.)                                                      */
+/***************************************************************/
+static KERNEL_INLINE int64_t DoubleBits(double x)
+{
+  int64_t Bits;
+  memcpy(&Bits, &x, sizeof(double));
+  return Bits;
+}
+
+static KERNEL_INLINE double BitsDouble(int64_t Bits)
+{
+  double x;
+  memcpy(&x, &Bits, sizeof(double));
+  return x;
+}
+
+// x if Mask is all ones, 0 if Mask is 0
+static KERNEL_INLINE double MaskDouble(double x, int64_t Mask)
+{
+  return BitsDouble( DoubleBits(x) & Mask );
+}
+
+
+/***************************************************************/
+/* sin(x) and cos(x) for |x| <= VSINCOS_MAXARG: reduce to      */
+/* |z| <= pi/4 and use the fdlibm kernel polynomials. the      */
+/* products q*PIO2_1 are exact only while q has at most 20     */
+/* bits, so beyond that the reduction loses accuracy and the   */
+/* caller must fall back to the library sin() and cos().       */
+/***************************************************************/
+#define VSINCOS_MAXARG 1048576.0 // 2^20
+static KERNEL_INLINE void VSinCos(double x, double *SinX, double *CosX)
+{
+  double qm = x*TWOOPI + ROUNDMAGIC;
+  double q  = qm - ROUNDMAGIC;
+  int64_t Quadrant = DoubleBits(qm) & 3;
+  double z  = ((x - q*PIO2_1) - q*PIO2_2) - q*PIO2_3;
+  double z2 = z*z;
+
+  double s = z + z*z2*(-1.66666666666666324348e-01
+                 + z2*( 8.33333333332248946124e-03
+                 + z2*(-1.98412698298579493134e-04
+                 + z2*( 2.75573137070700676789e-06
+                 + z2*(-2.50507602534068634195e-08
+                 + z2*  1.58969099521155010221e-10 )))));
+  double c = 1.0 - 0.5*z2 + z2*z2*( 4.16666666666666019037e-02
+                            + z2*(-1.38888888888741095749e-03
+                            + z2*( 2.48015872894767294178e-05
+                            + z2*(-2.75573143513906633035e-07
+                            + z2*( 2.08757232129817482790e-09
+                            + z2* -1.13596475577881948265e-11 )))));
+
+  // swap s and c in odd quadrants, then fix up signs
+  int64_t Odd = -(Quadrant & 1);
+  int64_t SBits = DoubleBits(s), CBits = DoubleBits(c);
+  int64_t SSBits = (CBits & Odd) | (SBits & ~Odd);
+  int64_t CCBits = (SBits & Odd) | (CBits & ~Odd);
+  *SinX = BitsDouble( SSBits ^ ((Quadrant & 2)     << 62) );
+  *CosX = BitsDouble( CCBits ^ (((Quadrant+1) & 2) << 62) );
+}
+
+/***************************************************************/
+/* exp(x), flushing to 0 below about exp(-708) and saturating  */
+/* above about exp(709). the caller redoes arguments beyond    */
+/* VEXP_MAXARG with the library exp().                         */
+/***************************************************************/
+#define VEXP_MAXARG 708.0
+static KERNEL_INLINE double VExp(double x)
+{
+  double nm = x*LOG2E + ROUNDMAGIC;
+  double n  = nm - ROUNDMAGIC;
+  double t  = (x - n*LN2HI) - n*LN2LO;
+
+  // Taylor series, |t| <= log(2)/2
+  double p = 1.0 + t*(1.0 + t*(1.0/2.0 + t*(1.0/6.0 + t*(1.0/24.0
+                 + t*(1.0/120.0 + t*(1.0/720.0 + t*(1.0/5040.0
+                 + t*(1.0/40320.0 + t*(1.0/362880.0 + t*(1.0/3628800.0
+                 + t*(1.0/39916800.0 + t*(1.0/479001600.0
+                 + t*(1.0/6227020800.0)))))))))))));
+
+  // 2^n, assembled directly from the exponent bits
+  int64_t ni = DoubleBits(nm) - DoubleBits(ROUNDMAGIC);
+  ni = (ni > 1023) ? 1023 : ni;
+  int64_t Underflow = -(int64_t)(ni < -1022);
+  double Scale = BitsDouble( (ni + 1023) << 52 );
+
+  return MaskDouble(p*Scale, ~Underflow);
+}
+
+/***************************************************************/
+/* the factor arrays are stored one after another with stride  */
+/* N, i.e. factor #nf for point pair #n is F[nf*N + n].        */
+/* Moments[0..NumPhi-1] are the Phi sums, followed by the Psi  */
+/* sums and then the Zeta sums.                                */
+/***************************************************************/
+KERNEL_TARGETS
+void GetHelmholtzKernelMoments(int N, const double *r, const double *w, cdouble k,
+                               int NumPhi,  const double *PhiFactors,
+                               int NumPsi,  const double *PsiFactors,
+                               int NumZeta, const double *ZetaFactors,
+                               cdouble *Moments)
+{
+  if (N>MAXKERNELPAIRS)
+   ErrExit("%s:%i: too many point pairs (%i)",__FILE__,__LINE__,N);
+
+  double kr=real(k), ki=imag(k);
+  double PhiR[MAXKERNELPAIRS], PhiI[MAXKERNELPAIRS];
+  double PsiR[MAXKERNELPAIRS], PsiI[MAXKERNELPAIRS];
+  double ZetaR[MAXKERNELPAIRS], ZetaI[MAXKERNELPAIRS];
+
+  /*--------------------------------------------------------------*/
+  /*- kernel values: ik = -ki + i*kr                              */
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int n=0; n<N; n++)
+   { double rn = r[n];
+     double OOR = 1.0/rn;
+     OOR = MaskDouble(OOR, -(int64_t)(DoubleBits(rn)>0)); // Phi=0 at r=0, as in the scalar code
+     double Mag = w[n]*OOR*(1.0/(4.0*M_PI))*VExp(-ki*rn);
+     double S, C;
+     VSinCos(kr*rn, &S, &C);
+     double pr = Mag*C, pi = Mag*S;
+     PhiR[n]=pr;
+     PhiI[n]=pi;
+
+     // Psi = Phi * (ik - 1/r) / r
+     double ar = (-ki - OOR)*OOR, ai = kr*OOR;
+     PsiR[n] = pr*ar - pi*ai;
+     PsiI[n] = pr*ai + pi*ar;
+   };
+
+  // redo with the library functions any point pairs whose
+  // arguments were outside the ranges of VSinCos and VExp
+  double rMax=0.0;
+  for(int n=0; n<N; n++)
+   if (r[n]>rMax) rMax=r[n];
+  if ( fabs(kr)*rMax > VSINCOS_MAXARG || fabs(ki)*rMax > VEXP_MAXARG )
+   for(int n=0; n<N; n++)
+    { double rn = r[n];
+      if ( !(fabs(kr*rn) > VSINCOS_MAXARG) && !(fabs(ki*rn) > VEXP_MAXARG) )
+       continue;
+      double OOR = 1.0/rn;
+      double Mag = w[n]*OOR*(1.0/(4.0*M_PI))*exp(-ki*rn);
+      double pr = Mag*cos(kr*rn), pi = Mag*sin(kr*rn);
+      PhiR[n]=pr;
+      PhiI[n]=pi;
+      double ar = (-ki - OOR)*OOR, ai = kr*OOR;
+      PsiR[n] = pr*ar - pi*ai;
+      PsiI[n] = pr*ai + pi*ar;
+    };
+
+  if (NumZeta>0)
+   {
+     // (ik)^2 = ki^2 - kr^2 - 2i*kr*ki
+     double ik2r = ki*ki - kr*kr, ik2i = -2.0*kr*ki;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+     for(int n=0; n<N; n++)
+      { double OOR = 1.0/r[n];
+        OOR = MaskDouble(OOR, -(int64_t)(DoubleBits(r[n])>0));
+        double OOR2 = OOR*OOR;
+        double zr = (ik2r + 3.0*ki*OOR + 3.0*OOR2)*OOR2;
+        double zi = (ik2i - 3.0*kr*OOR)*OOR2;
+        ZetaR[n] = PhiR[n]*zr - PhiI[n]*zi;
+        ZetaI[n] = PhiR[n]*zi + PhiI[n]*zr;
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- weighted sums ----------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  const double *Factors[3]  = { PhiFactors, PsiFactors, ZetaFactors };
+  const double *KernelR[3]  = { PhiR, PsiR, ZetaR };
+  const double *KernelI[3]  = { PhiI, PsiI, ZetaI };
+  int NumFactors[3]         = { NumPhi, NumPsi, NumZeta };
+  int nm=0;
+  for(int nkf=0; nkf<3; nkf++)
+   for(int nf=0; nf<NumFactors[nkf]; nf++, nm++)
+    { const double *F=Factors[nkf] + nf*N;
+      const double *KR=KernelR[nkf], *KI=KernelI[nkf];
+      double SumR=0.0, SumI=0.0;
+#ifdef USE_OPENMP
+#pragma omp simd reduction(+:SumR,SumI)
+#endif
+      for(int n=0; n<N; n++)
+       { SumR += F[n]*KR[n];
+         SumI += F[n]*KI[n];
+       };
+      Moments[nm]=cdouble(SumR, SumI);
+    };
+}
+
+} // namespace scuff
@@ -0,0 +1,254 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * IterativeSolve.cc -- libscuff routines for solving the BEM system
+ *                   -- by krylov-subspace iteration instead of dense
+ *                   -- LU factorization
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#include "libscuff.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* LU-factorize the single-surface diagonal blocks of the BEM  */
+/* matrix M, for use as a block-Jacobi preconditioner by       */
+/* IterativeSolve().                                           */
+/*                                                             */
+/* If DBlocks is NULL on entry, a new array of NumSurfaces     */
+/* HMatrix pointers is allocated and returned; otherwise the   */
+/* matrices in DBlocks (as returned by a previous call) are    */
+/* overwritten.                                                */
+/*                                                             */
+/* Surfaces with a Mate share the factorized block of the mate */
+/* since their diagonal blocks are identical.                  */
+/***************************************************************/
+HMatrix **RWGGeometry::FactorizeDiagonalBlocks(HMatrix *M, HMatrix **DBlocks)
+{
+  if (M->StorageType!=LHM_NORMAL)
+   ErrExit("%s:%i: FactorizeDiagonalBlocks not implemented for packed matrices",__FILE__,__LINE__);
+
+  if (DBlocks==0)
+   { DBlocks=(HMatrix **)mallocEC(NumSurfaces*sizeof(HMatrix *));
+     memset(DBlocks, 0, NumSurfaces*sizeof(HMatrix *));
+   };
+
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { 
+     int nsm=Mate[ns];
+     if (nsm!=-1)
+      { DBlocks[ns]=DBlocks[nsm];
+        continue;
+      };
+
+     int NBF=Surfaces[ns]->NumBFs;
+     int Offset=BFIndexOffset[ns];
+     if (DBlocks[ns]==0)
+      DBlocks[ns]=new HMatrix(NBF, NBF, M->RealComplex);
+     M->ExtractBlock(Offset, Offset, DBlocks[ns]);
+     DBlocks[ns]->LUFactorize();
+   };
+
+  return DBlocks;
+}
+
+/***************************************************************/
+/* data structure and callbacks passed to the krylov solvers   */
+/***************************************************************/
+typedef struct ISData
+ { RWGGeometry *G;
+   HMatrix *M;
+   HMatrix **DBlocks;
+ } ISData;
+
+static void ApplyBEMMatrix(HVector *X, HVector *Y, void *UserData)
+{
+  ISData *Data=(ISData *)UserData;
+  Data->M->Apply(X, Y);
+}
+
+static void ApplyBlockJacobi(HVector *X, HVector *Y, void *UserData)
+{
+  ISData *Data=(ISData *)UserData;
+  RWGGeometry *G=Data->G;
+  Y->Copy(X);
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { HVector YBlock(G->Surfaces[ns]->NumBFs, LHM_COMPLEX, Y->ZV + G->BFIndexOffset[ns]);
+     Data->DBlocks[ns]->LUSolve(&YBlock);
+   };
+}
+
+/***************************************************************/
+/* Solve the BEM system M*KN = RHS iteratively.                */
+/*                                                             */
+/* On entry, KN contains the RHS vector; on return it contains */
+/* the solution.                                               */
+/*                                                             */
+/* DBlocks is the array returned by FactorizeDiagonalBlocks(). */
+/*                                                             */
+/* Solver is SCUFF_SOLVER_GMRES or SCUFF_SOLVER_BICGSTAB.      */
+/*                                                             */
+/* The return value is the number of iterations, or -1 if the  */
+/* iteration did not converge to within Tol.                   */
+/***************************************************************/
+int RWGGeometry::IterativeSolve(HMatrix *M, HMatrix **DBlocks, HVector *KN,
+                                int Solver, double Tol, int MaxIters)
+{
+  if (M->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: IterativeSolve implemented only for complex BEM matrices",__FILE__,__LINE__);
+
+  ISData MyData, *Data=&MyData;
+  Data->G=this;
+  Data->M=M;
+  Data->DBlocks=DBlocks;
+
+  HVector *RHS = new HVector(KN);
+  KN->Zero();
+
+  double Residual;
+  int Iters;
+  const char *SolverName;
+  if (Solver==SCUFF_SOLVER_BICGSTAB)
+   { SolverName="BiCGStab";
+     Iters=BiCGStab(ApplyBEMMatrix, (void *)Data, RHS, KN,
+                    ApplyBlockJacobi, (void *)Data,
+                    Tol, MaxIters, &Residual);
+   }
+  else
+   { SolverName="GMRES";
+     Iters=GMRES(ApplyBEMMatrix, (void *)Data, RHS, KN,
+                 ApplyBlockJacobi, (void *)Data,
+                 Tol, MaxIters, 200, &Residual);
+   };
+  delete RHS;
+
+  if (Iters<0)
+   Warn("%s did not converge in %i iterations (residual %e)",SolverName,MaxIters,Residual);
+  else
+   Log(" %s converged in %i iterations (residual %e)",SolverName,Iters,Residual);
+
+  return Iters;
+}
+
+/***************************************************************/
+/* LU-factorize the dense diagonal blocks, which together      */
+/* cover all basis functions exactly once, for use as a block- */
+/* Jacobi preconditioner in CompressedBEMMatrix::IterativeSolve*/
+/* (this is not an LU factorization of the full matrix; see    */
+/* CompressedBEMMatrix::LUFactorize for that).                 */
+/***************************************************************/
+int CompressedBEMMatrix::FactorizePreconditioner()
+{
+  int Info=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { CBMBlock *B=Blocks + nb;
+     if ( B->RowCluster!=B->ColCluster )
+      continue;
+     if (B->LU) delete B->LU;
+     B->LU = new HMatrix(B->D);
+     int ThisInfo=B->LU->LUFactorize();
+     if (ThisInfo!=0 && Info==0)
+      Info=ThisInfo;
+   };
+  Factorized=true;
+  return Info;
+}
+
+/***************************************************************/
+/* Y = P^{-1} X, where P is the block diagonal of the matrix   */
+/***************************************************************/
+void CompressedBEMMatrix::ApplyPreconditioner(HVector *X, HVector *Y)
+{
+  cdouble *Buffer = (cdouble *)mallocEC(N*sizeof(cdouble));
+  for(int nb=0; nb<NumBlocks; nb++)
+   { CBMBlock *B=Blocks + nb;
+     if (B->LU==0)
+      continue;
+     CBMCluster *C=Clusters + B->RowCluster;
+     for(int n=0; n<C->NumBFs; n++)
+      Buffer[n] = X->ZV[ C->BFIndices[n] ];
+     HVector XB(C->NumBFs, LHM_COMPLEX, Buffer);
+     B->LU->LUSolve(&XB);
+     for(int n=0; n<C->NumBFs; n++)
+      Y->ZV[ C->BFIndices[n] ] = Buffer[n];
+   };
+  free(Buffer);
+}
+
+/***************************************************************/
+/* C-style wrappers for passing to the krylov solvers **********/
+/***************************************************************/
+static void CBMApply(HVector *X, HVector *Y, void *UserData)
+{ ((CompressedBEMMatrix *)UserData)->Apply(X, Y); }
+
+static void CBMPreconditioner(HVector *X, HVector *Y, void *UserData)
+{ ((CompressedBEMMatrix *)UserData)->ApplyPreconditioner(X, Y); }
+
+/***************************************************************/
+/* solve a compressed BEM system by GMRES or BiCGStab, using   */
+/* the block-Jacobi preconditioner above.                      */
+/* on entry X is the RHS vector; on return it is the solution. */
+/* the return value is 0 if the iteration converged to within  */
+/* SolverTol, or nonzero (in which case X holds the last       */
+/* iterate) if it did not.                                     */
+/***************************************************************/
+int CompressedBEMMatrix::IterativeSolve(HVector *X)
+{
+  if (!Factorized)
+   FactorizePreconditioner();
+
+  HVector *B = new HVector(X);
+  X->Zero();
+
+  double Residual;
+  int Iters;
+  const char *SolverName;
+  if (Solver==SCUFF_SOLVER_BICGSTAB)
+   { SolverName="BiCGStab";
+     Iters=BiCGStab(CBMApply, (void *)this, B, X,
+                    CBMPreconditioner, (void *)this,
+                    SolverTol, MaxIters, &Residual);
+   }
+  else
+   { SolverName="GMRES";
+     Iters=GMRES(CBMApply, (void *)this, B, X,
+                 CBMPreconditioner, (void *)this,
+                 SolverTol, MaxIters, Restart, &Residual);
+   };
+  delete B;
+
+  if (Iters<0)
+   { Warn("%s did not converge in %i iterations (residual %e)",SolverName,MaxIters,Residual);
+     return 1;
+   };
+  Log(" %s converged in %i iterations (residual %e)",SolverName,Iters,Residual);
+  return 0;
+}
+
+
+} // namespace scuff
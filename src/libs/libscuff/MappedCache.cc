@@ -0,0 +1,333 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MappedCache.cc -- memory-mapped, hash-indexed cache files that
+ *                -- may be shared by many processes at once
+ *
+ * The file consists of a fixed-size header followed by an
+ * open-addressed hash table of NumSlots fixed-size slots.
+ * Each slot is
+ *
+ *   uint64_t Tag      (0 = empty; otherwise the 64-bit hash of the
+ *                      key with the low bit set)
+ *   Key               (KeySize bytes, padded to a multiple of 8)
+ *   Data              (DataSize bytes, padded to a multiple of 8)
+ *
+ * The file is mapped MAP_SHARED, so lookups are zero-copy reads of
+ * the page cache, which is shared by all processes mapping the
+ * same file. Lookups take no locks: a slot becomes visible only
+ * when its tag is written, and the tag is written (with release
+ * semantics) after the key and data. Insertions are serialized by
+ * an advisory lock on the file (across processes) and by a
+ * process-local lock (across threads).
+ *
+ * The table does not grow; once it reaches MAXLOAD of capacity,
+ * Insert() returns 0 and callers fall back to process-local
+ * storage. The capacity of newly created files is set by the
+ * environment variable SCUFF_MAPPED_CACHE_SLOTS.
+ *
+ * Like the older cache-file formats, the format is not portable
+ * with respect to endianness.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_FLOCK)
+#  define USE_MAPPED_CACHE
+#endif
+
+namespace scuff {
+
+#define MC_SIGNATURE "SCUFF_MCACHE_01"
+#define DEFAULT_NUMSLOTS (1<<18)
+#define MAXLOAD 0.75
+
+typedef struct MCHeader
+ { char Signature[16];
+   uint64_t KeySize, DataSize, SlotSize, NumSlots, NumRecords;
+   uint64_t Reserved[3];
+ } MCHeader;
+
+static size_t Pad8(size_t N) { return (N+7) & ~((size_t)7); }
+
+/***************************************************************/
+/* 64-bit FNV-1a hash; unlike the hash used for in-memory      */
+/* tables, this one is stored in files, so it must not depend  */
+/* on the size of 'long'                                       */
+/***************************************************************/
+static uint64_t FNVHash(const void *Key, size_t KeySize)
+{
+  const unsigned char *p=(const unsigned char *)Key;
+  uint64_t h=14695981039346656037ULL;
+  for(size_t n=0; n<KeySize; n++)
+   { h ^= (uint64_t)p[n];
+     h *= 1099511628211ULL;
+   };
+  return h | 1;
+}
+
+/***************************************************************/
+/* return true if FileName exists and begins with the mapped-  */
+/* cache signature                                             */
+/***************************************************************/
+bool MappedCache::IsMappedCacheFile(const char *FileName)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+  char Signature[sizeof(MC_SIGNATURE)];
+  bool Status = (    fread(Signature, sizeof(Signature), 1, f)==1
+                  && !strcmp(Signature, MC_SIGNATURE) );
+  fclose(f);
+  return Status;
+}
+
+/***************************************************************/
+/* open (creating if necessary) and map a cache file. on       */
+/* failure, the object is left in an invalid state             */
+/* (IsValid() returns false) and the caller should fall back   */
+/* to process-local storage.                                   */
+/***************************************************************/
+MappedCache::MappedCache(const char *pFileName, size_t pKeySize, size_t pDataSize)
+{
+  FileName=strdupEC(pFileName);
+  KeySize=pKeySize;
+  DataSize=pDataSize;
+  SlotSize=sizeof(uint64_t) + Pad8(KeySize) + Pad8(DataSize);
+  fd=-1;
+  Map=0;
+  MapSize=0;
+  Header=0;
+  Slots=0;
+  ReadOnly=false;
+  WarnedFull=false;
+
+#ifndef USE_MAPPED_CACHE
+  Log("memory-mapped cache files not supported on this system (ignoring %s)",FileName);
+#else
+  /*--------------------------------------------------------------*/
+  /*- open the file, falling back to read-only access if we can't */
+  /*- write to it                                                 */
+  /*--------------------------------------------------------------*/
+  fd=open(FileName, O_RDWR | O_CREAT, 0666);
+  if (fd==-1)
+   { fd=open(FileName, O_RDONLY);
+     ReadOnly=true;
+   };
+  if (fd==-1)
+   { Log("could not open mapped cache file %s",FileName);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- if the file is empty we are the first process to use it, so */
+  /*- we size it and write the header; the exclusive lock keeps   */
+  /*- other processes from seeing a half-initialized file.        */
+  /*--------------------------------------------------------------*/
+  flock(fd, ReadOnly ? LOCK_SH : LOCK_EX);
+  const char *ErrMsg=0;
+  struct stat FileStats;
+  if ( fstat(fd, &FileStats) )
+   ErrMsg="could not stat file";
+  else if (FileStats.st_size==0 && !ReadOnly)
+   {
+     size_t NumSlots=DEFAULT_NUMSLOTS;
+     char *s=getenv("SCUFF_MAPPED_CACHE_SLOTS");
+     if (s) sscanf(s,"%zu",&NumSlots);
+     size_t PowerOfTwo=1024;
+     while(PowerOfTwo<NumSlots) PowerOfTwo*=2;
+     NumSlots=PowerOfTwo;
+
+     MCHeader NewHeader;
+     memset(&NewHeader, 0, sizeof(NewHeader));
+     strcpy(NewHeader.Signature, MC_SIGNATURE);
+     NewHeader.KeySize  = KeySize;
+     NewHeader.DataSize = DataSize;
+     NewHeader.SlotSize = SlotSize;
+     NewHeader.NumSlots = NumSlots;
+     // the slot table is created as a sparse file, so disk blocks
+     // are only allocated for slots that are actually written
+     if (    ftruncate(fd, sizeof(MCHeader) + NumSlots*SlotSize)
+          || pwrite(fd, &NewHeader, sizeof(NewHeader), 0)!=sizeof(NewHeader)
+        )
+      ErrMsg="could not initialize file";
+     else
+      { Log("Created mapped cache file %s (%zu slots of %zu bytes)",FileName,NumSlots,SlotSize);
+        FileStats.st_size = sizeof(MCHeader) + NumSlots*SlotSize;
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sanity-check the header of an existing file -----------------*/
+  /*--------------------------------------------------------------*/
+  MCHeader FileHeader;
+  if (ErrMsg==0)
+   { if ( pread(fd, &FileHeader, sizeof(FileHeader), 0)!=sizeof(FileHeader) )
+      ErrMsg="invalid cache file";
+     else if ( strcmp(FileHeader.Signature, MC_SIGNATURE) )
+      ErrMsg="invalid cache file";
+     else if (    FileHeader.KeySize!=KeySize
+               || FileHeader.DataSize!=DataSize
+               || FileHeader.SlotSize!=SlotSize
+             )
+      ErrMsg="cache file has incompatible record size";
+     else if (    FileHeader.NumSlots==0
+               || (FileHeader.NumSlots & (FileHeader.NumSlots-1))
+               || (off_t)(sizeof(MCHeader) + FileHeader.NumSlots*SlotSize)!=FileStats.st_size
+             )
+      ErrMsg="cache file has incorrect size";
+   };
+  flock(fd, LOCK_UN);
+
+  /*--------------------------------------------------------------*/
+  /*- map the file -----------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  if (ErrMsg==0)
+   { MapSize=FileStats.st_size;
+     Map=mmap(0, MapSize, ReadOnly ? PROT_READ : (PROT_READ|PROT_WRITE), MAP_SHARED, fd, 0);
+     if (Map==MAP_FAILED)
+      { Map=0;
+        ErrMsg="mmap failed";
+      };
+   };
+
+  if (ErrMsg)
+   { Log("mapped cache file %s: %s (ignoring)",FileName,ErrMsg);
+     close(fd);
+     fd=-1;
+     return;
+   };
+
+  Header = (MCHeader *)Map;
+  Slots  = ((char *)Map) + sizeof(MCHeader);
+  Log("Mapped cache file %s (%lu records%s)",FileName,
+       (unsigned long)Header->NumRecords, ReadOnly ? ", read-only" : "");
+#endif
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MappedCache::~MappedCache()
+{
+#ifdef USE_MAPPED_CACHE
+  if (Map) munmap(Map, MapSize);
+  if (fd!=-1) close(fd);
+#endif
+  free(FileName);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+size_t MappedCache::NumRecords()
+{ return Header ? (size_t)Header->NumRecords : 0; }
+
+/***************************************************************/
+/* return a pointer to the data stored for Key (within the     */
+/* mapped file), or 0 if there is no such record               */
+/***************************************************************/
+void *MappedCache::Lookup(const void *Key)
+{
+  if (!Header) return 0;
+
+  uint64_t Tag=FNVHash(Key, KeySize);
+  uint64_t Mask=Header->NumSlots - 1;
+  for(uint64_t n=0, ns=Tag&Mask; n<=Mask; n++, ns=(ns+1)&Mask)
+   { char *Slot=Slots + ns*SlotSize;
+     uint64_t SlotTag=__atomic_load_n( (uint64_t *)Slot, __ATOMIC_ACQUIRE);
+     if (SlotTag==0)
+      return 0;
+     if (SlotTag==Tag && !memcmp(Slot+sizeof(uint64_t), Key, KeySize))
+      return (void *)(Slot + sizeof(uint64_t) + Pad8(KeySize));
+   };
+  return 0;
+}
+
+/***************************************************************/
+/* add a record to the file and return a pointer to its data   */
+/* within the mapped file. if another thread or process added  */
+/* a record for the same key in the meantime, that record is   */
+/* returned instead. returns 0 if the file is read-only or     */
+/* full.                                                       */
+/***************************************************************/
+void *MappedCache::Insert(const void *Key, const void *Data)
+{
+  if (!Header || ReadOnly) return 0;
+
+  void *Result=0;
+#ifdef USE_MAPPED_CACHE
+  Lock.write_lock();
+  flock(fd, LOCK_EX);
+
+  if ( Header->NumRecords >= MAXLOAD*Header->NumSlots )
+   { if (!WarnedFull)
+      Warn("mapped cache file %s is full; new records will not be shared "
+           "(set SCUFF_MAPPED_CACHE_SLOTS to create a bigger file)",FileName);
+     WarnedFull=true;
+   }
+  else
+   { uint64_t Tag=FNVHash(Key, KeySize);
+     uint64_t Mask=Header->NumSlots - 1;
+     for(uint64_t n=0, ns=Tag&Mask; n<=Mask && !Result; n++, ns=(ns+1)&Mask)
+      { char *Slot=Slots + ns*SlotSize;
+        uint64_t SlotTag=*((uint64_t *)Slot);
+        char *SlotKey=Slot + sizeof(uint64_t);
+        char *SlotData=SlotKey + Pad8(KeySize);
+        if (SlotTag==Tag && !memcmp(SlotKey, Key, KeySize))
+         Result=(void *)SlotData;
+        else if (SlotTag==0)
+         { memcpy(SlotKey, Key, KeySize);
+           memcpy(SlotData, Data, DataSize);
+           __atomic_store_n( (uint64_t *)Slot, Tag, __ATOMIC_RELEASE);
+           Header->NumRecords++;
+           Result=(void *)SlotData;
+         };
+      };
+   };
+
+  flock(fd, LOCK_UN);
+  Lock.write_unlock();
+#else
+  (void) Key;
+  (void) Data;
+#endif
+  return Result;
+}
+
+} // namespace scuff
@@ -0,0 +1,1053 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MatrixFreeBEMOperator.cc -- action of the BEM matrix on a vector,
+ *                          -- computed without storing the matrix by
+ *                          -- the precorrected-FFT method: far-field
+ *                          -- interactions are convolutions on a
+ *                          -- uniform grid, and near-field interactions
+ *                          -- are corrected by a sparse matrix
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include <libhmat.h>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+namespace scuff {
+
+#define II cdouble(0,1)
+
+#define MAXSTENCIL 6
+
+/***************************************************************/
+/* data for the FFT convolutions in a single region. the grid  */
+/* points are X0 + h*(i,j,k) for 0<=i<NG[0] etc; grid arrays   */
+/* have dimensions L[0] x L[1] x L[2] (L >= 2*NG-1, so that    */
+/* cyclic convolutions of data supported in the NG box are     */
+/* free of aliasing) and are indexed as i + L[0]*(j + L[1]*k). */
+/***************************************************************/
+struct MFRegionGrid
+ {
+   cdouble k;
+   double X0[3], h;
+   int NG[3], L[3];
+   size_t LTot;
+
+   // the panels on the surfaces bounding the region; PanelSlot[np]
+   // is the index of global panel #np in PanelList, or -1
+   int NPR;
+   int *PanelList, *PanelSlot;
+   double *PanelSigns;
+   bool HaveNonPEC;
+
+   // the interpolation stencil of panel PanelList[m] consists of
+   // the P points Stencil0[3*m+d] + j, 0<=j<P, in dimension d, with
+   // Lagrange weights Weights[(3*m+d)*P + j]
+   int *Stencil0;
+   double *Weights;
+
+   // FFTs of the grid kernels Phi, Psi*Rx, Psi*Ry, Psi*Rz
+   cdouble *KernelFFTs[4];
+
+   // Phi and Psi at grid offsets D with |D|^2 = n, 0<n<=NMax,
+   // for computing the grid approximation of near interactions
+   int NMax;
+   cdouble *PhiTable, *PsiTable;
+ };
+
+/***************************************************************/
+/* +1 (-1) if region #nr lies on the exterior (interior) side  */
+/* of surface S, 0 if S does not bound region #nr. this agrees */
+/* with the signs assigned by CountCommonRegions().            */
+/***************************************************************/
+static double RegionSign(RWGSurface *S, int nr)
+{
+  if (S->RegionIndices[0]==nr) return +1.0;
+  if (S->RegionIndices[1]==nr) return -1.0;
+  return 0.0;
+}
+
+/***************************************************************/
+/* helmholtz kernel Phi and the radial factor Psi of its       */
+/* gradient (grad Phi = R*Psi); both vanish for r=0.           */
+/***************************************************************/
+static void GetPhiPsi(double r, cdouble ik, cdouble *Phi, cdouble *Psi)
+{
+  if (r==0.0)
+   { *Phi=*Psi=0.0;
+     return;
+   };
+  *Phi = exp(ik*r) / (4.0*M_PI*r);
+  *Psi = (*Phi) * (ik - 1.0/r) / r;
+}
+
+/***************************************************************/
+/* the one-point (centroid) approximation of the integral of   */
+/* the RWG function on edge E over its PPanel (iPM=0) or its   */
+/* MPanel (iPM=1) is Sign*L*F/2 with F = centroid - Q.         */
+/***************************************************************/
+static int GetPanelData(RWGSurface *S, RWGEdge *E, int iPM, double F[3], double *Sign)
+{
+  int np    = (iPM==0) ? E->iPPanel : E->iMPanel;
+  double *Q = S->Vertices + 3*( (iPM==0) ? E->iQP : E->iQM );
+  VecSub(S->Panels[np]->Centroid, Q, F);
+  *Sign = (iPM==0) ? 1.0 : -1.0;
+  return np;
+}
+
+/***************************************************************/
+/* the grid approximation to the interaction of the point      */
+/* sources at the centroids of panels PanelList[ma] (target)   */
+/* and PanelList[mb] (source): Phi and K = Psi*R are summed    */
+/* over all pairs of stencil points. the weights depend only   */
+/* on the offset between stencil points, so the sum runs over  */
+/* the (2P-1)^3 distinct offsets.                              */
+/***************************************************************/
+static void GetGridKernel(MFRegionGrid *RG, int P, int ma, int mb,
+                          cdouble *Phi, cdouble K[3])
+{
+  double C[3][2*MAXSTENCIL-1];
+  int D0[3];
+  for(int d=0; d<3; d++)
+   { D0[d] = RG->Stencil0[3*ma+d] - RG->Stencil0[3*mb+d];
+     double *Wa = RG->Weights + (3*ma+d)*P;
+     double *Wb = RG->Weights + (3*mb+d)*P;
+     for(int Delta=-(P-1); Delta<=(P-1); Delta++)
+      { double Sum=0.0;
+        for(int j=0; j<P; j++)
+         if ( (j-Delta)>=0 && (j-Delta)<P )
+          Sum += Wa[j]*Wb[j-Delta];
+        C[d][Delta+P-1]=Sum;
+      };
+   };
+
+  *Phi=K[0]=K[1]=K[2]=0.0;
+  for(int dx=0; dx<2*P-1; dx++)
+   for(int dy=0; dy<2*P-1; dy++)
+    for(int dz=0; dz<2*P-1; dz++)
+     { int D[3];
+       D[0] = D0[0] + dx-(P-1);
+       D[1] = D0[1] + dy-(P-1);
+       D[2] = D0[2] + dz-(P-1);
+       int n = D[0]*D[0] + D[1]*D[1] + D[2]*D[2];
+       if (n==0) continue;
+       if (n>RG->NMax)
+        ErrExit("%s:%i: internal error (%i>%i)",__FILE__,__LINE__,n,RG->NMax);
+       double W = C[0][dx]*C[1][dy]*C[2][dz];
+       *Phi += W*RG->PhiTable[n];
+       cdouble WPsi = W*RG->h*RG->PsiTable[n];
+       K[0] += WPsi*((double)D[0]);
+       K[1] += WPsi*((double)D[1]);
+       K[2] += WPsi*((double)D[2]);
+     };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MatrixFreeBEMOperator::MatrixFreeBEMOperator(RWGGeometry *pG, double pNearFactor,
+                                             int pSolver, double pTolerance)
+{
+  G=pG;
+
+  if (G->LDim!=0)
+   ErrExit("%s:%i: matrix-free BEM operators are not available for periodic geometries",__FILE__,__LINE__);
+  if (RWGGeometry::UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("%s:%i: matrix-free BEM operators are not available with multi-material junctions",__FILE__,__LINE__);
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Surfaces[ns]->SurfaceZeta)
+    ErrExit("%s:%i: matrix-free BEM operators are not available with surface impedances",__FILE__,__LINE__);
+
+  N=G->TotalBFs;
+  NearFactor=pNearFactor;
+  Solver=pSolver;
+  SolverTol=1.0e-6;
+  MaxIters=1000;
+  Restart=200;
+  Omega=0.0;
+
+  Tolerance=pTolerance;
+  GridSpacing=0.0;
+  StencilSize=3;
+  MaxRefinements=3;
+  FarFieldError=0.0;
+
+  int NE=G->TotalEdges;
+  EdgeSurfaces=(int *)mallocEC(NE*sizeof(int));
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+    EdgeSurfaces[G->EdgeIndexOffset[ns] + ne] = ns;
+
+  NearStart=NearEdges=0;
+  Correction=0;
+  Grids=(MFRegionGrid **)mallocEC(G->NumRegions*sizeof(MFRegionGrid *));
+  DiagBlocks=(cdouble *)mallocEC(4*NE*sizeof(cdouble));
+  Factorized=false;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MatrixFreeBEMOperator::~MatrixFreeBEMOperator()
+{
+  ClearGrids();
+  free(Grids);
+  if (NearStart) free(NearStart);
+  if (NearEdges) free(NearEdges);
+  if (Correction) delete Correction;
+  free(DiagBlocks);
+  free(EdgeSurfaces);
+}
+
+/***************************************************************/
+/* build the list of near-neighbor edges using a uniform grid  */
+/* of cells whose size is at least the largest near-neighbor   */
+/* distance, so that near neighbors lie in adjacent cells.     */
+/***************************************************************/
+static int CompareInts(const void *p1, const void *p2)
+{ return *((const int *)p1) - *((const int *)p2); }
+
+void MatrixFreeBEMOperator::GetNearEdgePairs()
+{
+  int NE=G->TotalEdges;
+
+  RWGEdge **Edges=(RWGEdge **)mallocEC(NE*sizeof(RWGEdge *));
+  double XMin[3]={HUGE_VAL, HUGE_VAL, HUGE_VAL};
+  double XMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+  double MaxRadius=0.0;
+  for(int ns=0, n=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++, n++)
+    { RWGEdge *E = Edges[n] = G->Surfaces[ns]->Edges[ne];
+      MaxRadius=fmax(MaxRadius, E->Radius);
+      for(int i=0; i<3; i++)
+       { XMin[i]=fmin(XMin[i], E->Centroid[i]);
+         XMax[i]=fmax(XMax[i], E->Centroid[i]);
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- choose the cell size, enlarging it if necessary to keep the */
+  /*- number of cells proportional to the number of edges         */
+  /*--------------------------------------------------------------*/
+  double CellSize=2.0*NearFactor*MaxRadius;
+  int NC[3];
+  size_t NumCells;
+  while(1)
+   { NumCells=1;
+     for(int i=0; i<3; i++)
+      { NC[i] = 1 + (int)floor( (XMax[i]-XMin[i]) / CellSize );
+        NumCells*=NC[i];
+      };
+     if ( NumCells <= 8*((size_t)NE) + 64 )
+      break;
+     CellSize*=2.0;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort edges into cells (counting sort) ----------------------*/
+  /*--------------------------------------------------------------*/
+  int *EdgeCells = (int *)mallocEC(NE*sizeof(int));
+  int *CellStart = (int *)mallocEC((NumCells+1)*sizeof(int));
+  int *CellEdges = (int *)mallocEC(NE*sizeof(int));
+  memset(CellStart, 0, (NumCells+1)*sizeof(int));
+  for(int n=0; n<NE; n++)
+   { int Index[3];
+     for(int i=0; i<3; i++)
+      Index[i] = (int)floor( (Edges[n]->Centroid[i] - XMin[i]) / CellSize );
+     EdgeCells[n] = Index[0] + NC[0]*(Index[1] + NC[1]*Index[2]);
+     CellStart[EdgeCells[n]+1]++;
+   };
+  for(size_t nc=0; nc<NumCells; nc++)
+   CellStart[nc+1]+=CellStart[nc];
+  int *Fill=(int *)mallocEC(NumCells*sizeof(int));
+  memcpy(Fill, CellStart, NumCells*sizeof(int));
+  for(int n=0; n<NE; n++)
+   CellEdges[ Fill[EdgeCells[n]]++ ] = n;
+  free(Fill);
+
+  /*--------------------------------------------------------------*/
+  /*- find near neighbors in the 27 surrounding cells ------------*/
+  /*--------------------------------------------------------------*/
+  if (NearStart) free(NearStart);
+  if (NearEdges) free(NearEdges);
+  NearStart=(int *)mallocEC((NE+1)*sizeof(int));
+  int MaxNear=27*NE;
+  NearEdges=(int *)mallocEC(MaxNear*sizeof(int));
+  int NumNear=0;
+  for(int na=0; na<NE; na++)
+   {
+     NearStart[na]=NumNear;
+     int nc=EdgeCells[na];
+     int Index[3]={ nc%NC[0], (nc/NC[0])%NC[1], nc/(NC[0]*NC[1]) };
+     for(int dx=-1; dx<=1; dx++)
+      for(int dy=-1; dy<=1; dy++)
+       for(int dz=-1; dz<=1; dz++)
+        { int ix=Index[0]+dx, iy=Index[1]+dy, iz=Index[2]+dz;
+          if (ix<0 || ix>=NC[0] || iy<0 || iy>=NC[1] || iz<0 || iz>=NC[2])
+           continue;
+          int ncp = ix + NC[0]*(iy + NC[1]*iz);
+          for(int m=CellStart[ncp]; m<CellStart[ncp+1]; m++)
+           { int nb=CellEdges[m];
+             double Dist=VecDistance(Edges[na]->Centroid, Edges[nb]->Centroid);
+             if ( Dist >= NearFactor*(Edges[na]->Radius + Edges[nb]->Radius) )
+              continue;
+             if (NumNear==MaxNear)
+              { MaxNear*=2;
+                NearEdges=(int *)reallocEC(NearEdges, MaxNear*sizeof(int));
+              };
+             NearEdges[NumNear++]=nb;
+           };
+        };
+     qsort(NearEdges+NearStart[na], NumNear-NearStart[na], sizeof(int), CompareInts);
+   };
+  NearStart[NE]=NumNear;
+
+  free(CellEdges);
+  free(CellStart);
+  free(EdgeCells);
+  free(Edges);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void MatrixFreeBEMOperator::ClearGrids()
+{
+  for(int nr=0; nr<G->NumRegions; nr++)
+   { MFRegionGrid *RG=Grids[nr];
+     if (RG==0) continue;
+     free(RG->PanelList);
+     free(RG->PanelSlot);
+     free(RG->PanelSigns);
+     free(RG->Stencil0);
+     free(RG->Weights);
+     for(int i=0; i<4; i++)
+      free(RG->KernelFFTs[i]);
+     free(RG->PhiTable);
+     free(RG->PsiTable);
+     free(RG);
+     Grids[nr]=0;
+   };
+}
+
+/***************************************************************/
+/* set up the grids with spacing h in all regions: interpolation*/
+/* stencils of all panels, FFTs of the kernel grids, and tables */
+/* of kernel values for the precorrection.                      */
+/***************************************************************/
+void MatrixFreeBEMOperator::InitGrids(double h)
+{
+  ClearGrids();
+
+  int P=StencilSize;
+  if (P<2 || P>MAXSTENCIL)
+   ErrExit("%s:%i: StencilSize must lie between 2 and %i",__FILE__,__LINE__,MAXSTENCIL);
+
+  int NP=G->TotalPanels;
+  int NumThreads=GetNumThreads();
+
+  // panel centroids are within one edge radius of the edge
+  // centroid, so offsets between the centroids of panels of
+  // near edges are bounded by this
+  double MaxRadius=0.0;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+    MaxRadius=fmax(MaxRadius, G->Surfaces[ns]->Edges[ne]->Radius);
+  double MaxNearDistance = 2.0*(NearFactor+1.0)*MaxRadius;
+
+  double **Centroids=(double **)mallocEC(NP*sizeof(double *));
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   for(int np=0; np<G->Surfaces[ns]->NumPanels; np++)
+    Centroids[G->PanelIndexOffset[ns] + np] = G->Surfaces[ns]->Panels[np]->Centroid;
+
+  size_t TotalBytes=0;
+  for(int nr=0; nr<G->NumRegions; nr++)
+   {
+     cdouble Eps=G->EpsTF[nr], Mu=G->MuTF[nr];
+     if (Eps==0.0) continue;
+
+     int NPR=0;
+     bool HaveNonPEC=false;
+     for(int ns=0; ns<G->NumSurfaces; ns++)
+      if (RegionSign(G->Surfaces[ns], nr)!=0.0)
+       { NPR+=G->Surfaces[ns]->NumPanels;
+         if (!G->Surfaces[ns]->IsPEC) HaveNonPEC=true;
+       };
+     if (NPR==0) continue;
+
+     MFRegionGrid *RG=Grids[nr]=(MFRegionGrid *)mallocEC(sizeof(MFRegionGrid));
+     RG->k=csqrt2(Eps*Mu)*Omega;
+     RG->h=h;
+     RG->NPR=NPR;
+     RG->HaveNonPEC=HaveNonPEC;
+     RG->PanelList  = (int *)mallocEC(NPR*sizeof(int));
+     RG->PanelSigns = (double *)mallocEC(NPR*sizeof(double));
+     RG->PanelSlot  = (int *)mallocEC(NP*sizeof(int));
+     for(int np=0; np<NP; np++)
+      RG->PanelSlot[np]=-1;
+
+     double XMin[3]={HUGE_VAL, HUGE_VAL, HUGE_VAL};
+     double XMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+     for(int ns=0, m=0; ns<G->NumSurfaces; ns++)
+      { double Sign=RegionSign(G->Surfaces[ns], nr);
+        if (Sign==0.0) continue;
+        for(int np=0; np<G->Surfaces[ns]->NumPanels; np++, m++)
+         { int npGlobal = G->PanelIndexOffset[ns] + np;
+           RG->PanelList[m]  = npGlobal;
+           RG->PanelSigns[m] = Sign;
+           RG->PanelSlot[npGlobal] = m;
+           double *X=Centroids[npGlobal];
+           for(int d=0; d<3; d++)
+            { XMin[d]=fmin(XMin[d], X[d]);
+              XMax[d]=fmax(XMax[d], X[d]);
+            };
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- grid dimensions, with a margin of P+1 points on all sides   */
+     /*- so that all stencils lie inside the grid                    */
+     /*--------------------------------------------------------------*/
+     int Margin=P+1;
+     RG->LTot=1;
+     for(int d=0; d<3; d++)
+      { RG->X0[d] = XMin[d] - Margin*h;
+        RG->NG[d] = (int)ceil( (XMax[d]-XMin[d])/h ) + 2*Margin + 1;
+        RG->L[d]  = GetFFTLength(2*RG->NG[d]-1);
+        RG->LTot *= RG->L[d];
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- Lagrange interpolation stencils centered on the nearest     */
+     /*- grid point (odd P) or grid cell (even P)                    */
+     /*--------------------------------------------------------------*/
+     RG->Stencil0 = (int *)mallocEC(3*NPR*sizeof(int));
+     RG->Weights  = (double *)mallocEC(3*NPR*P*sizeof(double));
+     for(int m=0; m<NPR; m++)
+      { double *X=Centroids[RG->PanelList[m]];
+        for(int d=0; d<3; d++)
+         { double t = (X[d] - RG->X0[d])/h;
+           int i0 = (int)floor( t - 0.5*(P-1) + 0.5 );
+           RG->Stencil0[3*m+d]=i0;
+           double *W = RG->Weights + (3*m+d)*P;
+           for(int j=0; j<P; j++)
+            { W[j]=1.0;
+              for(int l=0; l<P; l++)
+               if (l!=j)
+                W[j] *= (t - (i0+l)) / ((double)(j-l));
+            };
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- kernel grids, with negative offsets wrapped around, and     */
+     /*- their FFTs                                                  */
+     /*--------------------------------------------------------------*/
+     cdouble ik=II*RG->k;
+     int *L=RG->L;
+     for(int i=0; i<4; i++)
+      RG->KernelFFTs[i]=(cdouble *)mallocEC(RG->LTot*sizeof(cdouble));
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+     for(int kz=0; kz<L[2]; kz++)
+      for(int ky=0; ky<L[1]; ky++)
+       for(int kx=0; kx<L[0]; kx++)
+        { int D[3];
+          D[0] = (kx<=L[0]/2) ? kx : kx-L[0];
+          D[1] = (ky<=L[1]/2) ? ky : ky-L[1];
+          D[2] = (kz<=L[2]/2) ? kz : kz-L[2];
+          double r = h*sqrt( (double)(D[0]*D[0] + D[1]*D[1] + D[2]*D[2]) );
+          cdouble Phi, Psi;
+          GetPhiPsi(r, ik, &Phi, &Psi);
+          size_t n = kx + L[0]*(ky + ((size_t)L[1])*kz);
+          RG->KernelFFTs[0][n] = Phi;
+          RG->KernelFFTs[1][n] = Psi*h*((double)D[0]);
+          RG->KernelFFTs[2][n] = Psi*h*((double)D[1]);
+          RG->KernelFFTs[3][n] = Psi*h*((double)D[2]);
+        };
+     for(int i=0; i<4; i++)
+      FFT3D(RG->KernelFFTs[i], L, -1);
+
+     /*--------------------------------------------------------------*/
+     /*- kernel values at all offsets arising in near interactions  -*/
+     /*--------------------------------------------------------------*/
+     int DMax = (int)ceil(MaxNearDistance/h) + P + 1;
+     RG->NMax = 3*DMax*DMax;
+     RG->PhiTable = (cdouble *)mallocEC((RG->NMax+1)*sizeof(cdouble));
+     RG->PsiTable = (cdouble *)mallocEC((RG->NMax+1)*sizeof(cdouble));
+     for(int n=0; n<=RG->NMax; n++)
+      GetPhiPsi(h*sqrt((double)n), ik, RG->PhiTable+n, RG->PsiTable+n);
+
+     TotalBytes += 4*RG->LTot*sizeof(cdouble);
+     Log(" region %i: %ix%ix%i grid points (FFT size %ix%ix%i)",
+           nr,RG->NG[0],RG->NG[1],RG->NG[2],L[0],L[1],L[2]);
+   };
+  Log(" grid spacing %e: %lu MB for kernel FFTs",h,(unsigned long)(TotalBytes>>20));
+
+  free(Centroids);
+}
+
+/***************************************************************/
+/* approximations to the matrix elements computed by           */
+/* GetBEMMatrixElements(), with the same output conventions,   */
+/* obtained by collapsing each panel to a point source at its  */
+/* centroid. if OnGrid is true, the interactions of the point  */
+/* sources are computed exactly as in the grid convolutions    */
+/* done by Apply(); otherwise they are computed directly.      */
+/***************************************************************/
+void MatrixFreeBEMOperator::GetApproximateMEs(int nsa, int nea, int nsb, int neb,
+                                              cdouble MEs[4], bool OnGrid)
+{
+  RWGSurface *Sa=G->Surfaces[nsa], *Sb=G->Surfaces[nsb];
+  RWGEdge *Ea=Sa->Edges[nea], *Eb=Sb->Edges[neb];
+  bool SaIsPEC = (Sa->IsPEC==1);
+  bool SbIsPEC = (Sb->IsPEC==1);
+  int NPMa = (Ea->iMPanel==-1) ? 1 : 2;
+  int NPMb = (Eb->iMPanel==-1) ? 1 : 2;
+
+  memset(MEs, 0, 4*sizeof(cdouble));
+  for(int nr=0; nr<G->NumRegions; nr++)
+   {
+     double Sign = RegionSign(Sa, nr) * RegionSign(Sb, nr);
+     cdouble Eps = G->EpsTF[nr], Mu=G->MuTF[nr];
+     if (Sign==0.0 || Eps==0.0) continue;
+
+     cdouble k  = csqrt2(Eps*Mu)*Omega;
+     cdouble ik = II*k;
+
+     cdouble HG=0.0, HC=0.0;
+     for(int iPMa=0; iPMa<NPMa; iPMa++)
+      for(int iPMb=0; iPMb<NPMb; iPMb++)
+       { double Fa[3], Fb[3], SignA, SignB, FaxFb[3];
+         int npa=GetPanelData(Sa, Ea, iPMa, Fa, &SignA);
+         int npb=GetPanelData(Sb, Eb, iPMb, Fb, &SignB);
+         cdouble Phi, K[3];
+         if (OnGrid)
+          { MFRegionGrid *RG=Grids[nr];
+            GetGridKernel(RG, StencilSize,
+                          RG->PanelSlot[G->PanelIndexOffset[nsa] + npa],
+                          RG->PanelSlot[G->PanelIndexOffset[nsb] + npb],
+                          &Phi, K);
+          }
+         else
+          { double R[3];
+            VecSub(Sa->Panels[npa]->Centroid, Sb->Panels[npb]->Centroid, R);
+            cdouble Psi;
+            GetPhiPsi(VecNorm(R), ik, &Phi, &Psi);
+            K[0]=Psi*R[0];
+            K[1]=Psi*R[1];
+            K[2]=Psi*R[2];
+          };
+         VecCross(Fa, Fb, FaxFb);
+         HG += 0.25*SignA*SignB*(VecDot(Fa,Fb) + 4.0/(ik*ik))*Phi;
+         HC += 0.25*SignA*SignB*(FaxFb[0]*K[0] + FaxFb[1]*K[1] + FaxFb[2]*K[2]);
+       };
+     cdouble GC0 = Ea->Length*Eb->Length*HG;
+     cdouble GC1 = Ea->Length*Eb->Length*HC/ik;
+
+     cdouble PreFac1 =  Sign*II*Mu*Omega;
+     cdouble PreFac2 = -Sign*II*k;
+     cdouble PreFac3 = -Sign*II*Eps*Omega;
+     if ( SaIsPEC || SbIsPEC )
+      { MEs[0] += PreFac1*GC0;
+        if ( !(SaIsPEC && SbIsPEC) )
+         MEs[1] += PreFac2*GC1;
+      }
+     else
+      { MEs[0] += PreFac1*GC0;
+        MEs[1] += PreFac2*GC1;
+        MEs[2] += PreFac2*GC1;
+        MEs[3] += PreFac3*GC0;
+      };
+   };
+}
+
+/***************************************************************/
+/* stamp the precorrection (exact minus grid-approximated      */
+/* matrix elements for all near pairs) into the sparse matrix; */
+/* Exact[4*m...] are the exact matrix elements for near pair #m*/
+/***************************************************************/
+void MatrixFreeBEMOperator::StampCorrection(cdouble *Exact)
+{
+  int NE=G->TotalEdges;
+  int NumNear=NearStart[NE];
+
+  cdouble *Entries=(cdouble *)mallocEC(4*((size_t)NumNear)*sizeof(cdouble));
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int na=0; na<NE; na++)
+   { int nsa = EdgeSurfaces[na], nea = na - G->EdgeIndexOffset[nsa];
+     for(int m=NearStart[na]; m<NearStart[na+1]; m++)
+      { int nb  = NearEdges[m];
+        int nsb = EdgeSurfaces[nb], neb = nb - G->EdgeIndexOffset[nsb];
+        cdouble Approx[4];
+        GetApproximateMEs(nsa, nea, nsb, neb, Approx, true);
+        for(int i=0; i<4; i++)
+         Entries[4*m+i] = Exact[4*m+i]-Approx[i];
+      };
+   };
+
+  if (Correction==0)
+   Correction=new SMatrix(N, N, LHM_COMPLEX);
+  Correction->BeginAssembly(4*NumNear);
+  for(int na=0; na<NE; na++)
+   { int nsa  = EdgeSurfaces[na];
+     int NBFa = G->Surfaces[nsa]->IsPEC ? 1 : 2;
+     int Row  = G->BFIndexOffset[nsa] + NBFa*(na - G->EdgeIndexOffset[nsa]);
+     for(int i=0; i<NBFa; i++)
+      for(int m=NearStart[na]; m<NearStart[na+1]; m++)
+       { int nb   = NearEdges[m];
+         int nsb  = EdgeSurfaces[nb];
+         int NBFb = G->Surfaces[nsb]->IsPEC ? 1 : 2;
+         int Col  = G->BFIndexOffset[nsb] + NBFb*(nb - G->EdgeIndexOffset[nsb]);
+         for(int j=0; j<NBFb; j++)
+          Correction->AddEntry(Row+i, Col+j, Entries[4*m + i*NBFb + j], false);
+       };
+   };
+  Correction->EndAssembly();
+
+  free(Entries);
+}
+
+/***************************************************************/
+/* estimate the relative error of the grid approximation by    */
+/* comparing M*X for a fixed pseudorandom vector X, on a sample*/
+/* of rows, against the same rows computed with exact near and */
+/* directly-summed point-source far interactions.              */
+/***************************************************************/
+double MatrixFreeBEMOperator::EstimateFarFieldError(cdouble *Exact)
+{
+  HVector *X=new HVector(N, LHM_COMPLEX);
+  HVector *Y=new HVector(N, LHM_COMPLEX);
+  unsigned int Seed=12345;
+  for(int n=0; n<N; n++)
+   { double Re, Im;
+     Seed = 1103515245*Seed + 12345;
+     Re = ((double)((Seed>>8)&0xFFFF))/32768.0 - 1.0;
+     Seed = 1103515245*Seed + 12345;
+     Im = ((double)((Seed>>8)&0xFFFF))/32768.0 - 1.0;
+     X->ZV[n]=cdouble(Re,Im);
+   };
+  Apply(X, Y);
+
+  int NE=G->TotalEdges;
+  int NumSamples = (NE<32) ? NE : 32;
+  double Num=0.0, Den=0.0;
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads), reduction(+:Num,Den)
+#endif
+  for(int nSample=0; nSample<NumSamples; nSample++)
+   { int na   = (int)( (((long)nSample)*NE) / NumSamples );
+     int nsa  = EdgeSurfaces[na], nea = na - G->EdgeIndexOffset[nsa];
+     int NBFa = G->Surfaces[nsa]->IsPEC ? 1 : 2;
+     int Row  = G->BFIndexOffset[nsa] + NBFa*nea;
+     cdouble Ref[2]={0.0, 0.0};
+     int m=NearStart[na];
+     for(int nb=0; nb<NE; nb++)
+      { int nsb  = EdgeSurfaces[nb], neb = nb - G->EdgeIndexOffset[nsb];
+        int NBFb = G->Surfaces[nsb]->IsPEC ? 1 : 2;
+        int Col  = G->BFIndexOffset[nsb] + NBFb*neb;
+        cdouble MEs[4];
+        if ( m<NearStart[na+1] && NearEdges[m]==nb )
+         memcpy(MEs, Exact + 4*(m++), 4*sizeof(cdouble));
+        else
+         GetApproximateMEs(nsa, nea, nsb, neb, MEs, false);
+        for(int i=0; i<NBFa; i++)
+         for(int j=0; j<NBFb; j++)
+          Ref[i] += MEs[i*NBFb + j]*X->ZV[Col+j];
+      };
+     for(int i=0; i<NBFa; i++)
+      { Num += norm(Y->ZV[Row+i] - Ref[i]);
+        Den += norm(Ref[i]);
+      };
+   };
+
+  delete X;
+  delete Y;
+  return (Den==0.0) ? 0.0 : sqrt(Num/Den);
+}
+
+/***************************************************************/
+/* compute the exact near-field matrix elements and the        */
+/* single-edge diagonal blocks at frequency Omega, then set up */
+/* the grids and the precorrection, refining the grid until    */
+/* the estimated far-field error is below Tolerance            */
+/***************************************************************/
+void MatrixFreeBEMOperator::Assemble(cdouble pOmega)
+{
+  Omega=pOmega;
+  G->UpdateCachedEpsMuValues(Omega);
+  Factorized=false;
+
+  // the near-neighbor lists are rebuilt on every call because
+  // surfaces may have been displaced since the last call
+  GetNearEdgePairs();
+  int NE=G->TotalEdges;
+  int NumNear=NearStart[NE];
+  Log("Assembling matrix-free BEM operator at Omega=%s (%i near edge pairs)",z2s(Omega),NumNear);
+
+  /*--------------------------------------------------------------*/
+  /*- exact matrix elements for all near pairs --------------------*/
+  /*--------------------------------------------------------------*/
+  cdouble *Exact=(cdouble *)mallocEC(4*((size_t)NumNear)*sizeof(cdouble));
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int na=0; na<NE; na++)
+   { int nsa = EdgeSurfaces[na], nea = na - G->EdgeIndexOffset[nsa];
+     for(int m=NearStart[na]; m<NearStart[na+1]; m++)
+      { int nb  = NearEdges[m];
+        int nsb = EdgeSurfaces[nb], neb = nb - G->EdgeIndexOffset[nsb];
+        GetBEMMatrixElements(G, nsa, nea, nsb, neb, Omega, Exact + 4*m);
+        if (nb==na)
+         memcpy(DiagBlocks + 4*na, Exact + 4*m, 4*sizeof(cdouble));
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- the default grid spacing is the average edge length ---------*/
+  /*--------------------------------------------------------------*/
+  double h=GridSpacing;
+  if (h<=0.0)
+   { for(int ns=0; ns<G->NumSurfaces; ns++)
+      for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+       h+=G->Surfaces[ns]->Edges[ne]->Length;
+     h/=((double)NE);
+   };
+
+  for(int nRefine=0; ; nRefine++)
+   { InitGrids(h);
+     StampCorrection(Exact);
+     if (Tolerance<=0.0)
+      break;
+     FarFieldError=EstimateFarFieldError(Exact);
+     Log(" estimated relative far-field error %.2e (tolerance %.2e)",FarFieldError,Tolerance);
+     if (FarFieldError<=Tolerance)
+      break;
+     if (nRefine==MaxRefinements)
+      { Warn("matrix-free far-field error %.1e exceeds tolerance %.1e at grid spacing %e",FarFieldError,Tolerance,h);
+        break;
+      };
+     h/=1.5;
+   };
+
+  free(Exact);
+}
+
+/***************************************************************/
+/* Y = M*X                                                     */
+/***************************************************************/
+void MatrixFreeBEMOperator::Apply(HVector *X, HVector *Y)
+{
+  if ( X->N!=N || Y->N!=N )
+   ErrExit("%s:%i: dimension mismatch in MatrixFreeBEMOperator::Apply",__FILE__,__LINE__);
+  if (Correction==0)
+   ErrExit("%s:%i: Apply() called before Assemble()",__FILE__,__LINE__);
+
+  // near-field precorrection
+  Correction->Apply(X, Y);
+
+  /*--------------------------------------------------------------*/
+  /*- aggregate the electric (K) and magnetic (N) currents and    */
+  /*- charges of all RWG functions on each panel into panel       */
+  /*- sources. for each panel, Sources[8*np + 0..2, 3] are the    */
+  /*- current and charge due to K, [4..6, 7] those due to N.      */
+  /*--------------------------------------------------------------*/
+  int NP=G->TotalPanels;
+  cdouble *Sources = (cdouble *)mallocEC(8*NP*sizeof(cdouble));
+  cdouble *Fields  = (cdouble *)mallocEC(14*NP*sizeof(cdouble));
+  memset(Sources, 0, 8*NP*sizeof(cdouble));
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     int NBF=S->IsPEC ? 1 : 2;
+     for(int ne=0; ne<S->NumEdges; ne++)
+      { RWGEdge *E=S->Edges[ne];
+        int nbf=G->BFIndexOffset[ns] + NBF*ne;
+        cdouble KN[2];
+        KN[0] = X->ZV[nbf];
+        KN[1] = (NBF==2) ? X->ZV[nbf+1] : 0.0;
+        for(int iPM=0; iPM<( (E->iMPanel==-1) ? 1 : 2 ); iPM++)
+         { double F[3], Sign;
+           int np = G->PanelIndexOffset[ns] + GetPanelData(S, E, iPM, F, &Sign);
+           for(int nkn=0; nkn<2; nkn++)
+            { cdouble Q = Sign*E->Length*KN[nkn];
+              cdouble *Source = Sources + 8*np + 4*nkn;
+              Source[0] += Q*F[0];
+              Source[1] += Q*F[1];
+              Source[2] += Q*F[2];
+              Source[3] += Q;
+            };
+         };
+      };
+   };
+
+  size_t MaxLTot=0;
+  for(int nr=0; nr<G->NumRegions; nr++)
+   if (Grids[nr] && Grids[nr]->LTot>MaxLTot)
+    MaxLTot=Grids[nr]->LTot;
+  cdouble *SourceGrids = (cdouble *)mallocEC(4*MaxLTot*sizeof(cdouble));
+  cdouble *Work        = (cdouble *)mallocEC(MaxLTot*sizeof(cdouble));
+
+  /*--------------------------------------------------------------*/
+  /*- far-field interactions, region by region -------------------*/
+  /*--------------------------------------------------------------*/
+  int P=StencilSize;
+  int NumThreads=GetNumThreads();
+  for(int nr=0; nr<G->NumRegions; nr++)
+   {
+     MFRegionGrid *RG=Grids[nr];
+     if (RG==0) continue;
+     cdouble Eps=G->EpsTF[nr], Mu=G->MuTF[nr];
+     cdouble k  = RG->k;
+     cdouble ik = II*k;
+     int *L=RG->L;
+     size_t LTot=RG->LTot;
+
+     /*--------------------------------------------------------------*/
+     /*- for each panel, Fields[14*np + ...] holds the vector        */
+     /*- potential A, scalar potential S, and B = sum Psi J x R, for */
+     /*- K sources (0..6) and N sources (7..13). if all surfaces    */
+     /*- bounding the region are PEC, there are no N sources and    */
+     /*- only A and S due to K sources are needed.                   */
+     /*--------------------------------------------------------------*/
+     memset(Fields, 0, 14*NP*sizeof(cdouble));
+     int NumKN      = RG->HaveNonPEC ? 2 : 1;
+     int NumOutputs = RG->HaveNonPEC ? 7 : 4;
+     for(int nkn=0; nkn<NumKN; nkn++)
+      {
+        // project panel sources onto the grid and transform
+        memset(SourceGrids, 0, 4*LTot*sizeof(cdouble));
+        for(int m=0; m<RG->NPR; m++)
+         { cdouble *Source=Sources + 8*RG->PanelList[m] + 4*nkn;
+           int *S0=RG->Stencil0 + 3*m;
+           double *W=RG->Weights + 3*m*P;
+           for(int jz=0; jz<P; jz++)
+            for(int jy=0; jy<P; jy++)
+             for(int jx=0; jx<P; jx++)
+              { double w = RG->PanelSigns[m]*W[jx]*W[P+jy]*W[2*P+jz];
+                size_t n = (S0[0]+jx) + L[0]*((S0[1]+jy) + ((size_t)L[1])*(S0[2]+jz));
+                for(int c=0; c<4; c++)
+                 SourceGrids[c*LTot + n] += w*Source[c];
+              };
+         };
+        for(int c=0; c<4; c++)
+         FFT3D(SourceGrids + c*LTot, L, -1, RG->NG, 0);
+
+        // convolve with the kernels and interpolate back to panels
+        cdouble **K=RG->KernelFFTs;
+        cdouble *SG[4];
+        for(int c=0; c<4; c++)
+         SG[c]=SourceGrids + c*LTot;
+        for(int o=0; o<NumOutputs; o++)
+         {
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+           for(size_t n=0; n<LTot; n++)
+            { if (o<4)
+               Work[n] = K[0][n]*SG[o][n];
+              else
+               { int i=o-4, ip1=(i+1)%3, ip2=(i+2)%3;
+                 Work[n] = K[1+ip2][n]*SG[ip1][n] - K[1+ip1][n]*SG[ip2][n];
+               };
+            };
+           FFT3D(Work, L, +1, 0, RG->NG);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+           for(int m=0; m<RG->NPR; m++)
+            { int *S0=RG->Stencil0 + 3*m;
+              double *W=RG->Weights + 3*m*P;
+              cdouble Sum=0.0;
+              for(int jz=0; jz<P; jz++)
+               for(int jy=0; jy<P; jy++)
+                for(int jx=0; jx<P; jx++)
+                 { size_t n = (S0[0]+jx) + L[0]*((S0[1]+jy) + ((size_t)L[1])*(S0[2]+jz));
+                   Sum += W[jx]*W[P+jy]*W[2*P+jz]*Work[n];
+                 };
+              Fields[14*RG->PanelList[m] + 7*nkn + o] = Sum / ((double)LTot);
+            };
+         };
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- project the panel fields onto the testing functions --------*/
+     /*--------------------------------------------------------------*/
+     for(int ns=0; ns<G->NumSurfaces; ns++)
+      { RWGSurface *S=G->Surfaces[ns];
+        double Sign=RegionSign(S, nr);
+        if (Sign==0.0) continue;
+        int NBF=S->IsPEC ? 1 : 2;
+        cdouble PreFac1 =  Sign*II*Mu*Omega;
+        cdouble PreFac2 = -Sign*II*k;
+        cdouble PreFac3 = -Sign*II*Eps*Omega;
+        for(int ne=0; ne<S->NumEdges; ne++)
+         { RWGEdge *E=S->Edges[ne];
+           cdouble GC0[2]={0.0,0.0}, GC1[2]={0.0,0.0};
+           for(int iPM=0; iPM<( (E->iMPanel==-1) ? 1 : 2 ); iPM++)
+            { double F[3], PMSign;
+              int np = G->PanelIndexOffset[ns] + GetPanelData(S, E, iPM, F, &PMSign);
+              for(int nkn=0; nkn<2; nkn++)
+               { cdouble *Field=Fields + 14*np + 7*nkn;
+                 GC0[nkn] += PMSign*(F[0]*Field[0] + F[1]*Field[1] + F[2]*Field[2] + 4.0*Field[3]/(ik*ik));
+                 GC1[nkn] += PMSign*(F[0]*Field[4] + F[1]*Field[5] + F[2]*Field[6]);
+               };
+            };
+           for(int nkn=0; nkn<2; nkn++)
+            { GC0[nkn] *= 0.25*E->Length;
+              GC1[nkn] *= 0.25*E->Length/ik;
+            };
+
+           int nbf=G->BFIndexOffset[ns] + NBF*ne;
+           Y->ZV[nbf] += PreFac1*GC0[0] + PreFac2*GC1[1];
+           if (NBF==2)
+            Y->ZV[nbf+1] += PreFac2*GC1[0] + PreFac3*GC0[1];
+         };
+      };
+   };
+
+  free(Work);
+  free(SourceGrids);
+  free(Fields);
+  free(Sources);
+}
+
+/***************************************************************/
+/* invert the single-edge diagonal blocks (1x1 for PEC edges,  */
+/* 2x2 otherwise)                                              */
+/***************************************************************/
+int MatrixFreeBEMOperator::FactorizePreconditioner()
+{
+  int Info=0;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { bool IsPEC = G->Surfaces[ns]->IsPEC;
+     for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+      { cdouble *D=DiagBlocks + 4*(G->EdgeIndexOffset[ns] + ne);
+        if (IsPEC)
+         { if (D[0]==0.0) { Info=1; continue; };
+           D[0] = 1.0/D[0];
+         }
+        else
+         { cdouble Det = D[0]*D[3] - D[1]*D[2];
+           if (Det==0.0) { Info=1; continue; };
+           cdouble D0=D[0];
+           D[0] =  D[3]/Det;
+           D[1] = -D[1]/Det;
+           D[2] = -D[2]/Det;
+           D[3] =  D0/Det;
+         };
+      };
+   };
+  Factorized=true;
+  return Info;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void MatrixFreeBEMOperator::ApplyPreconditioner(HVector *X, HVector *Y)
+{
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { bool IsPEC = G->Surfaces[ns]->IsPEC;
+     for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+      { cdouble *D=DiagBlocks + 4*(G->EdgeIndexOffset[ns] + ne);
+        if (IsPEC)
+         { int nbf=G->BFIndexOffset[ns] + ne;
+           Y->ZV[nbf] = D[0]*X->ZV[nbf];
+         }
+        else
+         { int nbf=G->BFIndexOffset[ns] + 2*ne;
+           cdouble X0=X->ZV[nbf], X1=X->ZV[nbf+1];
+           Y->ZV[nbf]   = D[0]*X0 + D[1]*X1;
+           Y->ZV[nbf+1] = D[2]*X0 + D[3]*X1;
+         };
+      };
+   };
+}
+
+/***************************************************************/
+/* C-style wrappers for passing to the krylov solvers          */
+/***************************************************************/
+static void MFApply(HVector *X, HVector *Y, void *UserData)
+{ ((MatrixFreeBEMOperator *)UserData)->Apply(X, Y); }
+
+static void MFPreconditioner(HVector *X, HVector *Y, void *UserData)
+{ ((MatrixFreeBEMOperator *)UserData)->ApplyPreconditioner(X, Y); }
+
+/***************************************************************/
+/* on entry X is the RHS vector; on return it is the solution. */
+/* the return value is nonzero if the iteration did not        */
+/* converge.                                                   */
+/***************************************************************/
+int MatrixFreeBEMOperator::Solve(HVector *X)
+{
+  if (!Factorized)
+   FactorizePreconditioner();
+
+  HVector *B = new HVector(X);
+  X->Zero();
+
+  double Residual;
+  int Iters;
+  const char *SolverName;
+  if (Solver==SCUFF_SOLVER_BICGSTAB)
+   { SolverName="BiCGStab";
+     Iters=BiCGStab(MFApply, (void *)this, B, X,
+                    MFPreconditioner, (void *)this,
+                    SolverTol, MaxIters, &Residual);
+   }
+  else
+   { SolverName="GMRES";
+     Iters=GMRES(MFApply, (void *)this, B, X,
+                 MFPreconditioner, (void *)this,
+                 SolverTol, MaxIters, Restart, &Residual);
+   };
+  delete B;
+
+  if (Iters<0)
+   { Warn("%s did not converge in %i iterations (residual %e)",SolverName,MaxIters,Residual);
+     return 1;
+   };
+  Log(" %s converged in %i iterations (residual %e)",SolverName,Iters,Residual);
+  return 0;
+}
+
+} // namespace scuff
@@ -253,6 +253,55 @@ int GetOverlappingEdgeIndices(RWGSurface *S, int nea, int nebArray[5])
   return Count;
 }
 
+/***************************************************************/
+/* The overlap integrals depend only on the mesh, not on the   */
+/* frequency, and are nonzero only for pairs of edges that     */
+/* share a panel. The first time they are needed we compute    */
+/* them for all such pairs and store them as NUMOVERLAPS sparse*/
+/* NumEdges x NumEdges matrices, all with the same sparsity    */
+/* pattern (so the index of the (nea,neb) entry in the CSR     */
+/* arrays is the same in all of them). The matrices are        */
+/* discarded by Transform() and UnTransform().                 */
+/***************************************************************/
+SMatrix **RWGSurface::GetOverlapMatrices()
+{
+  if (OverlapMatrices)
+   return OverlapMatrices;
+
+  OverlapMatrices = (SMatrix **)mallocEC(NUMOVERLAPS*sizeof(SMatrix *));
+  for(int no=0; no<NUMOVERLAPS; no++)
+   { OverlapMatrices[no] = new SMatrix(NumEdges, NumEdges, LHM_REAL);
+     OverlapMatrices[no]->BeginAssembly(5*NumEdges);
+   };
+
+  for(int nea=0; nea<NumEdges; nea++)
+   { int nebArray[5];
+     int nebCount = GetOverlappingEdgeIndices(this, nea, nebArray);
+     for(int nneb=0; nneb<nebCount; nneb++)
+      { int neb=nebArray[nneb];
+        double Overlaps[NUMOVERLAPS];
+        GetOverlaps(nea, neb, Overlaps);
+        for(int no=0; no<NUMOVERLAPS; no++)
+         OverlapMatrices[no]->AddEntry(nea, neb, Overlaps[no], false);
+      };
+   };
+
+  for(int no=0; no<NUMOVERLAPS; no++)
+   OverlapMatrices[no]->EndAssembly();
+
+  return OverlapMatrices;
+}
+
+void RWGSurface::ClearOverlapMatrices()
+{
+  if (OverlapMatrices==0)
+   return;
+  for(int no=0; no<NUMOVERLAPS; no++)
+   delete OverlapMatrices[no];
+  free(OverlapMatrices);
+  OverlapMatrices=0;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -309,22 +358,23 @@ void GetOPFT(RWGGeometry *G, int SurfaceIndex, cdouble Omega,
   /***************************************************************/
   /* loop over all interior edges #nea                           */
   /***************************************************************/
+  SMatrix **OverlapMatrices = S->GetOverlapMatrices();
+  int *RowStart   = OverlapMatrices[0]->RowStart;
+  int *ColIndices = OverlapMatrices[0]->ColIndices;
   double PAbs=0.0, Fx=0.0, Fy=0.0, Fz=0.0, Taux=0.0, Tauy=0.0, Tauz=0.0;
   for(int nea=0; nea<NE; nea++)
    { 
      /*--------------------------------------------------------------*/
-     /* populate an array whose indices are the 3 or 5 edges         */
-     /* that have nonzero overlaps with edge #nea, then loop over    */
-     /* those edges                                                  */
+     /* loop over the 3 or 5 edges that have nonzero overlaps with   */
+     /* edge #nea, i.e. the nonzero entries in row #nea of the       */
+     /* overlap matrices                                             */
      /*--------------------------------------------------------------*/
-     int nebArray[5];
-     int nebCount= GetOverlappingEdgeIndices(S, nea, nebArray);
-     for(int nneb=0; nneb<nebCount; nneb++)
+     for(int nnz=RowStart[nea]; nnz<RowStart[nea+1]; nnz++)
       { 
-        int neb=nebArray[nneb];
-        if (neb<0) continue;
-        double Overlaps[20];
-        S->GetOverlaps(nea, neb, Overlaps);
+        int neb=ColIndices[nnz];
+        double Overlaps[NUMOVERLAPS];
+        for(int no=0; no<NUMOVERLAPS; no++)
+         Overlaps[no]=OverlapMatrices[no]->DM[nnz];
 
         /*--------------------------------------------------------------*/
         /*--------------------------------------------------------------*/
@@ -424,7 +474,7 @@ void GetOPFT(RWGGeometry *G, int SurfaceIndex, cdouble Omega,
           if (ByEdge[PFT_ZTORQUE]) ByEdge[PFT_ZTORQUE][nea] += dTau[2];
         };
 
-      } // for (int nneb=... 
+      } // for(int nnz=RowStart[nea]... 
 
    }; // for(int nea=0; nea<S->NE; nea++)
 
@@ -548,20 +598,21 @@ void GetOPFTMatrices(RWGGeometry *G,
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
+  SMatrix **OverlapMatrices = S->GetOverlapMatrices();
+  int *RowStart   = OverlapMatrices[0]->RowStart;
+  int *ColIndices = OverlapMatrices[0]->ColIndices;
   for(int nea=0; nea<NE; nea++)
    { 
      /*--------------------------------------------------------------*/
-     /* populate an array whose indices are the 3 or 5 edges         */
-     /* that have nonzero overlaps with edge #nea, then loop over    */
-     /* those edges                                                  */
+     /* loop over the 3 or 5 edges that have nonzero overlaps with   */
+     /* edge #nea                                                    */
      /*--------------------------------------------------------------*/
-     int nebArray[5];
-     int nebCount= GetOverlappingEdgeIndices(S, nea, nebArray);
-     for(int nneb=0; nneb<nebCount; nneb++)
+     for(int nnz=RowStart[nea]; nnz<RowStart[nea+1]; nnz++)
       { 
-        int neb=nebArray[nneb];
-        double Overlaps[20];
-        S->GetOverlaps(nea, neb, Overlaps);
+        int neb=ColIndices[nnz];
+        double Overlaps[NUMOVERLAPS];
+        for(int no=0; no<NUMOVERLAPS; no++)
+         Overlaps[no]=OverlapMatrices[no]->DM[nnz];
 
        // absorbed power
        if (QPAbs)
@@ -602,7 +653,7 @@ void GetOPFTMatrices(RWGGeometry *G,
            };
         };
 
-      } // for (int nneb=... 
+      } // for(int nnz=RowStart[nea]... 
 
    }; // for(int nea=0; nea<S->NE; nea++)
 
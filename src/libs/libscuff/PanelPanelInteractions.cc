@@ -65,6 +65,12 @@ namespace scuff {
 /**********************************************************************/
 #define DESINGULARIZATION_RADIUS 4.0
 
+/**********************************************************************/
+/* number of cubature-point pairs for which full Ewald summations     */
+/* are batched using stack storage in GetPPIs_Cubature                */
+/**********************************************************************/
+#define EWALDBUFSIZE 64
+
 #define AA0 1.0
 #define AA1 1.0
 #define AA2 (1.0/2.0)
@@ -108,7 +114,7 @@ cdouble ExpRel(cdouble x, int n)
 void AssembleInnerPPIIntegrand(double wp, double *R, double *X,
                                double *F, double *FP, cdouble k,
                                GBarAccelerator *GBA, bool ForceFullEwald,
-                               int DeSingularize,
+                               cdouble *GBarVD, int DeSingularize,
                                int NumTorqueAxes, double *GammaMatrix,
                                cdouble *HInner, cdouble *GradHInner, cdouble *dHdTInner)
 { 
@@ -124,7 +130,14 @@ void AssembleInnerPPIIntegrand(double wp, double *R, double *X,
   if (GBA)
    { 
      cdouble G, dG[3], ddG[9];
-     G=GetGBar(R, GBA, dG, (GradHInner ? ddG : 0 ), ForceFullEwald );
+     if (GBarVD) // precomputed by the caller
+      { G=GBarVD[0];
+        dG[0]=GBarVD[1];
+        dG[1]=GBarVD[2];
+        dG[2]=GBarVD[3];
+      }
+     else
+      G=GetGBar(R, GBA, dG, (GradHInner ? ddG : 0 ), ForceFullEwald );
 
      HInner[0] += wp * hPlus*G;
      HInner[1] += wp * (FxFP[0]*dG[0] + FxFP[1]*dG[1] + FxFP[2]*dG[2]);
@@ -276,6 +289,39 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
   else
    TCR=GetTCR(4, &NumPts);
 
+  /***************************************************************/
+  /* if GBar is to be computed by full Ewald summation, do it    */
+  /* for all pairs of cubature points at once; this is only done */
+  /* when second derivatives of GBar are not needed.             */
+  /***************************************************************/
+  GBarAccelerator *GBA=Args->GBA;
+  cdouble *GBarVD=0, GBarVDBuffer[8*EWALDBUFSIZE];
+  if ( GBA && (Args->ForceFullEwald || GBA->ForceFullEwald) && GradH==0 )
+   { 
+     int NumPairs=NumPts*NumPts;
+     double RBuffer[3*EWALDBUFSIZE], *R;
+     if (NumPairs<=EWALDBUFSIZE)
+      { R=RBuffer;
+        GBarVD=GBarVDBuffer;
+      }
+     else
+      { R=(double *)mallocEC(3*NumPairs*sizeof(double));
+        GBarVD=(cdouble *)mallocEC(8*NumPairs*sizeof(cdouble));
+      };
+
+     for(int np=0, ncp=0, nPair=0; np<NumPts; np++, ncp+=3)
+      for(int npp=0, ncpp=0; npp<NumPts; npp++, ncpp+=3, nPair++)
+       for(int Mu=0; Mu<3; Mu++)
+        { double X  = V0[Mu]  + TCR[ncp]*A[Mu]   + TCR[ncp+1]*B[Mu];
+          double XP = V0P[Mu] + TCR[ncpp]*AP[Mu] + TCR[ncpp+1]*BP[Mu];
+          R[3*nPair + Mu] = X - XP;
+        };
+
+     GBarVDEwald_v(NumPairs, R, GBA->k, GBA->kBloch, GBA->LBV, GBA->LDim,
+                   -1.0, GBA->ExcludeInnerCells, GBarVD);
+     if (R!=RBuffer) free(R);
+   };
+
   /***************************************************************/
   /* outer loop **************************************************/
   /***************************************************************/
@@ -321,6 +367,7 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
          };
 
         AssembleInnerPPIIntegrand(wp, R, X, F, FP, k, Args->GBA, Args->ForceFullEwald,
+                                  GBarVD ? GBarVD + 8*(np*NumPts + npp) : 0,
                                   DeSingularize, NumTorqueAxes, GammaMatrix,
                                   HInner, GradHInner, dHdTInner);
 
@@ -343,6 +390,8 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
+  if (GBarVD && GBarVD!=GBarVDBuffer) free(GBarVD);
+
   memcpy(Args->H, H, 2*sizeof(cdouble));
   if (GradH) memcpy(Args->GradH, GradH, 6*sizeof(cdouble));
   if (dHdT) memcpy(Args->dHdT, dHdT, 2*NumTorqueAxes*sizeof(cdouble));
@@ -579,6 +628,319 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
    memcpy(dHdT, Args->dHdT, 2*Args->NumTorqueAxes*sizeof(cdouble));
 }
 
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- PART 2: Multi-wavenumber versions of the above, which       -*/
+/*-         compute the H integrals for several wavenumbers at  -*/
+/*-         once (typically the wavenumbers of the two regions  -*/
+/*-         bounded by a dielectric surface). Everything that   -*/
+/*-         does not depend on k -- cubature points, polynomial -*/
+/*-         factors, FIPPI lookups, Taylor-Duffy setup -- is     -*/
+/*-         done only once for all wavenumbers.                 -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+
+/***************************************************************/
+/* multi-wavenumber version of GetPPIs_Cubature (H integrals   */
+/* only). for each wavenumber the integrand is evaluated just  */
+/* as in AssembleInnerPPIIntegrand.                            */
+/***************************************************************/
+static void GetPPIs_CubatureMultiK(int DeSingularize, int HighOrder,
+                                   double **Va, double *Qa,
+                                   double **Vb, double *Qb,
+                                   int NumKs, cdouble *ks, cdouble *H)
+{
+  double *V0=Va[0], A[3], B[3];
+  VecSub(Va[1], Va[0], A);
+  VecSub(Va[2], Va[0], B);
+
+  double *V0P=Vb[0], AP[3], BP[3];
+  VecSub(Vb[1], Vb[0], AP);
+  VecSub(Vb[2], Vb[0], BP);
+
+  int NumPts;
+  double *TCR=GetTCR( HighOrder ? 20 : 4, &NumPts);
+
+  cdouble ik[MAXPPIKS], FourOverIK2[MAXPPIKS];
+  for(int nk=0; nk<NumKs; nk++)
+   { ik[nk]=II*ks[nk];
+     FourOverIK2[nk]=4.0/(ik[nk]*ik[nk]);
+   };
+
+  memset(H, 0, 2*NumKs*sizeof(cdouble));
+
+  /*--------------------------------------------------------------*/
+  /*- without desingularization the kernel is the bare Helmholtz -*/
+  /*- kernel, and we tabulate the geometric factors for blocks of -*/
+  /*- point pairs and hand them to the vectorized kernel routine -*/
+  /*--------------------------------------------------------------*/
+  if (!DeSingularize)
+   { double r[MAXKERNELPAIRS], W[MAXKERNELPAIRS];
+     double PhiFactors[2*MAXKERNELPAIRS], PsiFactors[MAXKERNELPAIRS];
+     int NumPairs=NumPts*NumPts;
+     for(int nStart=0; nStart<NumPairs; nStart+=MAXKERNELPAIRS)
+      { 
+        int N = NumPairs - nStart;
+        if (N>MAXKERNELPAIRS) N=MAXKERNELPAIRS;
+        for(int n=0; n<N; n++)
+         { double *TC  = TCR + 3*((nStart+n)/NumPts);
+           double *TCP = TCR + 3*((nStart+n)%NumPts);
+           double X[3], F[3], XP[3], FP[3], R[3];
+           for(int Mu=0; Mu<3; Mu++)
+            { X[Mu]  = V0[Mu]  + TC[0]*A[Mu]   + TC[1]*B[Mu];
+              F[Mu]  = X[Mu] - Qa[Mu];
+              XP[Mu] = V0P[Mu] + TCP[0]*AP[Mu] + TCP[1]*BP[Mu];
+              FP[Mu] = XP[Mu] - Qb[Mu];
+              R[Mu]  = X[Mu] - XP[Mu];
+            };
+           double FxFP[3];
+           VecCross(F, FP, FxFP);
+           r[n]=VecNorm(R);
+           W[n]=TC[2]*TCP[2];
+           PhiFactors[n]=1.0;
+           PhiFactors[N+n]=VecDot(F,FP);
+           PsiFactors[n]=VecDot(FxFP, R);
+         };
+
+        for(int nk=0; nk<NumKs; nk++)
+         { cdouble Moments[3];
+           GetHelmholtzKernelMoments(N, r, W, ks[nk], 2, PhiFactors, 
+                                     1, PsiFactors, 0, 0, Moments);
+           H[2*nk+0] += Moments[1] + FourOverIK2[nk]*Moments[0];
+           H[2*nk+1] += Moments[2];
+         };
+      };
+     return;
+   };
+
+  cdouble HInner[2*MAXPPIKS];
+  for(int np=0, ncp=0; np<NumPts; np++)
+   { 
+     double u=TCR[ncp++];
+     double v=TCR[ncp++];
+     double w=TCR[ncp++];
+
+     double X[3], F[3];
+     for(int Mu=0; Mu<3; Mu++)
+      { X[Mu] = V0[Mu] + u*A[Mu] + v*B[Mu];
+        F[Mu] = X[Mu] - Qa[Mu];
+      };
+
+     memset(HInner, 0, 2*NumKs*sizeof(cdouble));
+     for(int npp=0, ncpp=0; npp<NumPts; npp++)
+      { 
+        double up=TCR[ncpp++];
+        double vp=TCR[ncpp++];
+        double wp=TCR[ncpp++];
+
+        double XP[3], FP[3], R[3];
+        for(int Mu=0; Mu<3; Mu++)
+         { XP[Mu] = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
+           FP[Mu] = XP[Mu] - Qb[Mu];
+           R[Mu] = X[Mu] - XP[Mu];
+         };
+
+        double r=sqrt(VecNorm2(R));
+        double FDotFP=VecDot(F,FP);
+        double FxFP[3];
+        VecCross(F, FP, FxFP);
+        double hTimes=VecDot(FxFP, R);
+
+        for(int nk=0; nk<NumKs; nk++)
+         { cdouble Phi = ExpRel(ik[nk]*r,4) / (4.0*M_PI*r);
+           if ( !IsFinite(real(Phi)) ) Phi=0.0;
+           Phi*=wp;
+           cdouble Psi = Phi * (ik[nk] - 1.0/r) / r;
+
+           HInner[2*nk+0] += (FDotFP + FourOverIK2[nk]) * Phi;
+           HInner[2*nk+1] += hTimes * Psi;
+         };
+      };
+
+     for(int n=0; n<2*NumKs; n++)
+      H[n] += w*HInner[n];
+   };
+}
+
+/***************************************************************/
+/* multi-wavenumber Taylor-Duffy: all kernels for all          */
+/* wavenumbers are integrated in a single call.                */
+/***************************************************************/
+static void GetPPIs_TaylorDuffyMultiK(int ncv, bool HighK,
+                                      double **Va, double *Qa,
+                                      double **Vb, double *Qb,
+                                      int NumKs, cdouble *ks, cdouble *H)
+{
+  TaylorDuffyArgStruct TDArgStruct, *TDArgs=&TDArgStruct;
+  InitTaylorDuffyArgs(TDArgs);
+
+  int PKsPerK = (ncv==3) ? 2 : 3;
+  int PIndex[3*MAXPPIKS], KIndex[3*MAXPPIKS];
+  cdouble KParam[3*MAXPPIKS], Result[3*MAXPPIKS], Error[3*MAXPPIKS];
+  for(int nk=0; nk<NumKs; nk++)
+   { int *P=PIndex + PKsPerK*nk, *K=KIndex + PKsPerK*nk;
+     P[0]=TD_UNITY;   K[0]= HighK ? TD_HIGHK_HELMHOLTZ : TD_HELMHOLTZ;
+     P[1]=TD_PMCHWG1; K[1]= HighK ? TD_HIGHK_HELMHOLTZ : TD_HELMHOLTZ;
+     if (PKsPerK==3)
+      { P[2]=TD_PMCHWC; K[2]= HighK ? TD_HIGHK_GRADHELMHOLTZ : TD_GRADHELMHOLTZ; };
+     for(int n=0; n<PKsPerK; n++)
+      KParam[PKsPerK*nk + n]=ks[nk];
+   };
+
+  TDArgs->WhichCase=ncv;
+  TDArgs->NumPKs=PKsPerK*NumKs;
+  TDArgs->PIndex=PIndex;
+  TDArgs->KIndex=KIndex;
+  TDArgs->KParam=KParam;
+  TDArgs->V1=Va[0];
+  TDArgs->V2=Va[1];
+  TDArgs->V3=Va[2];
+  TDArgs->V2P=Vb[1];
+  TDArgs->V3P=Vb[2];
+  TDArgs->Q=Qa;
+  TDArgs->QP=Qb;
+  TDArgs->Result=Result;
+  TDArgs->Error=Error;
+
+  TaylorDuffy(TDArgs);
+
+  for(int nk=0; nk<NumKs; nk++)
+   { cdouble *R=Result + PKsPerK*nk, k=ks[nk];
+     H[2*nk+0] = R[1] - 4.0*R[0]/(k*k);
+     H[2*nk+1] = (ncv==3) ? 0.0 : R[2];
+   };
+}
+
+/***************************************************************/
+/* multi-wavenumber desingularization: one FIPPI lookup serves */
+/* all wavenumbers.                                            */
+/***************************************************************/
+static void GetPPIs_DesingMultiK(GetPPIArgStruct *Args, int ncv,
+                                 double **Va, double *Qa,
+                                 double **Vb, double *Qb,
+                                 int NumKs, cdouble *ks, cdouble *H)
+{
+  GetPPIs_CubatureMultiK(1, 0, Va, Qa, Vb, Qb, NumKs, ks, H);
+
+  QDFIPPIData MyQDFD, *QDFD=&MyQDFD;
+  if (Args->opFC)
+   GetQDFIPPIData(Va, Qa, Vb, Qb, ncv, Args->opFC, QDFD);
+  else
+   GetQDFIPPIData(Va, Qa, Vb, Qb, ncv, &GlobalFIPPICache, QDFD);
+
+  for(int nk=0; nk<NumKs; nk++)
+   { cdouble ik=II*ks[nk]; 
+     cdouble OOIK2=1.0/(ik*ik);
+     cdouble PF[5];
+     PF[0]=1.0/(4.0*M_PI);
+     PF[1]=ik*PF[0];
+     PF[2]=ik*PF[1];
+     PF[3]=ik*PF[2];
+     PF[4]=ik*PF[3];
+
+     H[2*nk+0] +=  PF[0]*AA0*( QDFD->hDotRM1 + OOIK2*QDFD->hNablaRM1)
+                  +PF[1]*AA1*( QDFD->hDotR0  + OOIK2*QDFD->hNablaR0 )
+                  +PF[2]*AA2*( QDFD->hDotR1  + OOIK2*QDFD->hNablaR1 )
+                  +PF[3]*AA3*( QDFD->hDotR2  + OOIK2*QDFD->hNablaR2 );
+
+     H[2*nk+1] +=  PF[0]*BB0*QDFD->hTimesRM3
+                  +PF[2]*BB2*QDFD->hTimesRM1
+                  +PF[3]*BB3*QDFD->hTimesR0 
+                  +PF[4]*BB4*QDFD->hTimesR1;
+   };
+}
+
+/***************************************************************/
+/* multi-wavenumber entry point. the choice of algorithm for   */
+/* each wavenumber is the same as in the single-wavenumber     */
+/* routine above; wavenumbers that end up using the same       */
+/* algorithm are handled together.                             */
+/***************************************************************/
+void GetPanelPanelInteractions(GetPPIArgStruct *Args,
+                               int NumKs, cdouble *ks, cdouble *H,
+                               int *WhichAlgorithms)
+{
+  if (NumKs<1 || NumKs>MAXPPIKS)
+   ErrExit("%s:%i: invalid number of wavenumbers (%i)",__FILE__,__LINE__,NumKs);
+
+  /*--------------------------------------------------------------*/
+  /*- derivatives, displacements, and periodic kernels are not    */
+  /*- handled by the batched code, so in these cases we just do   */
+  /*- one wavenumber at a time                                    */
+  /*--------------------------------------------------------------*/
+  if (    Args->GBA || Args->Displacement 
+       || Args->NumGradientComponents>0 || Args->NumTorqueAxes>0 )
+   { for(int nk=0; nk<NumKs; nk++)
+      { Args->k=ks[nk];
+        GetPanelPanelInteractions(Args);
+        memcpy(H+2*nk, Args->H, 2*sizeof(cdouble));
+        if (WhichAlgorithms) WhichAlgorithms[nk]=Args->WhichAlgorithm;
+      };
+     return;
+   };
+
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  int npa        = Args->npa;
+  int npb        = Args->npb;
+  RWGPanel *Pa   = Sa->Panels[npa];
+  RWGPanel *Pb   = Sb->Panels[npb];
+  double *Qa     = Sa->Vertices + 3*Pa->VI[Args->iQa];
+  double *Qb     = Sb->Vertices + 3*Pb->VI[Args->iQb];
+  double *Va[3], *Vb[3];
+  double rRel;
+  int ncv=AssessPanelPair(Sa,npa,Sb,npb,&rRel,Va,Vb);
+
+  int Algorithm[MAXPPIKS];
+  double RMax=fmax(Pa->Radius, Pb->Radius);
+  for(int nk=0; nk<NumKs; nk++)
+   { double kR=abs(ks[nk]*RMax);
+     bool InSWRegime = kR > SWTHRESHOLD;
+     bool InVerySWRegime = kR > VERYSWTHRESHOLD;
+     if ( rRel > DESINGULARIZATION_RADIUS )
+      Algorithm[nk]=PPIALG_LOCUBATURE;
+     else if ( InSWRegime && ncv==0 )
+      Algorithm[nk]=PPIALG_HOCUBATURE;
+     else if ( ncv==3 || ( ncv>0 && (InSWRegime || Args->ForceTaylorDuffy) ) )
+      Algorithm[nk] = (InVerySWRegime && RWGGeometry::UseHighKTaylorDuffy) ? PPIALG_HKTD : PPIALG_TD;
+     else
+      Algorithm[nk]=PPIALG_DESING;
+     if (WhichAlgorithms) WhichAlgorithms[nk]=Algorithm[nk];
+   };
+
+  for(int Alg=0; Alg<NUMPPIALGORITHMS; Alg++)
+   { 
+     int NumKsAlg=0, nkAlg[MAXPPIKS];
+     cdouble ksAlg[MAXPPIKS], HAlg[2*MAXPPIKS];
+     for(int nk=0; nk<NumKs; nk++)
+      if (Algorithm[nk]==Alg)
+       { nkAlg[NumKsAlg]=nk;
+         ksAlg[NumKsAlg++]=ks[nk];
+       };
+     if (NumKsAlg==0) 
+      continue;
+
+     switch(Alg)
+      { case PPIALG_LOCUBATURE:
+        case PPIALG_HOCUBATURE:
+          GetPPIs_CubatureMultiK(0, Alg==PPIALG_HOCUBATURE, Va, Qa, Vb, Qb, NumKsAlg, ksAlg, HAlg);
+          break;
+        case PPIALG_TD:
+        case PPIALG_HKTD:
+          GetPPIs_TaylorDuffyMultiK(ncv, Alg==PPIALG_HKTD, Va, Qa, Vb, Qb, NumKsAlg, ksAlg, HAlg);
+          break;
+        default:
+          GetPPIs_DesingMultiK(Args, ncv, Va, Qa, Vb, Qb, NumKsAlg, ksAlg, HAlg);
+          break;
+      };
+
+     for(int n=0; n<NumKsAlg; n++)
+      memcpy(H + 2*nkAlg[n], HAlg + 2*n, 2*sizeof(cdouble));
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -594,4 +956,218 @@ void InitGetPPIArgs(GetPPIArgStruct *Args)
   Args->ForceFullEwald=false;
 }
 
+
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- PART 3: Panel-centric evaluation of far-zone panel-panel   -*/
+/*-         integrals via cached panel-pair moments.            -*/
+/*-                                                             -*/
+/*- With x=X-Ca, x'=X'-Cb (Ca, Cb = panel centroids) and        -*/
+/*- qa=Qa-Ca, qb=Qb-Cb, the polynomial factors in the integrand -*/
+/*- of AssembleInnerPPIIntegrand are                            -*/
+/*-  hPlus  = x*x' - qb*x - qa*x' + qa*qb + 4/(ik)^2            -*/
+/*-  hTimes = (x X x')*R - qb*(R X x) - qa*(x' X R)             -*/
+/*-           + (qa X qb)*R                                     -*/
+/*- so H[0], H[1] for all 9 choices of (iQa, iQb) are linear    -*/
+/*- combinations of the 18 moments                              -*/
+/*-  M[0]      = sum Phi                                        -*/
+/*-  M[1..3]   = sum Phi*x                                      -*/
+/*-  M[4..6]   = sum Phi*x'                                     -*/
+/*-  M[7]      = sum Phi*(x*x')                                 -*/
+/*-  M[8]      = sum Psi*(x X x')*R                             -*/
+/*-  M[9..11]  = sum Psi*(R X x)                                -*/
+/*-  M[12..14] = sum Psi*(x' X R)                               -*/
+/*-  M[15..17] = sum Psi*R                                      -*/
+/*- where the sums run over the same cubature points used by    -*/
+/*- GetPPIs_Cubature in the low-order case. The moments for all -*/
+/*- wavenumbers in the cache are computed in a single pass.     -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+PPIMomentCache::PPIMomentCache(RWGSurface *pSa, RWGSurface *pSb,
+                               int pNumKs, cdouble *pks)
+{
+  if (pNumKs<1 || pNumKs>MAXPPIKS)
+   ErrExit("%s:%i: invalid number of wavenumbers (%i)",__FILE__,__LINE__,pNumKs);
+  Sa=pSa;
+  Sb=pSb;
+  NumKs=pNumKs;
+  for(int nk=0; nk<NumKs; nk++)
+   ks[nk]=pks[nk];
+  NPb=Sb->NumPanels;
+  Clock=0;
+  for(int nr=0; nr<PPIMC_ROWS; nr++)
+   { RowPanel[nr]=-1;
+     RowStamp[nr]=0;
+     Moments[nr]=0; // allocated on first use
+     Status[nr]=(char *)mallocEC(NPb*sizeof(char));
+   };
+}
+
+PPIMomentCache::~PPIMomentCache()
+{
+  for(int nr=0; nr<PPIMC_ROWS; nr++)
+   { if (Moments[nr]) delete[] Moments[nr];
+     free(Status[nr]);
+   };
+}
+
+/***************************************************************/
+/* return a pointer to the moments for panel pair (npa,npb),   */
+/* computing them if necessary, or 0 if the pair is not in the */
+/* far zone.                                                   */
+/***************************************************************/
+cdouble *PPIMomentCache::GetMoments(int npa, int npb)
+{
+  /*--------------------------------------------------------------*/
+  /*- find the row for panel npa, evicting the least recently    -*/
+  /*- used row if it is not present                              -*/
+  /*--------------------------------------------------------------*/
+  int Row=-1, LRURow=0;
+  for(int nr=0; nr<PPIMC_ROWS && Row==-1; nr++)
+   { if (RowPanel[nr]==npa)
+      Row=nr;
+     else if (RowStamp[nr]<RowStamp[LRURow])
+      LRURow=nr;
+   };
+  if (Row==-1)
+   { Row=LRURow;
+     if (RowPanel[Row]!=-1)
+      memset(Status[Row], 0, NPb*sizeof(char));
+     else
+      Moments[Row]=new cdouble[NPb*NumKs*NUMPPIMOMENTS];
+     RowPanel[Row]=npa;
+   };
+  RowStamp[Row]=++Clock;
+
+  if (Status[Row][npb]==2)
+   return 0;
+  cdouble *M = Moments[Row] + npb*NumKs*NUMPPIMOMENTS;
+  if (Status[Row][npb]==1)
+   return M;
+
+  /*--------------------------------------------------------------*/
+  /*- same far-zone criterion as GetPanelPanelInteractions -------*/
+  /*--------------------------------------------------------------*/
+  RWGPanel *Pa=Sa->Panels[npa];
+  RWGPanel *Pb=Sb->Panels[npb];
+  double rRel = VecDistance(Pa->Centroid, Pb->Centroid) 
+                 / fmax(Pa->Radius, Pb->Radius);
+  if ( !(rRel > DESINGULARIZATION_RADIUS) )
+   { Status[Row][npb]=2;
+     return 0;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- compute the moments by low-order cubature, with cubature   -*/
+  /*- points identical to those of GetPPIs_Cubature. the         -*/
+  /*- geometric factors for all point pairs are tabulated first, -*/
+  /*- and the kernel and the sums are then evaluated in one      -*/
+  /*- vectorized pass for each wavenumber.                       -*/
+  /*--------------------------------------------------------------*/
+  double *V0  = Sa->Vertices + 3*Pa->VI[0];
+  double *V0P = Sb->Vertices + 3*Pb->VI[0];
+  double A[3], B[3], AP[3], BP[3];
+  VecSub(Sa->Vertices + 3*Pa->VI[1], V0, A);
+  VecSub(Sa->Vertices + 3*Pa->VI[2], V0, B);
+  VecSub(Sb->Vertices + 3*Pb->VI[1], V0P, AP);
+  VecSub(Sb->Vertices + 3*Pb->VI[2], V0P, BP);
+  double *Ca=Pa->Centroid, *Cb=Pb->Centroid;
+
+  int NumPts;
+  double *TCR=GetTCR(4, &NumPts);
+  int NumPairs=NumPts*NumPts;
+
+  double r[MAXKERNELPAIRS], W[MAXKERNELPAIRS];
+  double PhiFactors[8*MAXKERNELPAIRS], PsiFactors[10*MAXKERNELPAIRS];
+  double *PhF[8], *PsF[10];
+  for(int nf=0; nf<8; nf++)  PhF[nf]=PhiFactors + nf*NumPairs;
+  for(int nf=0; nf<10; nf++) PsF[nf]=PsiFactors + nf*NumPairs;
+
+  for(int np=0, ncp=0, n=0; np<NumPts; np++)
+   { 
+     double u=TCR[ncp++];
+     double v=TCR[ncp++];
+     double w=TCR[ncp++];
+
+     double X[3], x[3];
+     for(int Mu=0; Mu<3; Mu++)
+      { X[Mu] = V0[Mu] + u*A[Mu] + v*B[Mu];
+        x[Mu] = X[Mu] - Ca[Mu];
+      };
+
+     for(int npp=0, ncpp=0; npp<NumPts; npp++, n++)
+      { 
+        double up=TCR[ncpp++];
+        double vp=TCR[ncpp++];
+        double wp=TCR[ncpp++];
+
+        double XP[3], xp[3], R[3];
+        for(int Mu=0; Mu<3; Mu++)
+         { XP[Mu] = V0P[Mu] + up*AP[Mu] + vp*BP[Mu];
+           xp[Mu] = XP[Mu] - Cb[Mu];
+           R[Mu]  = X[Mu] - XP[Mu];
+         };
+
+        double xxxp[3], Rxx[3], xpxR[3];
+        VecCross(x, xp, xxxp);
+        VecCross(R, x, Rxx);
+        VecCross(xp, R, xpxR);
+
+        r[n]=VecNorm(R);
+        W[n]=w*wp;
+        PhF[0][n]=1.0;
+        PhF[7][n]=VecDot(x,xp);
+        PsF[0][n]=VecDot(xxxp,R);
+        for(int Mu=0; Mu<3; Mu++)
+         { PhF[1+Mu][n] = x[Mu];
+           PhF[4+Mu][n] = xp[Mu];
+           PsF[1+Mu][n] = Rxx[Mu];
+           PsF[4+Mu][n] = xpxR[Mu];
+           PsF[7+Mu][n] = R[Mu];
+         };
+      };
+   };
+
+  for(int nk=0; nk<NumKs; nk++)
+   GetHelmholtzKernelMoments(NumPairs, r, W, ks[nk], 
+                             8, PhiFactors, 10, PsiFactors, 0, 0,
+                             M + nk*NUMPPIMOMENTS);
+
+  Status[Row][npb]=1;
+  return M;
+}
+
+/***************************************************************/
+/* on return, H[2*nk + 0,1] are the H integrals for wavenumber */
+/* ks[nk].                                                     */
+/***************************************************************/
+bool PPIMomentCache::GetPPIs(int npa, int iQa, int npb, int iQb, cdouble *H)
+{
+  cdouble *M=GetMoments(npa, npb);
+  if (M==0)
+   return false;
+
+  RWGPanel *Pa=Sa->Panels[npa];
+  RWGPanel *Pb=Sb->Panels[npb];
+  double qa[3], qb[3], qaxqb[3];
+  VecSub(Sa->Vertices + 3*Pa->VI[iQa], Pa->Centroid, qa);
+  VecSub(Sb->Vertices + 3*Pb->VI[iQb], Pb->Centroid, qb);
+  VecCross(qa, qb, qaxqb);
+
+  double qaqb=VecDot(qa,qb);
+  for(int nk=0; nk<NumKs; nk++, M+=NUMPPIMOMENTS, H+=2)
+   { cdouble ik=II*ks[nk];
+     H[0] = M[7] + (qaqb + 4.0/(ik*ik))*M[0];
+     H[1] = M[8];
+     for(int Mu=0; Mu<3; Mu++)
+      { H[0] -= qb[Mu]*M[1+Mu] + qa[Mu]*M[4+Mu];
+        H[1] += qaxqb[Mu]*M[15+Mu] - qb[Mu]*M[9+Mu] - qa[Mu]*M[12+Mu];
+      };
+   };
+
+  return true;
+}
+
 } // namespace scuff
@@ -70,6 +70,8 @@
 
 #include "libscuff.h"
 
+#include <config.h>
+
 namespace scuff {
 
 /*************************************************************************/
@@ -97,23 +99,30 @@ static int point_in_tri(double x, double y,
 	  PAST_EDGE(x,y,xt[0],yt[0],xt[2],yt[2])) % 2;
 }
 
+/* Test whether (x,y,z) is above the plane of the given triangle,
+   assuming that (x,y) lies inside the triangle's xy projection. */
+static int point_above_plane(double x, double y, double z,
+		    const float xt[3], const float yt[3], const float zt[3])
+{
+  double d1x = xt[1] - xt[0];
+  double d1y = yt[1] - yt[0];
+  double d1z = zt[1] - zt[0];
+  double d2x = xt[2] - xt[0];
+  double d2y = yt[2] - yt[0];
+  double d2z = zt[2] - zt[0];
+  double cx = d1y * d2z - d1z * d2y; /* (d1 x d2).x */
+  double cy = d1z * d2x - d1x * d2z; /* (d1 x d2).y */
+  double cz = d1x * d2y - d1y * d2x; /* (d1 x d2).z */
+  return ((x - xt[0]) * cx + (y - yt[0]) * cy + (z - zt[0]) * cz) * cz > 0;
+}
+
 /* Test whether (x,y,z) is above the given triangle: whether the
    ray from (x,y,z) to (x,y,-infinity) intersects the triangle. */
 static int point_above_tri(double x, double y, double z,
 		    const float xt[3], const float yt[3], const float zt[3])
 {
-  if (point_in_tri(x,y,xt,yt)) {
-    double d1x = xt[1] - xt[0];
-    double d1y = yt[1] - yt[0];
-    double d1z = zt[1] - zt[0];
-    double d2x = xt[2] - xt[0];
-    double d2y = yt[2] - yt[0];
-    double d2z = zt[2] - zt[0];
-    double cx = d1y * d2z - d1z * d2y; /* (d1 x d2).x */
-    double cy = d1z * d2x - d1x * d2z; /* (d1 x d2).y */
-    double cz = d1x * d2y - d1y * d2x; /* (d1 x d2).z */
-    return ((x - xt[0]) * cx + (y - yt[0]) * cy + (z - zt[0]) * cz) * cz > 0;
-  }
+  if (point_in_tri(x,y,xt,yt))
+    return point_above_plane(x,y,z,xt,yt,zt);
   return 0;
 }
 
@@ -472,6 +481,33 @@ static int kdtri_count_below(kdtri t, const double p[3])
   }
 }
 
+/* store in Tris[] pointers to all triangles in t whose xy projections
+   contain (p[0],p[1]), i.e. all triangles that may be pierced by a ray
+   from (p[0],p[1],z) to (p[0],p[1],-infinity) for some z. returns the
+   number of such triangles, or -1 if there are more than MaxTris. */
+static int kdtri_collect_column(kdtri t, const double p[2],
+                                const boxtri **Tris, int MaxTris)
+{
+  if (!t) return 0;
+  if (t->le) { /* search subtrees */
+    if (p[t->dim] <= t->div)
+      return kdtri_collect_column(t->le, p, Tris, MaxTris);
+    else
+      return kdtri_collect_column(t->gt, p, Tris, MaxTris);
+  }
+  else { /* we are at a leaf node: search directly */
+    size_t i, n = t->n;
+    boxtri *B = t->B;
+    int count = 0;
+    for (i = 0; i < n; ++i)
+      if (boxtri_contains(B+i, p) && point_in_tri(p[0],p[1],B[i].x,B[i].y)) {
+	if (count == MaxTris) return -1;
+	Tris[count++] = B + i;
+      }
+    return count;
+  }
+}
+
 /* returns the number of times a ray from (px,py,pz) to (px,py,-infinity) 
    intersects the surface that was used to define t.
 */
@@ -691,4 +727,208 @@ int RWGGeometry::GetRegionIndex(const double X[3])
 
 }
 
+/***************************************************************/
+/* batched point location.                                     */
+/*                                                             */
+/* points are sorted by their (x,y) coordinates, so that all   */
+/* points lying on a common vertical line (a 'column,' as for  */
+/* instance along the z axis of a structured grid) are         */
+/* adjacent; for each column the kd-tree is searched only once */
+/* for the panels that the vertical ray might pierce, and then */
+/* each point in the column just checks whether it lies above  */
+/* each of those panels.                                       */
+/***************************************************************/
+typedef struct ColumnPoint
+ { double X[3];
+   int nx;
+ } ColumnPoint;
+
+static int CompareColumnPoints(const void *p1, const void *p2)
+{ 
+  const ColumnPoint *CP1=(const ColumnPoint *)p1;
+  const ColumnPoint *CP2=(const ColumnPoint *)p2;
+  if (CP1->X[0] < CP2->X[0]) return -1;
+  if (CP1->X[0] > CP2->X[0]) return +1;
+  if (CP1->X[1] < CP2->X[1]) return -1;
+  if (CP1->X[1] > CP2->X[1]) return +1;
+  return 0;
+}
+
+/***************************************************************/
+/* sort the points (given in the coordinate system of surface  */
+/* S) into columns; on return, column #nc comprises points     */
+/* CPs[ColumnStart[nc]...ColumnStart[nc+1]-1].                 */
+/***************************************************************/
+static int SortIntoColumns(ColumnPoint *CPs, int NX, int *ColumnStart)
+{
+  qsort(CPs, NX, sizeof(ColumnPoint), CompareColumnPoints);
+  int NumColumns=0;
+  for(int n=0; n<NX; n++)
+   if (    n==0
+        || CPs[n].X[0]!=CPs[n-1].X[0]
+        || CPs[n].X[1]!=CPs[n-1].X[1]
+      )
+    ColumnStart[NumColumns++]=n;
+  ColumnStart[NumColumns]=NX;
+  return NumColumns;
+}
+
+/***************************************************************/
+/* Piercings[nx] = number of panels of S pierced by a ray from */
+/* point #nx to z=-infinity. if CheckBoundingBox is true,      */
+/* points outside the bounding box of S get Piercings=0.       */
+/***************************************************************/
+#define MAXCOLUMNTRIS 256
+static void GetPiercings(RWGSurface *S, ColumnPoint *CPs, 
+                         int NumColumns, int *ColumnStart,
+                         bool CheckBoundingBox, int *Piercings)
+{
+  kdtri t=S->kdPanels;
+#ifdef USE_OPENMP
+  int NumThreads=GetNumThreads();
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int nc=0; nc<NumColumns; nc++)
+   { 
+     const boxtri *Tris[MAXCOLUMNTRIS];
+     int NumTris=kdtri_collect_column(t, CPs[ColumnStart[nc]].X, Tris, MAXCOLUMNTRIS);
+
+     for(int n=ColumnStart[nc]; n<ColumnStart[nc+1]; n++)
+      { 
+        double *X=CPs[n].X;
+        int Count=0;
+        if (    CheckBoundingBox
+             && (    X[0] < t->bmin[0] || X[0] > t->bmax[0]
+                  || X[1] < t->bmin[1] || X[1] > t->bmax[1]
+                  || X[2] < t->bmin[2] || X[2] > t->bmax[2]
+                )
+           )
+         Count=0;
+        else if (NumTris==-1)
+         Count=kdtri_surface_piercings(t, X);
+        else
+         for(int nt=0; nt<NumTris; nt++)
+          Count+=point_above_plane(X[0],X[1],X[2],Tris[nt]->x,Tris[nt]->y,Tris[nt]->z);
+        Piercings[CPs[n].nx]=Count;
+      };
+   };
+}
+
+/***************************************************************/
+/* get the indices of the regions containing all points in     */
+/* XMatrix (whose rows, starting at column ColumnOffset, are   */
+/* the cartesian coordinates of the points). returns the same  */
+/* results as calling GetRegionIndex() for each point.         */
+/*                                                             */
+/* if RegionIndices is nonzero it must point to an array of    */
+/* XMatrix->NR integers; otherwise the array is allocated.     */
+/***************************************************************/
+int *RWGGeometry::GetRegionIndices(HMatrix *XMatrix, int *RegionIndices,
+                                   int ColumnOffset)
+{
+  int NX=XMatrix->NR;
+  if (RegionIndices==0)
+   RegionIndices=(int *)mallocEC(NX*sizeof(int));
+  if (NX==0) return RegionIndices;
+
+  /***************************************************************/
+  /* reduce points to the unit cell and sort them into columns.  */
+  /* (CPs0 is the sorted list of points in the lab frame; for    */
+  /* surfaces that have been displaced or rotated we need a      */
+  /* separate sort in the surface's own coordinate system.)      */
+  /***************************************************************/
+  ColumnPoint *CPs0 = (ColumnPoint *)mallocEC(NX*sizeof(ColumnPoint));
+  ColumnPoint *CPs  = (ColumnPoint *)mallocEC(NX*sizeof(ColumnPoint));
+  int *ColumnStart0 = (int *)mallocEC((NX+1)*sizeof(int));
+  int *ColumnStart  = (int *)mallocEC((NX+1)*sizeof(int));
+  int *Piercings    = (int *)mallocEC(NX*sizeof(int));
+  for(int nx=0; nx<NX; nx++)
+   { double X[3];
+     X[0]=XMatrix->GetEntryD(nx, ColumnOffset+0);
+     X[1]=XMatrix->GetEntryD(nx, ColumnOffset+1);
+     X[2]=XMatrix->GetEntryD(nx, ColumnOffset+2);
+     if (LBasis)
+      GetUnitCellRepresentative(X, CPs0[nx].X);
+     else
+      memcpy(CPs0[nx].X, X, 3*sizeof(double));
+     CPs0[nx].nx=nx;
+   };
+  int NumColumns0=SortIntoColumns(CPs0, NX, ColumnStart0);
+
+  /***************************************************************/
+  /* in the all-closed-surfaces case, the region is that of the  */
+  /* innermost (highest-index) surface containing the point; in  */
+  /* the general case we need the total number of piercings of   */
+  /* all non-PEC surfaces bounding each region.                  */
+  /***************************************************************/
+  int *RegionPiercings=0;
+  if (AllSurfacesClosed)
+   { for(int nx=0; nx<NX; nx++) 
+      RegionIndices[nx]=0;
+   }
+  else
+   RegionPiercings=(int *)mallocEC(NX*NumRegions*sizeof(int));
+
+  for(int ns=0; ns<NumSurfaces; ns++)
+   { 
+     RWGSurface *S=Surfaces[ns];
+     if ( AllSurfacesClosed ? !S->IsClosed : S->IsPEC )
+      continue;
+
+     if (S->GT)
+      { memcpy(CPs, CPs0, NX*sizeof(ColumnPoint));
+        for(int nx=0; nx<NX; nx++) 
+         S->GT->UnApply(CPs[nx].X);
+
+        // displacements and rotations about the z axis map columns
+        // to columns, so we can skip the re-sort in those cases
+        double (*M)[3] = S->GT->M;
+        if ( M[0][2]==0.0 && M[1][2]==0.0 && M[2][0]==0.0 && M[2][1]==0.0 )
+         GetPiercings(S, CPs, NumColumns0, ColumnStart0, AllSurfacesClosed, Piercings);
+        else
+         { int NumColumns=SortIntoColumns(CPs, NX, ColumnStart);
+           GetPiercings(S, CPs, NumColumns, ColumnStart, AllSurfacesClosed, Piercings);
+         };
+      }
+     else
+      GetPiercings(S, CPs0, NumColumns0, ColumnStart0, AllSurfacesClosed, Piercings);
+
+     if (AllSurfacesClosed)
+      { for(int nx=0; nx<NX; nx++)
+         if (Piercings[nx]%2)
+          RegionIndices[nx]=S->RegionIndices[1];
+      }
+     else
+      { int nr0=S->RegionIndices[0], nr1=S->RegionIndices[1];
+        for(int nx=0; nx<NX; nx++)
+         { RegionPiercings[nx*NumRegions + nr0] += Piercings[nx];
+           if (nr1!=nr0)
+            RegionPiercings[nx*NumRegions + nr1] += Piercings[nx];
+         };
+      };
+   };
+
+  if (!AllSurfacesClosed)
+   { for(int nx=0; nx<NX; nx++)
+      { RegionIndices[nx]=0;
+        for(int nr=0; nr<NumRegions; nr++)
+         { bool Odd = RegionPiercings[nx*NumRegions + nr]%2;
+           if ( nr==0 ? !Odd : Odd )
+            { RegionIndices[nx]=nr;
+              break;
+            };
+         };
+      };
+     free(RegionPiercings);
+   };
+
+  free(Piercings);
+  free(ColumnStart);
+  free(ColumnStart0);
+  free(CPs);
+  free(CPs0);
+
+  return RegionIndices;
+}
+
 } // namespace scuff
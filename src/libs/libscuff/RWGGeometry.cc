@@ -50,6 +50,8 @@ bool RWGGeometry::UseHighKTaylorDuffy=true;
 bool RWGGeometry::UseTaylorDuffyV2P0=true;
 bool RWGGeometry::UseGetFieldsV2P0=false;
 bool RWGGeometry::DisableCache=false;
+bool RWGGeometry::UsePanelMoments=true;
+bool RWGGeometry::ReuseMateBlocks=true;
 int RWGGeometry::NumMeshDirs=0;
 char **RWGGeometry::MeshDirs=0;
 
@@ -435,6 +437,16 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
      RWGGeometry::DisableCache=true;
    };
 
+  if ( (s=getenv("SCUFF_PANEL_MOMENTS")) && (s[0]=='0') )
+   { Log("Disabling panel-moment evaluation of far-zone panel-panel integrals.");
+     RWGGeometry::UsePanelMoments=false;
+   };
+
+  if ( (s=getenv("SCUFF_REUSE_MATE_BLOCKS")) && (s[0]=='0') )
+   { Log("Disabling reuse of BEM matrix blocks between rigidly-displaced surfaces.");
+     RWGGeometry::ReuseMateBlocks=false;
+   };
+
   if ( (s= getenv("SCUFF_HALF_RWG")) && (s[0]=='1') )
    { Log("Assigning half-RWG basis functions to exterior edges.");
      RWGGeometry::UseHRWGFunctions=true;
@@ -867,13 +879,15 @@ RWGGeometry::~RWGGeometry()
   free(PanelIndexOffset);
   free(EpsTF);
   free(MuTF);
-  free(Mate);
   free(SurfaceMoved);
   free(GeoFileName);
 
+  // surfaces with mates share the FIBBI cache of their mate
   for(int ns=0; ns<NumSurfaces; ns++)
-   DestroyFIBBICache(FIBBICaches[ns]);
+   if (Mate[ns]==-1)
+    DestroyFIBBICache(FIBBICaches[ns]);
   free(FIBBICaches);
+  free(Mate);
 
 }
 
@@ -299,6 +299,7 @@ void RWGSurface::InitRWGSurface()
 { 
   ErrMsg=0;
   kdPanels = NULL;
+  OverlapMatrices = NULL;
 
   /*------------------------------------------------------------*/
   /*- try to open the mesh file. we look in several places:     */
@@ -459,6 +460,7 @@ RWGSurface::RWGSurface(double *pVertices, int pNumVertices,
 { 
   ErrMsg=0;
   kdPanels = NULL;
+  OverlapMatrices = NULL;
 
   MeshFileName=strdupEC("ByHand.msh");
   Label=strdupEC("ByHand");
@@ -583,6 +585,7 @@ RWGSurface::~RWGSurface()
   if (RegionLabels[1]) free(RegionLabels[1]);
 
   kdtri_destroy(kdPanels);
+  ClearOverlapMatrices();
 }
 
 /***************************************************************/
@@ -617,6 +620,7 @@ void RWGSurface::Transform(const GTransformation *DeltaGT)
    InitRWGPanel(Panels[np], Vertices);
 
   UpdateBoundingBox();
+  ClearOverlapMatrices();
 
   /***************************************************************/
   /* update the internally stored GTransformation ****************/
@@ -665,6 +669,7 @@ void RWGSurface::UnTransform()
    InitRWGPanel(Panels[np], Vertices);
 
   UpdateBoundingBox();
+  ClearOverlapMatrices();
 
   /***************************************************************/
   /***************************************************************/
@@ -150,6 +150,22 @@ void *GSSIThread(void *data)
   GetEEIArgs->GammaMatrix=GammaMatrix;
   GetEEIArgs->Displacement=Displacement;
 
+  /***************************************************************/
+  /* for compact geometries and plain matrix assembly (no        */
+  /* derivatives) the far-zone panel-panel integrals are         */
+  /* computed from cached panel-pair moments, one cache for each */
+  /* of the (at most two) wavenumbers. the caches are private to */
+  /* this task, which handles a contiguous range of edges on     */
+  /* surface a so that the panels of consecutive edges are      */
+  /* reused.                                                     */
+  /***************************************************************/
+  bool NoDerivatives   = (    !Displacement && !GradB
+                           && !Args->GBA1 && !Args->GBA2
+                           && (NumTorqueAxes==0 || GammaMatrix==0)
+                         );
+  bool UsePanelMoments = RWGGeometry::UsePanelMoments && NoDerivatives;
+  PPIMomentCache *PMCA=0, *PMCB=0;
+
   /* pointers to arrays inside the structure */
   cdouble *GC=GetEEIArgs->GC;
   cdouble *GradGC=GetEEIArgs->GradGC;
@@ -175,21 +191,50 @@ void *GSSIThread(void *data)
      PreFac3B = -SignB*II*EpsB*Omega;
    };
 
+  /***************************************************************/
+  /* if both regions contribute, we get the edge-edge            */
+  /* interactions for both wavenumbers in a single pass, sharing */
+  /* all the wavenumber-independent work.                        */
+  /***************************************************************/
+  bool BatchKs = (NoDerivatives && EpsA!=0.0 && EpsB!=0.0);
+  cdouble kAB[2], GCAB[4];
+  kAB[0]=kA;
+  kAB[1]=(EpsB!=0.0) ? kB : 0.0;
+
+  if (UsePanelMoments && BatchKs)
+   PMCA=new PPIMomentCache(Sa, Sb, 2, kAB);
+  else if (UsePanelMoments)
+   { if (EpsA!=0.0) PMCA=new PPIMomentCache(Sa, Sb, 1, &kA);
+     if (EpsB!=0.0) PMCB=new PPIMomentCache(Sa, Sb, 1, &kB);
+   };
+
   /***************************************************************/
   /* loop over all internal edges on both objects.               */
+  /* this task handles rows neaMin <= nea < neaMax; for          */
+  /* symmetric blocks, in which row nea involves NEa-nea edge    */
+  /* pairs, the row ranges are chosen to equalize the number of  */
+  /* edge pairs per task.                                        */
   /***************************************************************/
   int nea, NEa=Sa->NumEdges;
   int neb, NEb=Sb->NumEdges;
-  int X, Y, Mu, nt=0;
+  int X, Y, Mu;
   int NumGradientComponents = GradB ? 3 : 0;
   int nebStart = Symmetric ? 1 : 0;
-  for(nea=0; nea<NEa; nea++)
+  double tMin = ((double)TD->nt) / ((double)TD->NumTasks);
+  double tMax = ((double)(TD->nt+1)) / ((double)TD->NumTasks);
+  int neaMin, neaMax;
+  if (Symmetric)
+   { neaMin = (int)floor( NEa*(1.0 - sqrt(1.0-tMin)) + 0.5 );
+     neaMax = (int)floor( NEa*(1.0 - sqrt(1.0-tMax)) + 0.5 );
+   }
+  else
+   { neaMin = (int)floor( NEa*tMin + 0.5 );
+     neaMax = (int)floor( NEa*tMax + 0.5 );
+   };
+  if (TD->nt+1 == TD->NumTasks) neaMax=NEa;
+  for(nea=neaMin; nea<neaMax; nea++)
    for(neb=nebStart*nea; neb<NEb; neb++)
     { 
-      nt++;
-      if (nt==TD->NumTasks) nt=0;
-      if (nt!=TD->nt) continue;
-
       if (G->LogLevel>=SCUFF_VERBOSE2 && (neb==nebStart*nea) )
        LogPercent(nea, NEa);
 
@@ -198,9 +243,17 @@ void *GSSIThread(void *data)
       /*--------------------------------------------------------------*/
       GetEEIArgs->nea  = nea;
       GetEEIArgs->neb  = neb;
-      GetEEIArgs->k    = kA;
-      GetEEIArgs->GBA  = Args->GBA1;
-      GetEdgeEdgeInteractions(GetEEIArgs);
+      GetEEIArgs->PMC  = PMCA;
+      if (BatchKs)
+       { GetEEIArgs->GBA = 0;
+         GetEdgeEdgeInteractions(GetEEIArgs, 2, kAB, GCAB);
+         memcpy(GC, GCAB, 2*sizeof(cdouble));
+       }
+      else
+       { GetEEIArgs->k   = kA;
+         GetEEIArgs->GBA = Args->GBA1;
+         GetEdgeEdgeInteractions(GetEEIArgs);
+       };
 
       if ( SaIsPEC && SbIsPEC )
        { 
@@ -293,9 +346,14 @@ void *GSSIThread(void *data)
       /*--------------------------------------------------------------*/
       if (EpsB!=0.0)
        { 
-         GetEEIArgs->k   = kB;
-         GetEEIArgs->GBA = Args->GBA2;
-         GetEdgeEdgeInteractions(GetEEIArgs);
+         if (BatchKs)
+          memcpy(GC, GCAB+2, 2*sizeof(cdouble));
+         else
+          { GetEEIArgs->k   = kB;
+            GetEEIArgs->GBA = Args->GBA2;
+            GetEEIArgs->PMC = PMCB;
+            GetEdgeEdgeInteractions(GetEEIArgs);
+          };
 
          X=RowOffset + 2*nea;
          Y=ColOffset + 2*neb;
@@ -326,7 +384,10 @@ void *GSSIThread(void *data)
           };
        }; // if (EpsB!=0.0)
 
-    }; // for(nea=0; nea<NEa; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+    }; // for(nea=neaMin; nea<neaMax; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+
+  if (PMCA) delete PMCA;
+  if (PMCB) delete PMCB;
 
   memcpy(TD->PPIAlgorithmCount, GetEEIArgs->PPIAlgorithmCount, NUMPPIALGORITHMS*sizeof(unsigned));
   return 0;
@@ -410,9 +471,12 @@ void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args)
       if (neAlpha==0 && neBeta==neAlpha)
        Log("Zeta = %s ",CD2S(Zeta));
 
+      // in packed (symmetric) storage the (beta,alpha) entry is the
+      // same slot as the (alpha,beta) entry, so it must only be
+      // augmented once
       if ( S->IsPEC )
        { B->AddEntry(Offset+neAlpha, Offset+neBeta, -1.0*Zeta*Overlap);
-         if (neAlpha!=neBeta)
+         if (neAlpha!=neBeta && B->StorageType==LHM_NORMAL)
           B->AddEntry(Offset+neBeta, Offset+neAlpha, -1.0*Zeta*Overlap);
        };
       
@@ -420,10 +484,13 @@ void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args)
 
 }
 
-/***************************************************************/  
-/***************************************************************/  
 /***************************************************************/
-void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
+/* first stage of GetSurfaceSurfaceInteractions: zero out the  */
+/* destination block if necessary and fill in the fields of    */
+/* Args that describe the common regions of the two surfaces.  */
+/* returns false if there is nothing further to compute.       */
+/***************************************************************/
+static bool PrepareSSIArgs(GetSSIArgStruct *Args)
 { 
   RWGGeometry *G = Args->G;
   cdouble Omega = Args->Omega;
@@ -463,7 +530,7 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   int CommonRegions[2]; 
   int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
   if (NumCommonRegions==0)
-   return;
+   return false;
 
   Args->EpsA  = G->EpsTF[ CommonRegions[0] ];
   Args->MuA   = G->MuTF[  CommonRegions[0] ];
@@ -489,21 +556,57 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
    Args->EpsB=Args->MuB=Args->SignB=0.0;
 
   if ( Args->EpsA==0.0 && Args->EpsB==0.0 )
-   return;
+   return false;
+
+  return true;
+}
+
+/***************************************************************/
+/* final stage of GetSurfaceSurfaceInteractions: add surface-  */
+/* impedance contributions and fill in the lower triangle of   */
+/* symmetric blocks.                                           */
+/***************************************************************/
+static void FinishSSIArgs(GetSSIArgStruct *Args)
+{
+  RWGGeometry *G = Args->G;
 
   /***************************************************************/
-  /* fire off threads ********************************************/
+  /* 20120526 handle objects with finite surface conductivity    */
   /***************************************************************/
-  GlobalFIPPICache.Hits=GlobalFIPPICache.Misses=0;
+  if ( (Args->Sa == Args->Sb) && Args->Sa->SurfaceZeta!=0)
+   AddSurfaceZetaContributionToBEMMatrix(Args);
 
-  int nt, NumTasks, NumThreads = GetNumThreads();
-  unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];  
-  memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+  /***************************************************************/
+  /* if the caller specified the matrix as symmetric, then so far*/
+  /* we have only computed the upper triangle, so now we need to */
+  /* fill in the lower triangle. The exception is if the matrix  */
+  /* uses packed storage, in which case only the upper triangle  */
+  /* is stored anyway.                                           */
+  /***************************************************************/
+  if ( Args->Symmetric && (Args->B->StorageType==LHM_NORMAL) )
+   { 
+     if (G->LogLevel>=SCUFF_VERBOSE2)
+      Log("Handling symmetry...");
+     int N=Args->Sa->NumBFs;
+     int Offset=Args->RowOffset;
+     for(int nr=1; nr<N; nr++)
+      for(int nc=0; nc<nr; nc++)
+       Args->B->SetEntry(Offset+nr,Offset+nc,Args->B->GetEntry(Offset+nc,Offset+nr));
+     if (G->LogLevel>=SCUFF_VERBOSE2)
+      Log("...done with symmetry...");
+   };
+}
 
 #ifdef USE_PTHREAD
+/***************************************************************/
+/* pthreads version of the threaded stage for a single block   */
+/***************************************************************/
+static void FireGSSIThreads(GetSSIArgStruct *Args, int NumThreads,
+                            unsigned *PPIAlgorithmCount)
+{
   ThreadData *TDs = new ThreadData[NumThreads], *TD;
   pthread_t *Threads = new pthread_t[NumThreads];
-  for(nt=0; nt<NumThreads; nt++)
+  for(int nt=0; nt<NumThreads; nt++)
    { 
      TD=&(TDs[nt]);
      TD->nt=nt;
@@ -514,37 +617,116 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
      else
        pthread_create( &(Threads[nt]), 0, GSSIThread, (void *)TD);
    }
-  for(nt=0; nt<NumThreads-1; nt++)
-   { pthread_join(Threads[nt],0);
-     for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD->PPIAlgorithmCount[n];
-   };
+  for(int nt=0; nt<NumThreads-1; nt++)
+   pthread_join(Threads[nt],0);
+  for(int nt=0; nt<NumThreads; nt++)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += TDs[nt].PPIAlgorithmCount[n];
   delete[] Threads;
   delete[] TDs;
+}
+#endif
+
+/***************************************************************/
+/* Compute several matrix blocks at once.                      */
+/*                                                             */
+/* Instead of parallelizing separately over the edges of each  */
+/* block, the work of all blocks is split into a single list   */
+/* of tasks, each of which handles a contiguous range of       */
+/* rows of one block, and the whole list is handed to          */
+/* one OpenMP parallel loop with dynamic scheduling. Each      */
+/* block is split into a number of tasks proportional to the   */
+/* number of edge-edge interactions it involves, so that tasks */
+/* have comparable cost regardless of block size; this keeps   */
+/* all threads busy for geometries consisting of many small    */
+/* surfaces, for which the per-block parallel regions would    */
+/* otherwise be too short.                                     */
+/*                                                             */
+/* The blocks must write to non-overlapping matrix entries.    */
+/***************************************************************/
+void GetSurfaceSurfaceInteractions(GetSSIArgStruct **ArgsList, int NumBlocks)
+{
+  if (NumBlocks==0) return;
+  RWGGeometry *G = ArgsList[0]->G;
 
+  /***************************************************************/
+  /* prepare all blocks and estimate the work involved in each   */
+  /***************************************************************/
+  GetSSIArgStruct **Active = new GetSSIArgStruct *[NumBlocks];
+  double *Work = new double[NumBlocks];
+  double TotalWork=0.0;
+  int NumActive=0;
+  for(int nb=0; nb<NumBlocks; nb++)
+   { GetSSIArgStruct *Args=ArgsList[nb];
+     if ( !PrepareSSIArgs(Args) )
+      continue;
+     double NEa = (double)Args->Sa->NumEdges;
+     double NEb = (double)Args->Sb->NumEdges;
+     double NumPairs = Args->Symmetric ? 0.5*NEa*(NEa+1.0) : NEa*NEb;
+     int NumRegions = (Args->EpsA!=0.0 ? 1 : 0) + (Args->EpsB!=0.0 ? 1 : 0);
+     Work[NumActive] = NumPairs*NumRegions;
+     TotalWork += Work[NumActive];
+     Active[NumActive++] = Args;
+   };
+
+  /***************************************************************/
+  /* fire off threads ********************************************/
+  /***************************************************************/
+  GlobalFIPPICache.Hits=GlobalFIPPICache.Misses=0;
+
+  int NumThreads = GetNumThreads();
+  unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];  
+  memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+
+#ifdef USE_PTHREAD
+  for(int nb=0; nb<NumActive; nb++)
+   FireGSSIThreads(Active[nb], NumThreads, PPIAlgorithmCount);
 #else 
+  /*--------------------------------------------------------------*/
+  /*- split each block into tasks; task #nt of block #nb handles  */
+  /*- the nt-th of NumTasks contiguous ranges of rows of the block*/
+  /*--------------------------------------------------------------*/
 #ifndef USE_OPENMP
-  NumTasks=NumThreads=1;
-  if (G->LogLevel>=SCUFF_VERBOSE2)
-   Log(" no multithreading...");
+  NumThreads=1;
+  int TargetTasks=1;
 #else
-  NumTasks=NumThreads*100;
-  if (NumTasks>Sa->NumEdges) 
-   NumTasks=Sa->NumEdges;
+  int TargetTasks=NumThreads*100;
+#endif
+  int *TaskStart = new int[NumActive+1];
+  TaskStart[0]=0;
+  for(int nb=0; nb<NumActive; nb++)
+   { int NumTasks = (int)ceil( TargetTasks * Work[nb] / TotalWork );
+     if (NumTasks > Active[nb]->Sa->NumEdges) NumTasks=Active[nb]->Sa->NumEdges;
+     if (NumTasks < 1) NumTasks=1;
+     TaskStart[nb+1] = TaskStart[nb] + NumTasks;
+   };
+  int TotalTasks=TaskStart[NumActive];
+
+  ThreadData *TDs = new ThreadData[TotalTasks];
+  for(int nb=0; nb<NumActive; nb++)
+   for(int nt=TaskStart[nb]; nt<TaskStart[nb+1]; nt++)
+    { TDs[nt].Args     = Active[nb];
+      TDs[nt].nt       = nt - TaskStart[nb];
+      TDs[nt].NumTasks = TaskStart[nb+1] - TaskStart[nb];
+    };
+
   if (G->LogLevel>=SCUFF_VERBOSE2)
-   Log(" OpenMP multithreading (%i threads,%i tasks)...",NumThreads,NumTasks);
+   Log(" OpenMP multithreading (%i threads,%i blocks,%i tasks)...",NumThreads,NumActive,TotalTasks);
+
+  // each task keeps its own PPI algorithm counts, which
+  // are summed once all tasks have finished
+#ifdef USE_OPENMP
 #pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
 #endif
-  for(nt=0; nt<NumTasks; nt++)
-   { 
-     ThreadData TD1;
-     TD1.nt=nt;
-     TD1.NumTasks=NumTasks;
-     TD1.Args=Args;
-     GSSIThread((void *)&TD1);
-     for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
-   };
+  for(int nt=0; nt<TotalTasks; nt++)
+   GSSIThread((void *)(TDs + nt));
+
+  for(int nt=0; nt<TotalTasks; nt++)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += TDs[nt].PPIAlgorithmCount[n];
+
+  delete[] TDs;
+  delete[] TaskStart;
 #endif
 
   if (G->LogLevel>=SCUFF_VERBOSE2)
@@ -557,31 +739,19 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
             PPIAlgorithmCount[PPIALG_DESING]);
    };
 
-  /***************************************************************/
-  /* 20120526 handle objects with finite surface conductivity    */
-  /***************************************************************/
-  if ( (Args->Sa == Args->Sb) && Args->Sa->SurfaceZeta!=0)
-   AddSurfaceZetaContributionToBEMMatrix(Args);
+  for(int nb=0; nb<NumActive; nb++)
+   FinishSSIArgs(Active[nb]);
 
-  /***************************************************************/
-  /* if the caller specified the matrix as symmetric, then so far*/
-  /* we have only computed the upper triangle, so now we need to */
-  /* fill in the lower triangle. The exception is if the matrix  */
-  /* uses packed storage, in which case only the upper triangle  */
-  /* is stored anyway.                                           */
-  /***************************************************************/
-  if ( Args->Symmetric && (Args->B->StorageType==LHM_NORMAL) )
-   { 
-     if (G->LogLevel>=SCUFF_VERBOSE2)
-      Log("Handling symmetry...");
-     int N=Args->B->NR;
-     for(int nr=1; nr<N; nr++)
-      for(int nc=0; nc<nr; nc++)
-       Args->B->SetEntry(nr,nc,Args->B->GetEntry(nc,nr));
-     if (G->LogLevel>=SCUFF_VERBOSE2)
-      Log("...done with symmetry...");
-   };
+  delete[] Work;
+  delete[] Active;
+}
 
+/***************************************************************/  
+/***************************************************************/  
+/***************************************************************/
+void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
+{ 
+  GetSurfaceSurfaceInteractions(&Args, 1);
 }
 
 /***************************************************************/
@@ -626,4 +796,81 @@ void InitGetSSIArgs(GetSSIArgStruct *Args)
 
 }
 
+/***************************************************************/
+/* Compute the BEM matrix elements coupling the basis functions*/
+/* associated with edge #nea on surface #nsa to those          */
+/* associated with edge #neb on surface #nsb, without          */
+/* assembling any larger block of the matrix.                  */
+/*                                                             */
+/* On return, MEs[i*NBFb + j] is the matrix element between    */
+/* the ith basis function on edge nea and the jth basis        */
+/* function on edge neb, where NBFa, NBFb = 1 (PEC surface)    */
+/* or 2 (non-PEC surface) and i,j run from 0 to NBFa,NBFb-1.   */
+/*                                                             */
+/* The cached epsilon and mu values of the geometry must       */
+/* already have been updated for the frequency Omega by the    */
+/* caller, which makes this routine safe to call from many     */
+/* threads at once.                                            */
+/*                                                             */
+/* The contributions of surface impedances (SurfaceZeta) are   */
+/* not included.                                               */
+/***************************************************************/
+void GetBEMMatrixElements(RWGGeometry *G, int nsa, int nea, int nsb, int neb,
+                          cdouble Omega, cdouble MEs[4],
+                          unsigned *PPIAlgorithmCount)
+{
+  RWGSurface *Sa = G->Surfaces[nsa];
+  RWGSurface *Sb = G->Surfaces[nsb];
+  memset(MEs, 0, 4*sizeof(cdouble));
+
+  double Signs[2];
+  int CommonRegions[2];
+  int NumCommonRegions=CountCommonRegions(Sa, Sb, CommonRegions, Signs);
+  if (NumCommonRegions==0)
+   return;
+
+  bool SaIsPEC = (Sa->IsPEC==1);
+  bool SbIsPEC = (Sb->IsPEC==1);
+
+  GetEEIArgStruct MyGetEEIArgs, *GetEEIArgs=&MyGetEEIArgs;
+  InitGetEEIArgs(GetEEIArgs);
+  GetEEIArgs->Sa  = Sa;
+  GetEEIArgs->Sb  = Sb;
+  GetEEIArgs->nea = nea;
+  GetEEIArgs->neb = neb;
+  cdouble *GC=GetEEIArgs->GC;
+
+  for(int ncr=0; ncr<NumCommonRegions; ncr++)
+   { 
+     cdouble Eps = G->EpsTF[ CommonRegions[ncr] ];
+     cdouble Mu  = G->MuTF[  CommonRegions[ncr] ];
+     double Sign = Signs[ncr];
+     if (Eps==0.0) continue;
+
+     cdouble k       = csqrt2(Eps*Mu)*Omega;
+     cdouble PreFac1 =  Sign*II*Mu*Omega;
+     cdouble PreFac2 = -Sign*II*k;
+     cdouble PreFac3 = -Sign*II*Eps*Omega;
+
+     GetEEIArgs->k = k;
+     GetEdgeEdgeInteractions(GetEEIArgs);
+
+     if ( SaIsPEC || SbIsPEC )
+      { MEs[0] += PreFac1*GC[0];
+        if ( !(SaIsPEC && SbIsPEC) )
+         MEs[1] += PreFac2*GC[1];
+      }
+     else
+      { MEs[0] += PreFac1*GC[0];
+        MEs[1] += PreFac2*GC[1];
+        MEs[2] += PreFac2*GC[1];
+        MEs[3] += PreFac3*GC[0];
+      };
+   };
+
+  if (PPIAlgorithmCount)
+   for(int n=0; n<NUMPPIALGORITHMS; n++)
+    PPIAlgorithmCount[n] += GetEEIArgs->PPIAlgorithmCount[n];
+}
+
 } // namespace scuff
@@ -62,6 +62,11 @@ namespace scuff {
 #define SCUFF_VERBOSELOGGING 2
 #define SCUFF_VERBOSE2       3
 
+// methods for solving the BEM system
+#define SCUFF_SOLVER_LU       0
+#define SCUFF_SOLVER_GMRES    1
+#define SCUFF_SOLVER_BICGSTAB 2
+
 // maximum number of lattice basis vectors
 #ifndef MAXLDIM
 #define MAXLDIM 3
@@ -185,6 +190,11 @@ class RWGSurface
    double GetOverlap(int neAlpha, int neBeta, double *pOTimes = NULL);
    void GetOverlaps(int neAlpha, int neBeta, double *Overlaps);
 
+   /* sparse matrices of overlap integrals between all pairs of   */
+   /* basis functions (computed once and cached; see OPFT.cc)     */
+   SMatrix **GetOverlapMatrices();
+   void ClearOverlapMatrices();
+
    /* apply a general transformation (rotation+displacement) to the surface */
    void Transform(const GTransformation *GT);
    void Transform(const char *format, ...);
@@ -250,6 +260,11 @@ class RWGSurface
    int MeshTag;                    /* index of entity within mesh file; = -1 if not applicable */
    char *Label;                    /* unique label identifying surface */
 
+   /* OverlapMatrices[n] is the sparse NumEdges x NumEdges      */
+   /* matrix of overlap integrals of type n; it is computed on   */
+   /* first use and discarded whenever the surface is moved      */
+   SMatrix **OverlapMatrices;
+
    kdtri kdPanels; /* kd-tree of panels */
    void InitkdPanels(bool reinit = false, int LogLevel = SCUFF_NOLOGGING);
 
@@ -307,6 +322,17 @@ typedef struct MMJData
    int *SurfaceIndices, *EdgeIndices;
  } MMJData;
 
+class CompressedBEMMatrix;
+
+/***************************************************************/
+/* callback invoked by GetFieldsChunked() as each chunk of     */
+/* field values becomes available; XChunk and FChunk have one  */
+/* row per evaluation point in the chunk, and nxStart is the   */
+/* row of the full XMatrix corresponding to the first of them  */
+/***************************************************************/
+typedef void (*FieldChunkHandler)(int nxStart, HMatrix *XChunk,
+                                  HMatrix *FChunk, void *UserData);
+
 /*************************** ***********************************/
 /* an RWGGeometry is a collection of regions with interfaces   */
 /* described by RWGSurfaces.                                   */
@@ -330,12 +356,36 @@ class RWGGeometry
    HMatrix *AllocateBEMMatrix(bool PureImagFreq = false, bool Packed = false);
    HMatrix *AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL);
    HMatrix *AssembleBEMMatrix(cdouble Omega, HMatrix *M = NULL);
+   CompressedBEMMatrix *AssembleCompressedBEMMatrix(cdouble Omega,
+                                                    CompressedBEMMatrix *CM = NULL);
+
+   // distributed-memory version: each MPI rank computes only
+   // the tiles of the matrix that it stores (compact geometries only)
+   DHMatrix *AssembleDistributedBEMMatrix(cdouble Omega, DHMatrix *M = NULL,
+                                          int BlockSize = 64);
 
    HVector *AllocateRHSVector(bool PureImagFreq = false );
    HVector *AssembleRHSVector(cdouble Omega, double *kBloch,
                               IncField *IF, HVector *RHS = NULL);
    HVector *AssembleRHSVector(cdouble Omega, IncField *IF, HVector *RHS = NULL);
 
+   // multi-RHS versions: column #n of the result is the RHS vector
+   // for incident field IFs[n]
+   HMatrix *AssembleRHSVector(cdouble Omega, double *kBloch,
+                              IncField **IFs, int NumIFs, HMatrix *RHSMatrix = NULL);
+   HMatrix *AssembleRHSVector(cdouble Omega, IncField **IFs, int NumIFs,
+                              HMatrix *RHSMatrix = NULL);
+
+   /*--------------------------------------------------------------*/
+   /*- iterative (krylov-subspace) solution of the BEM system,     */
+   /*- preconditioned by the LU-factorized single-surface diagonal */
+   /*- blocks of the BEM matrix                                    */
+   /*--------------------------------------------------------------*/
+   HMatrix **FactorizeDiagonalBlocks(HMatrix *M, HMatrix **DBlocks = NULL);
+   int IterativeSolve(HMatrix *M, HMatrix **DBlocks, HVector *KN,
+                      int Solver = SCUFF_SOLVER_GMRES,
+                      double Tol = 1.0e-6, int MaxIters = 1000);
+
    /*--------------------------------------------------------------*/
    /*- post-processing routines for computing fields               */
    /*--------------------------------------------------------------*/
@@ -351,13 +401,27 @@ class RWGGeometry
    void GetFields(IncField *IF, HVector *KN, cdouble Omega,
                   double *X, cdouble *EH);
 
+   // streaming variant: fields are computed ChunkSize points at a time
+   // (ChunkSize=0 --> default, overridable via SCUFF_FIELD_CHUNKSIZE)
+   // and each chunk is passed to Handler as soon as it is complete
+   void GetFieldsChunked(IncField *IF, HVector *KN, cdouble Omega,
+                         double *kBloch, HMatrix *XMatrix,
+                         FieldChunkHandler Handler, void *UserData,
+                         int ChunkSize=0);
+
    /*--------------------------------------------------------------*/
    /*- post-processing routine for dyadic green's functions -------*/
    /*--------------------------------------------------------------*/
+   // if RFWorkspace is non-null, RFWorkspace[0] and RFWorkspace[1]
+   // are caller-owned reduced-field buffers used in place of the
+   // routine's internal static buffers (they are (re)allocated as
+   // needed); with distinct M, GMatrix, and RFWorkspace arguments
+   // the routine may then be called from several threads at once
    HMatrix *GetDyadicGFs(cdouble Omega, double *kBloch,
                          HMatrix *XMatrix, HMatrix *M,
                          HMatrix *GMatrix=0, 
-                         bool ScatteringOnly=false);
+                         bool ScatteringOnly=false,
+                         HMatrix **RFWorkspace=0);
 
    // these next two are legacy interfaces which will be
    // removed in future versions
@@ -427,6 +491,8 @@ class RWGGeometry
    int GetRegionByLabel(const char *Label);
    RWGSurface *GetSurfaceByLabel(const char *Label, int *pns=NULL);
    int GetRegionIndex(const double X[3]); // index of region containing X
+   int *GetRegionIndices(HMatrix *XMatrix, int *RegionIndices=0,
+                         int ColumnOffset=0); // same for all rows of XMatrix
    int PointInRegion(int RegionIndex, const double X[3]); 
 
    /* geometrical transformations */
@@ -580,6 +646,302 @@ class RWGGeometry
    static bool UseGetFieldsV2P0;
    static bool UseTaylorDuffyV2P0;
    static bool DisableCache;
+   static bool UsePanelMoments;
+   static bool ReuseMateBlocks;
+ };
+
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- 4. Class definition for CompressedBEMMatrix                -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+
+/***************************************************************/
+/* a CBMCluster is a set of RWG edges that are close together  */
+/* in space. the edges in a cluster occupy a contiguous range  */
+/* [EdgeStart, EdgeStart+NumEdges) of the reordered edge list  */
+/* of the parent CompressedBEMMatrix, and the basis functions  */
+/* associated with those edges are listed in BFIndices.        */
+/***************************************************************/
+typedef struct CBMCluster
+ { int EdgeStart, NumEdges;
+   int NumBFs;
+   int *BFIndices;      // global indices of BFs in this cluster
+   int *BFEdges;        // BFEdges[n] = cluster-local index of edge for BF #n
+   int *BFSubIndices;   // 0 or 1 (electric or magnetic current)
+   double Center[3], Radius;
+   int Children[2];     // -1 for leaf clusters
+ } CBMCluster;
+
+/***************************************************************/
+/* a CBMBlock is the block of the BEM matrix coupling the BFs  */
+/* in one cluster to the BFs in another. it is stored either   */
+/* densely (D) or in the low-rank form U*V.                    */
+/* if Mirror==true, the block also stands for its own          */
+/* transpose, i.e. the block coupling ColCluster to RowCluster.*/
+/***************************************************************/
+typedef struct CBMBlock
+ { int RowCluster, ColCluster;
+   bool Mirror;
+   bool Admissible;
+   HMatrix *D;
+   HMatrix *U, *V;
+   HMatrix *LU;   // LU factors of diagonal blocks, used for preconditioning
+ } CBMBlock;
+
+/***************************************************************/
+/* a CBMNode is a node of the hierarchical (H-LU) factorization*/
+/* of a CompressedBEMMatrix, covering the block coupling       */
+/* clusters RowCluster and ColCluster. a node is either split  */
+/* into subblocks (NumRowKids, NumColKids > 0, with kid (i,j)  */
+/* stored in Kids[i*NumColKids + j]), or stored densely (D, in */
+/* which case both clusters are leaves), or stored in low-rank */
+/* form U*V (U=V=0 for a vanishing block).                     */
+/***************************************************************/
+typedef struct CBMNode
+ { int RowCluster, ColCluster;
+   int NumRowKids, NumColKids;
+   struct CBMNode *Kids[4];
+   HMatrix *D;
+   HMatrix *U, *V;
+ } CBMNode;
+
+/***************************************************************/
+/* CompressedBEMMatrix stores the BEM matrix of a compact      */
+/* geometry in hierarchical form: the RWG edges are sorted into*/
+/* a binary tree of clusters by recursive geometric bisection, */
+/* blocks coupling well-separated clusters are approximated by */
+/* adaptive cross approximation (ACA), and all other blocks    */
+/* are stored densely. storage and matrix-vector cost are then */
+/* roughly O(N log N) instead of O(N^2).                       */
+/*                                                             */
+/* With Solver=SCUFF_SOLVER_LU, the linear system is solved    */
+/* directly by an approximate LU factorization carried out in  */
+/* the same hierarchical format (H-LU), with the low-rank      */
+/* blocks of the factors truncated to ACATol. With GMRES or    */
+/* BiCGStab, the system is instead solved iteratively, using   */
+/* the LU factors of the dense diagonal blocks as a block-     */
+/* Jacobi preconditioner.                                      */
+/***************************************************************/
+class CompressedBEMMatrix
+ {
+  public:
+   CompressedBEMMatrix(RWGGeometry *G, double ACATol=1.0e-4,
+                       int LeafSize=32, double Eta=2.0,
+                       int Solver=SCUFF_SOLVER_LU);
+   ~CompressedBEMMatrix();
+
+   // (re)compute all blocks at frequency Omega
+   void Assemble(cdouble Omega);
+
+   // Y = M*X
+   void Apply(HVector *X, HVector *Y);
+
+   // LUFactorize computes the H-LU factorization of the whole
+   // matrix, and LUSolve overwrites X (on entry the RHS) with the
+   // solution of the BEM system by forward and back substitution
+   // (return values as for HMatrix::LUFactorize and LUSolve).
+   int LUFactorize();
+   int LUSolve(HVector *X);
+
+   // FactorizePreconditioner LU-factorizes the dense diagonal
+   // blocks for use as a block-Jacobi preconditioner (return
+   // value as for HMatrix::LUFactorize).
+   int FactorizePreconditioner();
+   void ApplyPreconditioner(HVector *X, HVector *Y);
+
+   // IterativeSolve overwrites X (on entry the RHS) with the
+   // solution computed by GMRES or BiCGStab with the block-Jacobi
+   // preconditioner, and returns nonzero if the iteration failed
+   // to converge.
+   int IterativeSolve(HVector *X);
+
+   // Solve calls LUSolve if Solver is SCUFF_SOLVER_LU and
+   // IterativeSolve otherwise.
+   int Solve(HVector *X);
+
+   // storage in bytes for matrix entries, and the number of
+   // bytes the same matrix would take in dense form
+   size_t GetStorage(size_t *DenseStorage=0);
+
+   RWGGeometry *G;
+   int N;
+   double ACATol, Eta, SolverTol;
+   int LeafSize, MaxIters, Restart;
+   int Solver;   // SCUFF_SOLVER_LU, SCUFF_SOLVER_GMRES or SCUFF_SOLVER_BICGSTAB
+
+  // private:
+   void BuildClusterTree();
+   int AddCluster(int EdgeStart, int NumEdges);
+   void AddBlocks(int nca, int ncb, bool Mirror);
+   void ClearBlocks();
+   void ClearLUFactors();
+   void AssembleDenseBlock(CBMBlock *B, cdouble Omega);
+   void AssembleLowRankBlock(CBMBlock *B, cdouble Omega);
+
+   int *EdgeSurfaces, *EdgeIndices;  // reordered global edge list
+   int NumClusters, MaxClusters;
+   CBMCluster *Clusters;
+   int NumBlocks, MaxBlocks;
+   CBMBlock *Blocks;
+   bool Factorized;
+   CBMNode *LUFactors;
+ };
+
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*- 5. Class definition for MatrixFreeBEMOperator              -*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+/*--------------------------------------------------------------*/
+
+struct MFRegionGrid;
+
+/***************************************************************/
+/* MatrixFreeBEMOperator computes the action of the BEM matrix */
+/* of a compact geometry on a vector without ever storing the  */
+/* dense matrix, by the precorrected-FFT method.               */
+/*                                                             */
+/* Every panel is collapsed to a single point source at its    */
+/* centroid carrying the aggregated current and charge of all  */
+/* RWG functions defined on it. In each region, these sources  */
+/* are projected onto a uniform grid by Lagrange interpolation */
+/* on StencilSize^3 points, convolved with the Helmholtz kernel*/
+/* by FFT, and the resulting potentials are interpolated back  */
+/* to the panel centroids. For pairs of edges closer than      */
+/* NearFactor times the sum of their radii, the grid result is */
+/* replaced by the exact matrix elements via a sparse          */
+/* 'precorrection' matrix.                                     */
+/*                                                             */
+/* NearFactor thus controls the error of the point-source      */
+/* approximation, while the grid spacing controls the error of */
+/* the grid approximation to the point-source interactions.    */
+/* Assemble() estimates the latter on a sample of rows of M*X, */
+/* and refines the grid (starting from spacing GridSpacing, or */
+/* the average edge length if GridSpacing=0) up to             */
+/* MaxRefinements times until it is below Tolerance; the final */
+/* estimate is stored in FarFieldError. Tolerance=0 skips the  */
+/* estimate.                                                   */
+/*                                                             */
+/* Storage is O(N) for the precorrection plus four kernel FFTs */
+/* per region, each about 8 times the number of grid points in */
+/* the bounding box of the region's surfaces; a matrix-vector  */
+/* product costs at most 22 FFTs of that size per region.      */
+/***************************************************************/
+class MatrixFreeBEMOperator
+ {
+  public:
+   MatrixFreeBEMOperator(RWGGeometry *G, double NearFactor=3.0,
+                         int Solver=SCUFF_SOLVER_GMRES,
+                         double Tolerance=1.0e-3);
+   ~MatrixFreeBEMOperator();
+
+   // compute the near-field precorrection and the grid kernels
+   // at frequency Omega
+   void Assemble(cdouble Omega);
+
+   // Y = M*X
+   void Apply(HVector *X, HVector *Y);
+
+   // FactorizePreconditioner inverts the single-edge diagonal
+   // blocks for use as a preconditioner. Solve overwrites X (on
+   // entry the RHS) with the solution of M*X=RHS computed by
+   // GMRES or BiCGStab, and returns nonzero if the iteration
+   // failed to converge.
+   int FactorizePreconditioner();
+   int Solve(HVector *X);
+   void ApplyPreconditioner(HVector *X, HVector *Y);
+
+   RWGGeometry *G;
+   int N;
+   cdouble Omega;
+   double NearFactor, SolverTol;
+   int Solver, MaxIters, Restart;
+   double Tolerance, GridSpacing, FarFieldError;
+   int StencilSize, MaxRefinements;
+
+  // private:
+   void GetNearEdgePairs();
+   void GetApproximateMEs(int nsa, int nea, int nsb, int neb,
+                          cdouble MEs[4], bool OnGrid);
+   void InitGrids(double h);
+   void ClearGrids();
+   void StampCorrection(cdouble *Exact);
+   double EstimateFarFieldError(cdouble *Exact);
+
+   // list of near neighbors of each edge: the near neighbors of
+   // global edge #n are NearEdges[NearStart[n]...NearStart[n+1]-1]
+   // (global edge indices as in RWGGeometry::EdgeIndexOffset)
+   int *NearStart, *NearEdges;
+   int *EdgeSurfaces;     // surface index of each global edge
+
+   MFRegionGrid **Grids;  // one per region (0 for unused regions)
+   SMatrix *Correction;   // exact minus grid-approximated matrix elements
+   cdouble *DiagBlocks;   // inverted single-edge diagonal blocks
+   bool Factorized;
+ };
+
+/***************************************************************/
+/* BEMBlockInterpolator serves the (nsa,nsb) block of the BEM  */
+/* matrix at arbitrary frequencies on the line segment         */
+/* [OmegaMin, OmegaMax] of the complex plane by Chebyshev      */
+/* interpolation between exact assemblies at NumAnchors anchor */
+/* frequencies (Chebyshev nodes on the segment).               */
+/*                                                             */
+/* For off-diagonal blocks of surfaces sharing a single region,*/
+/* the dominant oscillation exp(ikR) (k = wavenumber of the    */
+/* common region, R = distance between edge centroids) is      */
+/* divided out of each entry before interpolation and restored */
+/* afterwards, so that far-apart surfaces need few anchors.    */
+/*                                                             */
+/* The anchor blocks may be assembled by AssembleAnchors(), or */
+/* supplied by the caller via SetAnchorBlock() (e.g. for blocks*/
+/* assembled with some regions zeroed out). GetBlock() returns */
+/* an estimate of the relative interpolation error based on    */
+/* the magnitude of the highest-order Chebyshev coefficients.  */
+/*                                                             */
+/* Storage is NumAnchors times that of the block.              */
+/***************************************************************/
+class BEMBlockInterpolator
+ {
+  public:
+   BEMBlockInterpolator(RWGGeometry *G, int nsa, int nsb,
+                        cdouble OmegaMin, cdouble OmegaMax,
+                        int NumAnchors, double *kBloch=0);
+   ~BEMBlockInterpolator();
+
+   cdouble GetAnchor(int na);
+   void SetAnchorBlock(int na, HMatrix *Block);
+   void AssembleAnchors();
+
+   // true if Omega lies on the interpolation segment
+   bool Contains(cdouble Omega);
+
+   // interpolated block at Omega, stored in Block starting at 
+   // (RowOffset, ColOffset); returns the error estimate
+   double GetBlock(cdouble Omega, HMatrix *Block,
+                   int RowOffset=0, int ColOffset=0);
+
+   RWGGeometry *G;
+   int nsa, nsb, NBFA, NBFB;
+   cdouble OmegaMin, OmegaMax;
+   int NumAnchors;
+   double kBloch[2];
+   bool HavekBloch;
+   double ErrorEstimate;
+
+  // private:
+   cdouble GetPhaseWavenumber(cdouble Omega);
+   void ComputeCoefficients();
+
+   int PhaseRegion;       // -1 if no phase extraction
+   double *Distances;     // NBFA x NBFB edge-centroid distances
+   cdouble *Coefficients; // Chebyshev coefficients, one NBFA x NBFB block each
+   bool *HaveAnchor;
+   bool CoefficientsValid;
  };
 
 /***************************************************************/
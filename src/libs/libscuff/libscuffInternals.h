@@ -111,6 +111,83 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
                                cdouble *GradH,
                                cdouble *dHdT);
 
+// multi-wavenumber version: H integrals (no derivatives) for 
+// NumKs<=MAXPPIKS wavenumbers at once, with the geometric work
+// (cubature points, FIPPI lookups, Taylor-Duffy setup) shared
+// among all wavenumbers. Args->k is ignored; on return 
+// H[2*nk + 0,1] are the H integrals for wavenumber ks[nk], and
+// WhichAlgorithms[nk] (if non-NULL) is the algorithm used for ks[nk].
+#define MAXPPIKS 4
+void GetPanelPanelInteractions(GetPPIArgStruct *Args,
+                               int NumKs, cdouble *ks, cdouble *H,
+                               int *WhichAlgorithms=0);
+
+/*--------------------------------------------------------------*/
+/*- GetHelmholtzKernelMoments(): vectorized evaluation of sums  -*/
+/*- of Phi=exp(ikr)/(4 pi r) and its radial derivatives Psi,    -*/
+/*- Zeta times real factors over N<=MAXKERNELPAIRS point pairs; -*/
+/*- see HelmholtzKernels.cc.                                    -*/
+/*--------------------------------------------------------------*/
+#define MAXKERNELPAIRS 256
+void GetHelmholtzKernelMoments(int N, const double *r, const double *w, cdouble k,
+                               int NumPhi,  const double *PhiFactors,
+                               int NumPsi,  const double *PsiFactors,
+                               int NumZeta, const double *ZetaFactors,
+                               cdouble *Moments);
+
+/*--------------------------------------------------------------*/
+/*- mixed-radix FFTs for the grid convolutions in               -*/
+/*- MatrixFreeBEMOperator (FFT.cc). GetFFTLength returns the    -*/
+/*- smallest length >= MinLength of the form 2^a 3^b 5^c. FFT3D -*/
+/*- is in place and unnormalized; InBox / OutBox optionally     -*/
+/*- restrict the nonzero input / the required output to a box   -*/
+/*- at the origin.                                              -*/
+/*--------------------------------------------------------------*/
+int GetFFTLength(int MinLength);
+void FFT3D(cdouble *Data, int L[3], int Sign, int *InBox=0, int *OutBox=0);
+
+/*--------------------------------------------------------------*/
+/*- panel-centric evaluation of far-zone panel-panel integrals: -*/
+/*- for a far pair of panels, the low-order cubature is done    -*/
+/*- once to compute a set of moments of the kernel, from which  -*/
+/*- the integrals H[0], H[1] for all 3x3 choices of the source  -*/
+/*- vertices (iQa, iQb) follow with a few flops each. Moments   -*/
+/*- are kept for the PPIMC_ROWS most recently used panels on    -*/
+/*- surface a (against all panels on surface b), which suffices -*/
+/*- to reuse them across the edges of each panel when edges are -*/
+/*- visited in order.                                           -*/
+/*- only for compact geometries without displacements and for   -*/
+/*- H integrals only (no derivatives). a cache may hold moments -*/
+/*- for up to MAXPPIKS wavenumbers, which are computed together.-*/
+/*--------------------------------------------------------------*/
+#define NUMPPIMOMENTS 18
+#define PPIMC_ROWS    8
+class PPIMomentCache
+ { 
+  public:
+   PPIMomentCache(RWGSurface *Sa, RWGSurface *Sb, int NumKs, cdouble *ks);
+   ~PPIMomentCache();
+
+   // fills in H[0..2*NumKs-1]; returns false if (npa,npb) is not a 
+   // far-zone panel pair, in which case the caller should use
+   // GetPanelPanelInteractions()
+   bool GetPPIs(int npa, int iQa, int npb, int iQb, cdouble *H);
+
+   RWGSurface *Sa, *Sb;
+   int NumKs;
+   cdouble ks[MAXPPIKS];
+
+  private:
+   cdouble *GetMoments(int npa, int npb);
+
+   int NPb;
+   int RowPanel[PPIMC_ROWS];     // index of panel on Sa cached in each row
+   unsigned RowStamp[PPIMC_ROWS];// last use, for least-recently-used eviction
+   unsigned Clock;
+   cdouble *Moments[PPIMC_ROWS]; // NPb*NumKs*NUMPPIMOMENTS per row
+   char *Status[PPIMC_ROWS];     // per panel b: 0=not yet known, 1=far, 2=near
+ };
+
 /*--------------------------------------------------------------*/
 /*- GetEdgeEdgeInteractions() ----------------------------------*/
 /*--------------------------------------------------------------*/
@@ -138,6 +215,10 @@ typedef struct GetEEIArgStruct
 
    void *opFC; // 'opaque pointer to FIPPI cache'
 
+   // if this is nonzero (and has the same k), far-zone panel-panel 
+   // integrals are obtained from its cached panel-pair moments
+   PPIMomentCache *PMC;
+
    // this is used to force the code to use a specific
    // panel-integration algorithm; for diagnostic purposes only
    int Force;
@@ -162,6 +243,9 @@ typedef struct GetEEIArgStruct
 
 void InitGetEEIArgs(GetEEIArgStruct *Args);
 void GetEdgeEdgeInteractions(GetEEIArgStruct *Args);
+// multi-wavenumber version (no derivatives): GC[2*nk+0,1] are
+// the G and C integrals for wavenumber ks[nk], nk<NumKs<=MAXPPIKS
+void GetEdgeEdgeInteractions(GetEEIArgStruct *Args, int NumKs, cdouble *ks, cdouble *GC);
 
 /*--------------------------------------------------------------*/
 /*- GetGCMatrixElements ----------------------------------------*/
@@ -258,8 +342,13 @@ typedef struct GetSSIArgStruct
 
 void InitGetSSIArgs(GetSSIArgStruct *Args);
 void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args);
+void GetSurfaceSurfaceInteractions(GetSSIArgStruct **ArgsList, int NumBlocks);
 void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args);
 
+void GetBEMMatrixElements(RWGGeometry *G, int nsa, int nea, int nsb, int neb,
+                          cdouble Omega, cdouble MEs[4],
+                          unsigned *PPIAlgorithmCount=0);
+
 /***************************************************************/
 /* 2. definition of data structures and methods for working    */
 /*    with frequency-independent panel-panel integrals (FIPPIs)*/
@@ -307,6 +396,42 @@ void ComputeQIFIPPIData(double **Va, double **Vb, int ncv, QIFIPPIData *QIFD);
 void GetQDFIPPIData(double **Va, double *Qa, double **Vb, double *Qb, 
                     int ncv, void *opFC, QDFIPPIData *QDFD);
 
+/*--------------------------------------------------------------*/
+/* 'MappedCache' is an on-disk hash table of fixed-size records */
+/* that is memory-mapped into the address space of every        */
+/* process using it, so that many processes (e.g. the jobs of a */
+/* frequency sweep) can share cached integrals without each     */
+/* reading the whole cache into memory. lookups return pointers */
+/* into the mapped file. used as a backing store by FIPPICache  */
+/* and FIBBICache; see MappedCache.cc for the file format.      */
+/*--------------------------------------------------------------*/
+struct MCHeader;
+class MappedCache
+ { 
+  public:
+    MappedCache(const char *FileName, size_t KeySize, size_t DataSize);
+    ~MappedCache();
+
+    bool IsValid() { return Header!=0; }
+    void *Lookup(const void *Key);
+    void *Insert(const void *Key, const void *Data);
+    size_t NumRecords();
+
+    static bool IsMappedCacheFile(const char *FileName);
+
+    char *FileName;
+
+  private:
+    size_t KeySize, DataSize, SlotSize;
+    int fd;
+    void *Map;
+    size_t MapSize;
+    struct MCHeader *Header;
+    char *Slots;
+    bool ReadOnly, WarnedFull;
+    rwlock Lock;
+ };
+
 /*--------------------------------------------------------------*/
 /* 'FIPPICache' is a class that implements efficient storage    */
 /* and retrieval of QIFIPPIData structures for many panel pairs.*/
@@ -328,6 +453,8 @@ class FIPPICache
     // look up an entry 
     QIFIPPIData *GetQIFIPPIData(double **OVa, double **OVb, int ncv);
 
+    // lookup statistics; GetQIFIPPIData() is called from many
+    // threads at once, so these are only updated atomically
     int Hits, Misses;
 
   private:
@@ -344,6 +471,9 @@ class FIPPICache
     char *PreloadFileName;
     unsigned int RecordsPreloaded;
 
+    // shared on-disk table consulted before opTable, if present
+    MappedCache *MC;
+
  };
 
 /***************************************************************/   
@@ -0,0 +1,134 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-CompressedBEMMatrix.cc -- SCUFF-EM unit test checking that
+ *                                  -- matrix-vector products with, and
+ *                                  -- H-LU solutions of, the compressed
+ *                                  -- BEM matrix agree with the dense
+ *                                  -- BEM matrix
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define NUMTESTS 4
+
+/***************************************************************/
+/* relative 2-norm difference |X-XRef| / |XRef|                */
+/***************************************************************/
+double RelativeError(HVector *X, HVector *XRef)
+{
+  double Diff=0.0, Norm=0.0;
+  for(int n=0; n<XRef->N; n++)
+   { Diff += norm(X->ZV[n] - XRef->ZV[n]);
+     Norm += norm(XRef->ZV[n]);
+   };
+  return sqrt(Diff/Norm);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  (void) argc;
+  (void) argv;
+  SetLogFileName("scuff-test-CompressedBEMMatrix.log");
+  Log("SCUFF-EM compressed BEM matrix unit test running on %s",GetHostName());
+
+  const char *GeoFileNames[NUMTESTS]=
+   { "PECSpheres_255.scuffgeo",
+     "PECSpheres_255.scuffgeo",
+     "SiSpheres_255.scuffgeo",
+     "SiSpheres_255.scuffgeo"
+   };
+  cdouble Omega[NUMTESTS] = { 0.5, 1.0*II, 0.5, 1.0*II };
+  const char *TestNames[NUMTESTS]=
+   { "PEC spheres, real frequency",
+     "PEC spheres, imaginary frequency",
+     "Dielectric spheres, real frequency",
+     "Dielectric spheres, imaginary frequency"
+   };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   {
+     RWGGeometry *G = new RWGGeometry(GeoFileNames[nt]);
+     int N=G->TotalBFs;
+
+     HMatrix *M = G->AllocateBEMMatrix(false, false);
+     G->AssembleBEMMatrix(Omega[nt], M);
+
+     CompressedBEMMatrix *CM = new CompressedBEMMatrix(G, 1.0e-6, 16, 2.0, SCUFF_SOLVER_LU);
+     CM->Assemble(Omega[nt]);
+
+     HVector *X    = new HVector(N, LHM_COMPLEX);
+     HVector *Y    = new HVector(N, LHM_COMPLEX);
+     HVector *YRef = new HVector(N, LHM_COMPLEX);
+     for(int n=0; n<N; n++)
+      X->SetEntry(n, cdouble(cos(1.0*n), sin(2.0*n)));
+
+     /*--------------------------------------------------------------*/
+     /*- matrix-vector product --------------------------------------*/
+     /*--------------------------------------------------------------*/
+     M->Apply(X, YRef);
+     CM->Apply(X, Y);
+     double ApplyError=RelativeError(Y, YRef);
+
+     /*--------------------------------------------------------------*/
+     /*- H-LU solve of M*X = YRef, which should recover X -----------*/
+     /*--------------------------------------------------------------*/
+     int Info=CM->LUFactorize();
+     Y->Copy(YRef);
+     if (Info==0)
+      Info=CM->LUSolve(Y);
+     double SolveError=RelativeError(Y, X);
+
+     printf("Test %i (%s): ",nt,TestNames[nt]);
+     if (Info!=0 || ApplyError>1.0e-5 || SolveError>1.0e-3)
+      { Success=false;
+        printf(" FAILED ");
+      }
+     else
+      printf(" PASSED ");
+     printf(" (Apply: RelErr = %.1e, LUSolve: RelErr = %.1e)\n",ApplyError,SolveError);
+
+     delete X;
+     delete Y;
+     delete YRef;
+     delete CM;
+     delete M;
+     delete G;
+   };
+
+  if (Success)
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,161 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-HelmholtzKernels.cc -- SCUFF-EM unit test comparing the
+ *                               -- vectorized Helmholtz-kernel sums of
+ *                               -- GetHelmholtzKernelMoments (with its
+ *                               -- inline sin/cos and exp) against the
+ *                               -- same sums computed with the library
+ *                               -- complex exponential
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define NUMTESTS 8
+#define NUMPAIRS 200
+#define NUMPHI   2
+#define NUMPSI   1
+#define NUMZETA  2
+
+/***************************************************************/
+/* reference sums, computed term by term; Scale[nm] is the sum */
+/* of the magnitudes of the terms in moment #nm                */
+/***************************************************************/
+void GetReferenceMoments(int N, double *r, double *w, cdouble k,
+                         double *PhiFactors, double *PsiFactors,
+                         double *ZetaFactors,
+                         cdouble *Moments, double *Scale)
+{
+  int NM=NUMPHI+NUMPSI+NUMZETA;
+  for(int nm=0; nm<NM; nm++)
+   { Moments[nm]=0.0;
+     Scale[nm]=0.0;
+   };
+
+  cdouble ik=II*k;
+  for(int n=0; n<N; n++)
+   { if (r[n]==0.0) continue;
+     cdouble Phi  = w[n]*exp(ik*r[n]) / (4.0*M_PI*r[n]);
+     cdouble Psi  = Phi*(ik - 1.0/r[n]) / r[n];
+     cdouble Zeta = Phi*(ik*ik - 3.0*ik/r[n] + 3.0/(r[n]*r[n])) / (r[n]*r[n]);
+     int nm=0;
+     for(int nf=0; nf<NUMPHI; nf++, nm++)
+      { Moments[nm] += PhiFactors[nf*N+n]*Phi;
+        Scale[nm]   += fabs(PhiFactors[nf*N+n])*abs(Phi);
+      };
+     for(int nf=0; nf<NUMPSI; nf++, nm++)
+      { Moments[nm] += PsiFactors[nf*N+n]*Psi;
+        Scale[nm]   += fabs(PsiFactors[nf*N+n])*abs(Psi);
+      };
+     for(int nf=0; nf<NUMZETA; nf++, nm++)
+      { Moments[nm] += ZetaFactors[nf*N+n]*Zeta;
+        Scale[nm]   += fabs(ZetaFactors[nf*N+n])*abs(Zeta);
+      };
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  (void) argc;
+  (void) argv;
+  SetLogFileName("scuff-test-HelmholtzKernels.log");
+
+  // wavenumbers and ranges of distances for each test; the
+  // large-phase tests cross the 2^20 limit of the inline sin/cos
+  // and the large-decay tests cross the 708 limit of the inline exp
+  cdouble k[NUMTESTS]    = { 0.1, 3.0, 1.0e6, 1.0e14, 0.3+2.0*II, 
+                             5.0*II, 100.0*II, 2.0e5+50.0*II };
+  double rMin[NUMTESTS]  = { 1.0e-3, 1.0e-3, 0.5,  0.5,  1.0e-2,
+                             1.0e-3, 0.1,    1.0 };
+  double rMax[NUMTESTS]  = { 1.0,    10.0,   10.0, 10.0, 2.0,
+                             10.0,   10.0,   20.0 };
+  const char *TestNames[NUMTESTS]=
+   { "real k, small phase",
+     "real k",
+     "real k, phase beyond 2^20",
+     "real k, phase near 2^50",
+     "complex k",
+     "imaginary k",
+     "imaginary k, decay beyond exp(-708)",
+     "complex k, large phase and decay"
+   };
+
+  srand48(0);
+  double r[NUMPAIRS], w[NUMPAIRS];
+  double PhiFactors[NUMPHI*NUMPAIRS];
+  double PsiFactors[NUMPSI*NUMPAIRS];
+  double ZetaFactors[NUMZETA*NUMPAIRS];
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   { 
+     for(int n=0; n<NUMPAIRS; n++)
+      { r[n] = rMin[nt]*pow(rMax[nt]/rMin[nt], drand48());
+        w[n] = drand48();
+      };
+     r[NUMPAIRS/2]=0.0; // r=0 pairs contribute nothing
+     for(int n=0; n<NUMPHI*NUMPAIRS; n++)  PhiFactors[n]  = 2.0*drand48()-1.0;
+     for(int n=0; n<NUMPSI*NUMPAIRS; n++)  PsiFactors[n]  = 2.0*drand48()-1.0;
+     for(int n=0; n<NUMZETA*NUMPAIRS; n++) ZetaFactors[n] = 2.0*drand48()-1.0;
+
+     int NM=NUMPHI+NUMPSI+NUMZETA;
+     cdouble Moments[NUMPHI+NUMPSI+NUMZETA], RefMoments[NUMPHI+NUMPSI+NUMZETA];
+     double Scale[NUMPHI+NUMPSI+NUMZETA];
+     GetHelmholtzKernelMoments(NUMPAIRS, r, w, k[nt],
+                               NUMPHI, PhiFactors, NUMPSI, PsiFactors,
+                               NUMZETA, ZetaFactors, Moments);
+     GetReferenceMoments(NUMPAIRS, r, w, k[nt], PhiFactors, PsiFactors,
+                         ZetaFactors, RefMoments, Scale);
+
+     double MaxRelError=0.0;
+     for(int nm=0; nm<NM; nm++)
+      { double Error = abs(Moments[nm]-RefMoments[nm]);
+        double RelError = (Scale[nm]==0.0) ? Error : Error/Scale[nm];
+        if ( !(RelError<=MaxRelError) ) MaxRelError=RelError; // catches NaN
+      };
+
+     printf("Test %i (%s): ",nt,TestNames[nt]);
+     if ( !(MaxRelError<1.0e-12) )
+      { Success=false;
+        printf(" FAILED ");
+      }
+     else
+      printf(" PASSED ");
+     printf(" (MaxRelErr = %.1e)\n",MaxRelError);
+   };
+
+  if (Success) 
+   exit(0);
+  else
+   exit(1);
+}
@@ -0,0 +1,107 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-MateBlocks.cc -- SCUFF-EM unit test checking that the BEM
+ *                         -- matrix of a geometry with rigidly
+ *                         -- displaced and rotated copies of the same
+ *                         -- surface is the same whether or not the
+ *                         -- blocks shared by those copies are reused
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define GEOFILE  "PECPlates_40.scuffgeo"
+#define NUMTESTS 3
+
+/***************************************************************/
+/* return the maximum over all matrix elements of the          */
+/* difference between the two matrices, relative to the       */
+/* largest entry of the reference matrix                       */
+/***************************************************************/
+double CompareMatrices(HMatrix *M, HMatrix *MRef)
+{ 
+  double MaxAbs=0.0;
+  for(int nr=0; nr<MRef->NR; nr++)
+   for(int nc=0; nc<MRef->NC; nc++)
+    MaxAbs=fmax(MaxAbs, abs(MRef->GetEntry(nr,nc)));
+
+  double MaxRelError=0.0;
+  for(int nr=0; nr<MRef->NR; nr++)
+   for(int nc=0; nc<MRef->NC; nc++)
+    { double RelError = abs(M->GetEntry(nr,nc) - MRef->GetEntry(nr,nc)) / MaxAbs;
+      if ( !(RelError<=MaxRelError) ) MaxRelError=RelError; // catches NaN
+    };
+  return MaxRelError;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  (void) argc;
+  (void) argv;
+  SetLogFileName("scuff-test-MateBlocks.log");
+  Log("SCUFF-EM BEM matrix block reuse unit test running on %s",GetHostName());
+
+  cdouble Omega[NUMTESTS] = { 0.1, 2.0, 0.5*II };
+
+  RWGGeometry *G = new RWGGeometry(GEOFILE);
+  HMatrix *M    = G->AllocateBEMMatrix();
+  HMatrix *MRef = G->AllocateBEMMatrix();
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   { 
+     RWGGeometry::ReuseMateBlocks=true;
+     G->AssembleBEMMatrix(Omega[nt], M);
+     RWGGeometry::ReuseMateBlocks=false;
+     G->AssembleBEMMatrix(Omega[nt], MRef);
+
+     double MaxRelError=CompareMatrices(M, MRef);
+     printf("Test %i (Omega=%s): ",nt,z2s(Omega[nt]));
+     if (MaxRelError>1.0e-10)
+      { Success=false;
+        printf(" FAILED ");
+      }
+     else
+      printf(" PASSED ");
+     printf(" (MaxRelErr = %.1e)\n",MaxRelError);
+   };
+
+  delete M;
+  delete MRef;
+  delete G;
+
+  if (Success) 
+   exit(0);
+  else
+   exit(1);
+}
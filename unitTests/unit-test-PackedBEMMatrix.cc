@@ -0,0 +1,113 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-PackedBEMMatrix.cc -- SCUFF-EM unit test checking that the
+ *                              -- BEM matrix assembled into packed
+ *                              -- (symmetric) storage agrees with the
+ *                              -- matrix assembled into full storage
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+#define II cdouble(0.0,1.0)
+
+#define NUMTESTS 4
+
+/***************************************************************/
+/* return the maximum over all matrix elements of the relative */
+/* difference between the packed and unpacked matrices         */
+/***************************************************************/
+double CompareMatrices(HMatrix *MPacked, HMatrix *MFull)
+{ 
+  double MaxAbs=0.0;
+  for(int nr=0; nr<MFull->NR; nr++)
+   for(int nc=0; nc<MFull->NC; nc++)
+    MaxAbs=fmax(MaxAbs, abs(MFull->GetEntry(nr,nc)));
+
+  double MaxRelError=0.0;
+  for(int nr=0; nr<MFull->NR; nr++)
+   for(int nc=0; nc<MFull->NC; nc++)
+    { double Error = abs(MPacked->GetEntry(nr,nc) - MFull->GetEntry(nr,nc));
+      MaxRelError=fmax(MaxRelError, Error/MaxAbs);
+    };
+  return MaxRelError;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{ 
+  (void) argc;
+  (void) argv;
+  SetLogFileName("scuff-test-PackedBEMMatrix.log");
+  Log("SCUFF-EM packed BEM matrix unit test running on %s",GetHostName());
+
+  const char *GeoFileNames[NUMTESTS]=
+   { "PECSpheres_255.scuffgeo",
+     "SiSpheres_255.scuffgeo",
+     "ImpedanceSpheres_255.scuffgeo",
+     "ImpedanceSpheres_255.scuffgeo"
+   };
+  cdouble Omega[NUMTESTS] = { 0.1, 0.1, 0.1, 1.0*II };
+  const char *TestNames[NUMTESTS]=
+   { "PEC spheres",
+     "Dielectric spheres",
+     "Impedance spheres, real frequency",
+     "Impedance spheres, imaginary frequency"
+   };
+
+  bool Success=true;
+  for(int nt=0; nt<NUMTESTS; nt++)
+   { 
+     RWGGeometry *G = new RWGGeometry(GeoFileNames[nt]);
+     HMatrix *MFull   = G->AllocateBEMMatrix(false, false);
+     HMatrix *MPacked = G->AllocateBEMMatrix(false, true);
+     G->AssembleBEMMatrix(Omega[nt], MFull);
+     G->AssembleBEMMatrix(Omega[nt], MPacked);
+
+     double MaxRelError=CompareMatrices(MPacked, MFull);
+     printf("Test %i (%s): ",nt,TestNames[nt]);
+     if (MaxRelError>1.0e-10)
+      { Success=false;
+        printf(" FAILED ");
+      }
+     else
+      printf(" PASSED ");
+     printf(" (MaxRelErr = %.1e)\n",MaxRelError);
+
+     delete MFull;
+     delete MPacked;
+     delete G;
+   };
+
+  if (Success) 
+   exit(0);
+  else
+   exit(1);
+}